@@ -24,6 +24,7 @@
 #include "a_star/best_cost_straight_lines.h"
 #include "a_star/astar_sparse0.cpp"
 #include "a_star/Position.h"
+#include "a_star/FieldGeometry.h"
 
 #ifdef DEBUG
 #include "output_helpers.h"
@@ -36,17 +37,14 @@
 using namespace std;
 
 //required global values
-double upperLeftLon;
-double upperLeftLat;
-double lonWidth;
-double latWidth;
-double res;
-double fieldWidth;
-double fieldHeight;
+FieldGeometry field;
 
 //where the planes are
 std::map<int,Plane> planes;
 
+//the planner's packed copy of the planes
+fleet_table fleet;
+
 #ifdef COLLISIONTESTING
 vector< point > plane_locs;
 #endif
@@ -80,14 +78,12 @@ Position randomized_position()
   //  double latitude = -( (double)( rand() % 3808 ) / 1000000 ) + upper_left_latitude;
   
   // For the final 1km test field
-  double longitude = upperLeftLon + ( (double)( rand() % 1282999 ) / 1000000000 );
-  double latitude = upperLeftLat - ( (double)( rand() % 23009 ) / 1000000000 );
+  double longitude = field.getUpperLeftLongitude() + ( (double)( rand() % 1282999 ) / 1000000000 );
+  double latitude = field.getUpperLeftLatitude() - ( (double)( rand() % 23009 ) / 1000000000 );
   
   // cout << "Starting long " << longitude << endl << "Starting lat " << latitude << endl;
   
-  return( Position( upperLeftLon, upperLeftLat,
-                   lonWidth, latWidth,
-                   longitude, latitude, res ) );
+  return( Position( &field, longitude, latitude ) );
 }
 
 int main()
@@ -154,20 +150,22 @@ int main()
   map_tools::bearing_t bearingNamed = planes[planeId].get_named_bearing();
   
   // Begin A*ing
-  best_cost bc = best_cost( &planes, fieldWidth, fieldHeight, res, planeId);
+  fleet.set( planes[ planeId ] );
+  best_cost bc = best_cost( &fleet, field.getWidthInMeters(), field.getHeightInMeters(),
+                            field.getResolution(), planeId);
   
   point a_Star;
-  a_Star = astar_point( &bc, startx, starty, endx, endy, planeId, bearingNamed, &planes );
+  a_Star = astar_point( &bc, startx, starty, endx, endy, planeId, bearingNamed, &fleet );
   
   // Prior to artificially updating the plane's location, make a note of where 
   // the plane is
   prev_dist[ planeId ] = 
   map_tools::calculate_distance_between_points( dummy.getLat(), dummy.getLon(), 
                                                current.getLat(), current.getLon(),
-                                               "meters" );
+                                               map_tools::METERS );
   
   //where to go next
-  Position aStar(upperLeftLon,upperLeftLat,lonWidth,latWidth,a_Star.x,a_Star.y,res);
+  Position aStar( &field, a_Star.x, a_Star.y );
   
 #ifdef DEBUG
   assert( (int)aStar.getLat() != 0 );
@@ -175,9 +173,9 @@ int main()
   
   
   //                         Update the plane object                             //
-  Position next = Position( upperLeftLon, upperLeftLat, lonWidth, latWidth,
-                           aStar.getLon(), aStar.getLat(), res);
+  Position next = Position( &field, aStar.getLon(), aStar.getLat() );
   planes[planeId].update_intermediate_wp( next );  
+  fleet.set( planes[ planeId ] );
   
   }
   cout << "End of loop " << endl << endl;
@@ -187,26 +185,6 @@ int main()
 
 void makeField()
 {
-  ifstream the_file( "/Volumes/DATA/Dropbox/school/Auburn/Code/AU_UAV_stack/AU_UAV_ROS/field_1000.txt" );
-  if ( the_file.is_open() )
-  {
-    the_file >> upperLeftLon;
-    the_file >> upperLeftLat;
-    the_file >> lonWidth;
-    the_file >> latWidth;
-    the_file >> res;
-    the_file.close();
-    
-    fieldWidth= /* in meters */
-    map_tools::calculate_distance_between_points( upperLeftLat, upperLeftLon,
-                                                 upperLeftLat, upperLeftLon + lonWidth,
-                                                 "meters");
-    
-    fieldHeight = 
-    map_tools::calculate_distance_between_points( upperLeftLat, upperLeftLon,
-                                                 upperLeftLat + latWidth, upperLeftLon,
-                                                 "meters"); 
-  }
-  else
+  if( !field.load( "/Volumes/DATA/Dropbox/school/Auburn/Code/AU_UAV_stack/AU_UAV_ROS/field_1000.txt" ) )
     assert( false );
-}
\ No newline at end of file
+}
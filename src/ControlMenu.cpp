@@ -20,6 +20,9 @@ This will be the primary UI for now just to control the simulator and coordinato
 #include "AU_UAV_ROS/LoadCourse.h"
 #include "AU_UAV_ROS/SaveFlightData.h"
 
+//the course file reader
+#include "course_file.h"
+
 //services to the simulator
 ros::ServiceClient createSimulatedPlaneClient;
 ros::ServiceClient deleteSimulatedPlaneClient;
@@ -38,78 +41,40 @@ takes a filename and will parse it to determine how many UAVs there are and crea
 */
 bool createCourseUAVs(std::string filename)
 {
-	//open our file
-	FILE *fp;
-	fp = fopen((ros::package::getPath("AU_UAV_ROS")+"/courses/"+filename).c_str(), "r");
+	//read the course (see course_file.h)
+	course_file course;
+	if(!course.load(ros::package::getPath("AU_UAV_ROS")+"/courses/"+filename))
+	{
+		ROS_ERROR("%s: %s", course.error().c_str(), filename.c_str());
+		return false;
+	}
 	
-	//check for a good file open
-	if(fp != NULL)
+	//create each plane at the first point it's given
+	for(unsigned int p = 0; p < course.planes().size(); p++)
 	{
-		char buffer[256];
+		const course_plane &plane = course.planes()[p];
+		const course_point &start = course.points()[plane.first];
 		
-		std::map<int, bool> isFirstPoint;
-		
-		while(fgets(buffer, sizeof(buffer), fp))
+		AU_UAV_ROS::CreateSimulatedPlane srv;
+		srv.request.startingLatitude = start.latitude;
+		srv.request.startingLongitude = start.longitude;
+		srv.request.startingAltitude = start.altitude;
+		srv.request.startingBearing = 0;
+		srv.request.requestedID = plane.id;
+	
+		//send the service request
+		printf("\nRequesting to create new plane with ID #%d...\n", plane.id);
+		if(createSimulatedPlaneClient.call(srv))
 		{
-			if(buffer[0] == '#' || isBlankLine(buffer))
-			{
-				//this line is a comment
-				continue;
-			}
-			else
-			{
-				//set some invalid defaults
-				int planeID = -1;
-				struct AU_UAV_ROS::waypoint temp;
-				temp.latitude = temp.longitude = temp.altitude = -1000;
-				
-				//parse the string
-				sscanf(buffer, "%d %lf %lf %lf\n", &planeID, &temp.latitude, &temp.longitude, &temp.altitude);
-				
-				//check for the invalid defaults
-				if(planeID == -1 || temp.latitude == -1000 || temp.longitude == -1000 || temp.altitude == -1000)
-				{
-					//this means we have a bad file somehow
-					ROS_ERROR("Bad file parse");
-					return false;
-				}
-				
-				//check our map for an entry, if we dont have one then this is the first time
-				//that this plane ID has been referenced so it's true
-				if(isFirstPoint.find(planeID) == isFirstPoint.end())
-				{
-					isFirstPoint[planeID] = true;
-					
-					//this is the first time we've seen this ID in the file, attempt to create it
-					AU_UAV_ROS::CreateSimulatedPlane srv;
-					srv.request.startingLatitude = temp.latitude;
-					srv.request.startingLongitude = temp.longitude;
-					srv.request.startingAltitude = temp.altitude;
-					srv.request.startingBearing = 0;
-					srv.request.requestedID = planeID;
-				
-					//send the service request
-					printf("\nRequesting to create new plane with ID #%d...\n", planeID);
-					if(createSimulatedPlaneClient.call(srv))
-					{
-						printf("New plane with ID #%d has been created!\n", srv.response.planeID);
-					}
-					else
-					{
-						ROS_ERROR("Did not receive a response from simulator");
-					}
-				}
-				
-				//only clear the queue with the first point
-				if(isFirstPoint[planeID]) isFirstPoint[planeID] = false;
-			}
+			printf("New plane with ID #%d has been created!\n", srv.response.planeID);
+		}
+		else
+		{
+			ROS_ERROR("Did not receive a response from simulator");
 		}
 	}
-	else
-	{
-		ROS_ERROR("Invalid filename or location: %s", filename.c_str());
-		return false;
-	}
+	
+	return true;
 }
 
 /*
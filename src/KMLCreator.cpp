@@ -14,6 +14,7 @@ This will monitor updates from the planes and then eventually write them to a fi
 #include "ros/package.h"
 #include "AU_UAV_ROS/standardDefs.h"
 #include "AU_UAV_ROS/TelemetryUpdate.h"
+#include "AU_UAV_ROS/FleetTelemetry.h"
 #include "AU_UAV_ROS/SaveFlightData.h"
 
 #define MAX_LINE_TYPES 6
@@ -51,6 +52,31 @@ void telemetryCallback(const AU_UAV_ROS::TelemetryUpdate::ConstPtr& msg)
 	}
 }
 
+/*
+fleetTelemetryCallback
+This is called when the simulator sends a whole tick's telemetry in one message.  It stores every plane's
+waypoint, just as telemetryCallback does.
+*/
+void fleetTelemetryCallback(const AU_UAV_ROS::FleetTelemetry::ConstPtr& msg)
+{
+	if(isMonitoringTelemetry)
+	{
+		for(unsigned int i = 0; i < msg->planeIDs.size(); i++)
+		{
+			struct AU_UAV_ROS::waypoint temp;
+			temp.latitude = msg->currentLatitudes[i];
+			temp.longitude = msg->currentLongitudes[i];
+			temp.altitude = msg->currentAltitudes[i];
+			mapOfPaths[msg->planeIDs[i]].push(temp);
+		}
+	}
+	else
+	{
+		//we stopped monitoring which means the data is saved, clean exit time
+		exit(0);
+	}
+}
+
 /*
 saveFlightData
 This is a service called when it's time to save the file.
@@ -192,6 +218,7 @@ int main(int argc, char **argv)
 	
 	//subscribe to telemetry outputs and create client for the avoid collision service
 	ros::Subscriber sub = n.subscribe("telemetry", 1000, telemetryCallback);
+	ros::Subscriber fleetSub = n.subscribe("fleet_telemetry", 10, fleetTelemetryCallback);
 	
 	//set up services
 	ros::ServiceServer saveFlightDataService = n.advertiseService("save_flight_data", saveFlightData);
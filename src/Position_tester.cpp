@@ -11,6 +11,7 @@
 #include "best_cost_straight_lines.h"
 #include "map_tools.h"
 #include "Plane_fixed.h"
+#include "FieldGeometry.h"
 #include <time.h>
 #include <vector>
 #include <iomanip>
@@ -39,6 +40,9 @@ const double upper_left_longitude = -85.490363;
 const double upper_left_latitude = 32.592425;
 const double width_in_degrees_longitude = 0.005002;
 const double height_in_degrees_latitude = -0.003808;
+const FieldGeometry field( upper_left_longitude, upper_left_latitude,
+                           width_in_degrees_longitude, height_in_degrees_latitude,
+                           resolution );
 
 #ifndef DOUBLE_TO_STRING
 #define DOUBLE_TO_STRING
@@ -56,15 +60,9 @@ int main()
   int run = 1;
   
   // The origin
-  Position plane_1_start( upper_left_longitude, upper_left_latitude,
-                         width_in_degrees_longitude, height_in_degrees_latitude,
-                         12, 7, resolution );
-  Position other_plane_start( upper_left_longitude, upper_left_latitude,
-                             width_in_degrees_longitude, height_in_degrees_latitude,
-                             14, 7, resolution );
-  Position plane_1_end( upper_left_longitude, upper_left_latitude,
-                             width_in_degrees_longitude, height_in_degrees_latitude,
-                             10, 10, resolution );
+  Position plane_1_start( &field, 12, 7 );
+  Position other_plane_start( &field, 14, 7 );
+  Position plane_1_end( &field, 10, 10 );
   cout << endl << "Pos is " << plane_1_start.getX() << ", " << plane_1_start.getY() << endl << endl;
   
   
@@ -0,0 +1,331 @@
+//
+// FieldGeometry.h
+// AU_UAV_ROS
+//
+// The size and location of an airfield, along with the grid laid over it.
+//
+// This is computed once (normally from a field.txt file) and shared by every
+// Position in the field, so that a Position needs to store nothing but its own
+// coordinates. Treat it as immutable once it has been set up; Positions keep a
+// pointer to it, so it must outlive them.
+//
+
+#ifndef FIELD_GEOMETRY
+#define FIELD_GEOMETRY
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "map_tools.h"
+
+#ifdef DEBUG
+#include <cassert>
+#endif
+
+using namespace std;
+
+class FieldGeometry
+{
+public:
+  /**
+   * The default constructor. The resulting field is uninitialized (see
+   * is_initialized()) until you call load() or set_up().
+   */
+  FieldGeometry();
+
+  /**
+   * Sets up a field whose upper left corner and size are given in degrees
+   * @param upperLeftLongitude The longitude of the field's upper left corner
+   * @param upperLeftLatitude The latitude of the field's upper left corner
+   * @param lonwidth The width of the field in degrees longitude
+   * @param latwidth The height of the field in degrees latitude (negative, since
+   *                 the field extends south from its upper left corner)
+   * @param resolution_to_use The width and height of a grid square, in meters
+   */
+  FieldGeometry( double upperLeftLongitude, double upperLeftLatitude,
+                 double lonwidth, double latwidth, double resolution_to_use );
+
+  /**
+   * Same as the five-argument constructor, but for an existing object
+   */
+  void set_up( double upperLeftLongitude, double upperLeftLatitude,
+               double lonwidth, double latwidth, double resolution_to_use );
+
+  /**
+   * Reads a field.txt file. The file holds, separated by whitespace, the upper
+   * left longitude, upper left latitude, width in degrees longitude, height in
+   * degrees latitude, and the grid resolution in meters.
+   * @param path The path to the file (e.g., "/var/field.txt")
+   * @return TRUE if the file could be read, FALSE otherwise
+   */
+  bool load( const string & path );
+
+  /**
+   * @return TRUE if this field has been set up with load() or set_up()
+   */
+  bool is_initialized() const;
+
+  /**
+   * @return TRUE if the lat-long coordinate lies within the field, in a square of
+   *         the grid (as Position rounds it)
+   */
+  bool contains( double latitude, double longitude ) const;
+
+  double getUpperLeftLongitude() const;
+  double getUpperLeftLatitude() const;
+  double getLonWidth() const;
+  double getLatWidth() const;
+
+  /**
+   * @return the width and height of a grid square, in meters
+   */
+  double getResolution() const;
+
+  /**
+   * @return the width and height of the field, in meters
+   */
+  double getWidthInMeters() const;
+  double getHeightInMeters() const;
+
+  /**
+   * @return the width and height of the field, in grid squares
+   */
+  int getWidth() const;
+  int getHeight() const;
+
+  /**
+   * @return the local tangent-plane projection about the upper left corner, used
+   *         for all lat-long <-> grid conversions in this field
+   */
+  const map_tools::local_projection & getProjection() const;
+
+  /**
+   * Finds the grid squares containing n lat-long coordinates at once. Gives the
+   * same squares as constructing a Position for each point.
+   * @param latitudes, longitudes The points to convert (decimal degrees)
+   * @param n The number of points
+   * @param out_x, out_y The grid squares containing the points
+   */
+  void lat_lon_to_grid( const double * latitudes, const double * longitudes,
+                        size_t n, int * out_x, int * out_y ) const;
+
+  /**
+   * Finds the lat-long coordinates of the centers of n grid squares at once
+   * @param x, y The grid squares to convert
+   * @param n The number of squares
+   * @param out_latitudes, out_longitudes The centers of the squares
+   */
+  void grid_to_lat_lon( const int * x, const int * y, size_t n,
+                        double * out_latitudes, double * out_longitudes ) const;
+
+  /**
+   * Looks up the lat-long coordinate of the center of a grid square. The centers
+   * are tabulated when the field is set up, so this is a couple of array reads
+   * and a divide; it gives exactly what unproject_from_local() would.
+   * @param x, y The grid square
+   * @param out_latitude, out_longitude The center of the square
+   */
+  void cell_center( int x, int y, double & out_latitude, double & out_longitude ) const;
+
+private:
+  double top_left_lat;
+  double top_left_long;
+  double latWidth;
+  double lonWidth;
+  double resolution; // meters per grid square
+
+  double width_in_meters;
+  double height_in_meters;
+  int w; // squares wide
+  int h; // squares high
+
+  map_tools::local_projection projection;
+  bool initialized;
+
+  // The cell-center memo. The latitude of a center depends only on its row, and
+  // its longitude is the column's meters east divided by the row's meters per
+  // degree longitude, so w + 2h numbers cover the whole grid.
+  vector< double > center_east;       // by column; meters east of the origin
+  vector< double > center_lat;        // by row
+  vector< double > row_m_per_deg_lon; // by row
+};
+
+inline FieldGeometry::FieldGeometry()
+{
+  initialized = false;
+  top_left_lat = top_left_long = latWidth = lonWidth = 0.0;
+  resolution = width_in_meters = height_in_meters = 0.0;
+  w = h = 0;
+}
+
+inline FieldGeometry::FieldGeometry( double upperLeftLongitude, double upperLeftLatitude,
+                                     double lonwidth, double latwidth, double resolution_to_use )
+{
+  set_up( upperLeftLongitude, upperLeftLatitude, lonwidth, latwidth, resolution_to_use );
+}
+
+inline void FieldGeometry::set_up( double upperLeftLongitude, double upperLeftLatitude,
+                                   double lonwidth, double latwidth, double resolution_to_use )
+{
+  top_left_long = upperLeftLongitude;
+  top_left_lat = upperLeftLatitude;
+  lonWidth = lonwidth;
+  latWidth = latwidth;
+  resolution = resolution_to_use;
+
+  if ( resolution < 1 ) // wasn't given, so . . .
+    resolution = 10.0; // default to a grid with 10 meter squares
+
+  map_tools::set_up_local_projection( top_left_lat, top_left_long, projection );
+
+  // A degree of longitude is longer on the edge nearer the equator, so measure
+  // both the top and bottom edges and keep the wider
+  double top_right_east, top_right_south, btm_right_east, btm_right_south;
+  map_tools::project_to_local( projection, top_left_lat, top_left_long + lonWidth,
+                               top_right_east, top_right_south );
+  map_tools::project_to_local( projection, top_left_lat + latWidth,
+                               top_left_long + lonWidth,
+                               btm_right_east, btm_right_south );
+
+  width_in_meters = fabs( top_right_east ) > fabs( btm_right_east ) ?
+                    fabs( top_right_east ) : fabs( btm_right_east );
+  height_in_meters = fabs( btm_right_south );
+
+  w = map_tools::find_width_in_squares( width_in_meters, height_in_meters,
+                                       resolution );
+  h = map_tools::find_height_in_squares( width_in_meters, height_in_meters,
+                                        resolution );
+
+  center_east.resize( w );
+  for( int x = 0; x < w; x++ )
+    center_east[ x ] = ( x + 0.5 ) * resolution;
+
+  center_lat.resize( h );
+  row_m_per_deg_lon.resize( h );
+  for( int y = 0; y < h; y++ )
+  {
+    // Same arithmetic as unproject_from_local(), so the results match it exactly
+    double d_lat = -( ( y + 0.5 ) * resolution ) / projection.m_per_deg_lat;
+    center_lat[ y ] = projection.origin_lat + d_lat;
+    row_m_per_deg_lon[ y ] = projection.m_per_deg_lon + projection.lon_scale_slope * d_lat;
+  }
+
+  initialized = true;
+}
+
+inline bool FieldGeometry::load( const string & path )
+{
+  ifstream the_file( path.c_str() );
+  if( !the_file.is_open() )
+    return false;
+
+  double ul_lon, ul_lat, lon_w, lat_w, res;
+  the_file >> ul_lon;
+  the_file >> ul_lat;
+  the_file >> lon_w;
+  the_file >> lat_w;
+  the_file >> res;
+
+  if( the_file.fail() )
+    return false;
+
+  set_up( ul_lon, ul_lat, lon_w, lat_w, res );
+  return true;
+}
+
+inline bool FieldGeometry::is_initialized() const
+{
+  return initialized;
+}
+
+inline bool FieldGeometry::contains( double latitude, double longitude ) const
+{
+  double east, south;
+  map_tools::project_to_local( projection, latitude, longitude, east, south );
+
+  // Position rounds to the nearest meter before finding the square
+  return ( east >= 0 && south >= 0 &&
+           (int)( (int)( east + 0.5 ) / resolution ) < w &&
+           (int)( (int)( south + 0.5 ) / resolution ) < h );
+}
+
+inline double FieldGeometry::getUpperLeftLongitude() const
+{
+  return top_left_long;
+}
+
+inline double FieldGeometry::getUpperLeftLatitude() const
+{
+  return top_left_lat;
+}
+
+inline double FieldGeometry::getLonWidth() const
+{
+  return lonWidth;
+}
+
+inline double FieldGeometry::getLatWidth() const
+{
+  return latWidth;
+}
+
+inline double FieldGeometry::getResolution() const
+{
+  return resolution;
+}
+
+inline double FieldGeometry::getWidthInMeters() const
+{
+  return width_in_meters;
+}
+
+inline double FieldGeometry::getHeightInMeters() const
+{
+  return height_in_meters;
+}
+
+inline int FieldGeometry::getWidth() const
+{
+  return w;
+}
+
+inline int FieldGeometry::getHeight() const
+{
+  return h;
+}
+
+inline const map_tools::local_projection & FieldGeometry::getProjection() const
+{
+  return projection;
+}
+
+inline void FieldGeometry::lat_lon_to_grid( const double * latitudes, const double * longitudes,
+                                            size_t n, int * out_x, int * out_y ) const
+{
+  map_tools::lat_lon_to_grid( projection, resolution, latitudes, longitudes, n,
+                              out_x, out_y );
+}
+
+inline void FieldGeometry::cell_center( int x, int y,
+                                        double & out_latitude, double & out_longitude ) const
+{
+  if( x < 0 || x >= w || y < 0 || y >= h ) // off the grid, so not in the memo
+  {
+    map_tools::unproject_from_local( projection, ( x + 0.5 ) * resolution,
+                                     ( y + 0.5 ) * resolution,
+                                     out_latitude, out_longitude );
+    return;
+  }
+
+  out_latitude = center_lat[ y ];
+  out_longitude = projection.origin_lon + center_east[ x ] / row_m_per_deg_lon[ y ];
+}
+
+inline void FieldGeometry::grid_to_lat_lon( const int * x, const int * y, size_t n,
+                                            double * out_latitudes, double * out_longitudes ) const
+{
+  map_tools::grid_to_lat_lon( projection, resolution, x, y, n,
+                              out_latitudes, out_longitudes );
+}
+
+#endif
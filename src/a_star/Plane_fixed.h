@@ -49,6 +49,9 @@ private:
   // The plane's speed, in whatever units you want to use (we aren't using this)
 	double speed;
   
+  // The plane's altitude, as last reported in its telemetry
+  double altitude;
+  
   /**
    * Updates the plane's current bearing and its bearing to its goal.
    * Current bearing is calculated as the bearing from the previous location to
@@ -57,6 +60,18 @@ private:
    */
 	void calculateBearings();
   
+  /**
+   * Calculates the bearing between two positions in the same field straight from
+   * their decimal grid coordinates (x is east, y is south), so no lat-long is
+   * needed. Over the size of a field, this agrees with the great-circle bearing
+   * to within a small fraction of a degree.
+   * @param from The starting position
+   * @param to The ending position
+   * @return The bearing, in degrees (-180 to 180, with 0 due north), from the
+   *         first position to the second
+   */
+  static double grid_bearing( const Position & from, const Position & to );
+  
   // Indicates whether your current position is a "virtual" position; see the
   // virtual_update_current() for more
   bool current_is_virtual;
@@ -72,6 +87,14 @@ public:
    */
   void update_current( Position current );
   
+  /**
+   * Same as update_current( current ), but also stores the plane's speed
+   * @param current The plane's location, as might be obtained through a telemetry
+   *                update
+   * @param speed The plane's ground speed, in meters per second
+   */
+  void update_current( Position current, double speed );
+  
   /**
    * Update a plane's waypoint on its way to the goal. This will not affect the
    * plane's bearing.
@@ -177,6 +200,27 @@ public:
    */
 	double getSpeed();
   
+  /**
+   * Stores the plane's altitude
+   * @param new_altitude The altitude from the plane's latest telemetry update
+   */
+  void setAltitude( double new_altitude );
+  
+  /**
+   * @return the plane's stored altitude (0 until setAltitude() is called)
+   */
+  double getAltitude() const;
+  
+  /**
+   * Dead reckons where the plane will be some time from now, assuming it keeps
+   * flying in the direction it went between its last two (real) positions--the
+   * same direction used for its bearing--at its stored speed
+   * @param seconds How far ahead to look
+   * @param out_x, out_y The plane's predicted decimal grid coordinates; these may
+   *                     be off the field
+   */
+  void extrapolate( double seconds, double & out_x, double & out_y ) const;
+  
   /**
    * @return the plane's ID number--if you're using this right, this number will be
    *         unique in your airspace
@@ -190,26 +234,26 @@ public:
   bool is_initialized();
   
   /**
-   * TODO: Return a pointer instead of the whole, memory-heavy object
-   * 
    * @return The Position object representing plane's NEXT location (may be an
    *         intermediate, collision-avoidance waypoint or may be its final goal)
    */
-	Position getDestination();
+	const Position & getDestination() const;
 	
   /**
-   * TODO: Return a pointer instead of the whole, memory-heavy object
-   * 
    * @return The Position object representing plane's final location (its goal)
    */
-  Position getFinalDestination();
+  const Position & getFinalDestination() const;
   
   /**
-   * TODO: Return a pointer instead of the whole, memory-heavy object
-   * 
    * @return The Position object representing plane's current location
    */
-	Position getLocation();
+	const Position & getLocation() const;
+  
+  /**
+   * @return The Position object representing the plane's previous real (i.e.,
+   *         non-virtual) location, from which its bearing is calculated
+   */
+  const Position & getLastLocation() const;
   
   /**
    * The default constructor for a plane object. Since a plane needs so much 
@@ -234,7 +278,7 @@ void Plane::update_current( Position newcurrent )
   // Only if the "current" location came from a telemetry update should it affect
   // our last position
   if( !current_is_virtual )
-    lastPosition.setLatLon( current.getLat(), current.getLon() );
+    lastPosition = current;
   
 	current = newcurrent; //.setLatLon( newcurrent.getLat(), newcurrent.getLon() );
   current_is_virtual = false;
@@ -244,6 +288,12 @@ void Plane::update_current( Position newcurrent )
 	calculateBearings();
 }
 
+void Plane::update_current( Position newcurrent, double newspeed )
+{
+  update_current( newcurrent );
+  speed = newspeed;
+}
+
 void Plane::virtual_update_current( Position virtual_current )
 {
 	current = virtual_current;
@@ -262,7 +312,7 @@ void Plane::update_intermediate_wp( Position next )
 void Plane::update(Position newcurrent, Position newdestination, double newspeed)
 {
   if( !current_is_virtual )
-    lastPosition.setLatLon( current.getLat(), current.getLon() );
+    lastPosition = current;
   
 	current = newcurrent; //.setLatLon( newcurrent.getLat(), newcurrent.getLon() );
   current_is_virtual = false;
@@ -278,7 +328,10 @@ void Plane::update(Position newcurrent, Position newdestination, double newspeed
 
 void Plane::setFinalDestination(double lon, double lat)
 {
-	finalDestination.setLatLon(lat, lon);
+  // The goal is usually the same as it was on the last update; don't bother
+  // re-projecting it if so
+  if( finalDestination.getLat() != lat || finalDestination.getLon() != lon )
+	  finalDestination.setLatLon(lat, lon);
   
   calculateBearings();
 }
@@ -295,7 +348,7 @@ void Plane::setFinalDestination(int x, int y)
   calculateBearings();
 }
 
-Position Plane::getFinalDestination()
+const Position & Plane::getFinalDestination() const
 {
 	return finalDestination;
 }
@@ -327,22 +380,22 @@ map_tools::bearing_t Plane::get_named_bearing_to_dest() const
 
 void Plane::calculateBearings()
 {
-  // NOTE: the map_tools::calculateBearing() fn takes lat and long in DEGREES
-  double lat1 = current.getLat();
-  double lon1 = current.getLon();
-  
   // If our current location isn't the same as our previous location . . .
 	if( !(current==lastPosition) )
 	{
-		//uses the same method that the simulator uses to find the planes bearing
-		bearing = map_tools::calculateBearing( lastPosition.getLat(), 
-                                           lastPosition.getLon(),
-                                           lat1, lon1 );
+		bearing = grid_bearing( lastPosition, current );
 	}
   
-  bearingToDest = map_tools::calculateBearing( lat1, lon1,
-                                               finalDestination.getLat(),
-                                               finalDestination.getLon() );
+  bearingToDest = grid_bearing( current, finalDestination );
+}
+
+double Plane::grid_bearing( const Position & from, const Position & to )
+{
+  double d_east = to.getDecimalX() - from.getDecimalX();
+  double d_north = from.getDecimalY() - to.getDecimalY(); // y increases southward
+  
+  // Same range as map_tools::calculateBearing(): -180 to 180, 0 is north
+  return atan2( d_east, d_north ) * RADtoDEGREES;
 }
 
 double Plane::getSpeed()
@@ -350,6 +403,31 @@ double Plane::getSpeed()
 	return speed;
 }
 
+void Plane::setAltitude( double new_altitude )
+{
+  altitude = new_altitude;
+}
+
+double Plane::getAltitude() const
+{
+  return altitude;
+}
+
+void Plane::extrapolate( double seconds, double & out_x, double & out_y ) const
+{
+  out_x = current.getDecimalX();
+  out_y = current.getDecimalY();
+  
+  const FieldGeometry * field = current.getField();
+  if( speed <= 0 || field == NULL )
+    return;
+  
+  double squares = speed * seconds / field->getResolution();
+  double rad = bearing * DEGREEStoRAD;
+  out_x += squares * sin( rad );
+  out_y -= squares * cos( rad ); // y increases southward
+}
+
 int Plane::getId()
 {
 	return id;
@@ -363,12 +441,17 @@ bool Plane::is_initialized()
 }
 
 
-Position Plane::getLocation()
+const Position & Plane::getLocation() const
 {
 	return current;
 }
 
-Position Plane::getDestination()
+const Position & Plane::getLastLocation() const
+{
+  return lastPosition;
+}
+
+const Position & Plane::getDestination() const
 {
 	return destination;
 }
@@ -376,6 +459,7 @@ Position Plane::getDestination()
 Plane::Plane(int newid)
 {
 	id=newid;
+  altitude = 0;
 }
 
 Plane::Plane(int newid, Position initial, Position goal )
@@ -386,6 +470,8 @@ Plane::Plane(int newid, Position initial, Position goal )
   finalDestination = Position(goal);
   lastPosition = Position(initial);
   bearing = 0;
+  speed = 0;
+  altitude = 0;
   current_is_virtual = false;
   
   calculateBearings();
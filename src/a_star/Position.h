@@ -10,6 +10,7 @@
 #include <iostream>
 #include <fstream>
 #include "map_tools.h"
+#include "FieldGeometry.h"
 #include <assert.h>
 
 #ifndef EPSILON
@@ -32,26 +33,17 @@ private:
 	int y;//lat
   double decimal_x; // decimal version of the x and y coordinates
   double decimal_y;
-	double resolution; // meters in a grid square(meters/square)
-	//position on the earth
-	double lat;//y
-	double lon;//x
-	double altidue;//just there for kicks
-	//size of the grid or matrix
-	int w;// number of squares wide
-	int h;// squares high
-	//size of the "earth"
-	//this part is kinda an issue for now the position class is built around a top left corner of the area it is contained within
-	double top_left_lat;//the value of the latitude of the top left corner
-	double top_left_long;//same as top_left_lat but for longitude 
-  double top_right_lat;
- 	double top_right_long;
-  double btm_left_lat;
- 	double btm_left_long;
-	double latWidth;
-	double lonWidth;
- 	double width_in_meters;
- 	double height_in_meters;
+	//position on the earth. The grid position is what we actually store; the
+	//lat-long is kept if it's what we were given, and otherwise looked up the
+	//first time someone asks for it (see getLat())
+	mutable double lat;//y
+	mutable double lon;//x
+	mutable bool lat_lon_known;
+  
+  // The field in which this position exists; shared by every position in the
+  // field, and holds the grid size, resolution, and the projection used for all
+  // lat-long <-> grid conversions
+  const FieldGeometry * field;
   
 	//functions for converting between systems
 	/**
@@ -70,12 +62,6 @@ private:
 		@param out_y the y value to be changed. note it is an out parameter.
 	**/
   void lat_lon_to_decimal_xy( double & out_x, double & out_y);
-    
-  
-    
-  // The constructor's "helper"; used to set the width and height of the grid in
-  // which the position exists.
-  void set_up_grid_parms();
     	
 public:
 	/**
@@ -84,11 +70,11 @@ public:
 		@param out_lon the latitude value to be changed. note it is an out parameter.
 		@param out_lon the longitude value to be changed. note it is an out parameter.
 	**/
-  void xy_to_latlon( double & out_lat, double & out_lon );
+  void xy_to_latlon( double & out_lat, double & out_lon ) const;
 	/**
 	A function that sets the x and y values of the position. They MUST be set together, if the Earth is round.
 	If it happens that in the future the Earth becomes flat most of this code would be unusable and would have to be 
-	replaced with Euclidian equations. After setting the xy the latlon is then set as well to keep everything up to date.
+	replaced with Euclidian equations. The latlon is not computed until someone asks for it.
 	input:
 		@param x1 the x value to be set. It must be >=0 and <w
 		@param y1 the y value to be set. It must be >=0 and <h
@@ -108,7 +94,8 @@ public:
   //the longitude and latitude of the top left of their block
 	
 	/** 
-	Getter for the latitude. Returns a value in decimal degrees.
+	Getter for the latitude. Returns a value in decimal degrees. If the position was
+	set by x and y, this is the center of the square, from the field's memo.
 	output:
 		@return the latitude of the position in decimal degrees.
 	**/
@@ -124,13 +111,13 @@ public:
 	output:
 		@return the x.
 	**/
-	int getX();
+	int getX() const;
 	/** 
 	Getter for the y. Returns a value of a grid position.
 	output:
 		@return the y.
 	**/
-	int getY();
+	int getY() const;
 	/** 
 	Getter for the decimal x. Returns a value of a decimal grid position.
 	output:
@@ -148,60 +135,57 @@ public:
 	output:
 		@return the width of the grid, in grid squares
 	**/
-	int getWidth();
+	int getWidth() const;
 	/** 
 	Getter for the height in squares aka the number of ys.
 	output:
 		@return the height of the grid, in grid squares
 	**/
-	int getHeight();
+	int getHeight() const;
 	/** 
 	Getter for the top longitude left of the field in which the position exists.
 	output:
 		@return the top left longitude
 	**/
-	double getUpperLeftLongitude();
+	double getUpperLeftLongitude() const;
 	/** 
 	Getter for the top latitude left of the field in which the position exists.
 	output:
 		@return the top left latitude
 	**/
-  double getUpperLeftLatitude();
+  double getUpperLeftLatitude() const;
+	/** 
+	Getter for the field in which the position exists.
+	output:
+		@return the shared field geometry, or NULL for a default-constructed position
+	**/
+  const FieldGeometry * getField() const;
 	/**
 	An overloaded == operator. Two points are equal if they have the same decimal x and y.
 	**/
 	bool operator==(Position &equal);
 
 	/**
-	A default constructor for whenever a default might be needed.
+	A default constructor for whenever a default might be needed. The position has no
+	field until it is assigned one.
 	**/
-  Position(double upperLeftLongitude=0.0, double upperLeftLatitude=0.0,
-             double lonwidth=0.0, double latwidth=0.0);
+  Position();
 	/**
 	A constructor to be used when making a plane with latitude and longitude.
 	input:
-		@param upperLeftLongitude the upper left longitude of the field to be used in decimal degrees
-		@param upperLeftLatitude the upper left latitude of the field to be used in decimal degrees
-		@param lonwidth the width of the field in longitude in decimal degrees
-		@param latwidth the width of the field in latitude in decimal degrees.
+		@param the_field the field in which the position exists; it must outlive the position
 		@param longitude the longitude at which this position is being constructed
 		@param latitude the latitude at which this position in being constructed
-		@resolution_to_use the resolution to use for the grid in meters per square
 	**/
-	Position(double upperLeftLongitude, double upperLeftLatitude, double lonwidth, 
-             double latwidth, double longitude, double latitude, double resolution_to_use);
+	Position(const FieldGeometry * the_field, double longitude, double latitude);
 						 /**
 	A constructor to be used when making a plane with x and y.
 	input:
-		@param upperLeftLongitude the upper left longitude of the field to be used in decimal degrees
-		@param upperLeftLatitude the upper left latitude of the field to be used in decimal degrees
-		@param lonwidth the width of the field in longitude in decimal degrees
-		@param latwidth the width of the field in latitude in decimal degrees.
+		@param the_field the field in which the position exists; it must outlive the position
 		@param x the x at which this position is being constructed
 		@param y the y at which this position in being constructed
-		@resolution_to_use the resolution to use for the grid in meters per square
 	**/
-	Position(double upperLeftLongitude, double upperLeftLatitude, double lonwidth, double latwidth, int x, int y, double resolution);
+	Position(const FieldGeometry * the_field, int x, int y);
 };
 
 bool Position::operator==(Position &rhs)
@@ -213,25 +197,58 @@ bool Position::operator==(Position &rhs)
 }
 
 double Position::getLat() const
-	{return lat;}
+{
+  if( !lat_lon_known )
+  {
+    xy_to_latlon( lat, lon );
+    lat_lon_known = true;
+  }
+  return lat;
+}
 
 double Position::getLon() const
-	{return lon;}
+{
+  if( !lat_lon_known )
+  {
+    xy_to_latlon( lat, lon );
+    lat_lon_known = true;
+  }
+  return lon;
+}
 
 void Position::setLatLon( double latitude, double longitude )
 {
   lon = longitude;
   lat = latitude;
+  lat_lon_known = true;
+  
+#ifndef HAVERSINE_GRID_CONVERSIONS
+  // A single projection gives us both the square and the decimal position
+  double resolution = field->getResolution();
+  double east, south; // in meters from the top left corner
+  map_tools::project_to_local( field->getProjection(), lat, lon, east, south );
+  
+  x = (int)( (int)( east + 0.5 ) / resolution );
+  y = (int)( (int)( south + 0.5 ) / resolution );
+  decimal_x = east / resolution;
+  decimal_y = south / resolution;
+  
+#ifdef DEBUG
+  assert( x < getWidth() && y < getHeight() );
+  assert( x >= 0 && y >= 0 );
+#endif
+#else
   latLonToXY( x, y );
   lat_lon_to_decimal_xy( decimal_x, decimal_y );
+#endif
 }
 
-int Position::getX() 
+int Position::getX() const
 	{
 	return x;
 	}
 
-int Position::getY() 
+int Position::getY() const
 	{
 		return y;
 	}
@@ -249,8 +266,8 @@ double Position::getDecimalY() const
 void Position::setXY(int x1, int y1)
 {
 #ifdef DEBUG
-  assert( y1 >= 0 && y1 < h );
-  assert( x1 >= 0 && x1 < w );
+  assert( y1 >= 0 && y1 < getHeight() );
+  assert( x1 >= 0 && x1 < getWidth() );
 #endif
 
   x=x1;
@@ -258,57 +275,45 @@ void Position::setXY(int x1, int y1)
   decimal_x = x1;
   decimal_y = y1;
   
-  xy_to_latlon( lat, lon );
-  
+  lat_lon_known = false; // we'll look it up if anyone asks
 }
-Position::Position(double upperLeftLongitude, double upperLeftLatitude, 
-                   double lonwidth, double latwidth)
+Position::Position()
 {
-	top_left_long=upperLeftLongitude;
-	top_left_lat=upperLeftLatitude;
-	lonWidth=lonwidth;
-	latWidth=latwidth;
-  resolution = -1.0;
-    
-  set_up_grid_parms();
+  field = NULL;
+  x = y = 0;
+  decimal_x = decimal_y = 0.0;
+  lat = lon = 0.0;
+  lat_lon_known = true;
 }
 
-Position::Position(double upperLeftLongitude, double upperLeftLatitude, 
-                   double lonwidth, double latwidth, double longitude,
-                   double latitude, double resolution_to_use)
+Position::Position(const FieldGeometry * the_field, double longitude, double latitude)
 {
-	top_left_long=upperLeftLongitude;
-	top_left_lat=upperLeftLatitude;
-	lonWidth=lonwidth;
-	latWidth=latwidth;
-	
-  resolution = resolution_to_use;
-    
-  set_up_grid_parms();
+  field = the_field;
   
 #ifdef DEBUG
+  assert( field != NULL && field->is_initialized() );
   assert( (int)latitude != 0 && (int)longitude != 0 );
 #endif
   setLatLon( latitude, longitude );
 }
 
-Position::Position(double upperLeftLongitude, double upperLeftLatitude,
-                   double lonwidth, double latwidth, int x1, int y1, double res)
+Position::Position(const FieldGeometry * the_field, int x1, int y1)
 {
-	top_left_long=upperLeftLongitude;
-	top_left_lat=upperLeftLatitude;
-	lonWidth=lonwidth;
-	latWidth=latwidth;
-
-  resolution = res;
-  lat=0;
-  lon=0;
-  set_up_grid_parms();
+  field = the_field;
+  
+#ifdef DEBUG
+  assert( field != NULL && field->is_initialized() );
+#endif
   setXY(x1,y1); // changes latitude and longitude
 }
 	
-void Position::xy_to_latlon( double & out_lat, double & out_lon )
+void Position::xy_to_latlon( double & out_lat, double & out_lon ) const
 {
+#ifndef HAVERSINE_GRID_CONVERSIONS
+  // Aim for the center of the square
+  field->cell_center( x, y, out_lat, out_lon );
+#else
+  double resolution = field->getResolution();
   double d_from_origin_to_pt = resolution * sqrt( x*x + y*y );
   double bearing_between_pts;
 	
@@ -317,22 +322,32 @@ void Position::xy_to_latlon( double & out_lat, double & out_lon )
   else
     bearing_between_pts = 90 + (RADtoDEGREES * asin( y*resolution / d_from_origin_to_pt ));
   
-  map_tools::calculate_point( top_left_lat, top_left_long, 
+  map_tools::calculate_point( getUpperLeftLatitude(), getUpperLeftLongitude(), 
                               d_from_origin_to_pt, bearing_between_pts,
                               out_lat, out_lon );
   
-  out_lat += (latWidth / (2 * getHeight() ) );
-  out_lon += (lonWidth / (2 * getWidth() ) );
+  out_lat += (field->getLatWidth() / (2 * getHeight() ) );
+  out_lon += (field->getLonWidth() / (2 * getWidth() ) );
 #ifdef DEBUG
   assert( d_from_origin_to_pt > -EPSILON ); // non-negative
 #endif
+#endif
 }
 
 void Position::latLonToXY( int & out_x, int & out_y)
 {
+  double resolution = field->getResolution();
+  
+#ifndef HAVERSINE_GRID_CONVERSIONS
+  double east, south; // in meters from the top left corner
+  map_tools::project_to_local( field->getProjection(), lat, lon, east, south );
+  
+  out_x = (int)( (int)( east + 0.5 ) / resolution );
+  out_y = (int)( (int)( south + 0.5 ) / resolution );
+#else
   double d_from_origin = map_tools::calculate_distance_between_points(
-                                                  top_left_lat, top_left_long,
-                                                  lat, lon, "meters");
+                                                  getUpperLeftLatitude(), getUpperLeftLongitude(),
+                                                  lat, lon, map_tools::METERS);
   double bearing; // in radians!
 
   if( d_from_origin > -EPSILON && d_from_origin < EPSILON )
@@ -341,7 +356,8 @@ void Position::latLonToXY( int & out_x, int & out_y)
   }
   else
   {
-    bearing = map_tools::calculate_bearing_in_rad( top_left_lat, top_left_long,
+    bearing = map_tools::calculate_bearing_in_rad( getUpperLeftLatitude(),
+                                                   getUpperLeftLongitude(),
                                                    lat, lon );
     
     if( bearing > 0 )
@@ -367,16 +383,19 @@ void Position::latLonToXY( int & out_x, int & out_y)
 #endif
   out_x = (int)( (int)(cos( bearing ) * d_from_origin + 0.5) / resolution );
   out_y = -(int)( (int)(sin( bearing ) * d_from_origin - 0.5) / resolution );
+#endif
   
 #ifdef DEBUG
-  if( out_x >= w || out_y >= h )
+  if( out_x >= getWidth() || out_y >= getHeight() )
   {
     cout << "You calculated (x, y) of (" << out_x << ", " << out_y << ") from bearing " << endl;
+#ifdef HAVERSINE_GRID_CONVERSIONS
     cout << bearing*RADtoDEGREES << " and dist from origin " << d_from_origin << endl;
-    cout << "Does this surprise you? Your origin is " << top_left_lat << ", " << top_left_long << endl;
+#endif
+    cout << "Does this surprise you? Your origin is " << getUpperLeftLatitude() << ", " << getUpperLeftLongitude() << endl;
   }
-  assert( out_x < w );
-  assert( out_y < h );
+  assert( out_x < getWidth() );
+  assert( out_y < getHeight() );
   assert( out_x >= 0 );
   assert( out_y >= 0 );
 #endif
@@ -384,9 +403,17 @@ void Position::latLonToXY( int & out_x, int & out_y)
 
 void Position::lat_lon_to_decimal_xy( double & out_x, double & out_y)
 {
+  double resolution = field->getResolution();
+  
+#ifndef HAVERSINE_GRID_CONVERSIONS
+  map_tools::project_to_local( field->getProjection(), lat, lon, out_x, out_y );
+  
+  out_x /= resolution;
+  out_y /= resolution;
+#else
   double d_from_origin = map_tools::calculate_distance_between_points(
-                                                                      top_left_lat, top_left_long,
-                                                                      lat, lon, "meters");
+                                                  getUpperLeftLatitude(), getUpperLeftLongitude(),
+                                                  lat, lon, map_tools::METERS);
   double bearing; // in radians!
   
   if( d_from_origin > -EPSILON && d_from_origin < EPSILON )
@@ -395,7 +422,8 @@ void Position::lat_lon_to_decimal_xy( double & out_x, double & out_y)
   }
   else
   {
-    bearing = map_tools::calculate_bearing_in_rad( top_left_lat, top_left_long,
+    bearing = map_tools::calculate_bearing_in_rad( getUpperLeftLatitude(),
+                                                   getUpperLeftLongitude(),
                                                    lat, lon );
     
     if( bearing > 0 )
@@ -421,54 +449,35 @@ void Position::lat_lon_to_decimal_xy( double & out_x, double & out_y)
 #endif
   out_x = (cos( bearing ) * d_from_origin) / resolution;
   out_y = -(sin( bearing ) * d_from_origin) / resolution;
+#endif
   
 #ifdef DEBUG
-  assert( (int)out_x < w );
-  assert( (int)out_y < h );
+  assert( (int)out_x < getWidth() );
+  assert( (int)out_y < getHeight() );
   assert( (int)out_x >= 0 );
   assert( (int)out_y >= 0 );
 #endif
 }
 
-int Position::getWidth()
+int Position::getWidth() const
 {
-    return w;
+    return field->getWidth();
 }
-int Position::getHeight()
+int Position::getHeight() const
 {
-    return h;
+    return field->getHeight();
 }
-double Position::getUpperLeftLongitude()
+double Position::getUpperLeftLongitude() const
 {
-    return top_left_long;
+    return field->getUpperLeftLongitude();
 }
-double Position::getUpperLeftLatitude()
+double Position::getUpperLeftLatitude() const
 {
-    return top_left_lat;
+    return field->getUpperLeftLatitude();
 }
-
-void Position::set_up_grid_parms()
+const FieldGeometry * Position::getField() const
 {
-  if ( resolution < 1 ) // wasn't set in constructor, so . . .
-    resolution = 10.0; // default to a grid with 10 meter squares
-  
-  top_right_lat = top_left_lat;
-  top_right_long = top_left_long + lonWidth;
-  btm_left_lat = top_left_lat + latWidth;
-  btm_left_long = top_left_long;
-  
-  width_in_meters = 
-  map_tools::calculate_distance_between_points( top_left_lat, top_left_long,
-                                               top_right_lat, top_right_long,
-                                               "meters" );
-  height_in_meters = 
-  map_tools::calculate_distance_between_points( top_left_lat, top_left_long,
-                                               btm_left_lat, btm_left_long,
-                                               "meters" );    
-  w = map_tools::find_width_in_squares( width_in_meters, height_in_meters,
-                                       resolution );
-  h = map_tools::find_height_in_squares( width_in_meters, height_in_meters,
-                                        resolution );
+    return field;
 }
 
 #endif
@@ -0,0 +1,184 @@
+//
+// altitude_bands.h
+// AU_UAV_ROS
+//
+// Splits the airspace into horizontal layers ("bands") by altitude, so that
+// planes hundreds of feet apart vertically don't count as threats to one another.
+//
+// Each plane is planned against only the planes in its own band: that band's
+// "layer" of the fleet table. Those are the only planes that go into its danger
+// grid and best cost grid, and the only ones its plan is checked against. A plane
+// within the margin of a boundary shows up in the layers of the bands on both
+// sides of it, so two planes either side of a boundary still see each other.
+//
+// With no boundaries, there is just one band, and every plane is in every other
+// plane's layer (that is, we plan in 2D, as we always have).
+//
+
+#ifndef ALTITUDE_BANDS
+#define ALTITUDE_BANDS
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "fleet_table.h"
+
+#ifdef DEBUG
+#include <cassert>
+#endif
+
+#ifndef natural
+#define natural unsigned int
+#endif
+
+using namespace std;
+
+class altitude_bands
+{
+public:
+  /**
+   * Creates a single band that holds every altitude
+   */
+  altitude_bands();
+
+  /**
+   * Splits the airspace at the given altitudes
+   * @param boundaries The altitudes between bands, in the same units as the
+   *                   telemetry's altitudes; they'll be sorted. N boundaries
+   *                   make N + 1 bands.
+   * @param margin How close to a boundary a plane must be to show up in the
+   *               bands on both sides of it
+   */
+  void set_up( const vector< double > & boundaries, double margin );
+
+  /**
+   * Reads the bands from a file holding, separated by whitespace, the margin
+   * followed by the boundaries (see set_up())
+   * @param path The path to the file (e.g., "/var/altitude_bands.txt")
+   * @return TRUE if the file could be read, FALSE otherwise (in which case
+   *         there's still one band)
+   */
+  bool load( const string & path );
+
+  /**
+   * @return the number of bands
+   */
+  natural count() const;
+
+  /**
+   * @return the altitudes between bands, lowest first
+   */
+  const vector< double > & boundaries() const;
+
+  /**
+   * @return how close to a boundary a plane must be to show up in the bands on
+   *         both sides of it
+   */
+  double get_margin() const;
+
+  /**
+   * @param altitude An altitude
+   * @return the band the altitude is in, 0 being the lowest
+   */
+  natural band_of( double altitude ) const;
+
+  /**
+   * @param band A band
+   * @param altitude An altitude
+   * @return TRUE if a plane at that altitude belongs in the band's layer: it's
+   *         in the band, or within the margin of one of the band's boundaries
+   */
+  bool in_layer( natural band, double altitude ) const;
+
+  /**
+   * Copies the planes in one band's layer out of a fleet table
+   * @param fleet Every plane
+   * @param band The band whose layer we want
+   * @param out_layer Set to the planes in the band's layer (the rows keep their
+   *                  IDs, but not necessarily their slots)
+   */
+  void layer( const fleet_table & fleet, natural band, fleet_table & out_layer ) const;
+
+private:
+  vector< double > bounds; // sorted; band i is between bounds[ i - 1 ] and bounds[ i ]
+  double margin;
+};
+
+altitude_bands::altitude_bands()
+{
+  margin = 0;
+}
+
+void altitude_bands::set_up( const vector< double > & boundaries, double new_margin )
+{
+  bounds = boundaries;
+  sort( bounds.begin(), bounds.end() );
+  margin = new_margin < 0 ? 0 : new_margin;
+}
+
+bool altitude_bands::load( const string & path )
+{
+  ifstream file( path.c_str() );
+  double new_margin;
+  if( !( file >> new_margin ) )
+    return false;
+
+  vector< double > boundaries;
+  double b;
+  while( file >> b )
+    boundaries.push_back( b );
+
+  set_up( boundaries, new_margin );
+  return true;
+}
+
+natural altitude_bands::count() const
+{
+  return bounds.size() + 1;
+}
+
+const vector< double > & altitude_bands::boundaries() const
+{
+  return bounds;
+}
+
+double altitude_bands::get_margin() const
+{
+  return margin;
+}
+
+natural altitude_bands::band_of( double altitude ) const
+{
+  // The number of boundaries at or below the altitude
+  return upper_bound( bounds.begin(), bounds.end(), altitude ) - bounds.begin();
+}
+
+bool altitude_bands::in_layer( natural band, double altitude ) const
+{
+#ifdef DEBUG
+  assert( band < count() );
+#endif
+  bool above_floor = ( band == 0 || altitude >= bounds[ band - 1 ] - margin );
+  bool below_ceiling = ( band == bounds.size() || altitude < bounds[ band ] + margin );
+  return above_floor && below_ceiling;
+}
+
+void altitude_bands::layer( const fleet_table & fleet, natural band,
+                            fleet_table & out_layer ) const
+{
+  out_layer.clear();
+  for( natural slot = 0; slot < fleet.size(); slot++ )
+  {
+    if( !in_layer( band, fleet.altitude()[ slot ] ) )
+      continue;
+
+    out_layer.set( fleet.ids()[ slot ], fleet.x()[ slot ], fleet.y()[ slot ],
+                   fleet.dest_x()[ slot ], fleet.dest_y()[ slot ],
+                   fleet.final_x()[ slot ], fleet.final_y()[ slot ],
+                   fleet.bearing()[ slot ], fleet.bearing_to_dest()[ slot ],
+                   fleet.altitude()[ slot ] );
+  }
+}
+
+#endif
@@ -12,6 +12,8 @@
 
 #include "stlastar.h" // See header for copyright and usage information
 #include "Plane_fixed.h"
+#include "fleet_table.h"
+#include "planning_deadline.h"
 #include <iostream>
 // pow, abs, round, sqrt used in this code; mainly in Euclidean distance calculations or Chebyshev square distance
 #include <math.h>
@@ -24,6 +26,8 @@
 #include <stack>
 // Used to hold a quick converter between map bearing_t -> a-star integer bearing and its reverse
 #include <map>
+// Holds the multi-waypoint plans handed back to Collision Avoidance
+#include <vector>
 
 #define DEBUG_LISTS 0
 #define DEBUG_LIST_LENGTHS_ONLY 0
@@ -52,6 +56,24 @@ const int ROUTE_ABANDONED = 0; // if 1, says if search terminated
 // This is our global pointer to the Best Cost/Danger Grid  so that all functions have access to it, as well as MapNode methods
 best_cost *bc_grid;
 
+// The deadline for the current plane's search (NULL if there isn't one); other_main() cancels A* once it passes
+const planning_deadline *search_deadline = NULL;
+
+// Set by other_main() if it had to cancel the search because the deadline passed
+bool search_timed_out = false;
+
+/**
+ * astar_point() can hand back a short prefix of A*'s path instead of a single waypoint, so that a plane can keep flying it
+ * without being replanned every second.  The prefix is at most PLAN_WAYPOINTS long, with PLAN_SPACING squares of A*'s path between
+ * consecutive waypoints, and it stops short of any square along the path that is dangerous.
+ */
+const int PLAN_WAYPOINTS = 4;
+const int PLAN_SPACING = 3;
+
+// How close (in squares) another plane's current position may be to a fallback waypoint before we call the waypoint dangerous;
+// this is the reach of the buffer zone the danger grid puts around each plane
+const int FALLBACK_CLEARANCE = 2;
+
 // 0-7 are actual moves, 8 is goal state, 9 is stall state
 /**
  * movex and movey are the way to quickly determine a move that A* specified in grid space
@@ -672,6 +694,12 @@ int other_main(){
 	  SearchState = astarsearch.SearchStep();
 
 	  SearchSteps++;
+
+	  // Out of time: the next SearchStep() frees the nodes and reports failure
+	  if (search_deadline != NULL && SearchState == AStarSearch<MapSearchNode>::SEARCH_STATE_SEARCHING && search_deadline->expired()){
+	    astarsearch.CancelSearch();
+	    search_timed_out = true;
+	  }
 	}
       while( SearchState == AStarSearch<MapSearchNode>::SEARCH_STATE_SEARCHING );
 
@@ -938,11 +966,11 @@ bool is_sparse(){
  * If less than 3, nothing we do will make any real difference (it is too late to change course since it will be time 2 by the time the plane gets the command and it will collide)
  * It searches the dangerous area (up to at 16 by 16 block sparse block) to determine what the closest threat is that it is trying to avoid
  *
- * @param planey_the_plane_map
+ * @param fleet the table of all living planes, as known by collision avoidance
  * @param a_st
  * @param previous [current unused]
  */
-point immediate_avoidance_point(std::map<int, Plane> &planey_the_plane_map, point a_st, point previous){
+point immediate_avoidance_point(const fleet_table &fleet, point a_st, point previous){
   // new_avoidance is our new, safer waypoint to move to that is still within the range of legal moves
   point new_avoidance = a_st;
 
@@ -953,10 +981,11 @@ point immediate_avoidance_point(std::map<int, Plane> &planey_the_plane_map, poin
   // loop through our grid look at time 0 to find these deadly planes
   for (int y = -a_st.t-1; y <= a_st.t+1; y++){
     for (int x = -a_st.t-1; x <= a_st.t+1; x++){
+      int x_pos = a_st.x + x;
+      int y_pos = a_st.y + y;
+
       // make sure our x and y pos are in the graph...would be silly to checkoutside of the graph :P
-      if (x >= 0 && x < MAP_WIDTH && y >= 0 && y < MAP_HEIGHT) {
-	int x_pos = a_st.x + x;
-	int y_pos = a_st.y + y;
+      if (x_pos >= 0 && x_pos < MAP_WIDTH && y_pos >= 0 && y_pos < MAP_HEIGHT) {
 
 	if (bc_grid->get_pos(x_pos, y_pos, 0) >  sqrt(pow(x_pos-e_x, 2) + pow(y_pos-e_y, 2))){
 	  point add;
@@ -969,16 +998,18 @@ point immediate_avoidance_point(std::map<int, Plane> &planey_the_plane_map, poin
   }
 
   // Any plane we actually discover with the proper coordinates is added to our threat queue, which we will then use (in conjunction with the BC/DG) to plot proper avoidance :))))
+  // (the queue holds the planes' slots in the fleet table)
+  const vector<int> &fleet_x = fleet.x();
+  const vector<int> &fleet_y = fleet.y();
+  const vector<bearing_t> &fleet_bearing = fleet.named_bearing();
   queue<int> threat;
   while (!planes_discovered.empty()){
     point plane_threat = planes_discovered.front();
-    for( map< int, Plane >::iterator crnt_plane = planey_the_plane_map.begin(); crnt_plane != planey_the_plane_map.end(); ++crnt_plane )
+    for (natural slot = 0; slot < fleet.size(); slot++)
       {     
-	Plane myplane =  (*crnt_plane).second;
-	Position plane_p = myplane.getLocation();
-	if (plane_p.getX() == plane_threat.x && plane_p.getY() == plane_threat.y){
-	  if (similar_bearing(myplane.get_named_bearing(), initial_bearing)){
-	    threat.push( (*crnt_plane).second.getId());
+	if (fleet_x[slot] == plane_threat.x && fleet_y[slot] == plane_threat.y){
+	  if (similar_bearing(fleet_bearing[slot], initial_bearing)){
+	    threat.push(slot);
 	  }
 	  break;
 	}
@@ -989,16 +1020,16 @@ point immediate_avoidance_point(std::map<int, Plane> &planey_the_plane_map, poin
   // determine closest threat that is at least 2 spots away (otherwise we cannot do anything about it)
   double closest = numeric_limits<double>::infinity();
   while(!threat.empty()){
-    Plane myplane = planey_the_plane_map[threat.front()];
+    int slot = threat.front();
     point plane_point;
-    plane_point.x = myplane.getLocation().getX();
-    plane_point.y = myplane.getLocation().getY();
+    plane_point.x = fleet_x[slot];
+    plane_point.y = fleet_y[slot];
     double distance = sqrt(pow(plane_point.x-s_x, 2) + pow(plane_point.y-s_y, 2));
     if (distance > 3){
       if (distance < closest){
 
 	// run parallel to avoid crashing into a plane with similar bearing as yourself -- and then break away slightly?
-	int new_bear = map_to_astar[myplane.get_named_bearing()];
+	int new_bear = map_to_astar[fleet_bearing[slot]];
 	// is threat right or left?
 	if (plane_point.x < s_x && plane_point.y < s_y){ // threat is on left -- we want to go E, SE, S, or NE/SW
 	  if (initial_bearing == E){
@@ -1044,6 +1075,136 @@ point immediate_avoidance_point(std::map<int, Plane> &planey_the_plane_map, poin
   return new_avoidance;
 }
 
+/**
+ * Checks a square against the danger at time 0: that is, whether any plane other than the owner is currently within FALLBACK_CLEARANCE squares of it.
+ * This is what the danger grid's first slice encodes (each plane's square plus its buffer zone), but it can be answered straight from the fleet table,
+ * so it is usable even when there was no time to build the Best Cost/Danger Grid.
+ *
+ * @param fleet the table of all living planes
+ * @param planeid the plane we are finding a waypoint for (its own position is not a threat)
+ * @param x, y the square in question
+ */
+bool dangerous_at_time_zero(const fleet_table &fleet, int planeid, int x, int y){
+  const vector<int> &ids = fleet.ids();
+  const vector<int> &fleet_x = fleet.x();
+  const vector<int> &fleet_y = fleet.y();
+  for (natural slot = 0; slot < fleet.size(); slot++){
+    if (ids[slot] == planeid)
+      continue;
+    if (abs(fleet_x[slot] - x) <= FALLBACK_CLEARANCE && abs(fleet_y[slot] - y) <= FALLBACK_CLEARANCE)
+      return true;
+  }
+  return false;
+}
+
+/**
+ * Picks a waypoint for a plane whose planning (Best Cost/Danger Grid + A*) did not finish before its deadline, without doing any planning.
+ * In order of preference:
+ *    1) the previous plan's next waypoint (the plane's current destination in the fleet table), if it is still valid: on the field,
+ *       not the square the plane is already in, and not dangerous at time 0
+ *    2) a point up to 3 squares along the straight line to the goal, stopping short of the first square that is dangerous at time 0
+ *    3) the same, but 45* to the right of the goal bearing (the right-of-way convention), then 45* to the left
+ * If every direction is blocked, we head straight for the goal anyway; it is no worse than the command the plane is already flying.
+ *
+ * @param fleet the table of all living planes; must contain planeid
+ * @param planeid the plane that missed its deadline
+ * @param width, height the size of the field in squares
+ * @param used_previous set to TRUE if the waypoint returned is the previous plan's, FALSE otherwise
+ */
+point fallback_point(const fleet_table &fleet, int planeid, int width, int height, bool &used_previous){
+  int slot = fleet.slot_of(planeid);
+#ifdef DEBUG
+  assert(slot != -1);
+#endif
+
+  int x = fleet.x()[slot];
+  int y = fleet.y()[slot];
+
+  point move;
+  move.t = 0;
+  move.b = fleet.named_bearing()[slot];
+
+  // 1) The previous plan, if it still holds up
+  move.x = fleet.dest_x()[slot];
+  move.y = fleet.dest_y()[slot];
+  used_previous = true;
+  if (move.x >= 0 && move.x < width && move.y >= 0 && move.y < height &&
+      !(move.x == x && move.y == y) &&
+      !dangerous_at_time_zero(fleet, planeid, move.x, move.y))
+    return move;
+
+  used_previous = false;
+
+  int goal_x = fleet.final_x()[slot];
+  int goal_y = fleet.final_y()[slot];
+  int goal_orientation = getGridBearing(x, y, goal_x, goal_y); // an A* bearing (0 = E, clockwise)
+
+  // 2) and 3) Straight at the goal, then veer right, then left
+  const int veer[3] = {0, 1, -1};
+  for (int i = 0; i < 3; i++){
+    int heading = (goal_orientation + veer[i] + movegoals) % movegoals;
+    int steps = 0;
+    for (int step = 1; step <= 3; step++){
+      int next_x = x + movex[heading]*step;
+      int next_y = y + movey[heading]*step;
+      if (next_x < 0 || next_x >= width || next_y < 0 || next_y >= height ||
+	  dangerous_at_time_zero(fleet, planeid, next_x, next_y))
+	break;
+      steps = step;
+      // no sense flying past the goal
+      if (next_x == goal_x && next_y == goal_y)
+	break;
+    }
+
+    if (steps > 0){
+      move.x = x + movex[heading]*steps;
+      move.y = y + movey[heading]*steps;
+      return move;
+    }
+  }
+
+  move.x = goal_x < 0 ? 0 : (goal_x >= width ? width - 1 : goal_x);
+  move.y = goal_y < 0 ? 0 : (goal_y >= height ? height - 1 : goal_y);
+  return move;
+}
+
+/**
+ * Continues a plan past its first waypoint along the rest of A*'s path.  The front of a_path must be the plan's first waypoint.
+ * Stops (without adding it) at the first square along the path that is dangerous, since we will have replanned before then;
+ * if the whole path is safe and there is room, the plan ends at the goal.
+ *
+ * @param bc the Best Cost/Danger Grid A* was run on
+ * @param plan the plan to extend; holds just its first waypoint when called
+ */
+void extend_plan(best_cost *bc, vector<point> *plan){
+  a_path.pop(); // that's plan->front()
+
+  int since_last = 0;
+  while (!a_path.empty() && (int)plan->size() < PLAN_WAYPOINTS){
+    point a_st = a_path.front();
+    if (bc->get_pos(a_st.x, a_st.y, a_st.t) > sqrt(pow(a_st.x-e_x, 2) + pow(a_st.y-e_y, 2)))
+      return;
+
+    since_last++;
+    if (since_last == PLAN_SPACING){
+      plan->push_back(a_st);
+      since_last = 0;
+    }
+    a_path.pop();
+  }
+
+  // A* took us the rest of the way safely, so finish at the goal
+  if (a_path.empty() && (int)plan->size() < PLAN_WAYPOINTS &&
+      !(plan->back().x == e_x && plan->back().y == e_y)){
+    point goal;
+    goal.x = e_x;
+    goal.y = e_y;
+    goal.t = plan->back().t + PLAN_SPACING;
+    goal.b = plan->back().b;
+    plan->push_back(goal);
+  }
+}
+
 // Returns the point of divergence between provable optimal path and a-star path
 /**
  * This function is what is called by collisionAvoidance, as well as what coordinates all the parts of A* (Check Sparse, setup Search, run Search, Analyze Search)
@@ -1054,12 +1215,22 @@ point immediate_avoidance_point(std::map<int, Plane> &planey_the_plane_map, poin
  * @param endx, endy the goal position
  * @param planeid the current plane we are operating on, very useful for debugging purposes
  * @param current_bear the current planes bearing as given by collision avoidance
- * @param planey_the_plane_map a list of all living planes in our world, as known by collision avoidance
+ * @param fleet a table of all living planes in our world, as known by collision avoidance
+ * @param deadline if given, A* is cancelled once this expires; the point returned is then meaningless, so check the deadline
+ *                 before using it (see fallback_point())
+ * @param plan if given, this is filled with the waypoints to send the plane, in order: the point returned, followed by up to
+ *             PLAN_WAYPOINTS - 1 more from further along A*'s path (none if the point returned is an avoidance maneuver)
  */
-point astar_point(best_cost *bc, double sx, double sy, int endx, int endy, int planeid, bearing_t current_bear, std::map<int, Plane> *planey_the_plane_map)
+point astar_point(best_cost *bc, double sx, double sy, int endx, int endy, int planeid, bearing_t current_bear, const fleet_table *fleet,
+		  const planning_deadline *deadline = NULL, vector<point> *plan = NULL)
 {
+  if (plan != NULL)
+    plan->clear();
+
   // set our global pointer bc_grd to point to the pointer bc which points to a Best Cost/Danger Grid
   bc_grid = bc;
+  search_deadline = deadline;
+  search_timed_out = false;
 
   // Construct atar_to_map std::map (since map is 0=N and A_ST is 0=E)
   astar_to_map[0] = E;
@@ -1122,6 +1293,9 @@ point astar_point(best_cost *bc, double sx, double sy, int endx, int endy, int p
 
     if (move.y >= MAP_HEIGHT)
       move.y = MAP_HEIGHT - 1;
+
+    if (plan != NULL)
+      plan->push_back(move);
     return move;
   }
   
@@ -1180,6 +1354,14 @@ point astar_point(best_cost *bc, double sx, double sy, int endx, int endy, int p
   // if result is -1...something bad has happened
   int result = other_main();
 
+  // Out of time; whatever A* found is incomplete, so don't bother with it
+  if (search_timed_out){
+    move.x = s_x;
+    move.y = s_y;
+    move.t = -1;
+    return move;
+  }
+
   // Outside Zero means: our plane is trying to move away from our goal (probably due to bearing facing a different direction)
   // However, if this is true, we must do a new type of bounds checking to bring it back in.
   // Our new type of checking asks: if plane is still out of bounds AND the position is safe, continue ELSE return spot
@@ -1240,7 +1422,7 @@ point astar_point(best_cost *bc, double sx, double sy, int endx, int endy, int p
       double predicted_val = sqrt(pow(a_st.x-e_x, 2) + pow(a_st.y-e_y, 2));
       // if, for some reason, our turn is dangerous -- break from it      
       if ((bc->get_pos(a_st.x, a_st.y, a_st.t) > predicted_val) && a_st.t > 1){
-	move = immediate_avoidance_point(*planey_the_plane_map, a_st, previous);
+	move = immediate_avoidance_point(*fleet, a_st, previous);
 	break;
       }
       
@@ -1248,7 +1430,7 @@ point astar_point(best_cost *bc, double sx, double sy, int endx, int endy, int p
       if (a_st.x > greater_x || a_st.x < lesser_x || a_st.y > greater_y || a_st.y < lesser_y){
 	outside_zero = true;
       } else {
-	move = immediate_avoidance_point(*planey_the_plane_map, a_st, previous);
+	move = immediate_avoidance_point(*fleet, a_st, previous);
 	break;
       } 
       
@@ -1271,7 +1453,7 @@ point astar_point(best_cost *bc, double sx, double sy, int endx, int endy, int p
 	  // DETERMINE EMPIRICALLY the best place to go; behind the hazardous plane or in front of it.
 	  // At times 4, 5, and 6 this is reasonable; at times 2 and 3 it may not be as good, but you should already be out of the way by then :)
 
-	  move = immediate_avoidance_point(*planey_the_plane_map, a_st, previous);	  
+	  move = immediate_avoidance_point(*fleet, a_st, previous);	  
 	} else {	  
 	  move = a_st;
 	}
@@ -1299,6 +1481,9 @@ point astar_point(best_cost *bc, double sx, double sy, int endx, int endy, int p
   }
 
 
+  // If our move is where A*'s path has gotten to (rather than an avoidance point), the plan can follow the path on from there
+  bool move_on_path = !a_path.empty() && a_path.front().x == move.x && a_path.front().y == move.y;
+
   // Bounds check our move -- if it is moving off the field bring it back in
   if (move.x < 0)
     move.x = 0;
@@ -1312,5 +1497,11 @@ point astar_point(best_cost *bc, double sx, double sy, int endx, int endy, int p
   if (move.y >= MAP_HEIGHT)
     move.y = MAP_HEIGHT - 1;
 
+  if (plan != NULL){
+    plan->push_back(move);
+    if (move_on_path)
+      extend_plan(bc, plan);
+  }
+
   return move;
 }
@@ -0,0 +1,403 @@
+//
+// async_log.h
+// AU_UAV_ROS
+//
+// A logger cheap enough for the hot paths (every telemetry update, every
+// command, every plan). ROS_INFO formats the message, takes a lock, and writes it
+// out, all on the calling thread; here the calling thread only formats the
+// message into a slot of a ring buffer, and a background thread does the
+// writing. If the ring is full, the message is dropped (and counted) rather
+// than making the caller wait.
+//
+// Use the macros:
+//   ALOG_DEBUG( "Plane %d is at %f, %f", id, lat, lon );
+//   ALOG_INFO_THROTTLE( 1.0, "Queue full" );   // at most once a second from here
+//
+// Messages below ALOG_COMPILED_LEVEL (DEBUG, unless it's #defined before this
+// header is included) aren't compiled in at all. Above that, the level set at run
+// time (INFO, unless set_level() says otherwise; each node takes it from its
+// ~log_level parameter) is checked before anything else, so a message that
+// isn't wanted costs a load and a compare: its arguments aren't evaluated and
+// it isn't formatted. The compiled level has nothing to do with DEBUG, which
+// turns on the planner's asserts.
+//
+// The ring takes any number of writer threads, and never locks. Each slot
+// carries a sequence number saying whose turn it is: a writer claims the next
+// slot by bumping the tail with a compare-and-swap, fills it in, then publishes
+// it by setting its sequence; the flusher reads slots in order as they're
+// published, and hands each one back by setting its sequence one lap ahead.
+//
+// Messages go to stdout with a ROS-style "[ INFO] [time]: " prefix, or, with
+// write_to(), as they are to a file of their own (see write_to_log.h).
+// Everything is defined in the class, so that all the nodes linked into one
+// process (see composedNodes.cpp) share one log.
+//
+
+#ifndef ASYNC_LOG
+#define ASYNC_LOG
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+#ifndef natural
+#define natural unsigned int
+#endif
+
+using namespace std;
+
+#define ALOG_LEVEL_DEBUG 0
+#define ALOG_LEVEL_INFO 1
+#define ALOG_LEVEL_WARN 2
+#define ALOG_LEVEL_ERROR 3
+
+#ifndef ALOG_COMPILED_LEVEL
+#define ALOG_COMPILED_LEVEL ALOG_LEVEL_DEBUG
+#endif
+
+// Logs if the level is wanted at run time
+#define ALOG_AT( level, ... )                                  \
+  do                                                           \
+  {                                                            \
+    async_log & alog_here = async_log::instance();             \
+    if( alog_here.enabled( level ) )                           \
+      alog_here.write( level, __VA_ARGS__ );                   \
+  } while( 0 )
+
+#if ALOG_COMPILED_LEVEL <= ALOG_LEVEL_DEBUG
+#define ALOG_DEBUG( ... ) ALOG_AT( ALOG_LEVEL_DEBUG, __VA_ARGS__ )
+#else
+#define ALOG_DEBUG( ... ) ( (void)0 )
+#endif
+
+#if ALOG_COMPILED_LEVEL <= ALOG_LEVEL_INFO
+#define ALOG_INFO( ... ) ALOG_AT( ALOG_LEVEL_INFO, __VA_ARGS__ )
+#else
+#define ALOG_INFO( ... ) ( (void)0 )
+#endif
+
+#if ALOG_COMPILED_LEVEL <= ALOG_LEVEL_WARN
+#define ALOG_WARN( ... ) ALOG_AT( ALOG_LEVEL_WARN, __VA_ARGS__ )
+#else
+#define ALOG_WARN( ... ) ( (void)0 )
+#endif
+
+#define ALOG_ERROR( ... ) ALOG_AT( ALOG_LEVEL_ERROR, __VA_ARGS__ )
+
+// Logs at most once every period seconds from this spot in the code
+#define ALOG_THROTTLE( LOG, period, ... )            \
+  do                                                 \
+  {                                                  \
+    static log_throttle alog_throttle_here;          \
+    if( alog_throttle_here.ready( period ) )         \
+      LOG( __VA_ARGS__ );                            \
+  } while( 0 )
+
+#define ALOG_INFO_THROTTLE( period, ... ) ALOG_THROTTLE( ALOG_INFO, period, __VA_ARGS__ )
+#define ALOG_WARN_THROTTLE( period, ... ) ALOG_THROTTLE( ALOG_WARN, period, __VA_ARGS__ )
+#define ALOG_ERROR_THROTTLE( period, ... ) ALOG_THROTTLE( ALOG_ERROR, period, __VA_ARGS__ )
+
+#ifdef __GNUC__
+#define ALOG_PRINTF_LIKE( fmt, args ) __attribute__( ( format( printf, fmt, args ) ) )
+#else
+#define ALOG_PRINTF_LIKE( fmt, args )
+#endif
+
+/**
+ * Rate-limits one log statement (see ALOG_THROTTLE)
+ */
+class log_throttle
+{
+public:
+  log_throttle() : next_ns( 0 ) {}
+
+  /**
+   * @param period The least time (s) between messages
+   * @return TRUE if it's been long enough since the last message, in which case
+   *         the caller should log (and the clock starts again)
+   */
+  bool ready( double period )
+  {
+    timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    int64_t now_ns = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+
+    int64_t next = next_ns.load( boost::memory_order_relaxed );
+    if( now_ns < next )
+      return false;
+    // If two threads get here at once, only one of them logs
+    return next_ns.compare_exchange_strong( next, now_ns + (int64_t)( period * 1e9 ) );
+  }
+
+private:
+  boost::atomic< int64_t > next_ns;
+};
+
+class async_log
+{
+public:
+  // The ring's size (a power of two), and the longest message (longer ones are cut off)
+  enum { CAPACITY = 4096, TEXT_SIZE = 232 };
+
+  // Where messages go unless they're written to a particular file
+  enum { CONSOLE = 0 };
+
+  /**
+   * @return the process's log; it's made (and its flusher started) on first use,
+   *         and everything logged is written out when the process exits
+   */
+  static async_log & instance()
+  {
+    static async_log the_log;
+    return the_log;
+  }
+
+  /**
+   * Logs a message to the console
+   * @param level One of the ALOG_LEVELs
+   * @param format, ... As for printf()
+   */
+  ALOG_PRINTF_LIKE( 3, 4 ) void write( int level, const char * format, ... )
+  {
+    if( level < min_level.load( boost::memory_order_relaxed ) )
+      return;
+    va_list args;
+    va_start( args, format );
+    enqueue( CONSOLE, level, format, args );
+    va_end( args );
+  }
+
+  /**
+   * Logs a line, exactly as given, to a file opened with sink_for()
+   * @param sink The file's ID
+   * @param format, ... As for printf()
+   */
+  ALOG_PRINTF_LIKE( 3, 4 ) void write_to( int sink, const char * format, ... )
+  {
+    va_list args;
+    va_start( args, format );
+    enqueue( sink, ALOG_LEVEL_INFO, format, args );
+    va_end( args );
+  }
+
+  /**
+   * Opens a file (for appending) to write_to(). Opening the same path again gets
+   * the same ID. Not meant for hot paths, since it takes a lock.
+   * @param path The file
+   * @return its ID, or -1 if it couldn't be opened
+   */
+  int sink_for( const string & path )
+  {
+    boost::mutex::scoped_lock lock( sink_lock );
+    map< string, int >::iterator found = sink_ids.find( path );
+    if( found != sink_ids.end() )
+      return (*found).second;
+
+    FILE * file = fopen( path.c_str(), "a" );
+    if( file == NULL )
+      return -1;
+    sinks.push_back( file );
+    sink_ids[ path ] = sinks.size() - 1;
+    return sinks.size() - 1;
+  }
+
+  /**
+   * Sets the least important level that gets logged (for levels that were
+   * compiled in at all)
+   */
+  void set_level( int level )
+  {
+    min_level.store( level );
+  }
+
+  /**
+   * Sets the level by name, as given in a node's ~log_level parameter
+   * @param name "debug", "info", "warn", or "error"
+   * @return FALSE if that isn't a level (the level is left as it was)
+   */
+  bool set_level( const string & name )
+  {
+    static const char * names[] = { "debug", "info", "warn", "error" };
+    for( int level = ALOG_LEVEL_DEBUG; level <= ALOG_LEVEL_ERROR; level++ )
+    {
+      if( name == names[ level ] )
+      {
+        set_level( level );
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @return TRUE if a message at this level would be logged
+   */
+  bool enabled( int level ) const
+  {
+    return level >= min_level.load( boost::memory_order_relaxed );
+  }
+
+  /**
+   * Waits until everything logged so far has been written out
+   */
+  void flush()
+  {
+    size_t target = tail.load();
+    while( written.load() < target )
+      boost::this_thread::sleep( boost::posix_time::milliseconds( 1 ) );
+  }
+
+  /**
+   * @return the number of messages dropped because the ring was full
+   */
+  natural dropped() const
+  {
+    return drops.load();
+  }
+
+  ~async_log()
+  {
+    stopping.store( true );
+    flusher->join();
+    delete flusher;
+    if( drops.load() > 0 )
+      fprintf( stderr, "async_log: dropped %u messages because the log couldn't keep up\n", drops.load() );
+    for( natural i = 1; i < sinks.size(); i++ )
+      fclose( sinks[ i ] );
+    delete [] records;
+  }
+
+private:
+  struct record
+  {
+    boost::atomic< size_t > sequence; // == its index when free, index + 1 when full
+    int sink;
+    int level;
+    timespec time;
+    char text[ TEXT_SIZE ];
+  };
+
+  async_log() : tail( 0 ), written( 0 ), min_level( ALOG_LEVEL_INFO ), drops( 0 ), stopping( false )
+  {
+    records = new record[ CAPACITY ];
+    for( size_t i = 0; i < CAPACITY; i++ )
+      records[ i ].sequence.store( i, boost::memory_order_relaxed );
+    head = 0;
+    sinks.push_back( stdout );
+    flusher = new boost::thread( &async_log::flush_loop, this );
+  }
+
+  // Not copyable
+  async_log( const async_log & );
+  async_log & operator=( const async_log & );
+
+  void enqueue( int sink, int level, const char * format, va_list args )
+  {
+    // Claim a slot
+    size_t position = tail.load( boost::memory_order_relaxed );
+    record * r;
+    while( true )
+    {
+      r = &records[ position & ( CAPACITY - 1 ) ];
+      size_t sequence = r->sequence.load( boost::memory_order_acquire );
+      if( sequence == position )
+      {
+        if( tail.compare_exchange_weak( position, position + 1, boost::memory_order_relaxed ) )
+          break;
+      }
+      else if( sequence < position )
+      {
+        // Still holds a message from the last lap: we're full
+        drops.fetch_add( 1, boost::memory_order_relaxed );
+        return;
+      }
+      else
+        position = tail.load( boost::memory_order_relaxed );
+    }
+
+    r->sink = sink;
+    r->level = level;
+    clock_gettime( CLOCK_REALTIME, &r->time );
+    vsnprintf( r->text, TEXT_SIZE, format, args );
+
+    // Publish it
+    r->sequence.store( position + 1, boost::memory_order_release );
+  }
+
+  /**
+   * Writes out every message that's ready (flusher thread only)
+   * @return TRUE if there were any
+   */
+  bool drain()
+  {
+    bool any = false;
+    while( true )
+    {
+      record * r = &records[ head & ( CAPACITY - 1 ) ];
+      if( r->sequence.load( boost::memory_order_acquire ) != head + 1 )
+        break;
+
+      print( *r );
+      r->sequence.store( head + CAPACITY, boost::memory_order_release );
+      head++;
+      any = true;
+    }
+
+    if( any )
+    {
+      boost::mutex::scoped_lock lock( sink_lock );
+      for( natural i = 0; i < sinks.size(); i++ )
+        fflush( sinks[ i ] );
+    }
+    written.store( head );
+    return any;
+  }
+
+  void print( const record & r )
+  {
+    if( r.sink == CONSOLE )
+    {
+      static const char * names[] = { "DEBUG", " INFO", " WARN", "ERROR" };
+      fprintf( stdout, "[%s] [%ld.%09ld]: %s\n", names[ r.level & 3 ],
+               (long)r.time.tv_sec, (long)r.time.tv_nsec, r.text );
+      return;
+    }
+
+    boost::mutex::scoped_lock lock( sink_lock );
+    if( r.sink > 0 && (natural)r.sink < sinks.size() )
+      fprintf( sinks[ r.sink ], "%s\n", r.text );
+  }
+
+  void flush_loop()
+  {
+    while( !stopping.load() )
+    {
+      if( !drain() )
+        boost::this_thread::sleep( boost::posix_time::milliseconds( 2 ) );
+    }
+    drain();
+  }
+
+  record * records;
+  boost::atomic< size_t > tail;    // the next slot a writer will claim
+  size_t head;                     // the next slot to write out (flusher only)
+  boost::atomic< size_t > written; // everything before this has been written out
+  boost::atomic< int > min_level;
+  boost::atomic< natural > drops;
+  boost::atomic< bool > stopping;
+  boost::thread * flusher;
+
+  // The files we write to; sinks[ CONSOLE ] is stdout
+  boost::mutex sink_lock;
+  vector< FILE * > sinks;
+  map< string, int > sink_ids;
+};
+
+#endif
@@ -38,7 +38,7 @@
 #include "danger_grid_with_turns.h"
 #include "Position.h"
 #include "map_tools.h"
-#include "Plane_fixed.h"
+#include "fleet_table.h"
 #include "coord.h"
 
 // used to tell the map class that it's okay to have costs greater than 1 associated
@@ -66,16 +66,25 @@ public:
    *
    * Note that the width, height, and resolution may be in any units, but the units
    * must be consistent across all measurements.
-   * @param set_of_aircraft A std::map containing the aircraft that need to
+   * @param set_of_aircraft The fleet table holding the aircraft that need to
    * be considered
    * @param width The width of the airspace (our x dimension)
    * @param height The height of the airspace (our y dimension)
    * @param resolution The resolution to be used in the map
    * @param plane_id The index of the plane for which we are generating the best 
    *                 cost grid
+   * @param deadline If given, building the grids stops as soon as it expires,
+   *                 leaving them incomplete (see is_complete())
    */
-  best_cost( std::map< int, Plane > * set_of_aircraft, double width, double height,
-             double resolution, unsigned int plane_id );
+  best_cost( const fleet_table * set_of_aircraft, double width, double height,
+             double resolution, unsigned int plane_id,
+             const planning_deadline * deadline = NULL );
+  
+  /**
+   * @return FALSE if the deadline given to the constructor expired before the
+   *         grids were built, in which case nothing else may be called
+   */
+  bool is_complete() const;
    
   /**
    * The overloaded ( ) operator. Allows simple access to the cost rating of a
@@ -158,10 +167,12 @@ public:
   
 private:
   // The "owner" of this BC grid, for whom we will calculate distance costs &c.
-  Plane * owner;
+  // This is its slot in the fleet table.
+  natural owner;
   
   danger_grid * mc; // the map cost (MC) grid (a.k.a., the danger grid)
   danger_grid * bc; // the best cost grid; the heart of this class
+  bool complete;    // FALSE if the deadline cut building the grids short
   
   coord goal; // the x and y coordinates of the goal
   coord start;
@@ -172,12 +183,12 @@ private:
   unsigned int n_sqrs_w;     // width of the danger grid in grid squares
 };
 
-best_cost::best_cost( std::map< int, Plane > * set_of_aircraft,
+best_cost::best_cost( const fleet_table * set_of_aircraft,
                       double width, double height, double resolution, 
-                      unsigned int plane_id)
+                      unsigned int plane_id, const planning_deadline * deadline )
 {
 #ifdef DEBUG
-  assert( (*set_of_aircraft).find( plane_id ) != (*set_of_aircraft).end() );
+  assert( set_of_aircraft->contains( plane_id ) );
   assert( set_of_aircraft->size() != 0 );
   assert( set_of_aircraft->size() < 100000 );
   assert( resolution > EPSILON );
@@ -189,24 +200,35 @@ best_cost::best_cost( std::map< int, Plane > * set_of_aircraft,
   // Set up all the variables relating to the characteristics of our airspace //
   res = resolution;
   
-  start.x = (*set_of_aircraft)[ plane_id ].getLocation().getX();
-  start.y = (*set_of_aircraft)[ plane_id ].getLocation().getY();
+  owner = set_of_aircraft->slot_of( plane_id );
   
-  goal.x = (*set_of_aircraft)[ plane_id ].getFinalDestination().getX();
-  goal.y = (*set_of_aircraft)[ plane_id ].getFinalDestination().getY();
+  start.x = set_of_aircraft->x()[ owner ];
+  start.y = set_of_aircraft->y()[ owner ];
   
-  owner = &( (*set_of_aircraft)[ plane_id ] );
+  goal.x = set_of_aircraft->final_x()[ owner ];
+  goal.y = set_of_aircraft->final_y()[ owner ];
   
   // The "map cost" array, a very sparse representation of our airspace which notes
   // the likelihood of encountering an aircraft at each square at each time.
   // This is consulted when calculating the best cost from a given square.
-  mc = new danger_grid( set_of_aircraft, width, height, resolution, plane_id );
+  mc = new danger_grid( set_of_aircraft, width, height, resolution, plane_id, deadline );
+  
+  // Out of time: the danger grid is unfinished, so there's no use building on it
+  if( deadline != NULL && deadline->expired() )
+  {
+    bc = NULL;
+    complete = false;
+    n_secs = 0;
+    n_sqrs_w = n_sqrs_h = 0;
+    return;
+  }
   
   // The real meat of this class; stores the cost of the best possible path from each
   // square at each time to the goal square. Initializes each square with the 
   // following simple heuristic:
   //      cost( node n ) = mc( n ) + (weighing factor) * distance( from n to goal )
-  bc = new danger_grid( mc, set_of_aircraft, plane_id, "heuristic" );
+  bc = new danger_grid( mc, set_of_aircraft, plane_id, "heuristic", deadline );
+  complete = ( deadline == NULL || !deadline->expired() );
   
   n_secs = bc->get_time_in_secs();
   n_sqrs_w = bc->get_width_in_squares();
@@ -234,6 +256,11 @@ best_cost::~best_cost()
   delete bc;
 }
 
+bool best_cost::is_complete() const
+{
+  return complete;
+}
+
 double best_cost::operator()( unsigned int x, unsigned int y, int time ) const
 {
   return bc->get_danger_at( x, y, time );
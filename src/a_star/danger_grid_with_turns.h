@@ -16,20 +16,33 @@
 // in the future, you would call your_danger_grid_variable( 10, 7, 4 ) (which works 
 // in virtue of the overloaded parenthesis operator), which would return a double 
 // with the "danger rating" at that square.
+//
+// Filling the grid can be split across worker threads (see danger_tile_workers),
+// which are kept in a pool between grids (see danger_tile_pool).
+// The grid is cut into strips of columns ("tiles"), one per worker. Each worker
+// predicts the paths of the planes that start in its tile, then, once every
+// worker is done predicting, adds the danger for every plane that can reach its
+// tile--its own planes, plus those in the "halo" around it--writing only the
+// squares in its tile. Planes are added in the same order on every worker, so the
+// grid comes out exactly as it would on one thread.
 
 #ifndef DANGER_GRID
 #define DANGER_GRID
 
 #include <vector>
-#include <map> // std::map, which stores our set of aircraft
 #include <math.h>
 #include <climits>
+#include <unistd.h>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
 
 #include "map_cleaner.h"
 #include "estimate.h"
-#include "Plane_fixed.h"
+#include "fleet_table.h"
 #include "map_tools.h"
 #include "coord.h"
+#include "planning_deadline.h"
 
 using namespace std;
 
@@ -44,6 +57,14 @@ static const unsigned int look_ahead = 20;
 // the number of seconds to consider in the past
 static const unsigned int look_behind = 2;
 
+// The most worker threads to split filling a danger grid across (1 means fill it on
+// the calling thread). Set this before building any grids.
+static unsigned int danger_tile_workers = 1;
+// Don't bother with another worker for fewer planes than this
+static const unsigned int min_planes_per_worker = 8;
+// How far, in squares, set_danger_buffer() spreads danger from a predicted square
+static const int buffer_reach = 3;
+
 // This is defined in the constructor to be a bit greater than:
 // sqrt( (width in squares)^2 + (height in squares) ^2) 
 static double default_plane_danger;
@@ -63,6 +84,49 @@ const double DEGREEStoRAD = PI/180;//Conversion factor from Degrees to Radians
 // close)
 static const double field_weight = 0.6;
 
+/**
+ * The helper threads that fill danger grid tiles. They're started the first time
+ * a grid needs them and then kept, waiting for the next grid, so that a replan
+ * doesn't pay for creating and joining threads. One batch of tiles runs at a time.
+ */
+class danger_tile_pool
+{
+public:
+  typedef boost::function< void () > job;
+  
+  /**
+   * @return the one pool
+   */
+  static danger_tile_pool & instance();
+  
+  ~danger_tile_pool();
+  
+  /**
+   * Runs jobs[ 0 ] on the calling thread and the rest on helpers, all at the same
+   * time (so they may wait on each other), and returns once they're all done
+   * @param jobs The jobs
+   */
+  void run( const vector< job > & jobs );
+  
+private:
+  danger_tile_pool();
+  
+  /**
+   * What helper i does: runs jobs[ i + 1 ] of each batch there is one for
+   */
+  void work( natural i );
+  
+  boost::mutex batch_lock;  // held for a whole batch
+  boost::mutex state_lock;  // guards everything below
+  boost::condition_variable batch_ready, batch_done;
+  vector< boost::thread * > helpers;
+  pid_t owner_pid;          // a forked child has none of our threads
+  const vector< job > * batch;
+  natural generation;       // bumped for each batch
+  natural unfinished;       // helpers still working on this batch
+  bool stopping;
+};
+
 class danger_grid
 {
 public:
@@ -73,30 +137,36 @@ public:
    *
    * Note that the width, height, and resolution may be in any units, but the units
    * must be consistent across all measurements.
-   * @param set_of_aircraft A vector array containing the aircraft that need to
+   * @param set_of_aircraft The fleet table holding the aircraft that need to
    * be considered
    * @param width The width of the airspace (our x dimension)
    * @param height The height of the airspace (our y dimension)
    * @param resolution The resolution to be used in the map
-   * @param plane_id The ID of this danger grid's "owner" (should be its position
-   *                 in the set_of_aircraft vector
+   * @param plane_id The ID of this danger grid's "owner" (it must be in the
+   *                 set_of_aircraft table)
+   * @param deadline If given, filling the grid stops as soon as it expires, leaving
+   *                 the grid incomplete (so it mustn't be used)
    */
-  danger_grid( std::map< int, Plane > * set_of_aircraft, const double width,
-              const double height, const double resolution, const natural plane_id );
+  danger_grid( const fleet_table * set_of_aircraft, const double width,
+              const double height, const double resolution, const natural plane_id,
+              const planning_deadline * deadline = NULL );
   
   /**
    * The heuristic generation constructor; takes a reference to a danger grid
    *  and makes this object a best cost grid.
    * @param dg A reference to another danger grid
-   * @param set_of_aircraft A vector array containing the aircraft that need to
+   * @param set_of_aircraft The fleet table holding the aircraft that need to
    *                        be considered
-   * @param plane_id The ID of this danger grid's "owner" (should be its position
-   *                 in the set_of_aircraft vector
+   * @param plane_id The ID of this danger grid's "owner" (it must be in the
+   *                 set_of_aircraft table)
    * @param flag The flag -- if this is set to "heuristic", we will initialize all
    *             squares to the straight-line cost to the goal
+   * @param deadline If given, filling the grid stops as soon as it expires, leaving
+   *                 the grid incomplete (so it mustn't be used)
    */
-  danger_grid( const danger_grid * dg, std::map< int, Plane > * set_of_aircraft,
-              const natural plane_id, string flag );
+  danger_grid( const danger_grid * dg, const fleet_table * set_of_aircraft,
+              const natural plane_id, string flag,
+              const planning_deadline * deadline = NULL );
   
   /**
    * The destructor for the danger_grid object
@@ -166,10 +236,10 @@ public:
   double get_res() const;
   
   /**
-   * @return a reference to the "owner" of this danger grid (the plane for which
+   * @return the ID of the "owner" of this danger grid (the plane for which
    * it was created)
    */
-  Plane * get_owner();
+  int get_owner() const;
   
   /**
    * Gives the "threshold" value indicating that there is a plane in the square.
@@ -241,6 +311,55 @@ private:
    */
   void fill_danger_space( const natural plane_id );
   
+  // One worker's share of the grid: the columns from x_begin up to (but not
+  // including) x_end, at every time
+  struct danger_tile
+  {
+    natural x_begin;
+    natural x_end;
+  };
+  
+  // A plane's predicted path (see calculate_future_pos()), and the columns it
+  // reaches
+  struct plane_prediction
+  {
+    bool predicted;
+    vector< estimate > to_avoid;
+    vector< estimate > to_goal;
+    int min_x, max_x; // including the plane's starting square, but not the buffer
+    
+    plane_prediction() : predicted( false ), min_x( 0 ), max_x( -1 ) {}
+  };
+  
+  /**
+   * One worker's part of fill_danger_space(): predicts the paths of the planes
+   * starting in its tile, waits for every other worker to do the same, then adds
+   * the danger of each plane that can reach the tile
+   * @param plane_id The ID of the plane to ignore
+   * @param tile The worker's tile
+   * @param predictions Every plane's prediction, by slot; this worker fills in
+   *                    those of the planes in its tile
+   * @param predicted The barrier to wait at between predicting and adding danger,
+   *                  or NULL if this is the only worker
+   */
+  void fill_tile( const natural plane_id, const danger_tile & tile,
+                  vector< plane_prediction > & predictions, boost::barrier * predicted );
+  
+  /**
+   * Adds one plane's danger (at its current square and along its predicted path)
+   * to the squares of the grid in a tile
+   * @param slot The plane's slot in the fleet table
+   * @param prediction The plane's predicted path
+   * @param tile The squares to write to; the rest are left alone
+   */
+  void add_plane_danger( natural slot, const plane_prediction & prediction,
+                         const danger_tile & tile );
+  
+  /**
+   * Adds to the danger at a square, if it's in the tile (and on the grid)
+   */
+  void add_in_tile( const danger_tile & tile, int time, natural x, natural y, double danger );
+  
   /**
    * Set up the weighting scheme for danger ratings in the future.
    * At the moment, this simply decreases the danger linearly as you go farther
@@ -268,9 +387,10 @@ private:
    * @param y The y coordinate of the plane's actual location
    * @param time The number of seconds in the future for which the plane's danger was
    *             just set
+   * @param tile The squares to write to; the rest of the buffer is left alone
    */
   void set_danger_buffer( double bearing, double unweighted_danger,
-                         natural x, natural y, int time );
+                         natural x, natural y, int time, const danger_tile & tile );
   
   /**
    * Outputs the contents of an "estimate" vector array
@@ -300,13 +420,15 @@ private:
    works well enough for most of our purposes. turns are predicted both from the start to the avoidance point
    and from the avoidance point to the goal. note: this function assumes a basic cartesian grid. p.s. this is by thomas
    input:(yes there is more to this function than just a description)
-   @param plane the plane whose path you are predicting
+   @param slot the fleet table slot of the plane whose path you are predicting
    @param time the time from which you are starting prediction, must be >=0
+   @param bearing_after_avoid the estimated bearing of the plane on reaching its avoidance point; set
+   by the first call and used by the second
    output:
    @return a vector that contains estimates of the planes path. as the plane traves through time a (0,0,-1) estimate is inserter
    as a time marker.
    **/
-  vector< estimate > calculate_future_pos( Plane & the_plane, int & time );
+  vector< estimate > calculate_future_pos( natural slot, int & time, double & bearing_after_avoid );
   
 	/**
 	a function that finds the neighbors of a given angle. a neighboring angle is one of the angles
@@ -371,14 +493,18 @@ private:
   vector< double > plane_danger; // in case the plane danger were to change over time
   
   // the set of aircraft with which we are concerned
-  std::map< int, Plane > * aircraft;
+  const fleet_table * aircraft;
+  
+  // When to give up filling the grid, if ever (see the constructor)
+  const planning_deadline * deadline;
   
   // The danger space is a bit strange due to the fact that it's an array of maps,
   // where each position in the array corresponds to a time.
   vector< bc::map > * danger_space;
   
   // The "owner" of this danger grid, for whom we will calculate distance costs &c.
-  Plane * owner;
+  // This is its slot in the aircraft table.
+  natural owner;
   
 #ifdef OVERLAYED
   vector< bc::map > overlayed; // Used only when dumping output
@@ -389,23 +515,23 @@ private:
   bc::map * dist_map;
   bc::map * encouraged_right;
   bool distance_costs_initialized;
-  
-  // a value calculated by plane prediction for use of calculating the turn made
-  // after an avoidance point
-  double bearingAfterAvoid;
 };
 
-danger_grid::danger_grid( std::map< int, Plane > * set_of_aircraft, const double width,
+danger_grid::danger_grid( const fleet_table * set_of_aircraft, const double width,
                          const double height, const double resolution,
-                         const natural plane_id )
+                         const natural plane_id, const planning_deadline * deadline )
 {
   aircraft = set_of_aircraft;
+  this->deadline = deadline;
   map_res = resolution;
   distance_costs_initialized = false;
-  owner = &( (*set_of_aircraft)[ plane_id ] );
   
 #ifdef DEBUG
-  assert( (*owner).getId() != -100 );
+  assert( set_of_aircraft->contains( plane_id ) );
+#endif
+  owner = set_of_aircraft->slot_of( plane_id );
+  
+#ifdef DEBUG
   assert( set_of_aircraft->size() != 0 );
   assert( resolution > EPSILON );
   assert( resolution < height && resolution < width );
@@ -435,16 +561,22 @@ danger_grid::danger_grid( std::map< int, Plane > * set_of_aircraft, const double
   fill_danger_space( plane_id );
 }
 
-danger_grid::danger_grid( const danger_grid * dg, std::map< int, Plane > * set_of_aircraft,
-                         const natural plane_id,  string flag )
+danger_grid::danger_grid( const danger_grid * dg, const fleet_table * set_of_aircraft,
+                         const natural plane_id,  string flag,
+                         const planning_deadline * deadline )
 {
-  owner = &( (*set_of_aircraft)[ plane_id ] );
+  aircraft = set_of_aircraft;
+  this->deadline = deadline;
+#ifdef DEBUG
+  assert( set_of_aircraft->contains( plane_id ) );
+#endif
+  owner = set_of_aircraft->slot_of( plane_id );
   if( flag != "heuristic" )
     cout << "You're using the wrong constructor." << endl;
   assert( flag == "heuristic" );
     
-  calculate_distance_costs( owner->getFinalDestination().getX(),
-                            owner->getFinalDestination().getY(),
+  calculate_distance_costs( aircraft->final_x()[ owner ],
+                            aircraft->final_y()[ owner ],
                             dg, 1.0 );
 }
 
@@ -460,146 +592,336 @@ danger_grid::~danger_grid()
   delete danger_space;
 }
 
+danger_tile_pool & danger_tile_pool::instance()
+{
+  static danger_tile_pool pool;
+  return pool;
+}
+
+danger_tile_pool::danger_tile_pool()
+{
+  owner_pid = getpid();
+  batch = NULL;
+  generation = 0;
+  unfinished = 0;
+  stopping = false;
+}
+
+danger_tile_pool::~danger_tile_pool()
+{
+  {
+    boost::mutex::scoped_lock lock( state_lock );
+    stopping = true;
+  }
+  batch_ready.notify_all();
+  
+  if( getpid() != owner_pid )
+    return;
+  for( natural i = 0; i < helpers.size(); i++ )
+  {
+    helpers[ i ]->join();
+    delete helpers[ i ];
+  }
+}
+
+void danger_tile_pool::run( const vector< job > & jobs )
+{
+  boost::mutex::scoped_lock whole_batch( batch_lock );
+  
+  {
+    boost::mutex::scoped_lock lock( state_lock );
+    
+    // After a fork, the helpers we remember belong to our parent
+    if( getpid() != owner_pid )
+    {
+      helpers.clear();
+      owner_pid = getpid();
+    }
+    
+    while( helpers.size() + 1 < jobs.size() )
+      helpers.push_back( new boost::thread( &danger_tile_pool::work, this, (natural)helpers.size() ) );
+    
+    batch = &jobs;
+    unfinished = helpers.size();
+    generation++;
+  }
+  batch_ready.notify_all();
+  
+  jobs[ 0 ]();
+  
+  boost::mutex::scoped_lock lock( state_lock );
+  while( unfinished > 0 )
+    batch_done.wait( lock );
+  batch = NULL;
+}
+
+void danger_tile_pool::work( natural i )
+{
+  natural done_generation;
+  {
+    // A helper started for this batch still has to take part in it
+    boost::mutex::scoped_lock lock( state_lock );
+    done_generation = generation - 1;
+  }
+  
+  while( true )
+  {
+    const vector< job > * jobs;
+    {
+      boost::mutex::scoped_lock lock( state_lock );
+      while( !stopping && generation == done_generation )
+        batch_ready.wait( lock );
+      if( stopping )
+        return;
+      done_generation = generation;
+      jobs = batch;
+    }
+    
+    if( i + 1 < jobs->size() )
+      (*jobs)[ i + 1 ]();
+    
+    boost::mutex::scoped_lock lock( state_lock );
+    if( --unfinished == 0 )
+      batch_done.notify_one();
+  }
+}
+
 void danger_grid::fill_danger_space( const natural plane_id )
-{  
-  // This will store the list of predicted plane locations from the plane's
-  // current location to its avoidance waypoint; if there is no avoidance waypoint,
-  // it will contain predictions all the way to the plane's goal.
-  vector< estimate > est_to_avoid;
-  // If the plane has an avoidance waypoint, this will store the predicted plane
-  // locations from the avoidance waypoint to the goal; else, it will be empty.
-  vector< estimate > est_to_goal;
-  
-  // For each plane . . .
-  for( map< int, Plane >::iterator plane_pair = aircraft->begin(); 
-      plane_pair != aircraft->end(); ++plane_pair )
+{
+  natural width = (*danger_space)[ 0 ].get_width_in_squares();
+  
+  // One worker per tile; don't make tiles narrower than a column, or give a
+  // worker hardly any planes
+  natural workers = danger_tile_workers;
+  if( workers > aircraft->size() / min_planes_per_worker )
+    workers = aircraft->size() / min_planes_per_worker;
+  if( workers > width )
+    workers = width;
+  if( workers < 1 )
+    workers = 1;
+#ifdef OVERLAYED
+  workers = 1; // the overlay isn't split into tiles
+#endif
+  
+  vector< danger_tile > tiles( workers );
+  for( natural i = 0; i < workers; i++ )
+  {
+    tiles[ i ].x_begin = width * i / workers;
+    tiles[ i ].x_end = width * ( i + 1 ) / workers;
+  }
+  
+  vector< plane_prediction > predictions( aircraft->size() );
+  
+  if( workers == 1 )
+  {
+    fill_tile( plane_id, tiles[ 0 ], predictions, NULL );
+    return;
+  }
+  
+  // The calling thread does the first tile itself, and the pool's helpers the rest
+  boost::barrier predicted( workers );
+  vector< danger_tile_pool::job > jobs( workers );
+  for( natural i = 0; i < workers; i++ )
+    jobs[ i ] = boost::bind( &danger_grid::fill_tile, this, plane_id, boost::cref( tiles[ i ] ),
+                             boost::ref( predictions ), &predicted );
+  danger_tile_pool::instance().run( jobs );
+}
+
+void danger_grid::fill_tile( const natural plane_id, const danger_tile & tile,
+                             vector< plane_prediction > & predictions, boost::barrier * predicted )
+{
+  const vector< int > & ids = aircraft->ids();
+  const vector< int > & xs = aircraft->x();
+#ifdef DEBUG
+  const vector< int > & ys = aircraft->y();
+#endif
+  
+  // Predict the paths of the planes that start in our tile (other than the owner)
+  for( natural slot = 0; slot < aircraft->size(); slot++ )
   { 
-    Plane * current_plane = &( (*plane_pair).second ); // avoid the double indirection
-    
 #ifdef DEBUG
-    assert( (*current_plane).getId() != -100 );
-    
-    if( (*current_plane).getLocation().getY() > 10000 )
-      cout << " plane " << (*current_plane).getId() << endl;
-    assert( (*current_plane).getLocation().getX() < 10000 );
-    assert( (*current_plane).getLocation().getY() < 10000 );
+    if( ys[ slot ] > 10000 )
+      cout << " plane " << ids[ slot ] << endl;
+    assert( xs[ slot ] < 10000 );
+    assert( ys[ slot ] < 10000 );
 #endif
     
-    // If this is not the "owner" of the danger grid . . . 
-    if( (*current_plane).getId() != (int)plane_id )
+    if( deadline != NULL && deadline->expired() )
+      break;
+    
+    if( ids[ slot ] == (int)plane_id ||
+        xs[ slot ] < (int)tile.x_begin || xs[ slot ] >= (int)tile.x_end )
+      continue;
+    
+    plane_prediction & prediction = predictions[ slot ];
+    
+    // This will store the list of predicted plane locations from the plane's
+    // current location to its avoidance waypoint; if there is no avoidance waypoint,
+    // it will contain predictions all the way to the plane's goal.
+    // If the plane has an avoidance waypoint, the second list will store the
+    // predicted plane locations from the avoidance waypoint to the goal; else, it
+    // will be empty.
+    int dummy = 0;
+    double bearing_after_avoid = aircraft->bearing()[ slot ];
+    prediction.to_avoid = calculate_future_pos( slot, dummy, bearing_after_avoid );
+    prediction.to_goal = calculate_future_pos( slot, dummy, bearing_after_avoid );
+    
+    // Note the columns it can reach, so other tiles know whether it's in their halo
+    prediction.min_x = prediction.max_x = xs[ slot ];
+    for( int leg = 0; leg < 2; leg++ )
     {
-      // Set the danger at the plane's starting location
-      (*danger_space)[0 + look_behind].
-        add_danger_at( (*current_plane).getLocation().getX(),
-                      (*current_plane).getLocation().getY(), 
-                      default_plane_danger);
+      const vector< estimate > & est = ( leg == 0 ? prediction.to_avoid : prediction.to_goal );
+      for( natural i = 0; i < est.size(); i++ )
+      {
+        if( est[ i ].danger > -(EPSILON) )
+        {
+          prediction.min_x = min( prediction.min_x, est[ i ].x );
+          prediction.max_x = max( prediction.max_x, est[ i ].x );
+        }
+      }
+    }
+    prediction.predicted = true;
+  }
+  
+  if( predicted != NULL )
+    predicted->wait();
+  
+  // Add the danger for every plane that can reach our tile, in slot order, so that
+  // each square gets its danger in the same order it would on a single thread
+  for( natural slot = 0; slot < aircraft->size(); slot++ )
+  {
+    if( deadline != NULL && deadline->expired() )
+      break;
+    
+    const plane_prediction & prediction = predictions[ slot ];
+    if( !prediction.predicted ||
+        prediction.max_x + buffer_reach < (int)tile.x_begin ||
+        prediction.min_x - buffer_reach >= (int)tile.x_end )
+      continue;
+    
+    add_plane_danger( slot, prediction, tile );
+  }
+}
+
+void danger_grid::add_plane_danger( natural slot, const plane_prediction & prediction,
+                                    const danger_tile & tile )
+{
+  int start_x = aircraft->x()[ slot ];
+  int start_y = aircraft->y()[ slot ];
+  
+  // Set the danger at the plane's starting location
+  if( start_x >= (int)tile.x_begin && start_x < (int)tile.x_end )
+  {
+    (*danger_space)[0 + look_behind].
+      add_danger_at( start_x, start_y, default_plane_danger);
 #ifdef OVERLAYED
-      overlayed[0].add_danger_at((*current_plane).getLocation().getX(),
-                                 (*current_plane).getLocation().getY(), 1.0);
+    overlayed[0].add_danger_at( start_x, start_y, 1.0);
 #endif
-      
-      // Get the estimated danger for relevant squares in the map at this time
-      int dummy = 0;
-      est_to_avoid = calculate_future_pos( *current_plane, dummy );
-      est_to_goal = calculate_future_pos( *current_plane, dummy );
-      
-      double bearing = (*current_plane).getBearing();
-      
-      int t = 1; // initialize the counter for steps in time (seconds)
-      int counter = 0;
-      
-      // For each estimated (x, y, danger) triple . . .
-      for( vector< estimate >::iterator current_est = est_to_avoid.begin();
-          current_est != est_to_avoid.end(); ++current_est )
+  }
+  
+  double bearing = aircraft->bearing()[ slot ];
+  
+  int t = 1; // initialize the counter for steps in time (seconds)
+  int counter = 0;
+  
+  // For each estimated (x, y, danger) triple . . .
+  for( vector< estimate >::const_iterator current_est = prediction.to_avoid.begin();
+      current_est != prediction.to_avoid.end(); ++current_est )
+  {
+    ++counter; // we got a legal estimate
+    
+    if( t <= (int)look_ahead ) // if this estimate is close enough to plan for it . . .
+    {
+      // If these are legal xs and ys, and if the danger is not a "timestamp" divider
+      if( (*current_est).x >= 0 && (*current_est).x <
+         (int)( (*danger_space)[0].get_width_in_squares() ) &&
+         (*current_est).y >= 0 &&
+         (*current_est).y < (int)( (*danger_space)[0].get_height_in_squares() ) &&
+         (*current_est).danger > -(EPSILON) )
       {
-        ++counter; // we got a legal estimate
+        // Set the danger of the square based on what
+        // calculate_future_pos() found 
+        natural time = t + look_behind;
+        natural x = (*current_est).x;
+        natural y = (*current_est).y;
+        double d = (*current_est).danger * adjust_danger( t );
+        
+        add_in_tile( tile, time, x, y, d );
+        
+        // . . . and then add a bit of "fuzziness" (danger around the predicted
+        // square, so that other planes don't come too close)
+        set_danger_buffer( bearing, d, x, y, time, tile );
         
-        if( t <= (int)look_ahead ) // if this estimate is close enough to plan for it . . .
-        {
-          // If these are legal xs and ys, and if the danger is not a "timestamp" divider
-          if( (*current_est).x >= 0 && (*current_est).x <
-             (int)( (*danger_space)[0].get_width_in_squares() ) &&
-             (*current_est).y >= 0 &&
-             (*current_est).y < (int)( (*danger_space)[0].get_height_in_squares() ) &&
-             (*current_est).danger > -(EPSILON) )
-          {
-            // Set the danger of the square based on what
-            // calculate_future_pos() found 
-            natural time = t + look_behind;
-            natural x = (*current_est).x;
-            natural y = (*current_est).y;
-            double d = (*current_est).danger * adjust_danger( t );
-            
-            (*danger_space)[ time ].add_danger_at( x, y, d );
-            
-            // . . . and then add a bit of "fuzziness" (danger around the predicted
-            // square, so that other planes don't come too close)
-            set_danger_buffer( bearing, d, x, y, time );
-            
 #ifdef OVERLAYED
-            overlayed[0].add_danger_at((*current_est).x,
-                                       (*current_est).y,
-                                       (*current_est).danger * adjust_danger(t) );
+        overlayed[0].add_danger_at((*current_est).x,
+                                   (*current_est).y,
+                                   (*current_est).danger * adjust_danger(t) );
 #endif
-          } // end if these are legal xs and ys, and if this is not a "timestamp" divider
-          else // this estimate is only a timestamp marker
-          {
+      } // end if these are legal xs and ys, and if this is not a "timestamp" divider
+      else // this estimate is only a timestamp marker
+      {
 #ifdef DEBUG
-            assert( counter > 0 ); // we got at least one estimate
+        assert( counter > 0 ); // we got at least one estimate
 #endif
-            ++t;
-          }
-        } // end if t < look_ahead
-      } // end for each estimated (x, y, danger) triple
-      
-      // Now do the same thing with the list of predicted plane locations from the
-      // avoidance waypoint to the goal, where applicable
-      ++t; // increment t because the estimate ends with a good value
-      for( vector< estimate >::iterator current_est = est_to_goal.begin();
-          current_est != est_to_goal.end(); ++current_est )
+        ++t;
+      }
+    } // end if t < look_ahead
+  } // end for each estimated (x, y, danger) triple
+  
+  // Now do the same thing with the list of predicted plane locations from the
+  // avoidance waypoint to the goal, where applicable
+  ++t; // increment t because the estimate ends with a good value
+  for( vector< estimate >::const_iterator current_est = prediction.to_goal.begin();
+      current_est != prediction.to_goal.end(); ++current_est )
+  {
+    if( t <= (int)look_ahead ) // if this estimate is close enough to plan for it . . .
+    {
+      // If these are legal xs and ys, and if the danger is not a "timestamp" divider
+      if( (*current_est).x >= 0 && (*current_est).x <
+         (int)( (*danger_space)[0].get_width_in_squares() ) &&
+         (*current_est).y >= 0 &&
+         (*current_est).y < (int)( (*danger_space)[0].get_height_in_squares() ) &&
+         (*current_est).danger > -(EPSILON) )
       {
-        if( t <= (int)look_ahead ) // if this estimate is close enough to plan for it . . .
-        {
-          // If these are legal xs and ys, and if the danger is not a "timestamp" divider
-          if( (*current_est).x >= 0 && (*current_est).x <
-             (int)( (*danger_space)[0].get_width_in_squares() ) &&
-             (*current_est).y >= 0 &&
-             (*current_est).y < (int)( (*danger_space)[0].get_height_in_squares() ) &&
-             (*current_est).danger > -(EPSILON) )
-          {
-            // Set the danger of the square based on what
-            // calculate_future_pos() found, but scale it according to how
-            // far back in time we're predicting
-            natural time = t + look_behind;
-            natural x = (*current_est).x;
-            natural y = (*current_est).y;
-            double d = (*current_est).danger * adjust_danger( t );
-            
-            (*danger_space)[ time ].add_danger_at( x, y, d );
-            
-            // . . . and then add a bit of "fuzziness" (danger around the predicted
-            // square, so that other planes don't come too close)
-            set_danger_buffer( bearing, d, x, y, time );
-            
+        // Set the danger of the square based on what
+        // calculate_future_pos() found, but scale it according to how
+        // far back in time we're predicting
+        natural time = t + look_behind;
+        natural x = (*current_est).x;
+        natural y = (*current_est).y;
+        double d = (*current_est).danger * adjust_danger( t );
+        
+        add_in_tile( tile, time, x, y, d );
+        
+        // . . . and then add a bit of "fuzziness" (danger around the predicted
+        // square, so that other planes don't come too close)
+        set_danger_buffer( bearing, d, x, y, time, tile );
+        
 #ifdef OVERLAYED
-            overlayed[0].add_danger_at((*current_est).x,
-                                       (*current_est).y,
-                                       (*current_est).danger * adjust_danger(t) );
+        overlayed[0].add_danger_at((*current_est).x,
+                                   (*current_est).y,
+                                   (*current_est).danger * adjust_danger(t) );
 #endif
-          } // end if these are legal xs and ys, and if this is not a "timestamp" divider
-          else // this estimate is only a timestamp marker
-          {
-            ++t;
-          }
-        } // end if t < look_ahead
-      } // end for each estimated (x, y, danger) triple
-      
-    } // end if this is not the "owner" of the danger grid
-  } // end for each plane in the list
+      } // end if these are legal xs and ys, and if this is not a "timestamp" divider
+      else // this estimate is only a timestamp marker
+      {
+        ++t;
+      }
+    } // end if t < look_ahead
+  } // end for each estimated (x, y, danger) triple
+}
+
+void danger_grid::add_in_tile( const danger_tile & tile, int time, natural x, natural y,
+                               double danger )
+{
+  // (x and y may have wrapped around below zero; those fail the checks too)
+  if( x >= tile.x_begin && x < tile.x_end )
+    (*danger_space)[ time ].safely_add_danger_at( x, y, danger );
 }
 
 void danger_grid::set_danger_buffer( double bearing, double unweighted_danger,
-                                     natural x, natural y, int time )
+                                     natural x, natural y, int time,
+                                     const danger_tile & tile )
 {
   map_tools::bearing_t named_bearing = map_tools::name_bearing( bearing );
   double d = unweighted_danger * field_weight;
@@ -608,21 +930,21 @@ void danger_grid::set_danger_buffer( double bearing, double unweighted_danger,
   // diagonals when we allow it.
   
   // dag left+down
-  (*danger_space)[ time ].safely_add_danger_at( x - 1, y + 1, d );
+  add_in_tile( tile, time, x - 1, y + 1, d );
   // straight left
-  (*danger_space)[ time ].safely_add_danger_at( x - 1,   y  , d );
+  add_in_tile( tile, time, x - 1,   y  , d );
   // dag left+up
-  (*danger_space)[ time ].safely_add_danger_at( x - 1, y - 1, d );
+  add_in_tile( tile, time, x - 1, y - 1, d );
   // straight up
-  (*danger_space)[ time ].safely_add_danger_at(   x  , y - 1, d );
+  add_in_tile( tile, time,   x  , y - 1, d );
   // dag right+up
-  (*danger_space)[ time ].safely_add_danger_at( x + 1, y - 1, d );
+  add_in_tile( tile, time, x + 1, y - 1, d );
   // straight right
-  (*danger_space)[ time ].safely_add_danger_at( x + 1,   y  , d );
+  add_in_tile( tile, time, x + 1,   y  , d );
   // dag right+down
-  (*danger_space)[ time ].safely_add_danger_at( x + 1, y + 1, d );
+  add_in_tile( tile, time, x + 1, y + 1, d );
   // straight down
-  (*danger_space)[ time ].safely_add_danger_at(   x ,  y + 1, d);
+  add_in_tile( tile, time,   x ,  y + 1, d);
   
   
   // Scale the danger down slightly so A* will not treat collision distances
@@ -631,127 +953,127 @@ void danger_grid::set_danger_buffer( double bearing, double unweighted_danger,
   
   // Begin squares that are 2 away from current location
   // dag less left+down
-  (*danger_space)[ time ].safely_add_danger_at( x - 1, y + 2, d );
+  add_in_tile( tile, time, x - 1, y + 2, d );
   // dag left+down
-  (*danger_space)[ time ].safely_add_danger_at( x - 2, y + 2, d );
+  add_in_tile( tile, time, x - 2, y + 2, d );
   // dag left+less down
-  (*danger_space)[ time ].safely_add_danger_at( x - 2, y + 1, d );
+  add_in_tile( tile, time, x - 2, y + 1, d );
   // straight left
-  (*danger_space)[ time ].safely_add_danger_at( x - 2,   y  , d );
+  add_in_tile( tile, time, x - 2,   y  , d );
   // dag left+up
-  (*danger_space)[ time ].safely_add_danger_at( x - 2, y - 2, d );
+  add_in_tile( tile, time, x - 2, y - 2, d );
   // dag left+less up
-  (*danger_space)[ time ].safely_add_danger_at( x - 2, y - 1, d );
+  add_in_tile( tile, time, x - 2, y - 1, d );
   // dag less left+up
-  (*danger_space)[ time ].safely_add_danger_at( x - 1, y - 2, d );
+  add_in_tile( tile, time, x - 1, y - 2, d );
   // straight up
-  (*danger_space)[ time ].safely_add_danger_at(   x  , y - 2, d );
+  add_in_tile( tile, time,   x  , y - 2, d );
   // dag less right+up
-  (*danger_space)[ time ].safely_add_danger_at( x + 1, y - 2, d );
+  add_in_tile( tile, time, x + 1, y - 2, d );
   // dag right+up
-  (*danger_space)[ time ].safely_add_danger_at( x + 2, y - 2, d );
+  add_in_tile( tile, time, x + 2, y - 2, d );
   // dag right+less up
-  (*danger_space)[ time ].safely_add_danger_at( x + 2, y - 1, d );
+  add_in_tile( tile, time, x + 2, y - 1, d );
   // straight right
-  (*danger_space)[ time ].safely_add_danger_at( x + 2,   y  , d );
+  add_in_tile( tile, time, x + 2,   y  , d );
   // dag right+less down
-  (*danger_space)[ time ].safely_add_danger_at( x + 2, y + 1, d );
+  add_in_tile( tile, time, x + 2, y + 1, d );
   // dag right+down
-  (*danger_space)[ time ].safely_add_danger_at( x + 2, y + 2, d );
+  add_in_tile( tile, time, x + 2, y + 2, d );
   // dag less right+down
-  (*danger_space)[ time ].safely_add_danger_at( x + 1, y + 2, d );
+  add_in_tile( tile, time, x + 1, y + 2, d );
   // straight down
-  (*danger_space)[ time ].safely_add_danger_at(   x ,  y + 2, d );
+  add_in_tile( tile, time,   x ,  y + 2, d );
   
   // These buffer zones have been made wider in the direction of the plane's travel
   // in light of A*'s propensity for taking risky paths.
   switch( named_bearing )
   {
     case map_tools::N:
-      (*danger_space)[ time ].safely_add_danger_at( x - 2, y - 3, d );
+      add_in_tile( tile, time, x - 2, y - 3, d );
       // dag left+up
-      (*danger_space)[ time ].safely_add_danger_at( x - 1, y - 3, d );
+      add_in_tile( tile, time, x - 1, y - 3, d );
       // straight up
-      (*danger_space)[ time ].safely_add_danger_at( x , y - 3, d );
+      add_in_tile( tile, time, x , y - 3, d );
       // dag right+up
-      (*danger_space)[ time ].safely_add_danger_at( x + 1, y - 3, d );
-      (*danger_space)[ time ].safely_add_danger_at( x + 2, y - 3, d );
+      add_in_tile( tile, time, x + 1, y - 3, d );
+      add_in_tile( tile, time, x + 2, y - 3, d );
       break;
       
     case map_tools::NE:
       // straight up
-      (*danger_space)[ time ].safely_add_danger_at( x , y - 3, d );
+      add_in_tile( tile, time, x , y - 3, d );
       // dag right+up
-      (*danger_space)[ time ].safely_add_danger_at( x + 1, y - 3, d );
+      add_in_tile( tile, time, x + 1, y - 3, d );
       
-      (*danger_space)[ time ].safely_add_danger_at( x + 2, y - 3, d );
-      (*danger_space)[ time ].safely_add_danger_at( x + 3, y - 3, d );
-      (*danger_space)[ time ].safely_add_danger_at( x + 3, y - 2, d );
-      (*danger_space)[ time ].safely_add_danger_at( x + 3, y - 1, d );
+      add_in_tile( tile, time, x + 2, y - 3, d );
+      add_in_tile( tile, time, x + 3, y - 3, d );
+      add_in_tile( tile, time, x + 3, y - 2, d );
+      add_in_tile( tile, time, x + 3, y - 1, d );
       // straight right
-      (*danger_space)[ time ].safely_add_danger_at( x + 3, y , d );
+      add_in_tile( tile, time, x + 3, y , d );
       break;
       
     case map_tools::E:
       // dag right+up
-      (*danger_space)[ time ].safely_add_danger_at( x + 3, y - 2, d );
-      (*danger_space)[ time ].safely_add_danger_at( x + 3, y - 1, d );
+      add_in_tile( tile, time, x + 3, y - 2, d );
+      add_in_tile( tile, time, x + 3, y - 1, d );
       // straight right
-      (*danger_space)[ time ].safely_add_danger_at( x + 3, y , d );
-      (*danger_space)[ time ].safely_add_danger_at( x + 3, y + 1, d );
-      (*danger_space)[ time ].safely_add_danger_at( x + 3, y + 2, d );
+      add_in_tile( tile, time, x + 3, y , d );
+      add_in_tile( tile, time, x + 3, y + 1, d );
+      add_in_tile( tile, time, x + 3, y + 2, d );
       break;
       
     case map_tools::SE:
-      (*danger_space)[ time ].safely_add_danger_at( x + 3, y, d );
-      (*danger_space)[ time ].safely_add_danger_at( x + 3, y + 1, d );
-      (*danger_space)[ time ].safely_add_danger_at( x + 3, y + 2, d );
-      (*danger_space)[ time ].safely_add_danger_at( x + 3, y + 3, d );
-      (*danger_space)[ time ].safely_add_danger_at( x + 2, y + 3, d );
-      (*danger_space)[ time ].safely_add_danger_at( x + 1, y + 3, d );
+      add_in_tile( tile, time, x + 3, y, d );
+      add_in_tile( tile, time, x + 3, y + 1, d );
+      add_in_tile( tile, time, x + 3, y + 2, d );
+      add_in_tile( tile, time, x + 3, y + 3, d );
+      add_in_tile( tile, time, x + 2, y + 3, d );
+      add_in_tile( tile, time, x + 1, y + 3, d );
       // straight down
-      (*danger_space)[ time ].safely_add_danger_at( x , y + 3, d );
+      add_in_tile( tile, time, x , y + 3, d );
       break;
       
     case map_tools::S:
-      (*danger_space)[ time ].safely_add_danger_at( x - 2, y + 3, d );
-      (*danger_space)[ time ].safely_add_danger_at( x - 1, y + 3, d );
-      (*danger_space)[ time ].safely_add_danger_at( x , y + 3, d );
-      (*danger_space)[ time ].safely_add_danger_at( x + 1, y + 3, d );
-      (*danger_space)[ time ].safely_add_danger_at( x + 2, y + 3, d );
+      add_in_tile( tile, time, x - 2, y + 3, d );
+      add_in_tile( tile, time, x - 1, y + 3, d );
+      add_in_tile( tile, time, x , y + 3, d );
+      add_in_tile( tile, time, x + 1, y + 3, d );
+      add_in_tile( tile, time, x + 2, y + 3, d );
       break;
       
     case map_tools::SW:
       // straight down
-      (*danger_space)[ time ].safely_add_danger_at( x , y + 3, d );
-      (*danger_space)[ time ].safely_add_danger_at( x - 1, y + 3, d );
-      (*danger_space)[ time ].safely_add_danger_at( x - 2, y + 3, d );
-      (*danger_space)[ time ].safely_add_danger_at( x - 3, y + 3, d );
-      (*danger_space)[ time ].safely_add_danger_at( x - 3, y + 2, d );
-      (*danger_space)[ time ].safely_add_danger_at( x - 3, y + 1, d );
+      add_in_tile( tile, time, x , y + 3, d );
+      add_in_tile( tile, time, x - 1, y + 3, d );
+      add_in_tile( tile, time, x - 2, y + 3, d );
+      add_in_tile( tile, time, x - 3, y + 3, d );
+      add_in_tile( tile, time, x - 3, y + 2, d );
+      add_in_tile( tile, time, x - 3, y + 1, d );
       // straight left
-      (*danger_space)[ time ].safely_add_danger_at( x - 3, y, d );
+      add_in_tile( tile, time, x - 3, y, d );
       break;
       
     case map_tools::W:
-      (*danger_space)[ time ].safely_add_danger_at( x - 3, y - 2, d );
-      (*danger_space)[ time ].safely_add_danger_at( x - 3, y - 1, d );
+      add_in_tile( tile, time, x - 3, y - 2, d );
+      add_in_tile( tile, time, x - 3, y - 1, d );
       // straight right
-      (*danger_space)[ time ].safely_add_danger_at( x - 3, y , d );
-      (*danger_space)[ time ].safely_add_danger_at( x - 3, y + 1, d );
-      (*danger_space)[ time ].safely_add_danger_at( x - 3, y + 2, d );
+      add_in_tile( tile, time, x - 3, y , d );
+      add_in_tile( tile, time, x - 3, y + 1, d );
+      add_in_tile( tile, time, x - 3, y + 2, d );
       break;
       
     case map_tools::NW:
       // straight left
-      (*danger_space)[ time ].safely_add_danger_at( x - 3, y, d );
-      (*danger_space)[ time ].safely_add_danger_at( x - 3, y - 1, d );
-      (*danger_space)[ time ].safely_add_danger_at( x - 3, y - 2, d );
-      (*danger_space)[ time ].safely_add_danger_at( x - 3, y - 3, d );
-      (*danger_space)[ time ].safely_add_danger_at( x - 2, y - 3, d );
-      (*danger_space)[ time ].safely_add_danger_at( x - 1, y - 3, d );
+      add_in_tile( tile, time, x - 3, y, d );
+      add_in_tile( tile, time, x - 3, y - 1, d );
+      add_in_tile( tile, time, x - 3, y - 2, d );
+      add_in_tile( tile, time, x - 3, y - 3, d );
+      add_in_tile( tile, time, x - 2, y - 3, d );
+      add_in_tile( tile, time, x - 1, y - 3, d );
       // straight up
-      (*danger_space)[ time ].safely_add_danger_at( x , y - 3, d );
+      add_in_tile( tile, time, x , y - 3, d );
       break;
       
   } // end switch case
@@ -835,9 +1157,9 @@ double danger_grid::get_res() const
   return (*danger_space)[ 0 ].get_resolution();
 }
 
-Plane * danger_grid::get_owner()
+int danger_grid::get_owner() const
 {
-  return owner;
+  return aircraft->ids()[ owner ];
 }
 
 double danger_grid::get_plane_danger( int time ) const
@@ -854,29 +1176,35 @@ vector< bc::map > danger_grid::get_danger_space() const
 }
 
 
-vector< estimate > danger_grid::calculate_future_pos( Plane & plane, int &time )
+vector< estimate > danger_grid::calculate_future_pos( natural slot, int &time,
+                                                    double & bearing_after_avoid )
 {
   bool turned=false;//did the plane turn?
   
   vector< estimate > theFuture;//prevents memory errors
 	theFuture.reserve(1);
 	
-  Position current, destination;
+  int x1, y1, x2, y2;
   
   if(time==0)//meaning that the plane is now moving towards it's next goal be it an avoidance point or a final destination
 	{
-  	current=plane.getLocation();
-  	destination=plane.getDestination();
+  	x1=aircraft->x()[ slot ];
+  	y1=aircraft->y()[ slot ];
+  	x2=aircraft->dest_x()[ slot ];
+  	y2=aircraft->dest_y()[ slot ];
     }
 	
   else//the function will always be called twice. if its moving to its final goal the distance will be 0 and it will break out immediatly
 	{
-		destination=plane.getFinalDestination();
-		current=plane.getDestination(); 
+		x2=aircraft->final_x()[ slot ];
+		y2=aircraft->final_y()[ slot ];
+		x1=aircraft->dest_x()[ slot ];
+		y1=aircraft->dest_y()[ slot ]; 
 	}
+  // where the plane is headed on this leg
+  const int destination_x=x2, destination_y=y2;
 
   //distance formula: line to destination
-  int x1=current.getX(),x2=destination.getX(),y1=current.getY(),y2=destination.getY();
   double xDistance=( fabs((double)x2-x1) ),yDistance=( fabs((double)y2-y1) );
   double distance = sqrt((double)(xDistance*xDistance)+(yDistance*yDistance));
 
@@ -894,9 +1222,9 @@ vector< estimate > danger_grid::calculate_future_pos( Plane & plane, int &time )
   
 	//begin looking to see if a turn needs to be made
   if(time==0)
-    bearing = plane.getBearing();//the planes bearing
+    bearing = aircraft->bearing()[ slot ];//the planes bearing
   else
-    bearing=bearingAfterAvoid;//an estimated bearing upon the planes arrival to the avoidance point, not 100% correct because it is based off of guessed positions
+    bearing=bearing_after_avoid;//an estimated bearing upon the planes arrival to the avoidance point, not 100% correct because it is based off of guessed positions
 	
   map_tools::bearing_t bearingNamed = map_tools::name_bearing(bearing);
   
@@ -987,7 +1315,10 @@ vector< estimate > danger_grid::calculate_future_pos( Plane & plane, int &time )
 	else
   dangerRecurse(theFuture[theFuture.size()-3],dest,theFuture,time);
   
-  //calculate the bearing after the avoidance point
+  //calculate the bearing after the avoidance point (if the path is long enough
+  //to have one; otherwise the bearing we came in with stands)
+  if(theFuture.size()>=4)
+  {
   xDistance=fabs((double)theFuture[theFuture.size()-4].x-theFuture[theFuture.size()-2].x);
   yDistance=fabs((double)theFuture[theFuture.size()-4].y-theFuture[theFuture.size()-2].y);
   distance = sqrt((double)(xDistance*xDistance)+(yDistance*yDistance));
@@ -996,12 +1327,13 @@ vector< estimate > danger_grid::calculate_future_pos( Plane & plane, int &time )
     angle=(RADtoDEGREES*(asin((double)xDistance/(double)distance)));
   if((x2-x1)<0)//positive means that the plane is headed to the left aka west
     angle=(-1)*angle;//the plane goes from -180 to +180
-	bearingAfterAvoid=angle;
+	bearing_after_avoid=angle;
+  }
   
   
 	//add prediction to one square ahead of goal
 	//find closest straight line from target bearing
-	angle=plane.getBearingToDest();
+	angle=aircraft->bearing_to_dest()[ slot ];
   neighoboringAngles(angle, neighbors[0], neighbors[1]);
   if(fabs(angle-neighbors[0])>=fabs(angle-neighbors[1]))//distance
   {closestAngle=neighbors[1]; otherAngle=neighbors[0];}
@@ -1010,7 +1342,7 @@ vector< estimate > danger_grid::calculate_future_pos( Plane & plane, int &time )
 	
 	//predict 3 spaces past the goal
 	//note this could be changed into a for loop however as i knew we wanted exactly 3 spaces past i didn't bother
-  if(destination.getX()==plane.getFinalDestination().getX() && destination.getY()==plane.getFinalDestination().getY())
+  if(destination_x==aircraft->final_x()[ slot ] && destination_y==aircraft->final_y()[ slot ])
   {
 	danger=1;
 	
@@ -1561,6 +1893,9 @@ void danger_grid::calculate_distance_costs( unsigned int goal_x, unsigned int go
   
   for( unsigned int crnt_t = 0; crnt_t <= look_ahead; crnt_t++ )
   {
+    if( deadline != NULL && deadline->expired() )
+      break;
+    
     //d_at_goal = (*dg).get_danger_at(goal_x, goal_y, crnt_t);
     d_at_goal = 0;
     
@@ -1600,7 +1935,10 @@ void danger_grid::encourage_right( natural width_in_sqrs, natural height_in_sqrs
     in_list_of_pts[ x ].resize( height_in_sqrs, false );
   }
   
-  Position start_pos = (*owner).getLocation();
+  // Work in meters east and south of the upper left corner, from the center of
+  // the owner's square
+  double start_east = ( aircraft->x()[ owner ] + 0.5 ) * resolution;
+  double start_south = ( aircraft->y()[ owner ] + 0.5 ) * resolution;
   
   // For each deviation from a straight line to the goal that we're adding cost to . . .
   for( natural i = 0; i < 4; i++ )
@@ -1612,11 +1950,12 @@ void danger_grid::encourage_right( natural width_in_sqrs, natural height_in_sqrs
     // angle widens
     double dist = 4 * resolution;
     natural deviation = i*deg_per_deviation + deviation_min;
-    double plane_bearing = (*owner).getBearing();
+    double plane_bearing = aircraft->bearing()[ owner ];
+    double heading = map_tools::to_radians( plane_bearing - deviation );
     
 #ifdef DEBUG_DG
     cout << "Plane says its bearing is " << plane_bearing;
-    cout << ", which gets named " << map_tools::bearing_to_string( (*owner).get_named_bearing() ) << endl;
+    cout << ", which gets named " << map_tools::bearing_to_string( aircraft->named_bearing()[ owner ] ) << endl;
     cout << "At round " << i << " we're working with deviation " << deviation << endl;
 #endif
     
@@ -1626,60 +1965,13 @@ void danger_grid::encourage_right( natural width_in_sqrs, natural height_in_sqrs
       natural the_x, the_y;
       
       // Get the grid square which is one resolution-length farther away than the last
+      double east = start_east + dist * sin( heading );
+      double south = start_south - dist * cos( heading );
       
-      double end_lat, end_lon;
-      // Get the ending point in latitude and longitude
-      map_tools::calculate_point( start_pos.getLat(), start_pos.getLon(), 
-                                  dist, plane_bearing - deviation,
-                                  end_lat, end_lon );
-      double d_from_origin = 
-        map_tools::calculate_distance_between_points( start_pos.getUpperLeftLatitude(), 
-                                                      start_pos.getUpperLeftLongitude(),
-                                                      end_lat, end_lon, "meters");
-      
-      double bearing; // in radians!
-      
-      if( d_from_origin > -EPSILON && d_from_origin < EPSILON ) // d == 0
-      {
-        bearing = 0;
-      }
-      else
-      {
-        bearing = map_tools::calculate_bearing_in_rad( start_pos.getUpperLeftLatitude(), 
-                                                       start_pos.getUpperLeftLongitude(),
-                                                       end_lat, end_lon );
-        
-        if( bearing > 0 )
-        {
-          if( bearing < PI/2 )
-          {
-            bearing -= PI/2;
-          }
-          else
-            bearing = PI/2 - bearing;
-        }
-        bearing = fmod( bearing, PI/2 );
-      }
-      
-#ifdef DEBUG_DG
-      if( bearing > 0.001 )
-      {
-        cout << "That bearing of " << bearing << "is gonna break things!" << endl;
-        cout << "Your point was (" << end_lat << ", " << end_lon << ")" << endl;
-      }
-      assert( bearing < 0.001 );
-      assert( bearing > -PI/2 - 0.01 );
-#endif
-      
-      the_x = (int)( (int)(cos( bearing ) * d_from_origin + 0.5) / resolution );
-      the_y = -(int)( (int)(sin( bearing ) * d_from_origin - 0.5) / resolution );
-      
-#ifdef DEBUG_DG
-      assert( (int)the_x < start_pos.getWidth() + 5 );
-      assert( (int)the_y < start_pos.getHeight() + 5 );
-      assert( the_x >= 0 );
-      assert( the_y >= 0 );
-#endif
+      // Anything off the top or left edge gets pinned to it (and so ends this
+      // deviation, below)
+      the_x = ( east < 0 ? 0 : (natural)( east / resolution ) );
+      the_y = ( south < 0 ? 0 : (natural)( south / resolution ) );
       
       // If we've reached the edge of the grid, the thing we just pushed back will
       // serve as the "marker" indicating we've moved to the next deviation width
@@ -1706,7 +1998,7 @@ void danger_grid::encourage_right( natural width_in_sqrs, natural height_in_sqrs
         }
         
         // Add to the list a marker indicating we're moving to the next deviation
-        pts.push_back( coord( start_pos.getWidth() + 100, start_pos.getHeight() + 100 ) );
+        pts.push_back( coord( width_in_sqrs + 100, height_in_sqrs + 100 ) );
       }
       else
       {
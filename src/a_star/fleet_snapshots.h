@@ -0,0 +1,228 @@
+//
+// fleet_snapshots.h
+// AU_UAV_ROS
+//
+// Immutable, numbered versions of the fleet table, for planners that read the
+// fleet on other threads while telemetry keeps changing it.
+//
+// There is one writer. It keeps its own fleet_table, updates it as telemetry
+// comes in, and publish()es a copy of it whenever readers should see the
+// changes; publishing is a single atomic pointer swap. A reader pin()s the
+// current version, plans against it for as long as it likes (nothing in it will
+// change), and unpin()s it when done. Neither side ever takes a lock.
+//
+// Old versions are freed by epoch-based reclamation. Every publish() advances a
+// global epoch, and a pinned reader announces the epoch it pinned in. A version
+// that was replaced in epoch e can only be held by readers that pinned in epoch
+// e or earlier, so once every pinned reader has announced a later epoch, the
+// version can be deleted. The writer does this as part of publish().
+//
+
+#ifndef FLEET_SNAPSHOTS
+#define FLEET_SNAPSHOTS
+
+#include <vector>
+#include <utility>
+#include <boost/atomic.hpp>
+#include "fleet_table.h"
+
+#ifdef DEBUG
+#include <cassert>
+#endif
+
+#ifndef natural
+#define natural unsigned int
+#endif
+
+using namespace std;
+
+/**
+ * One published version of the fleet
+ */
+struct fleet_version
+{
+  natural number; // 0 for the empty fleet we start with, then 1, 2, . . .
+  fleet_table fleet;
+};
+
+class fleet_snapshots
+{
+public:
+  // The most reader threads that can be registered at once
+  enum { MAX_READERS = 16 };
+
+  /**
+   * Starts out with version 0: an empty fleet
+   */
+  fleet_snapshots();
+
+  /**
+   * Frees every version. No reader may be pinned.
+   */
+  ~fleet_snapshots();
+
+  /**
+   * Makes a copy of the fleet the current version. Writer thread only.
+   * Also frees any old versions no reader can be using any more.
+   * @param next The fleet as readers should now see it
+   * @return the new version's number
+   */
+  natural publish( const fleet_table & next );
+
+  /**
+   * @return the number of replaced versions not yet freed (because a reader
+   *         might still be using them). Writer thread only.
+   */
+  natural retired_count() const;
+
+  /**
+   * Claims a reader slot for the calling thread. Each thread that reads versions
+   * needs its own slot.
+   * @return the slot's ID, to pass to pin() and unpin(), or -1 if all
+   *         MAX_READERS slots are taken
+   */
+  int register_reader();
+
+  /**
+   * Gives up a reader slot. The reader must not be pinned.
+   * @param reader The ID returned by register_reader()
+   */
+  void unregister_reader( int reader );
+
+  /**
+   * Gets the current version and keeps it from being freed until unpin()
+   * @param reader The calling thread's reader ID
+   * @return the current version; don't use it after calling unpin()
+   */
+  const fleet_version * pin( int reader );
+
+  /**
+   * Lets go of the version returned by pin()
+   * @param reader The calling thread's reader ID
+   */
+  void unpin( int reader );
+
+private:
+  /**
+   * Deletes the retired versions that no pinned reader can be holding
+   */
+  void reclaim();
+
+  // Marks a reader that isn't pinned (real epochs start at 1)
+  enum { IDLE = 0 };
+
+  struct reader_slot
+  {
+    boost::atomic< natural > epoch; // the epoch it pinned in, or IDLE
+    boost::atomic< bool > in_use;
+    char pad[ 64 ]; // keep each reader's slot on its own cache line
+  };
+
+  boost::atomic< const fleet_version * > current;
+  boost::atomic< natural > epoch;
+  reader_slot readers[ MAX_READERS ];
+
+  // Writer only: replaced versions, with the epoch they were replaced in
+  vector< pair< const fleet_version *, natural > > retired;
+  natural next_number;
+};
+
+fleet_snapshots::fleet_snapshots()
+  : current( new fleet_version() ), epoch( 1 )
+{
+  for( natural i = 0; i < MAX_READERS; i++ )
+  {
+    readers[ i ].epoch.store( IDLE );
+    readers[ i ].in_use.store( false );
+  }
+  next_number = 1;
+}
+
+fleet_snapshots::~fleet_snapshots()
+{
+  for( natural i = 0; i < retired.size(); i++ )
+    delete retired[ i ].first;
+  delete current.load();
+}
+
+natural fleet_snapshots::publish( const fleet_table & next )
+{
+  fleet_version * v = new fleet_version();
+  v->number = next_number++;
+  v->fleet = next;
+
+  const fleet_version * old = current.exchange( v );
+
+  // Anyone who pins after this increment is guaranteed to see v
+  retired.push_back( make_pair( old, epoch.fetch_add( 1 ) ) );
+
+  reclaim();
+  return v->number;
+}
+
+natural fleet_snapshots::retired_count() const
+{
+  return retired.size();
+}
+
+int fleet_snapshots::register_reader()
+{
+  for( natural i = 0; i < MAX_READERS; i++ )
+  {
+    bool expected = false;
+    if( readers[ i ].in_use.compare_exchange_strong( expected, true ) )
+      return i;
+  }
+  return -1;
+}
+
+void fleet_snapshots::unregister_reader( int reader )
+{
+#ifdef DEBUG
+  assert( reader >= 0 && reader < (int)MAX_READERS );
+  assert( readers[ reader ].epoch.load() == IDLE );
+#endif
+  readers[ reader ].in_use.store( false );
+}
+
+const fleet_version * fleet_snapshots::pin( int reader )
+{
+#ifdef DEBUG
+  assert( reader >= 0 && reader < (int)MAX_READERS );
+  assert( readers[ reader ].epoch.load() == IDLE );
+#endif
+  // Announce our epoch before looking at the pointer (both sequentially
+  // consistent, so the writer can't miss us)
+  readers[ reader ].epoch.store( epoch.load() );
+  return current.load();
+}
+
+void fleet_snapshots::unpin( int reader )
+{
+  readers[ reader ].epoch.store( IDLE, boost::memory_order_release );
+}
+
+void fleet_snapshots::reclaim()
+{
+  // The oldest epoch any pinned reader is in
+  natural oldest = epoch.load();
+  for( natural i = 0; i < MAX_READERS; i++ )
+  {
+    natural e = readers[ i ].epoch.load();
+    if( e != IDLE && e < oldest )
+      oldest = e;
+  }
+
+  // A version replaced in an epoch before that one is unreachable
+  natural kept = 0;
+  for( natural i = 0; i < retired.size(); i++ )
+  {
+    if( retired[ i ].second < oldest )
+      delete retired[ i ].first;
+    else
+      retired[ kept++ ] = retired[ i ];
+  }
+  retired.resize( kept );
+}
+
+#endif
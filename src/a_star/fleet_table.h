@@ -0,0 +1,348 @@
+//
+// fleet_table.h
+// AU_UAV_ROS
+//
+// The planner's view of every aircraft in the airspace, stored as a structure of
+// arrays: one packed column per field, one row ("slot") per plane.
+//
+// The danger grid, best cost grid, and A* only ever need a plane's grid squares
+// and bearings, and they need them for every plane, every time we plan. Walking
+// a std::map< int, Plane > to get them meant a red-black tree traversal and
+// three Position copies per plane per loop; here it's a linear scan over a few
+// arrays of ints and doubles.
+//
+// Rows are kept packed: removing a plane moves the last row into its slot, so
+// slots are NOT stable across a remove(). Look a plane up by ID (slot_of() is a
+// single array access) rather than holding on to a slot.
+//
+
+#ifndef FLEET_TABLE
+#define FLEET_TABLE
+
+#include <vector>
+#include <map>
+#include "map_tools.h"
+#include "Plane_fixed.h"
+
+#ifdef DEBUG
+#include <cassert>
+#endif
+
+#ifndef natural
+#define natural unsigned int
+#endif
+
+using namespace std;
+
+class fleet_table
+{
+public:
+  /**
+   * Creates an empty table
+   */
+  fleet_table();
+
+  /**
+   * Builds a table holding every plane in a std::map
+   * @param set_of_aircraft The planes to store, keyed by ID
+   */
+  fleet_table( std::map< int, Plane > & set_of_aircraft );
+
+  /**
+   * Inserts a plane, or overwrites its row if it's already in the table
+   * @param id The plane's unique, non-negative ID number
+   * @param x, y The plane's current grid square
+   * @param dest_x, dest_y The plane's next waypoint (possibly an avoidance
+   *                       waypoint), in grid squares
+   * @param final_x, final_y The plane's goal, in grid squares
+   * @param bearing The plane's current bearing, in degrees
+   * @param bearing_to_dest The bearing from the plane to its goal, in degrees
+   * @param altitude The plane's altitude
+   */
+  void set( int id, int x, int y, int dest_x, int dest_y,
+            int final_x, int final_y, double bearing, double bearing_to_dest,
+            double altitude = 0 );
+
+  /**
+   * Inserts a plane, or overwrites its row if it's already in the table, with
+   * the state currently stored in a Plane object. Call this whenever you've
+   * updated the Plane.
+   * @param plane The plane to copy
+   */
+  void set( Plane & plane );
+
+  /**
+   * Removes a plane from the table (if it's there). This moves the last row into
+   * the removed plane's slot.
+   * @param id The ID of the plane to remove
+   */
+  void remove( int id );
+
+  /**
+   * Removes every plane from the table
+   */
+  void clear();
+
+  /**
+   * @return the number of planes in the table
+   */
+  natural size() const;
+
+  /**
+   * @return TRUE if the plane with this ID is in the table
+   */
+  bool contains( int id ) const;
+
+  /**
+   * @param id The ID of the plane in question
+   * @return the plane's slot (its index into each of the columns below), or -1 if
+   *         it isn't in the table
+   */
+  int slot_of( int id ) const;
+
+  /*
+   * The columns. Each has size() elements, and element i of every column
+   * describes the same plane.
+   */
+  const vector< int > & ids() const;
+  const vector< int > & x() const;
+  const vector< int > & y() const;
+  const vector< int > & dest_x() const;
+  const vector< int > & dest_y() const;
+  const vector< int > & final_x() const;
+  const vector< int > & final_y() const;
+
+  /**
+   * @return each plane's current bearing, in degrees
+   */
+  const vector< double > & bearing() const;
+
+  /**
+   * @return the bearing from each plane to its goal, in degrees
+   */
+  const vector< double > & bearing_to_dest() const;
+
+  /**
+   * @return each plane's current bearing, discretized to N, NE, E, &c.
+   */
+  const vector< map_tools::bearing_t > & named_bearing() const;
+
+  /**
+   * @return each plane's altitude
+   */
+  const vector< double > & altitude() const;
+
+private:
+  vector< int > id_col;
+  vector< int > x_col;
+  vector< int > y_col;
+  vector< int > dest_x_col;
+  vector< int > dest_y_col;
+  vector< int > final_x_col;
+  vector< int > final_y_col;
+  vector< double > bearing_col;
+  vector< double > bearing_to_dest_col;
+  vector< map_tools::bearing_t > named_bearing_col;
+  vector< double > altitude_col;
+
+  // Indexed by plane ID; holds the plane's slot, or -1 if it has none. Plane IDs
+  // are handed out sequentially by the coordinator, so this stays small.
+  vector< int > slot_by_id;
+};
+
+fleet_table::fleet_table()
+{
+}
+
+fleet_table::fleet_table( std::map< int, Plane > & set_of_aircraft )
+{
+  for( map< int, Plane >::iterator plane_pair = set_of_aircraft.begin();
+      plane_pair != set_of_aircraft.end(); ++plane_pair )
+  {
+    set( (*plane_pair).second );
+  }
+}
+
+void fleet_table::set( int id, int x, int y, int dest_x, int dest_y,
+                       int final_x, int final_y, double bearing, double bearing_to_dest,
+                       double altitude )
+{
+#ifdef DEBUG
+  assert( id >= 0 );
+#endif
+
+  if( id >= (int)slot_by_id.size() )
+    slot_by_id.resize( id + 1, -1 );
+
+  int slot = slot_by_id[ id ];
+  if( slot == -1 ) // new plane; give it a row at the end
+  {
+    slot = (int)id_col.size();
+    slot_by_id[ id ] = slot;
+
+    id_col.push_back( id );
+    x_col.push_back( 0 );
+    y_col.push_back( 0 );
+    dest_x_col.push_back( 0 );
+    dest_y_col.push_back( 0 );
+    final_x_col.push_back( 0 );
+    final_y_col.push_back( 0 );
+    bearing_col.push_back( 0 );
+    bearing_to_dest_col.push_back( 0 );
+    named_bearing_col.push_back( map_tools::N );
+    altitude_col.push_back( 0 );
+  }
+
+  x_col[ slot ] = x;
+  y_col[ slot ] = y;
+  dest_x_col[ slot ] = dest_x;
+  dest_y_col[ slot ] = dest_y;
+  final_x_col[ slot ] = final_x;
+  final_y_col[ slot ] = final_y;
+  bearing_col[ slot ] = bearing;
+  bearing_to_dest_col[ slot ] = bearing_to_dest;
+  named_bearing_col[ slot ] = map_tools::name_bearing( bearing );
+  altitude_col[ slot ] = altitude;
+}
+
+void fleet_table::set( Plane & plane )
+{
+  const Position & location = plane.getLocation();
+  const Position & destination = plane.getDestination();
+  const Position & final_destination = plane.getFinalDestination();
+
+  set( plane.getId(), location.getX(), location.getY(),
+       destination.getX(), destination.getY(),
+       final_destination.getX(), final_destination.getY(),
+       plane.getBearing(), plane.getBearingToDest(), plane.getAltitude() );
+}
+
+void fleet_table::remove( int id )
+{
+  int slot = slot_of( id );
+  if( slot == -1 )
+    return;
+
+  // Move the last row into the hole
+  int last = (int)id_col.size() - 1;
+  if( slot != last )
+  {
+    id_col[ slot ] = id_col[ last ];
+    x_col[ slot ] = x_col[ last ];
+    y_col[ slot ] = y_col[ last ];
+    dest_x_col[ slot ] = dest_x_col[ last ];
+    dest_y_col[ slot ] = dest_y_col[ last ];
+    final_x_col[ slot ] = final_x_col[ last ];
+    final_y_col[ slot ] = final_y_col[ last ];
+    bearing_col[ slot ] = bearing_col[ last ];
+    bearing_to_dest_col[ slot ] = bearing_to_dest_col[ last ];
+    named_bearing_col[ slot ] = named_bearing_col[ last ];
+    altitude_col[ slot ] = altitude_col[ last ];
+
+    slot_by_id[ id_col[ slot ] ] = slot;
+  }
+
+  id_col.pop_back();
+  x_col.pop_back();
+  y_col.pop_back();
+  dest_x_col.pop_back();
+  dest_y_col.pop_back();
+  final_x_col.pop_back();
+  final_y_col.pop_back();
+  bearing_col.pop_back();
+  bearing_to_dest_col.pop_back();
+  named_bearing_col.pop_back();
+  altitude_col.pop_back();
+
+  slot_by_id[ id ] = -1;
+}
+
+void fleet_table::clear()
+{
+  id_col.clear();
+  x_col.clear();
+  y_col.clear();
+  dest_x_col.clear();
+  dest_y_col.clear();
+  final_x_col.clear();
+  final_y_col.clear();
+  bearing_col.clear();
+  bearing_to_dest_col.clear();
+  named_bearing_col.clear();
+  altitude_col.clear();
+  slot_by_id.clear();
+}
+
+natural fleet_table::size() const
+{
+  return id_col.size();
+}
+
+bool fleet_table::contains( int id ) const
+{
+  return slot_of( id ) != -1;
+}
+
+int fleet_table::slot_of( int id ) const
+{
+  if( id < 0 || id >= (int)slot_by_id.size() )
+    return -1;
+  return slot_by_id[ id ];
+}
+
+const vector< int > & fleet_table::ids() const
+{
+  return id_col;
+}
+
+const vector< int > & fleet_table::x() const
+{
+  return x_col;
+}
+
+const vector< int > & fleet_table::y() const
+{
+  return y_col;
+}
+
+const vector< int > & fleet_table::dest_x() const
+{
+  return dest_x_col;
+}
+
+const vector< int > & fleet_table::dest_y() const
+{
+  return dest_y_col;
+}
+
+const vector< int > & fleet_table::final_x() const
+{
+  return final_x_col;
+}
+
+const vector< int > & fleet_table::final_y() const
+{
+  return final_y_col;
+}
+
+const vector< double > & fleet_table::bearing() const
+{
+  return bearing_col;
+}
+
+const vector< double > & fleet_table::bearing_to_dest() const
+{
+  return bearing_to_dest_col;
+}
+
+const vector< map_tools::bearing_t > & fleet_table::named_bearing() const
+{
+  return named_bearing_col;
+}
+
+const vector< double > & fleet_table::altitude() const
+{
+  return altitude_col;
+}
+
+#endif
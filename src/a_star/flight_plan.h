@@ -0,0 +1,249 @@
+//
+// flight_plan.h
+// AU_UAV_ROS
+//
+// The waypoints we last sent a plane, and the corridor (grid squares, one per
+// second) it should fly through to follow them.
+//
+// Collision avoidance sends each plane a short prefix of its A* path rather than
+// a single waypoint, and keeps the plan here so that on later telemetry updates
+// it can tell whether the plan still holds up: has the plane strayed from the
+// corridor, has some other plane's predicted track entered it, has the plane
+// run out of waypoints? If none of those has happened, there's no need to plan
+// again yet.
+//
+
+#ifndef FLIGHT_PLAN
+#define FLIGHT_PLAN
+
+#include <vector>
+#include <stdlib.h>
+#include "coord.h"
+#include "fleet_table.h"
+
+#ifdef DEBUG
+#include <cassert>
+#endif
+
+#ifndef natural
+#define natural unsigned int
+#endif
+
+using namespace std;
+
+class flight_plan
+{
+public:
+  /**
+   * Creates an empty plan
+   */
+  flight_plan();
+
+  /**
+   * Replaces the plan
+   * @param start_x, start_y The plane's grid square when the plan was made
+   * @param waypoints The waypoints sent to the plane, in the order it will fly them
+   *                  (their times are ignored)
+   * @param goal_x, goal_y The goal A* was solving to
+   */
+  void set( int start_x, int start_y, const vector< coord > & waypoints,
+            int goal_x, int goal_y );
+
+  /**
+   * Forgets the plan (so that the plane will be replanned on its next update)
+   */
+  void clear();
+
+  /**
+   * @return TRUE if there is no plan, or the plane has passed all its waypoints
+   */
+  bool finished() const;
+
+  /**
+   * Notes the plane's new position: moves our place in the corridor up to the
+   * square nearest the plane, and drops any waypoints it has reached (come
+   * within one square of) or passed along the way.
+   * @param x, y The plane's current grid square
+   */
+  void advance( int x, int y );
+
+  /**
+   * @return the waypoint the plane is currently flying to. Don't call this on a
+   *         finished() plan.
+   */
+  const coord & next_waypoint() const;
+
+  /**
+   * @return TRUE if the plan was made for some goal other than this one
+   */
+  bool goal_changed( int goal_x, int goal_y ) const;
+
+  /**
+   * @param x, y The plane's current grid square
+   * @param tolerance The farthest (in squares) the plane may be from the rest of
+   *                  its corridor and still be considered on course
+   * @return TRUE if the plane has strayed from its corridor
+   */
+  bool off_course( int x, int y, natural tolerance ) const;
+
+  /**
+   * Checks the rest of the corridor against every other plane's track, assuming
+   * each keeps flying straight along its current bearing at a square per second
+   * @param fleet The table of all living planes
+   * @param owner_id The ID of the plane this plan belongs to
+   * @param horizon How many seconds ahead to look
+   * @param clearance How close (in squares) another plane may come to where this
+   *                  plane will be at the same second
+   * @return TRUE if some plane is predicted to come within clearance
+   */
+  bool threatened( const fleet_table & fleet, int owner_id, natural horizon,
+                   natural clearance ) const;
+
+private:
+  /**
+   * Appends the squares from the last square in the corridor to (x, y), moving a
+   * square at a time (diagonally first, as A* does)
+   */
+  void extend_corridor( int x, int y );
+
+  vector< coord > waypoints;
+  natural next; // index of the waypoint the plane is flying to
+
+  vector< coord > corridor; // corridor[ t ] is where the plane should be t seconds after planning
+  natural progress;         // index of the corridor square nearest the plane
+
+  int goal_x, goal_y;
+};
+
+flight_plan::flight_plan()
+{
+  next = 0;
+  progress = 0;
+  goal_x = goal_y = -1;
+}
+
+void flight_plan::set( int start_x, int start_y, const vector< coord > & wps,
+                       int g_x, int g_y )
+{
+  waypoints = wps;
+  next = 0;
+  goal_x = g_x;
+  goal_y = g_y;
+
+  corridor.clear();
+  corridor.push_back( coord( start_x, start_y, 0 ) );
+  for( natural i = 0; i < waypoints.size(); i++ )
+  {
+    extend_corridor( waypoints[ i ].x, waypoints[ i ].y );
+    waypoints[ i ].t = corridor.back().t; // so we can tell when the plane is past it
+  }
+  progress = 0;
+}
+
+void flight_plan::clear()
+{
+  waypoints.clear();
+  corridor.clear();
+  next = 0;
+  progress = 0;
+  goal_x = goal_y = -1;
+}
+
+bool flight_plan::finished() const
+{
+  return next >= waypoints.size();
+}
+
+void flight_plan::advance( int x, int y )
+{
+  // Find the nearest corridor square from where we were; the plane only moves forward
+  int best = -1;
+  for( natural i = progress; i < corridor.size(); i++ )
+  {
+    int d = max( abs( (int)corridor[ i ].x - x ), abs( (int)corridor[ i ].y - y ) );
+    if( best == -1 || d < best )
+    {
+      best = d;
+      progress = i;
+    }
+  }
+
+  while( !finished() &&
+         ( waypoints[ next ].t <= progress ||
+           ( abs( (int)waypoints[ next ].x - x ) <= 1 &&
+             abs( (int)waypoints[ next ].y - y ) <= 1 ) ) )
+    next++;
+}
+
+const coord & flight_plan::next_waypoint() const
+{
+#ifdef DEBUG
+  assert( !finished() );
+#endif
+  return waypoints[ next ];
+}
+
+bool flight_plan::goal_changed( int g_x, int g_y ) const
+{
+  return g_x != goal_x || g_y != goal_y;
+}
+
+bool flight_plan::off_course( int x, int y, natural tolerance ) const
+{
+  if( progress >= corridor.size() )
+    return true;
+
+  int d = max( abs( (int)corridor[ progress ].x - x ),
+               abs( (int)corridor[ progress ].y - y ) );
+  return d > (int)tolerance;
+}
+
+bool flight_plan::threatened( const fleet_table & fleet, int owner_id, natural horizon,
+                              natural clearance ) const
+{
+  const vector< int > & ids = fleet.ids();
+  const vector< int > & xs = fleet.x();
+  const vector< int > & ys = fleet.y();
+  const vector< map_tools::bearing_t > & bearings = fleet.named_bearing();
+
+  for( natural slot = 0; slot < fleet.size(); slot++ )
+  {
+    if( ids[ slot ] == owner_id )
+      continue;
+
+    int step_x, step_y;
+    map_tools::bearing_to_grid_step( bearings[ slot ], step_x, step_y );
+
+    for( natural t = 0; t <= horizon && progress + t < corridor.size(); t++ )
+    {
+      const coord & ours = corridor[ progress + t ];
+      int theirs_x = xs[ slot ] + step_x * (int)t;
+      int theirs_y = ys[ slot ] + step_y * (int)t;
+
+      if( abs( (int)ours.x - theirs_x ) <= (int)clearance &&
+          abs( (int)ours.y - theirs_y ) <= (int)clearance )
+        return true;
+    }
+  }
+  return false;
+}
+
+void flight_plan::extend_corridor( int x, int y )
+{
+  coord last = corridor.back();
+  int cx = last.x;
+  int cy = last.y;
+  natural t = last.t;
+
+  while( cx != x || cy != y )
+  {
+    if( cx < x ) cx++;
+    else if( cx > x ) cx--;
+    if( cy < y ) cy++;
+    else if( cy > y ) cy--;
+
+    corridor.push_back( coord( cx, cy, ++t ) );
+  }
+}
+
+#endif
@@ -10,6 +10,12 @@
 #define MAP_TOOLS
 
 #include <math.h>
+#include <stddef.h>
+#include <string>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #ifdef DEBUG
 #include <cassert>
@@ -32,6 +38,12 @@ namespace map_tools
 {
   enum bearing_t { N, NE, E, SE, S, SW, W, NW };
   
+  /**
+   * Units for the distance functions. A distance is computed in meters, then
+   * multiplied by unit_conversion( units ).
+   */
+  enum distance_unit_t { METERS, FEET, YARDS, MILES, KILOMETERS, ATTOPARSECS };
+  
   /**
    * Converts a bearing in degrees to a "named" version, for use in deciding which
    * nearby squares are in the path of the aircraft
@@ -67,6 +79,14 @@ namespace map_tools
    */
   bearing_t reverse_bearing( bearing_t start_bearing );
   
+  /**
+   * Gives the grid step (one square) taken by a plane flying a "named" bearing.
+   * Remember that y increases to the south.
+   * @param the_bearing The bearing in question
+   * @param dx, dy The change in x and y; each is -1, 0, or 1
+   */
+  void bearing_to_grid_step( bearing_t the_bearing, int & dx, int & dy );
+  
   /**
    * Using the width, height, and resolution (in whatever system of measurement
    * you're using, such as meters), this returns the width of the field IN SQUARES.
@@ -95,6 +115,12 @@ namespace map_tools
                                       double height_of_field, 
                                       double map_resolution );
   
+  /**
+   * @param units The units you want a distance in
+   * @return The number of those units in a meter
+   */
+  double unit_conversion( distance_unit_t units );
+  
   /**
    * Uses the haversine formula to calculate the distance between two points.
    * 
@@ -103,19 +129,12 @@ namespace map_tools
    * @param longitude_1 The longitude (in decimal degrees) for point 1
    * @param latitude_2 The latitude (in decimal degrees) for point 2
    * @param longitude_2 The longitude (in decimal degrees) for point 2
-   * @param units The units for the returned distance. Allowed values are:
-   *                   - 'feet'
-   *                   - 'yards'
-   *                   - 'miles'
-   *                   - 'meters'
-   *                   - 'kilometers'
-   *                   - 'attoparsecs'
-   *              Default value is meters.
+   * @param units The units for the returned distance (default is METERS)
    * @return The distance, measured in whatever units were specified (default is meters)
    */
   double calculate_distance_between_points( double latitude_1, double longitude_1, 
                                             double latitude_2, double longitude_2,
-                                            string units );
+                                            distance_unit_t units = METERS );
 
   /**
    * Calculates an ending lat-long coordinate given a starting lat-long position, 
@@ -181,10 +200,184 @@ namespace map_tools
    */
   double get_euclidean_dist_between( int x_1, int y_1,
                                      int x_2, int y_2 );
+
+  /**
+   * A local tangent-plane projection about a fixed origin (normally the upper left
+   * corner of the field). Points are mapped to meters east and meters south of
+   * the origin, so the field's rows run along parallels and its columns along
+   * meridians.
+   *
+   * The projection is equirectangular, with the length of a degree of longitude
+   * corrected to first order for the point's latitude. All the trig is done once,
+   * in set_up_local_projection(); a conversion afterward is a handful of
+   * multiplies and adds.
+   *
+   * Error bounds, measured against the haversine distance + initial bearing
+   * conversion (see projection_tester.cpp), at 37 deg N:
+   *    - 500 m field:   under 0.02 m
+   *    - 1 km field:    under 0.06 m
+   *    - 2 km field:    under 0.25 m
+   *    - 5 km field:    under 1.5 m
+   * Nearly all of that is the haversine path's own curvature (a great circle
+   * heading east from the origin drifts south of the parallel), not error in the
+   * projection; east-west distances along a parallel agree to a millimeter.
+   * Either way, it's far below our 10 m grid resolution.
+   */
+  struct local_projection
+  {
+    double origin_lat;       // decimal degrees
+    double origin_lon;       // decimal degrees
+    double m_per_deg_lat;    // meters per degree of latitude
+    double m_per_deg_lon;    // meters per degree of longitude, at the origin
+    double lon_scale_slope;  // change in m_per_deg_lon per degree of latitude
+  };
+
+  /**
+   * Precomputes a local projection about the given origin
+   * @param origin_lat The latitude (in decimal degrees) of the origin
+   * @param origin_lon The longitude (in decimal degrees) of the origin
+   * @param out_proj The projection to set up
+   */
+  void set_up_local_projection( double origin_lat, double origin_lon,
+                                local_projection & out_proj );
+
+  /**
+   * Converts a lat-long coordinate to meters east and south of the projection's
+   * origin. No transcendental functions are called.
+   * @param proj A projection prepared with set_up_local_projection()
+   * @param latitude The latitude (in decimal degrees) of the point
+   * @param longitude The longitude (in decimal degrees) of the point
+   * @param out_east_m Meters east of the origin (negative if west)
+   * @param out_south_m Meters south of the origin (negative if north)
+   */
+  void project_to_local( const local_projection & proj,
+                         double latitude, double longitude,
+                         double & out_east_m, double & out_south_m );
+
+  /**
+   * The inverse of project_to_local(); converts meters east and south of the
+   * origin back to a lat-long coordinate.
+   * @param proj A projection prepared with set_up_local_projection()
+   * @param east_m Meters east of the origin
+   * @param south_m Meters south of the origin
+   * @param out_latitude The latitude (in decimal degrees) of the point
+   * @param out_longitude The longitude (in decimal degrees) of the point
+   */
+  void unproject_from_local( const local_projection & proj,
+                             double east_m, double south_m,
+                             double & out_latitude, double & out_longitude );
+  
+  /*
+   * Batch versions of the above. Each takes parallel arrays of n elements and
+   * writes n results; use these when converting a whole course, a set of
+   * telemetry updates, or the simulator's fleet at once. The output arrays may
+   * not overlap the inputs.
+   *
+   * The projection and grid kernels are pure arithmetic, so when compiled with
+   * AVX2 (-mavx2) they handle four points per instruction; otherwise they fall
+   * back to the scalar functions above. Either way, the results are identical to
+   * calling the scalar functions point by point. The haversine and bearing
+   * kernels are bound by sin/cos/atan2, so they are plain loops, but they
+   * hoist the trig on the shared starting point and the units lookup out of
+   * the loop.
+   */
+  
+  /**
+   * Converts n lat-long coordinates to meters east and south of the origin
+   * @param proj A projection prepared with set_up_local_projection()
+   * @param latitudes, longitudes The points to convert (decimal degrees)
+   * @param n The number of points
+   * @param out_east_m, out_south_m Meters east and south of the origin
+   */
+  void project_to_local( const local_projection & proj,
+                         const double * latitudes, const double * longitudes,
+                         size_t n, double * out_east_m, double * out_south_m );
+  
+  /**
+   * Converts n points, in meters east and south of the origin, to lat-long
+   * @param proj A projection prepared with set_up_local_projection()
+   * @param east_m, south_m The points to convert
+   * @param n The number of points
+   * @param out_latitudes, out_longitudes The points in decimal degrees
+   */
+  void unproject_from_local( const local_projection & proj,
+                             const double * east_m, const double * south_m,
+                             size_t n,
+                             double * out_latitudes, double * out_longitudes );
+  
+  /**
+   * Finds the grid square containing each of n lat-long coordinates, the same way
+   * Position does
+   * @param proj A projection about the field's upper left corner
+   * @param resolution The width and height of a grid square, in meters
+   * @param latitudes, longitudes The points to convert (decimal degrees)
+   * @param n The number of points
+   * @param out_x, out_y The grid squares containing the points
+   */
+  void lat_lon_to_grid( const local_projection & proj, double resolution,
+                        const double * latitudes, const double * longitudes,
+                        size_t n, int * out_x, int * out_y );
+  
+  /**
+   * Finds the lat-long coordinate of the center of each of n grid squares, the
+   * same way Position does
+   * @param proj A projection about the field's upper left corner
+   * @param resolution The width and height of a grid square, in meters
+   * @param x, y The grid squares to convert
+   * @param n The number of squares
+   * @param out_latitudes, out_longitudes The centers of the squares
+   */
+  void grid_to_lat_lon( const local_projection & proj, double resolution,
+                        const int * x, const int * y, size_t n,
+                        double * out_latitudes, double * out_longitudes );
+  
+  /**
+   * Uses the haversine formula to calculate the distance from one point to each
+   * of n others
+   * @param latitude_1 The latitude (in decimal degrees) for the starting point
+   * @param longitude_1 The longitude (in decimal degrees) for the starting point
+   * @param latitudes_2, longitudes_2 The n other points (decimal degrees)
+   * @param n The number of other points
+   * @param out_distances The distance to each of the other points
+   * @param units The units for the returned distances (default is METERS)
+   */
+  void calculate_distances_from_point( double latitude_1, double longitude_1,
+                                       const double * latitudes_2,
+                                       const double * longitudes_2,
+                                       size_t n, double * out_distances,
+                                       distance_unit_t units = METERS );
+  
+  /**
+   * Uses the haversine formula to calculate n distances between pairs of points
+   * @param latitudes_1, longitudes_1 The starting points (decimal degrees)
+   * @param latitudes_2, longitudes_2 The ending points (decimal degrees)
+   * @param n The number of pairs
+   * @param out_distances The distance between each pair
+   * @param units The units for the returned distances (default is METERS)
+   */
+  void calculate_distances_between_points( const double * latitudes_1,
+                                           const double * longitudes_1,
+                                           const double * latitudes_2,
+                                           const double * longitudes_2,
+                                           size_t n, double * out_distances,
+                                           distance_unit_t units = METERS );
+  
+  /**
+   * Calculates the bearing, in degrees, from one point to each of n others
+   * @param latitude_1 The latitude (in decimal degrees) for the starting point
+   * @param longitude_1 The longitude (in decimal degrees) for the starting point
+   * @param latitudes_2, longitudes_2 The n other points (decimal degrees)
+   * @param n The number of other points
+   * @param out_bearings The bearing, in degrees, to each of the other points
+   */
+  void calculate_bearings_from_point( double latitude_1, double longitude_1,
+                                      const double * latitudes_2,
+                                      const double * longitudes_2,
+                                      size_t n, double * out_bearings );
 }
 
 
-map_tools::bearing_t map_tools::name_bearing( double the_bearing )
+inline map_tools::bearing_t map_tools::name_bearing( double the_bearing )
 {
   the_bearing = fmod(the_bearing, 360); // modular division for floats
   
@@ -227,7 +420,7 @@ map_tools::bearing_t map_tools::name_bearing( double the_bearing )
   }
 }
 
-string map_tools::bearing_to_string( map_tools::bearing_t the_bearing )
+inline string map_tools::bearing_to_string( map_tools::bearing_t the_bearing )
 {
   switch( the_bearing )
   {
@@ -250,7 +443,7 @@ string map_tools::bearing_to_string( map_tools::bearing_t the_bearing )
   }
 }
 
-double map_tools::bearing_to_double( bearing_t the_bearing )
+inline double map_tools::bearing_to_double( bearing_t the_bearing )
 {
   if( the_bearing == N )
     return 0.0;
@@ -271,7 +464,7 @@ double map_tools::bearing_to_double( bearing_t the_bearing )
   }
 
 
-map_tools::bearing_t map_tools::reverse_bearing( map_tools::bearing_t start_bearing )
+inline map_tools::bearing_t map_tools::reverse_bearing( map_tools::bearing_t start_bearing )
 {
   switch( start_bearing )
   {
@@ -298,23 +491,58 @@ map_tools::bearing_t map_tools::reverse_bearing( map_tools::bearing_t start_bear
   }
 }
 
-unsigned int map_tools::find_width_in_squares( double width_of_field, 
-                                               double height_of_field, 
-                                               double map_resolution )
+inline void map_tools::bearing_to_grid_step( map_tools::bearing_t the_bearing, int & dx, int & dy )
+{
+  dx = 0;
+  dy = 0;
+  
+  if( the_bearing == NE || the_bearing == E || the_bearing == SE )
+    dx = 1;
+  else if( the_bearing == SW || the_bearing == W || the_bearing == NW )
+    dx = -1;
+  
+  if( the_bearing == NW || the_bearing == N || the_bearing == NE )
+    dy = -1;
+  else if( the_bearing == SE || the_bearing == S || the_bearing == SW )
+    dy = 1;
+}
+
+inline unsigned int map_tools::find_width_in_squares( double width_of_field, 
+                                                      double height_of_field, 
+                                                      double map_resolution )
 {
     return (int)( ceil( (double)(width_of_field) / map_resolution ) + 0.1 );
 }
 
-unsigned int map_tools::find_height_in_squares( double width_of_field, 
-                                                double height_of_field, 
-                                                double map_resolution )
+inline unsigned int map_tools::find_height_in_squares( double width_of_field, 
+                                                       double height_of_field, 
+                                                       double map_resolution )
 {
     return (int)( ceil( (double)( height_of_field ) / map_resolution ) + 0.1 );
 }
 
-double map_tools::calculate_distance_between_points( double latitude_1, double longitude_1, 
-                                                     double latitude_2, double longitude_2,
-                                                     string units )
+inline double map_tools::unit_conversion( distance_unit_t units )
+{
+  switch( units )
+  {
+    case FEET:
+      return 3.28083989501312;
+    case YARDS:
+      return 3.28083989501312 / 3;
+    case MILES:
+      return 3.28083989501312 / 5280;
+    case KILOMETERS:
+      return 1.0 / 1000;
+    case ATTOPARSECS:
+      return 32.4077649;
+    default:
+      return 1.0;
+  }
+}
+
+inline double map_tools::calculate_distance_between_points( double latitude_1, double longitude_1, 
+                                                            double latitude_2, double longitude_2,
+                                                            distance_unit_t units )
 {    
   double the_distance;
   double d_lat = to_radians( latitude_2 - latitude_1 );
@@ -338,23 +566,14 @@ double map_tools::calculate_distance_between_points( double latitude_1, double l
   assert( the_distance < 100000 );
 #endif
   
-  if( units == "feet" )
-    return the_distance * 3.28083989501312;
-  if( units == "yards" )
-    return the_distance * 3.28083989501312 / 3;
-  if( units == "miles" )
-    return the_distance * 3.28083989501312 / 5280;
-  if( units == "kilometers" )
-    return the_distance / 1000;
-  if( units == "attoparsecs" )
-    return the_distance * 32.4077649;
-  else
+  if( units == METERS )
     return the_distance;
+  return the_distance * unit_conversion( units );
 }
 
-void map_tools::calculate_point( double latitude_1, double longitude_1, 
-                                 double distance_in_meters, double bearing_in_deg,
-                                 double & out_latitude_2, double & out_longitude_2 )
+inline void map_tools::calculate_point( double latitude_1, double longitude_1, 
+                                        double distance_in_meters, double bearing_in_deg,
+                                        double & out_latitude_2, double & out_longitude_2 )
 {
   double ang_dist_in_rad = (distance_in_meters / earth_radius);
   double bearing_in_rad = to_radians(bearing_in_deg);
@@ -377,8 +596,8 @@ void map_tools::calculate_point( double latitude_1, double longitude_1,
   out_latitude_2 *= RADtoDEGREES;
 }
 
-double map_tools::calculateBearing( double latitude_1, double longitude_1, 
-                                    double latitude_2, double longitude_2 )
+inline double map_tools::calculateBearing( double latitude_1, double longitude_1, 
+                                           double latitude_2, double longitude_2 )
 {
   latitude_1 = to_radians( latitude_1 );
   latitude_2 = to_radians( latitude_2 );
@@ -392,8 +611,8 @@ double map_tools::calculateBearing( double latitude_1, double longitude_1,
   return atan2(y, x)*RADtoDEGREES;
 }
 
-double map_tools::calculate_bearing_in_rad( double latitude_1, double longitude_1, 
-                                            double latitude_2, double longitude_2 )
+inline double map_tools::calculate_bearing_in_rad( double latitude_1, double longitude_1, 
+                                                   double latitude_2, double longitude_2 )
 {  
   latitude_1 = to_radians( latitude_1 );
   latitude_2 = to_radians( latitude_2 );
@@ -407,8 +626,8 @@ double map_tools::calculate_bearing_in_rad( double latitude_1, double longitude_
   return atan2(y, x);
 }
 
-double map_tools::calculate_euclidean_bearing( int x_1, int y_1,
-                                               int x_2, int y_2 )
+inline double map_tools::calculate_euclidean_bearing( int x_1, int y_1,
+                                                      int x_2, int y_2 )
 {
   int d_y = y_2 - y_1;
   int d_x = x_2 - x_1;
@@ -416,15 +635,260 @@ double map_tools::calculate_euclidean_bearing( int x_1, int y_1,
 }
 
 
-double map_tools::to_radians( double angle_in_degrees )
+inline double map_tools::to_radians( double angle_in_degrees )
 {
     return ( angle_in_degrees * DEGREEStoRAD );
 }
 
-double map_tools::get_euclidean_dist_between( int x_1, int y_1,
-                                              int x_2, int y_2 )
+inline double map_tools::get_euclidean_dist_between( int x_1, int y_1,
+                                                     int x_2, int y_2 )
 {
   return sqrt( (x_2 - x_1)*(x_2 - x_1) + (y_2 - y_1)*(y_2 - y_1) );
 }
 
+inline void map_tools::set_up_local_projection( double origin_lat, double origin_lon,
+                                                local_projection & out_proj )
+{
+  double origin_lat_in_rad = to_radians( origin_lat );
+  
+  out_proj.origin_lat = origin_lat;
+  out_proj.origin_lon = origin_lon;
+  out_proj.m_per_deg_lat = earth_radius * DEGREEStoRAD;
+  out_proj.m_per_deg_lon = out_proj.m_per_deg_lat * cos( origin_lat_in_rad );
+  
+  // d/d(lat) of R cos(lat), with lat in degrees
+  out_proj.lon_scale_slope = -out_proj.m_per_deg_lat * sin( origin_lat_in_rad ) *
+                              DEGREEStoRAD;
+}
+
+inline void map_tools::project_to_local( const local_projection & proj,
+                                         double latitude, double longitude,
+                                         double & out_east_m, double & out_south_m )
+{
+  double d_lat = latitude - proj.origin_lat;
+  
+  out_east_m = ( longitude - proj.origin_lon ) *
+               ( proj.m_per_deg_lon + proj.lon_scale_slope * d_lat );
+  out_south_m = -d_lat * proj.m_per_deg_lat;
+}
+
+inline void map_tools::unproject_from_local( const local_projection & proj,
+                                             double east_m, double south_m,
+                                             double & out_latitude, double & out_longitude )
+{
+  double d_lat = -south_m / proj.m_per_deg_lat;
+  
+  out_latitude = proj.origin_lat + d_lat;
+  out_longitude = proj.origin_lon +
+                  east_m / ( proj.m_per_deg_lon + proj.lon_scale_slope * d_lat );
+}
+
+inline void map_tools::project_to_local( const local_projection & proj,
+                                         const double * latitudes, const double * longitudes,
+                                         size_t n, double * out_east_m, double * out_south_m )
+{
+  size_t i = 0;
+#ifdef __AVX2__
+  const __m256d origin_lat = _mm256_set1_pd( proj.origin_lat );
+  const __m256d origin_lon = _mm256_set1_pd( proj.origin_lon );
+  const __m256d m_per_deg_lat = _mm256_set1_pd( proj.m_per_deg_lat );
+  const __m256d m_per_deg_lon = _mm256_set1_pd( proj.m_per_deg_lon );
+  const __m256d slope = _mm256_set1_pd( proj.lon_scale_slope );
+  const __m256d zero = _mm256_setzero_pd();
+  
+  for( ; i + 4 <= n; i += 4 )
+  {
+    __m256d d_lat = _mm256_sub_pd( _mm256_loadu_pd( latitudes + i ), origin_lat );
+    __m256d d_lon = _mm256_sub_pd( _mm256_loadu_pd( longitudes + i ), origin_lon );
+    // Multiply and add separately (no FMA), so we round exactly as the scalar
+    // version does
+    __m256d scale = _mm256_add_pd( m_per_deg_lon, _mm256_mul_pd( slope, d_lat ) );
+    
+    _mm256_storeu_pd( out_east_m + i, _mm256_mul_pd( d_lon, scale ) );
+    _mm256_storeu_pd( out_south_m + i,
+                      _mm256_mul_pd( _mm256_sub_pd( zero, d_lat ), m_per_deg_lat ) );
+  }
+#endif
+  for( ; i < n; i++ )
+    project_to_local( proj, latitudes[ i ], longitudes[ i ],
+                      out_east_m[ i ], out_south_m[ i ] );
+}
+
+inline void map_tools::unproject_from_local( const local_projection & proj,
+                                             const double * east_m, const double * south_m,
+                                             size_t n,
+                                             double * out_latitudes, double * out_longitudes )
+{
+  size_t i = 0;
+#ifdef __AVX2__
+  const __m256d origin_lat = _mm256_set1_pd( proj.origin_lat );
+  const __m256d origin_lon = _mm256_set1_pd( proj.origin_lon );
+  const __m256d m_per_deg_lat = _mm256_set1_pd( proj.m_per_deg_lat );
+  const __m256d m_per_deg_lon = _mm256_set1_pd( proj.m_per_deg_lon );
+  const __m256d slope = _mm256_set1_pd( proj.lon_scale_slope );
+  const __m256d zero = _mm256_setzero_pd();
+  
+  for( ; i + 4 <= n; i += 4 )
+  {
+    __m256d d_lat = _mm256_div_pd( _mm256_sub_pd( zero, _mm256_loadu_pd( south_m + i ) ),
+                                   m_per_deg_lat );
+    __m256d scale = _mm256_add_pd( m_per_deg_lon, _mm256_mul_pd( slope, d_lat ) );
+    
+    _mm256_storeu_pd( out_latitudes + i, _mm256_add_pd( origin_lat, d_lat ) );
+    _mm256_storeu_pd( out_longitudes + i,
+                      _mm256_add_pd( origin_lon,
+                                     _mm256_div_pd( _mm256_loadu_pd( east_m + i ), scale ) ) );
+  }
+#endif
+  for( ; i < n; i++ )
+    unproject_from_local( proj, east_m[ i ], south_m[ i ],
+                          out_latitudes[ i ], out_longitudes[ i ] );
+}
+
+inline void map_tools::lat_lon_to_grid( const local_projection & proj, double resolution,
+                                        const double * latitudes, const double * longitudes,
+                                        size_t n, int * out_x, int * out_y )
+{
+  size_t i = 0;
+#ifdef __AVX2__
+  const __m256d origin_lat = _mm256_set1_pd( proj.origin_lat );
+  const __m256d origin_lon = _mm256_set1_pd( proj.origin_lon );
+  const __m256d m_per_deg_lat = _mm256_set1_pd( proj.m_per_deg_lat );
+  const __m256d m_per_deg_lon = _mm256_set1_pd( proj.m_per_deg_lon );
+  const __m256d slope = _mm256_set1_pd( proj.lon_scale_slope );
+  const __m256d res = _mm256_set1_pd( resolution );
+  const __m256d half = _mm256_set1_pd( 0.5 );
+  const __m256d zero = _mm256_setzero_pd();
+  
+  for( ; i + 4 <= n; i += 4 )
+  {
+    __m256d d_lat = _mm256_sub_pd( _mm256_loadu_pd( latitudes + i ), origin_lat );
+    __m256d d_lon = _mm256_sub_pd( _mm256_loadu_pd( longitudes + i ), origin_lon );
+    __m256d scale = _mm256_add_pd( m_per_deg_lon, _mm256_mul_pd( slope, d_lat ) );
+    __m256d east = _mm256_mul_pd( d_lon, scale );
+    __m256d south = _mm256_mul_pd( _mm256_sub_pd( zero, d_lat ), m_per_deg_lat );
+    
+    // Same as Position: (int)( (int)( meters + 0.5 ) / resolution )
+    east = _mm256_round_pd( _mm256_add_pd( east, half ),
+                            _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC );
+    south = _mm256_round_pd( _mm256_add_pd( south, half ),
+                             _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC );
+    
+    _mm_storeu_si128( (__m128i *)( out_x + i ),
+                      _mm256_cvttpd_epi32( _mm256_div_pd( east, res ) ) );
+    _mm_storeu_si128( (__m128i *)( out_y + i ),
+                      _mm256_cvttpd_epi32( _mm256_div_pd( south, res ) ) );
+  }
+#endif
+  for( ; i < n; i++ )
+  {
+    double east, south;
+    project_to_local( proj, latitudes[ i ], longitudes[ i ], east, south );
+    
+    out_x[ i ] = (int)( (int)( east + 0.5 ) / resolution );
+    out_y[ i ] = (int)( (int)( south + 0.5 ) / resolution );
+  }
+}
+
+inline void map_tools::grid_to_lat_lon( const local_projection & proj, double resolution,
+                                        const int * x, const int * y, size_t n,
+                                        double * out_latitudes, double * out_longitudes )
+{
+  size_t i = 0;
+#ifdef __AVX2__
+  const __m256d origin_lat = _mm256_set1_pd( proj.origin_lat );
+  const __m256d origin_lon = _mm256_set1_pd( proj.origin_lon );
+  const __m256d m_per_deg_lat = _mm256_set1_pd( proj.m_per_deg_lat );
+  const __m256d m_per_deg_lon = _mm256_set1_pd( proj.m_per_deg_lon );
+  const __m256d slope = _mm256_set1_pd( proj.lon_scale_slope );
+  const __m256d res = _mm256_set1_pd( resolution );
+  const __m256d half = _mm256_set1_pd( 0.5 );
+  const __m256d zero = _mm256_setzero_pd();
+  
+  for( ; i + 4 <= n; i += 4 )
+  {
+    // Aim for the center of the square
+    __m256d east = _mm256_cvtepi32_pd( _mm_loadu_si128( (const __m128i *)( x + i ) ) );
+    __m256d south = _mm256_cvtepi32_pd( _mm_loadu_si128( (const __m128i *)( y + i ) ) );
+    east = _mm256_mul_pd( _mm256_add_pd( east, half ), res );
+    south = _mm256_mul_pd( _mm256_add_pd( south, half ), res );
+    
+    __m256d d_lat = _mm256_div_pd( _mm256_sub_pd( zero, south ), m_per_deg_lat );
+    __m256d scale = _mm256_add_pd( m_per_deg_lon, _mm256_mul_pd( slope, d_lat ) );
+    
+    _mm256_storeu_pd( out_latitudes + i, _mm256_add_pd( origin_lat, d_lat ) );
+    _mm256_storeu_pd( out_longitudes + i,
+                      _mm256_add_pd( origin_lon, _mm256_div_pd( east, scale ) ) );
+  }
+#endif
+  for( ; i < n; i++ )
+    unproject_from_local( proj, ( x[ i ] + 0.5 ) * resolution,
+                          ( y[ i ] + 0.5 ) * resolution,
+                          out_latitudes[ i ], out_longitudes[ i ] );
+}
+
+inline void map_tools::calculate_distances_from_point( double latitude_1, double longitude_1,
+                                                       const double * latitudes_2,
+                                                       const double * longitudes_2,
+                                                       size_t n, double * out_distances,
+                                                       distance_unit_t units )
+{
+  double cos_lat_1 = cos( to_radians( latitude_1 ) );
+  double conversion = earth_radius * unit_conversion( units );
+  
+  for( size_t i = 0; i < n; i++ )
+  {
+    double sin_d_lat = sin( to_radians( latitudes_2[ i ] - latitude_1 ) / 2 );
+    double sin_d_long = sin( to_radians( longitudes_2[ i ] - longitude_1 ) / 2 );
+    double a = ( sin_d_lat * sin_d_lat +
+                cos_lat_1 * cos( to_radians( latitudes_2[ i ] ) ) *
+                sin_d_long * sin_d_long );
+    
+    out_distances[ i ] = fabs( conversion * 2 * atan2( sqrt(a), sqrt(1 - a) ) );
+  }
+}
+
+inline void map_tools::calculate_distances_between_points( const double * latitudes_1,
+                                                           const double * longitudes_1,
+                                                           const double * latitudes_2,
+                                                           const double * longitudes_2,
+                                                           size_t n, double * out_distances,
+                                                           distance_unit_t units )
+{
+  double conversion = earth_radius * unit_conversion( units );
+  
+  for( size_t i = 0; i < n; i++ )
+  {
+    double sin_d_lat = sin( to_radians( latitudes_2[ i ] - latitudes_1[ i ] ) / 2 );
+    double sin_d_long = sin( to_radians( longitudes_2[ i ] - longitudes_1[ i ] ) / 2 );
+    double a = ( sin_d_lat * sin_d_lat +
+                cos( to_radians( latitudes_1[ i ] ) ) *
+                cos( to_radians( latitudes_2[ i ] ) ) *
+                sin_d_long * sin_d_long );
+    
+    out_distances[ i ] = fabs( conversion * 2 * atan2( sqrt(a), sqrt(1 - a) ) );
+  }
+}
+
+inline void map_tools::calculate_bearings_from_point( double latitude_1, double longitude_1,
+                                                      const double * latitudes_2,
+                                                      const double * longitudes_2,
+                                                      size_t n, double * out_bearings )
+{
+  double lat_1_in_rad = to_radians( latitude_1 );
+  double sin_lat_1 = sin( lat_1_in_rad );
+  double cos_lat_1 = cos( lat_1_in_rad );
+  
+  for( size_t i = 0; i < n; i++ )
+  {
+    double lat_2_in_rad = to_radians( latitudes_2[ i ] );
+    double cos_lat_2 = cos( lat_2_in_rad );
+    double deltalon = to_radians( longitudes_2[ i ] - longitude_1 );
+    
+    double y = sin(deltalon) * cos_lat_2;
+    double x = cos_lat_1 * sin( lat_2_in_rad ) - sin_lat_1 * cos_lat_2 * cos(deltalon);
+    out_bearings[ i ] = atan2(y, x) * RADtoDEGREES;
+  }
+}
+
 #endif
\ No newline at end of file
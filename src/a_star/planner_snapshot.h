@@ -0,0 +1,278 @@
+//
+// planner_snapshot.h
+// AU_UAV_ROS
+//
+// A compact binary snapshot of collision avoidance's per-plane state, kept in a
+// memory-mapped file so that a restarted node can pick up where the last one
+// left off instead of spending its first few dozen callbacks relearning every
+// plane's position, bearing, and loop-detection history.
+//
+// The file is a header followed by one fixed-size record per plane. Writing it is
+// a memcpy into the mapping; the OS flushes it to disk on its own schedule, and
+// the checksum (written last) lets a reader reject a snapshot that was only
+// partly written when the node died. A snapshot is also rejected if it was taken
+// on a different field, or if it is too old for its positions to be of any use.
+//
+
+#ifndef PLANNER_SNAPSHOT
+#define PLANNER_SNAPSHOT
+
+#include <string>
+#include <vector>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "FieldGeometry.h"
+
+#ifndef natural
+#define natural unsigned int
+#endif
+
+using namespace std;
+
+/**
+ * Everything we keep about one plane. Positions are stored as lat-longs so that
+ * they come back exactly as they went in.
+ */
+struct snapshot_plane
+{
+  int32_t id;
+  int32_t last_callback_updated; // the callback count at the plane's last update
+  int32_t needs_a_push;          // 1 if the plane needs a break-out waypoint
+  int32_t unused;                // (keeps the doubles 8-byte aligned)
+  double prev_dist;              // meters to its goal at its last update
+  double speed;                  // ground speed, m/s
+  double altitude;
+  double current_lat, current_lon;
+  double last_lat, last_lon;     // the previous real position
+  double dest_lat, dest_lon;     // the intermediate waypoint
+  double final_lat, final_lon;   // the goal
+};
+
+class planner_snapshot
+{
+public:
+  /**
+   * Creates a snapshot that isn't attached to a file yet
+   */
+  planner_snapshot();
+
+  /**
+   * Unmaps and closes the file
+   */
+  ~planner_snapshot();
+
+  /**
+   * Opens (creating it if need be) and maps the snapshot file
+   * @param path The file to use
+   * @return TRUE if the file could be opened and mapped
+   */
+  bool open( const string & path );
+
+  /**
+   * Overwrites the snapshot
+   * @param field The field we're planning on
+   * @param now The current wall-clock time, in seconds since the epoch
+   * @param callback_count The number of callbacks handled so far
+   * @param planes The state of every plane
+   * @return TRUE if the snapshot was written
+   */
+  bool write( const FieldGeometry & field, double now, int callback_count,
+              const vector< snapshot_plane > & planes );
+
+  /**
+   * Reads the snapshot back, if there's a good one
+   * @param field The field we're planning on; a snapshot from any other is rejected
+   * @param now The current wall-clock time, in seconds since the epoch
+   * @param max_age The oldest (in seconds) a snapshot may be and still be used
+   * @param callback_count Set to the number of callbacks handled when it was taken
+   * @param planes Set to the state of every plane
+   * @return TRUE if there was a complete, recent snapshot for this field
+   */
+  bool read( const FieldGeometry & field, double now, double max_age,
+             int & callback_count, vector< snapshot_plane > & planes ) const;
+
+private:
+  struct header
+  {
+    char magic[ 8 ];       // "AUCASNAP"
+    uint32_t format;       // SNAPSHOT_FORMAT
+    uint32_t plane_count;
+    double taken_at;       // wall-clock seconds since the epoch
+    int32_t callback_count;
+    uint32_t checksum;     // of everything else in the header and the records
+    double field_params[ 5 ]; // upper left lon, lat; lon width, lat width; resolution
+  };
+
+  enum { SNAPSHOT_FORMAT = 2 };
+
+  /**
+   * Makes sure the mapping can hold this many records, growing the file if need be
+   */
+  bool reserve( natural plane_count );
+
+  /**
+   * FNV-1a over the header (with its checksum field zeroed) and the records
+   */
+  static uint32_t checksum_of( const header & h, const snapshot_plane * records );
+
+  static void field_params_of( const FieldGeometry & field, double * out_params );
+
+  int fd;
+  char * mapped;
+  size_t mapped_size;
+};
+
+planner_snapshot::planner_snapshot()
+{
+  fd = -1;
+  mapped = NULL;
+  mapped_size = 0;
+}
+
+planner_snapshot::~planner_snapshot()
+{
+  if( mapped != NULL )
+    munmap( mapped, mapped_size );
+  if( fd != -1 )
+    close( fd );
+}
+
+bool planner_snapshot::open( const string & path )
+{
+  fd = ::open( path.c_str(), O_RDWR | O_CREAT, 0644 );
+  if( fd == -1 )
+    return false;
+
+  struct stat info;
+  if( fstat( fd, &info ) != 0 )
+    return false;
+
+  // Map whatever's there now (for read()), or make room for a header
+  natural existing = 0;
+  if( (size_t)info.st_size > sizeof( header ) )
+    existing = ( info.st_size - sizeof( header ) ) / sizeof( snapshot_plane );
+  return reserve( existing );
+}
+
+bool planner_snapshot::reserve( natural plane_count )
+{
+  size_t needed = sizeof( header ) + plane_count * sizeof( snapshot_plane );
+  if( mapped != NULL && needed <= mapped_size )
+    return true;
+  if( fd == -1 )
+    return false;
+
+  // Grow by doubling, so that a steadily growing fleet doesn't remap every time
+  size_t size = mapped_size > 0 ? mapped_size : sizeof( header ) + 64 * sizeof( snapshot_plane );
+  while( size < needed )
+    size *= 2;
+
+  struct stat info;
+  if( fstat( fd, &info ) != 0 )
+    return false;
+  if( (size_t)info.st_size < size && ftruncate( fd, size ) != 0 )
+    return false;
+  if( (size_t)info.st_size > size )
+    size = info.st_size;
+
+  if( mapped != NULL )
+    munmap( mapped, mapped_size );
+  void * m = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+  if( m == MAP_FAILED )
+  {
+    mapped = NULL;
+    mapped_size = 0;
+    return false;
+  }
+
+  mapped = (char *)m;
+  mapped_size = size;
+  return true;
+}
+
+bool planner_snapshot::write( const FieldGeometry & field, double now, int callback_count,
+                              const vector< snapshot_plane > & planes )
+{
+  if( !reserve( planes.size() ) )
+    return false;
+
+  header * h = (header *)mapped;
+  snapshot_plane * records = (snapshot_plane *)( mapped + sizeof( header ) );
+
+  // Spoil the old checksum first, so a snapshot we die in the middle of writing
+  // can't be mistaken for a good one
+  h->checksum = ~h->checksum;
+
+  if( !planes.empty() )
+    memcpy( records, &planes[ 0 ], planes.size() * sizeof( snapshot_plane ) );
+
+  memcpy( h->magic, "AUCASNAP", 8 );
+  h->format = SNAPSHOT_FORMAT;
+  h->plane_count = planes.size();
+  h->taken_at = now;
+  h->callback_count = callback_count;
+  field_params_of( field, h->field_params );
+  h->checksum = checksum_of( *h, records );
+  return true;
+}
+
+bool planner_snapshot::read( const FieldGeometry & field, double now, double max_age,
+                             int & callback_count, vector< snapshot_plane > & planes ) const
+{
+  if( mapped == NULL || mapped_size < sizeof( header ) )
+    return false;
+
+  const header * h = (const header *)mapped;
+  const snapshot_plane * records = (const snapshot_plane *)( mapped + sizeof( header ) );
+
+  if( memcmp( h->magic, "AUCASNAP", 8 ) != 0 || h->format != SNAPSHOT_FORMAT )
+    return false;
+  if( sizeof( header ) + (size_t)h->plane_count * sizeof( snapshot_plane ) > mapped_size )
+    return false;
+  if( h->checksum != checksum_of( *h, records ) )
+    return false;
+
+  // Too old (or from the future, which means the clock has been messed with)
+  if( now - h->taken_at > max_age || now < h->taken_at )
+    return false;
+
+  double params[ 5 ];
+  field_params_of( field, params );
+  if( memcmp( params, h->field_params, sizeof( params ) ) != 0 )
+    return false;
+
+  callback_count = h->callback_count;
+  planes.assign( records, records + h->plane_count );
+  return true;
+}
+
+uint32_t planner_snapshot::checksum_of( const header & h, const snapshot_plane * records )
+{
+  header copy = h;
+  copy.checksum = 0;
+
+  uint32_t hash = 2166136261u;
+  const unsigned char * bytes = (const unsigned char *)&copy;
+  for( size_t i = 0; i < sizeof( header ); i++ )
+    hash = ( hash ^ bytes[ i ] ) * 16777619u;
+
+  bytes = (const unsigned char *)records;
+  for( size_t i = 0; i < h.plane_count * sizeof( snapshot_plane ); i++ )
+    hash = ( hash ^ bytes[ i ] ) * 16777619u;
+  return hash;
+}
+
+void planner_snapshot::field_params_of( const FieldGeometry & field, double * out_params )
+{
+  out_params[ 0 ] = field.getUpperLeftLongitude();
+  out_params[ 1 ] = field.getUpperLeftLatitude();
+  out_params[ 2 ] = field.getLonWidth();
+  out_params[ 3 ] = field.getLatWidth();
+  out_params[ 4 ] = field.getResolution();
+}
+
+#endif
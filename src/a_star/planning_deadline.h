@@ -0,0 +1,90 @@
+//
+// planning_deadline.h
+// AU_UAV_ROS
+//
+// A wall-clock budget for planning a single plane's next move. Start it when the
+// telemetry update comes in; the planner checks expired() as it goes and gives
+// up on the search if the budget runs out, so that a command (possibly a
+// fallback) still goes out on time.
+//
+
+#ifndef PLANNING_DEADLINE
+#define PLANNING_DEADLINE
+
+#include <time.h>
+
+class planning_deadline
+{
+public:
+  /**
+   * Creates a deadline that never expires (until you call start())
+   */
+  planning_deadline();
+
+  /**
+   * Starts the clock
+   * @param budget_ms The number of milliseconds, from now, until the deadline;
+   *                  zero or less means "no deadline"
+   */
+  void start( double budget_ms );
+
+  /**
+   * @return TRUE if the deadline has been started and has passed
+   */
+  bool expired() const;
+
+  /**
+   * @return the number of milliseconds since start() was called
+   */
+  double elapsed_ms() const;
+
+  /**
+   * @return the budget given to start(), in milliseconds
+   */
+  double get_budget_ms() const;
+
+private:
+  /**
+   * @return the current time, in milliseconds, from a clock that never jumps
+   */
+  static double now_ms();
+
+  double started_at;  // ms
+  double budget;      // ms; <= 0 if there is no deadline
+};
+
+planning_deadline::planning_deadline()
+{
+  started_at = now_ms();
+  budget = 0;
+}
+
+void planning_deadline::start( double budget_ms )
+{
+  started_at = now_ms();
+  budget = budget_ms;
+}
+
+bool planning_deadline::expired() const
+{
+  return budget > 0 && elapsed_ms() > budget;
+}
+
+double planning_deadline::elapsed_ms() const
+{
+  return now_ms() - started_at;
+}
+
+double planning_deadline::get_budget_ms() const
+{
+  return budget;
+}
+
+double planning_deadline::now_ms()
+{
+  timespec t;
+  clock_gettime( CLOCK_MONOTONIC, &t );
+  return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+#endif
@@ -0,0 +1,129 @@
+//
+// spsc_ring.h
+// AU_UAV_ROS
+//
+// A fixed-size, lock-free ring buffer for handing items from exactly one
+// producer thread to exactly one consumer thread.
+//
+// Collision avoidance uses it to get telemetry off the ROS spinner thread: the
+// subscriber callback pushes each decoded update and returns immediately, and
+// the planning thread pops them and does the (slow) planning. Neither side ever
+// waits on the other. With more than one producer or more than one consumer,
+// this is NOT safe.
+//
+
+#ifndef SPSC_RING
+#define SPSC_RING
+
+#include <vector>
+#include <boost/atomic.hpp>
+
+#ifndef natural
+#define natural unsigned int
+#endif
+
+using namespace std;
+
+template< typename T >
+class spsc_ring
+{
+public:
+  /**
+   * Creates an empty ring
+   * @param min_capacity The fewest items the ring must be able to hold; this is
+   *                     rounded up to a power of two
+   */
+  spsc_ring( natural min_capacity );
+
+  /**
+   * Adds an item to the back of the ring. Call this from the producer thread only.
+   * @param item The item to add (copied into the ring)
+   * @return TRUE if the item was added, FALSE if the ring was full
+   */
+  bool push( const T & item );
+
+  /**
+   * Takes the item from the front of the ring. Call this from the consumer thread
+   * only.
+   * @param out_item Set to the item taken, if there was one
+   * @return TRUE if an item was taken, FALSE if the ring was empty
+   */
+  bool pop( T & out_item );
+
+  /**
+   * @return the number of items in the ring. This is exact when called from
+   *         either end's thread, as far as that end is concerned; the other end may
+   *         have moved on by the time you look at it.
+   */
+  natural size() const;
+
+  /**
+   * @return the most items the ring can hold at once
+   */
+  natural capacity() const;
+
+private:
+  vector< T > slots;
+  natural mask; // slots.size() - 1; slots.size() is a power of two
+
+  // head and tail only ever increase (wrapping around at the top of the range of
+  // natural); an index into slots is (counter & mask). Each is written by one
+  // thread only, and they live on separate cache lines so that the producer and
+  // consumer don't fight over one.
+  char pad_0[ 64 ];
+  boost::atomic< natural > head; // next slot to pop; written by the consumer
+  char pad_1[ 64 ];
+  boost::atomic< natural > tail; // next slot to push; written by the producer
+  char pad_2[ 64 ];
+};
+
+template< typename T >
+spsc_ring< T >::spsc_ring( natural min_capacity )
+  : head( 0 ), tail( 0 )
+{
+  natural cap = 1;
+  while( cap < min_capacity )
+    cap <<= 1;
+
+  slots.resize( cap );
+  mask = cap - 1;
+}
+
+template< typename T >
+bool spsc_ring< T >::push( const T & item )
+{
+  natural t = tail.load( boost::memory_order_relaxed );
+  if( t - head.load( boost::memory_order_acquire ) > mask ) // full
+    return false;
+
+  slots[ t & mask ] = item;
+  tail.store( t + 1, boost::memory_order_release ); // publishes the item to pop()
+  return true;
+}
+
+template< typename T >
+bool spsc_ring< T >::pop( T & out_item )
+{
+  natural h = head.load( boost::memory_order_relaxed );
+  if( h == tail.load( boost::memory_order_acquire ) ) // empty
+    return false;
+
+  out_item = slots[ h & mask ];
+  head.store( h + 1, boost::memory_order_release ); // hands the slot back to push()
+  return true;
+}
+
+template< typename T >
+natural spsc_ring< T >::size() const
+{
+  return tail.load( boost::memory_order_acquire ) -
+         head.load( boost::memory_order_acquire );
+}
+
+template< typename T >
+natural spsc_ring< T >::capacity() const
+{
+  return mask + 1;
+}
+
+#endif
@@ -5,6 +5,9 @@
 //  Created by Tyler Young on 6/13/11.
 //
 // Writes some text to our own log file, for use in Ubuntu's ROS.
+//
+// Lines are handed to the background flusher in async_log.h, which keeps the
+// file open, rather than opening and closing the file for each line.
 
 #ifndef WRITE_TO_LOG
 #define WRITE_TO_LOG
@@ -13,6 +16,7 @@
 #include <fstream>
 #include <time.h>
 #include <sstream>
+#include "async_log.h"
 
 #ifndef TO_STRING
 #define TO_STRING
@@ -27,6 +31,9 @@ inline std::string to_string( const T& t )
 
 void create_log( string text, string log_dir )
 {
+  // Anything still on its way to the old log belongs before we start it over
+  async_log::instance().flush();
+  
   ofstream log;
   string log_path = log_dir + "ros_log.txt";
   log.open( log_path.c_str(), ios::out );
@@ -40,15 +47,10 @@ void create_log( string text, string log_dir )
 
 void add_to_log( string text, string log_dir )
 {
-  ofstream log;
   string log_path = log_dir + "ros_log.txt";
-  log.open( log_path.c_str(), ios::app );
-  if( log.is_open() )
-  {  
-    log << "At " << time(NULL) << ":     " << text << "\n";
-    
-    log.close();
-  }
+  int sink = async_log::instance().sink_for( log_path );
+  if( sink != -1 )
+    async_log::instance().write_to( sink, "At %ld:     %s", (long)time(NULL), text.c_str() );
 }
 
 #endif
\ No newline at end of file
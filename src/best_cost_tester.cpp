@@ -10,6 +10,7 @@
 #include <iostream>
 #include "best_cost_straight_lines.h"
 #include "map_tools.h"
+#include "FieldGeometry.h"
 #include <time.h>
 #include <vector>
 
@@ -59,6 +60,10 @@ const double height_in_degrees_latitude = -0.016023;
 //const double width_in_degrees_longitude = 0.021;
 //const double height_in_degrees_latitude = -0.018;
 
+const FieldGeometry field( upper_left_longitude, upper_left_latitude,
+                           width_in_degrees_longitude, height_in_degrees_latitude,
+                           resolution );
+
 // for testing only; returns a position whose latitude and longitude are randomized
 Position randomized_position()
 {
@@ -72,12 +77,10 @@ Position randomized_position()
   
   // cout << "Starting long " << longitude << endl << "Starting lat " << latitude << endl;
   
-  return( Position( upper_left_longitude, upper_left_latitude,
-                   width_in_degrees_longitude, height_in_degrees_latitude,
-                   longitude, latitude, resolution ) );
+  return( Position( &field, longitude, latitude ) );
 }
 
-std::map< int, Plane > randomized_planes( natural num_planes )
+fleet_table randomized_planes( natural num_planes )
 {
   std::map< int, Plane > the_planes;
   // The following vars are required to set a plane's position
@@ -98,7 +101,7 @@ std::map< int, Plane > randomized_planes( natural num_planes )
     the_planes[ i ] = Plane(i, new_pos, destination);
     the_planes[ i ].update( randomized_position(), randomized_position(), 30);
   }
-  return the_planes;
+  return fleet_table( the_planes );
 }
 
 // Test the danger_grid class by:
@@ -126,23 +129,13 @@ int main()
   std::map< int, Plane > test_set;
   /*
   // The origin
-  Position plane_1_start( upper_left_longitude, upper_left_latitude,
-                          width_in_degrees_longitude, height_in_degrees_latitude,
-                          0, 0, resolution );
-  Position other_plane_start( upper_left_longitude, upper_left_latitude,
-                              width_in_degrees_longitude, height_in_degrees_latitude,
-                              10, 10, resolution );  
+  Position plane_1_start( &field, 0, 0 );
+  Position other_plane_start( &field, 10, 10 );
   // The farthest corner
-  Position plane_1_end(  upper_left_longitude, upper_left_latitude,
-                       width_in_degrees_longitude, height_in_degrees_latitude,
-                       0, 40, resolution );
-  Position other_plane_end(  upper_left_longitude, upper_left_latitude,
-                       width_in_degrees_longitude, height_in_degrees_latitude,
-                       20, 40, resolution );
+  Position plane_1_end( &field, 0, 40 );
+  Position other_plane_end( &field, 20, 40 );
   
-  Position plane_2_start(  upper_left_longitude, upper_left_latitude,
-                       width_in_degrees_longitude, height_in_degrees_latitude,
-                       0, 41, resolution );
+  Position plane_2_start( &field, 0, 41 );
   
   test_set[ 0 ] = Plane( 0, other_plane_end, plane_1_end );
   test_set[ 0 ].update( plane_1_start, plane_1_end, 30 );
@@ -150,9 +143,7 @@ int main()
   test_set[ 1 ] = Plane( 1, plane_2_start, other_plane_end );
   
   
-  Position plane_3_start(  upper_left_longitude, upper_left_latitude,
-                         width_in_degrees_longitude, height_in_degrees_latitude,
-                         15, 20, resolution );
+  Position plane_3_start( &field, 15, 20 );
   
   plane_3_start.setLatLon(upper_left_latitude, 
                           -85.489251);
@@ -164,23 +155,14 @@ int main()
   
   
   
-  vector< std::map< int, Plane > > all_planes;
-  //all_planes.push_back( test_set );
+  vector< fleet_table > all_planes;
+  //all_planes.push_back( fleet_table( test_set ) );
   
   for( int i = 0; i <= 39; i++ )
     all_planes.push_back( randomized_planes( num_planes ) );
   
-  double width_of_field = 
-  map_tools::calculate_distance_between_points( upper_left_latitude, upper_left_longitude,
-                                               upper_left_latitude, upper_left_longitude +
-                                               width_in_degrees_longitude,
-                                               "meters");
-  double height_of_field = 
-  map_tools::calculate_distance_between_points( upper_left_latitude, upper_left_longitude,
-                                               upper_left_latitude + 
-                                               height_in_degrees_latitude,
-                                               upper_left_longitude,
-                                               "meters");
+  double width_of_field = field.getWidthInMeters();
+  double height_of_field = field.getHeightInMeters();
   
   cout << "Here, width is " << width_of_field << " and height is " << height_of_field << endl;
   
@@ -34,12 +34,25 @@
 #include <iostream>
 #include <fstream>
 #include <map>
+#include <set>
 
 // Our framework
 #include "a_star/Plane_fixed.h"
 #include "a_star/best_cost_straight_lines.h"
 #include "a_star/astar_sparse0.cpp"
 #include "a_star/Position.h"
+#include "a_star/FieldGeometry.h"
+#include "a_star/planning_deadline.h"
+#include "a_star/flight_plan.h"
+#include "a_star/spsc_ring.h"
+#include "a_star/fleet_snapshots.h"
+#include "a_star/planner_snapshot.h"
+#include "a_star/altitude_bands.h"
+#include "a_star/async_log.h"
+
+// Boost (comes with ROS)
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
 
 #ifdef DEBUG
 #include "a_star/output_helpers.h"
@@ -48,8 +61,13 @@
 // ROS headers
 #include "ros/ros.h"
 #include "AU_UAV_ROS/TelemetryUpdate.h"
+#include "AU_UAV_ROS/FleetTelemetry.h"
 #include "AU_UAV_ROS/GoToWaypoint.h"
 #include "AU_UAV_ROS/RequestWaypointInfo.h"
+#include "node_composition.h"
+
+// For recording what we're given, to replay later
+#include "telemetry_recording.h"
 
 #ifndef EPSILON
 #define EPSILON 0.00000001
@@ -57,26 +75,21 @@
 
 using namespace std;
 
-//ROS service client for calling a service from the coordinator
-ros::ServiceClient client;
-ros::ServiceClient findGoal;
-
-// Global values for storing this airplane's telemetry information
-double upperLeftLon;
-double upperLeftLat;
-double lonWidth;
-double latWidth;
-double res;
-double fieldWidth;
-double fieldHeight;
+// Everything in this file is private to it, but for the entry points declared in
+// node_composition.h (and main())
+namespace
+{
 
-// Where the planes are stored
-std::map< int, Plane> planes;
+//ROS service client for calling a service from the coordinator (these call the coordinator directly
+//when it's in the same process; see node_composition.h)
+service_link< AU_UAV_ROS::GoToWaypoint > client;
+service_link< AU_UAV_ROS::RequestWaypointInfo > findGoal;
 
-#ifdef COLLISIONTESTING
-// TODO: This should be changed to a std::map to mirror the planes std::map
-vector< point > plane_locs;
-#endif
+// Our telemetry subscriptions (one update at a time, or a tick's worth at
+// once), and the planning thread (see planning_loop())
+ros::Subscriber telemetry_sub;
+ros::Subscriber fleet_telemetry_sub;
+boost::thread * planning_thread;
 
 #ifdef VISUALIZATION_OUTPUT
 // The number of files each plane has written to the visualization telemetry data
@@ -84,65 +97,630 @@ int output_indices[12];
 int planesmade;
 #endif
 
-// Keeps count of the number of callbacks received
+/**
+ * A telemetry update, decoded from its ROS message, along with when it came in.
+ * The subscriber callback makes one of these and queues it for the planning
+ * thread.
+ */
+struct telemetry_sample
+{
+  int planeID;
+  double currentLongitude;
+  double currentLatitude;
+  double currentAltitude;
+  double destLongitude;
+  double destLatitude;
+  double destAltitude;
+  double groundSpeed;
+  double targetBearing;
+  ros::WallTime received;
+  bool departed; // TRUE if this isn't an update, but word that the plane has
+                 // flown into another field (and should be forgotten here)
+};
+
+/**
+ * A plan made ahead of time, while the planning thread had nothing else to do,
+ * for where we expect a plane to be when its next update comes in (see
+ * speculate()). If the plane turns up where we expected, the plan is sent as soon
+ * as the update arrives, without waiting on A*.
+ */
+struct speculation
+{
+  bool attempted;     // TRUE once we've tried to make one for the plane's next update
+  bool valid;         // TRUE if we succeeded (and it hasn't been used up)
+  int x, y;           // the square we expect the plane to report from
+  int goal_x, goal_y; // the goal we planned to
+  ros::WallTime made;
+  vector< point > path;
+
+  speculation()
+  {
+    attempted = valid = false;
+    x = y = goal_x = goal_y = -1;
+  }
+};
+
+// The most planes the coordinator will fly at once (MAX_PLANES in coordinator.cpp)
+const unsigned int MAX_PLANES = 4096;
+
+// How many updates a field's ingest queue holds: two whole fleet telemetry ticks of
+// the largest fleet, so a tick is never dropped just because the planning thread
+// is still working through the one before it
+const unsigned int INGEST_CAPACITY = 2 * MAX_PLANES;
+
+/**
+ * Everything we know about one airfield: its geometry and grid, the planes flying
+ * in it, and their plans. Each field is planned on its own, as if it were the only
+ * one; a plane belongs to whichever field it's flying over (see route()).
+ *
+ * The ingest queue is filled by the ROS spinner thread; everything else belongs to
+ * the planning thread alone.
+ */
+struct airfield
+{
+  int index; // our place in fields (for the log)
+
+  // The field's location, size, and grid, shared by every Position in it
+  FieldGeometry field;
+
+  // Telemetry for the planes in this field, waiting to be planned on
+  spsc_ring< telemetry_sample > ingest;
+
+  // Where the planes are stored
+  std::map< int, Plane > planes;
+
+  // The planner's packed copy of the planes. Whenever a Plane in the map above
+  // changes, call fleet.set() on it so that the two stay in step. This is the
+  // working copy; planning reads versions of it published to the snapshots below.
+  fleet_table fleet;
+
+  // Published versions of the fleet. The planning thread applies a batch of
+  // telemetry updates (as many as are waiting, up to MAX_BATCH, one per plane),
+  // publishes once, then pins that version (as planning_reader) and does all of
+  // the batch's planning against it.
+  fleet_snapshots snapshots;
+  int planning_reader;
+  
+  // An update taken off the ingest queue that has to wait for the next batch,
+  // since its plane already has one in this batch
+  telemetry_sample held;
+  bool holding;
+
+  // The number of callbacks (telemetry updates) handled in this field
+  int callback_count;
+
+  // The waypoints each plane was last sent, and the corridor it should fly to follow them
+  std::map< int, flight_plan > plans;
+
+  // The number of telemetry updates each plane has sent since it was last planned
+  std::map< int, int > updates_since_plan;
+
+  // Each plane's speculative plan for its next update
+  std::map< int, speculation > speculations;
+
+  // When each plane's last update came in, and the time (s) between its last two
+  std::map< int, ros::WallTime > last_report;
+  std::map< int, double > report_interval;
+
+  // Stores the number of the callback (callback_count) each time a plane gets its
+  // location updated (Used in deciding if planes are dead during the garbage
+  // collection step)
+  std::map< int, int > last_callback_updated;
+
+  // The distance between a plane and its goal during its previous telemetry update;
+  // if this increases within a certain threshold, it indicates the aircraft is
+  // stuck in a loop
+  std::map< int, double > prev_dist;
+
+  // If aircraft is stuck in a loop (as indicated by its spot in prev_dist), this
+  // signals that it needs a "break-out" waypoint away from its goal in order to come
+  // around
+  std::map< int, bool > needs_a_push;
+
+  // Where this field's state is saved for a warm restart (see save_state())
+  planner_snapshot state_file;
+  string snapshot_path;
+  ros::WallTime last_snapshot;
+  bool restored; // TRUE if we started from the saved state
+
+#ifdef COLLISIONTESTING
+  // TODO: This should be changed to a std::map to mirror the planes std::map
+  vector< point > plane_locs;
+#endif
+
+  airfield() : ingest( INGEST_CAPACITY )
+  {
+    index = 0;
+    planning_reader = -1;
+    callback_count = 0;
+    holding = false;
+    restored = false;
+  }
+};
+
+/**
+ * A telemetry update that has been applied to its field's planes, waiting to be
+ * planned for against the batch's version of the fleet
+ */
+struct pending_update
+{
+  int planeId;
+  int startx, starty; // where the plane is
+  int endx, endy;     // where to plan to
+  double latitude, longitude, altitude;
+  double goal_latitude, goal_longitude, goal_altitude;
+  double dist_from_goal;
+  ros::WallTime received;
+};
+
+// The most updates planned against one version of a field's fleet
+const unsigned int MAX_BATCH = 64;
+
+// The airfields we plan for. A list of field.txt files (one path per line) is read
+// from FIELD_LIST_PATH; without one, we plan for the single field in FIELD_PATH.
+vector< airfield * > fields;
+const char * FIELD_LIST_PATH = "/var/fields.txt";
+const char * FIELD_PATH = "/var/field.txt";
+
+// The field each plane was last routed to (spinner thread only)
+std::map< int, int > plane_field;
+
+// Tells the planning thread to finish up
+boost::atomic< bool > stop_planning( false );
+
+// The number of updates dropped because an ingest queue was full (counted by the
+// spinner, reported by the planning thread)
+boost::atomic< int > ingest_drops( 0 );
+
+// Ingest queue statistics, kept by the planning thread and reported every
+// INGEST_STATS_PERIOD updates (in DEBUG) and at shutdown
+const int INGEST_STATS_PERIOD = 500;
+natural max_queue_depth;       // updates waiting when a batch is taken
+double total_queue_wait_ms;    // time from arriving to leaving the queue
+double total_ingest_to_plan_ms; // time from arriving to being fully handled
+double max_ingest_to_plan_ms;
+
+// Keeps count of the number of callbacks received (that is, telemetry updates
+// handled by the planning thread), in all fields
 int the_count;
 
-// Stores the number of the callback (the_count) each time a plane gets its location
-// updated (Used in deciding if planes are dead during the garbage collection step)
-std::map< int, int > last_callback_updated;
+// A speculative plan is only used if the plane reports from within this many
+// squares of where we guessed, and the plan is no older than this (s)
+const int SPECULATION_TOLERANCE = 1;
+const double SPECULATION_MAX_AGE = 2.0;
+
+// The number of speculative plans used and thrown away this run
+int speculation_hits;
+int speculation_misses;
+
+// Each field's per-plane state is saved every SNAPSHOT_PERIOD seconds, and
+// reloaded at startup if it's no more than SNAPSHOT_MAX_AGE seconds old, so that
+// a restarted node doesn't have to relearn every plane. Field 0 uses
+// SNAPSHOT_PATH; field n uses SNAPSHOT_PATH with ".n" on the end.
+const char * SNAPSHOT_PATH = "/var/collisionAvoidance.snapshot";
+const double SNAPSHOT_PERIOD = 1.0;
+const double SNAPSHOT_MAX_AGE = 10.0;
+
+// FALSE while replaying a recording, which mustn't touch the live node's state
+bool saving_state = true;
+
+// The time we give ourselves to plan (build the best cost grid and run A*) for one
+// telemetry update, in milliseconds. If planning takes any longer, we discard its
+// result and send the plane a fallback waypoint (see fallback_point()) instead, so
+// that a slow search never holds up a plane's command.
+const double PLANNING_DEADLINE_MS = 30;
+
+// The deadline actually used: PLANNING_DEADLINE_MS, unless a replay asks for
+// another (or none at all)
+double planning_budget_ms = PLANNING_DEADLINE_MS;
+
+// Where the telemetry, goals, and commands are recorded, if the record_telemetry
+// parameter names a file (planning thread only, once it's running). The planning
+// thread flushes it every RECORDING_FLUSH_PERIOD seconds.
+telemetry_recorder recorder;
+const double RECORDING_FLUSH_PERIOD = 1.0;
 
-// The distance between a plane and its goal during its previous telemetry update;
-// if this increases within a certain threshold, it indicates the aircraft is 
-// stuck in a loop 
-std::map< int, double > prev_dist;
+// The number of times planning has missed its deadline this run
+int deadline_misses;
 
-// If aircraft is stuck in a loop (as indicated by its spot in prev_dist), this 
-// signals that it needs a "break-out" waypoint away from its goal in order to come
-// around
-std::map< int, bool > needs_a_push;
+// The number of times we've planned (built a best cost grid and run A*) this run
+int plans_made;
+
+// In a replay, how long (ms) each of those plans took, kept until the replayer
+// takes them (see takeReplayPlanTimes()); a node keeps none
+bool keeping_plan_times = false;
+vector< double > plan_times_ms;
+
+// The altitude bands, read from ALTITUDE_BANDS_PATH (see altitude_bands.h), or in a
+// replay, from the recording. A plane is only planned against the planes in its
+// own band. Without the file, there's one band, and every plane is a threat to
+// every other.
+altitude_bands bands;
+const char * ALTITUDE_BANDS_PATH = "/var/altitude_bands.txt";
+
+// A plane is only replanned when its plan stops holding up (see replan_reason())
+// or, failing that, every so many updates. These control both.
+const unsigned int OFF_COURSE_TOLERANCE = 2; // squares from the corridor before a plane is off course
+const unsigned int THREAT_HORIZON = 10;      // seconds ahead to check the corridor for other planes
+const unsigned int THREAT_CLEARANCE = 2;     // squares another plane may come to the corridor
+const int NEAR_TRAFFIC_SQUARES = 15;         // another plane this close means we're in traffic
+const int NEAR_TRAFFIC_REPLAN_PERIOD = 2;    // updates between plans when in traffic
+const int FAR_REPLAN_PERIOD = 5;             // updates between plans when not
 
 /**
- * Reads a field.txt file from the /var directory. This stores the upper left point
- * of the airfield (effectively, our origin), as well as the width and length of
- * the field, in degrees latitude and longitude. It also stores the resolution used
- * in our grids.
- * 
- * TODO: Make the field locations and resolution chosen on-the-fly based on the
- *       point returned by a telemetry update and the aircraft nearby.
+ * Reads the field.txt files named in FIELD_LIST_PATH (or, if there isn't one, the
+ * one at FIELD_PATH) and sets up an airfield for each. A field.txt stores the upper
+ * left point of the airfield (effectively, its origin), as well as the width and
+ * length of the field, in degrees latitude and longitude. It also stores the
+ * resolution used in its grids.
+ */
+void makeFields();
+
+/**
+ * Picks the field a telemetry update belongs to: the first field the plane is
+ * flying over. A plane outside every field stays with the field it was last in
+ * (or, if it's new, goes to the first field).
+ * @param sample The update
+ * @param out_previous Set to the field the plane was in before, or -1 if it was
+ *                     new or hasn't moved to a different field
+ * @return the index of the plane's field
+ */
+int route( const telemetry_sample & sample, int & out_previous );
+
+/**
+ * Puts a telemetry update on its field's ingest queue for the planning thread
+ * (telling the field it left, if it has moved to another)
+ * @param sample The update
+ */
+void enqueue_telemetry( const telemetry_sample & sample );
+
+/**
+ * The records we make of what we're given and what we send (when we're
+ * recording; see telemetry_recording.h). record_field() is called for every field
+ * and record_bands() once, at startup; the others by the planning thread, as
+ * things happen.
+ */
+void record_field( const airfield & af );
+void record_bands();
+void record_sample( const airfield & af, const telemetry_sample & sample, bool batch_start );
+void record_goal( const airfield & af, int planeId, bool succeeded,
+                  const AU_UAV_ROS::RequestWaypointInfo::Response & goal );
+void record_command( const airfield & af, const AU_UAV_ROS::GoToWaypoint::Request & command,
+                     bool succeeded, bool speculative, bool fallback );
+
+/**
+ * Picks out the planes that could be a threat to a plane: those in its altitude
+ * band's layer
+ * @param fleet Every plane in the plane's field
+ * @param planeId The plane
+ * @param scratch Where to build the layer, if need be
+ * @return the plane's layer: fleet itself if there's only one band, or else scratch
  */
-void makeField();
+const fleet_table & layer_for( const fleet_table & fleet, int planeId, fleet_table & scratch );
 
 /**
  * Checks a plane's location against all others to see if there is a collision
+ * @param af The field the plane is in
  * @param id_to_check The ID of the plane that was just updated; all other planes'
  * locations will be checked against this one
  * @return TRUE if a collision occurred, FALSE if it's business as usual
  */
-bool collision_occurred( int id_to_check );
+bool collision_occurred( airfield & af, int id_to_check );
+
+/**
+ * Forgets everything a field knows about a plane
+ * @param af The field
+ * @param planeId The plane
+ */
+void forget_plane( airfield & af, int planeId );
 
 /**
- * This function does all of the interesting things in our framework. Each time a 
- * plane's location is updated, this function is called. It can command an aircraft's
- * autopilot to deviate toward some "avoidance" waypoint, or it can send it along
- * to its destination.
+ * Writes every plane's state in a field (and its callback count) to the field's
+ * snapshot file
+ */
+void save_state( airfield & af );
+
+/**
+ * Reloads a field's planes from its snapshot file, if it holds a recent snapshot
+ * taken on this field; otherwise, we start from scratch as usual. Call this after
+ * makeFields() and before planning starts.
+ * @return TRUE if the planes were restored
+ */
+bool restore_state( airfield & af );
+
+/**
+ * Decides whether a plane's current plan still holds up. It doesn't if the plane
+ * has flown all its waypoints, its goal has changed, it has strayed from its
+ * corridor, or some other plane's predicted track enters the corridor; otherwise
+ * we replan only every NEAR_TRAFFIC_REPLAN_PERIOD updates when there are other
+ * planes nearby, and every FAR_REPLAN_PERIOD updates when there aren't.
+ * @param af The plane's field
+ * @param version The fleet to check the plan against
+ * @param planeId The plane in question (already advanced along its plan)
+ * @param x, y The plane's current grid square
+ * @param goal_x, goal_y The goal we'd plan to now
+ * @return why the plane needs replanning (for the log), or NULL if it doesn't
+ */
+const char * replan_reason( airfield & af, const fleet_table & version, int planeId,
+                            int x, int y, int goal_x, int goal_y );
+
+/**
+ * Plans a plane's path (with a deadline; see PLANNING_DEADLINE_MS) and sends the
+ * first few waypoints of it to the coordinator, replacing the plane's avoidance
+ * queue. Updates the plane's stored plan and intermediate waypoint to match.
+ * @param af The plane's field
+ * @param version The fleet to plan against
+ * @param planeId The plane to plan for
+ * @param startx, starty The plane's current grid square
+ * @param endx, endy The goal to plan to
+ * @param altitude The altitude to send the plane's waypoints at
+ */
+void plan_and_send( airfield & af, const fleet_table & version, int planeId,
+                    int startx, int starty, int endx, int endy, double altitude );
+
+/**
+ * Builds the best cost grid and runs A* for a plane, giving up if the deadline
+ * passes
+ * @param af The plane's field
+ * @param version The fleet to plan against
+ * @param planeId The plane to plan for
+ * @param startx, starty The plane's grid square
+ * @param endx, endy The goal to plan to
+ * @param bearing The plane's bearing
+ * @param path Set to the waypoints to send the plane (see astar_point())
+ * @param deadline The (already started) deadline
+ * @return TRUE if planning finished in time; if not, path is meaningless
+ */
+bool run_planner( const airfield & af, const fleet_table & version, int planeId,
+                  int startx, int starty, int endx, int endy, map_tools::bearing_t bearing,
+                  vector< point > & path, const planning_deadline & deadline );
+
+/**
+ * Makes a speculative plan for the plane in a field whose next update is due
+ * soonest and that doesn't have one yet. Every plane in the field is dead reckoned
+ * (Plane::extrapolate()) to where it should be when that update arrives, and we
+ * plan from there.
+ * @param af The field
+ * @return TRUE if there was a plane to plan for, FALSE if there was nothing to do
+ */
+bool speculate( airfield & af );
+
+/**
+ * Uses up a plane's speculative plan, if it has one, and checks whether it can
+ * stand in for planning now: the plane has to be within SPECULATION_TOLERANCE
+ * squares of where we guessed, the goal has to be the same, the plan has to be
+ * recent enough, and its corridor must be clear of threats in the current fleet.
+ * @param af The plane's field
+ * @param version The current fleet
+ * @param planeId The plane that just reported
+ * @param startx, starty The plane's actual grid square
+ * @param endx, endy The goal we'd plan to now
+ * @param path Set to the speculative plan, if it's usable
+ * @return TRUE if the speculative plan is usable
+ */
+bool take_speculation( airfield & af, const fleet_table & version, int planeId,
+                       int startx, int starty, int endx, int endy, vector< point > & path );
+
+/**
+ * Handles a batch of telemetry updates for a field, at most one per plane: applies
+ * them all to the field's planes, publishes the fleet once, and plans for each
+ * plane against that version
+ * @param af The field the updates were routed to
+ * @param batch The updates, in the order they came in
+ */
+void handle_batch( airfield & af, const vector< telemetry_sample > & batch );
+
+/**
+ * Applies one telemetry update to a field's planes: asks the coordinator for the
+ * plane's goal and updates everything we know about the plane (or, for a
+ * departure, forgets it)
+ * @param af The field the update was routed to
+ * @param sample The update
+ * @param out_update Set to what to plan for, if anything (all but where to plan
+ *                   from and to; see set_endpoints())
+ * @return TRUE if the plane needs planning for
+ */
+bool apply_telemetry( airfield & af, const telemetry_sample & sample, pending_update & out_update );
+
+/**
+ * Decides where to plan an applied update from and to: the plane's goal, or a
+ * "break-out" waypoint if it's stuck circling its goal
+ * @param af The plane's field
+ * @param update The update, as applied, with its dist_from_goal filled in
+ */
+void set_endpoints( airfield & af, pending_update & update );
+
+/**
+ * Plans for one applied update: replans the plane if its plan no longer holds up,
+ * and takes care of the field's bookkeeping
+ * @param af The plane's field
+ * @param version The batch's version of the fleet
+ * @param update The update, as applied
+ */
+void plan_update( airfield & af, const fleet_table & version, const pending_update & update );
+
+/**
+ * Prints the ingest queue statistics gathered so far
+ */
+void report_ingest_stats();
+
+/**
+ * The planning thread. Takes telemetry off the fields' ingest queues and handles
+ * it, a batch at a time (see handle_batch()), until stop_planning is set. The
+ * fields take turns, a batch apiece, so that a busy field can't hold up the others.
+ */
+void planning_loop();
+
+/**
+ * Called by ROS each time a plane's telemetry comes in. All it does is copy the
+ * update onto its field's ingest queue for the planning thread, so the spinner
+ * never waits on planning.
  * 
  * @param msg The telemetry "message" sent in by the ROS framework
  */
 void telemetryCallback(const AU_UAV_ROS::TelemetryUpdate::ConstPtr& msg)
 {
+  telemetry_sample sample;
+  sample.planeID = msg->planeID;
+  sample.currentLongitude = msg->currentLongitude;
+  sample.currentLatitude = msg->currentLatitude;
+  sample.currentAltitude = msg->currentAltitude;
+  sample.destLongitude = msg->destLongitude;
+  sample.destLatitude = msg->destLatitude;
+  sample.destAltitude = msg->destAltitude;
+  sample.groundSpeed = msg->groundSpeed;
+  sample.targetBearing = msg->targetBearing;
+  sample.received = ros::WallTime::now();
+  sample.departed = false;
+  
+  enqueue_telemetry( sample );
+}
+
+/**
+ * Called by ROS when the simulator sends a whole tick's telemetry in one message.
+ * Queues each plane's update, just as telemetryCallback() would.
+ * 
+ * @param msg Every simulated plane's telemetry for the tick
+ */
+void fleetTelemetryCallback(const AU_UAV_ROS::FleetTelemetry::ConstPtr& msg)
+{
+  telemetry_sample sample;
+  sample.received = ros::WallTime::now();
+  sample.departed = false;
+  
+  for( unsigned int i = 0; i < msg->planeIDs.size(); i++ )
+  {
+    sample.planeID = msg->planeIDs[ i ];
+    sample.currentLongitude = msg->currentLongitudes[ i ];
+    sample.currentLatitude = msg->currentLatitudes[ i ];
+    sample.currentAltitude = msg->currentAltitudes[ i ];
+    sample.destLongitude = msg->destLongitudes[ i ];
+    sample.destLatitude = msg->destLatitudes[ i ];
+    sample.destAltitude = msg->destAltitudes[ i ];
+    sample.groundSpeed = msg->groundSpeeds[ i ];
+    sample.targetBearing = msg->targetBearings[ i ];
+    enqueue_telemetry( sample );
+  }
+}
+
+void enqueue_telemetry( const telemetry_sample & sample )
+{
+  int previous;
+  airfield & af = *fields[ route( sample, previous ) ];
+  
+  // If it has crossed into another field, the field it left should forget it
+  if( previous != -1 )
+  {
+    telemetry_sample departure = sample;
+    departure.departed = true;
+    if( !fields[ previous ]->ingest.push( departure ) )
+      ingest_drops++;
+  }
+  
+  if( !af.ingest.push( sample ) )
+  {
+    int drops = ++ingest_drops;
+    ALOG_WARN_THROTTLE( 1.0, "Ingest queue for field %d is full (%u updates); dropped an update from plane %d (%d dropped so far)",
+                        af.index, af.ingest.capacity(), sample.planeID, drops );
+  }
+}
+
+int route( const telemetry_sample & sample, int & out_previous )
+{
+  out_previous = -1;
+  
+  map< int, int >::iterator last = plane_field.find( sample.planeID );
+  int chosen = ( last == plane_field.end() ) ? 0 : (*last).second;
+  for( unsigned int i = 0; i < fields.size(); i++ )
+  {
+    if( fields[ i ]->field.contains( sample.currentLatitude, sample.currentLongitude ) )
+    {
+      chosen = i;
+      break;
+    }
+  }
+  
+  if( last != plane_field.end() && (*last).second != chosen )
+  {
+    out_previous = (*last).second;
+    ALOG_INFO( "Plane %d has flown from field %d into field %d",
+               sample.planeID, out_previous, chosen );
+  }
+  plane_field[ sample.planeID ] = chosen;
+  return chosen;
+}
+
+/**
+ * This function does all of the interesting things in our framework. Each time 
+ * planes' locations are updated, this function is called (on the planning thread).
+ * It can command an aircraft's autopilot to deviate toward some "avoidance" 
+ * waypoint, or it can send it along to its destination.
+ */
+void handle_batch( airfield & af, const vector< telemetry_sample > & batch )
+{
+  vector< pending_update > pending;
+  pending.reserve( batch.size() );
+  for( unsigned int i = 0; i < batch.size(); i++ )
+  {
+    record_sample( af, batch[ i ], i == 0 );
+    
+    pending_update update;
+    if( apply_telemetry( af, batch[ i ], update ) )
+      pending.push_back( update );
+  }
+  if( pending.empty() )
+    return;
+  
+  // Every plane's distance from its goal, in one go
+  size_t n = pending.size();
+  vector< double > latitudes( n ), longitudes( n ), goal_latitudes( n ), goal_longitudes( n );
+  vector< double > distances( n );
+  for( size_t i = 0; i < n; i++ )
+  {
+    latitudes[ i ] = pending[ i ].latitude;
+    longitudes[ i ] = pending[ i ].longitude;
+    goal_latitudes[ i ] = pending[ i ].goal_latitude;
+    goal_longitudes[ i ] = pending[ i ].goal_longitude;
+  }
+  map_tools::calculate_distances_between_points( &goal_latitudes[ 0 ], &goal_longitudes[ 0 ],
+                                                 &latitudes[ 0 ], &longitudes[ 0 ], n,
+                                                 &distances[ 0 ], map_tools::METERS );
+  for( size_t i = 0; i < n; i++ )
+  {
+    pending[ i ].dist_from_goal = distances[ i ];
+    set_endpoints( af, pending[ i ] );
+  }
+  
+  // Everything below reads this one version of the fleet
+  af.snapshots.publish( af.fleet );
+  const fleet_version * version = af.snapshots.pin( af.planning_reader );
+  for( unsigned int i = 0; i < pending.size(); i++ )
+    plan_update( af, version->fleet, pending[ i ] );
+  af.snapshots.unpin( af.planning_reader );
+}
+
+bool apply_telemetry( airfield & af, const telemetry_sample & sample, pending_update & out_update )
+{
+  if( sample.departed )
+  {
+    forget_plane( af, sample.planeID );
+    return false;
+  }
+  
   the_count++;
+  af.callback_count++;
   
-  // Store the information from the message in local variables
+  // Store the information from the update in local variables
   // (only to limit indirection)
-  int planeId = msg->planeID;
-  double currentLon = msg->currentLongitude;
-  double currentLat = msg->currentLatitude;
-  double currentAlt = msg->currentAltitude;
-  double destLon = msg->destLongitude;
-  double destLat = msg->destLatitude;
-  double destAlt = msg->destAltitude;
-  double gSpeed = msg->groundSpeed;
-  double bearing = msg->targetBearing;
+  int planeId = sample.planeID;
+  double currentLon = sample.currentLongitude;
+  double currentLat = sample.currentLatitude;
+  double currentAlt = sample.currentAltitude;
+  double destLon = sample.destLongitude;
+  double destLat = sample.destLatitude;
+  double destAlt = sample.destAltitude;
+  double gSpeed = sample.groundSpeed;
+  double bearing = sample.targetBearing;
   
 #ifdef DEBUG
   if( planeId < 0 )
@@ -160,15 +738,15 @@ void telemetryCallback(const AU_UAV_ROS::TelemetryUpdate::ConstPtr& msg)
   goalSrv.request.positionInQueue = 0;
   
   // Ask the coordinator nicely
-  if( !findGoal.call(goalSrv) )
+  bool found_goal = findGoal.call(goalSrv);
+  if( !found_goal )
     ROS_ERROR("No goal was returned");
+  record_goal( af, planeId, found_goal, goalSrv.response );
   
-#ifdef DEBUG
-  ROS_INFO("The goal of plane %d returned was %f,%f",
-           planeId,goalSrv.response.longitude, goalSrv.response.latitude);
-  ROS_INFO("The current location of plane %d is %f,%f",
-           planeId, currentLon, currentLat);
-#endif
+  ALOG_DEBUG("The goal of plane %d returned was %f,%f",
+             planeId,goalSrv.response.longitude, goalSrv.response.latitude);
+  ALOG_DEBUG("The current location of plane %d is %f,%f",
+             planeId, currentLon, currentLat);
   
   // If this is not a dummy update . . .
   if( !(goalSrv.response.latitude < -900 && goalSrv.response.longitude < -900) &&
@@ -214,207 +792,587 @@ void telemetryCallback(const AU_UAV_ROS::TelemetryUpdate::ConstPtr& msg)
 #endif
     
     // Prepare to update the plane's current location
-    Position current = Position(upperLeftLon,upperLeftLat,lonWidth,latWidth,currentLon,currentLat,res);
+    Position current = Position( &af.field, currentLon, currentLat );
     
 #ifdef COLLISIONTESTING
     // If this plane ID is not in the list of plane locations, increase the size of 
     // the vector to accomodate it
-    while( planeId >= (int)plane_locs.size() )
+    while( planeId >= (int)af.plane_locs.size() )
     {
       point dummy;
       dummy.x = -1;
       dummy.y = -1;
       dummy.t = -1;
-      plane_locs.push_back( dummy );
+      af.plane_locs.push_back( dummy );
     }
     
     // store the current plane's current location in the vector
-    plane_locs[ planeId ].x = current.getX();
-    plane_locs[ planeId ].y = current.getY();
-    plane_locs[ planeId ].t = 0;
+    af.plane_locs[ planeId ].x = current.getX();
+    af.plane_locs[ planeId ].y = current.getY();
+    af.plane_locs[ planeId ].t = 0;
     
     // If a collision occured, don't die, just print
-    if( collision_occurred( planeId ) )
+    if( collision_occurred( af, planeId ) )
       ROS_ERROR( " You've made a mistake, Sir." );
 #endif
     
     // If it's a new plane . . .
-    if( planes.find(planeId) == planes.end() )
+    if( af.planes.find(planeId) == af.planes.end() )
     {
       // . . . give it an initial destination obtained through the telemetry update
-      Position next = Position( upperLeftLon, upperLeftLat, lonWidth, latWidth, 
-                                destLon, destLat, res);
+      Position next = Position( &af.field, destLon, destLat );
       
       // Create and store the plane object
-      planes[ planeId ] = Plane( planeId, current, next );
+      af.planes[ planeId ] = Plane( planeId, current, next );
       
       // Create a spot for this plane in the list of planes which need a "push"
       // away from their goal
-      needs_a_push[ planeId ] = false;
+      af.needs_a_push[ planeId ] = false;
     }
     else // it's an old plane, so . . .
     {
       // we need only update its current location with info from the telemetry update
-      planes[ planeId ].update_current( current );
+      af.planes[ planeId ].update_current( current, gSpeed );
+    }
+    af.planes[ planeId ].setAltitude( currentAlt );
+    
+    // Note how long it has been since the plane's last update, so that we know
+    // how far ahead to dead reckon it
+    if( af.last_report.find( planeId ) != af.last_report.end() )
+    {
+      double interval = ( sample.received - af.last_report[ planeId ] ).toSec();
+      af.report_interval[ planeId ] = interval < 0.2 ? 0.2 : ( interval > 5 ? 5 : interval );
     }
+    else
+      af.report_interval[ planeId ] = 1.0;
+    af.last_report[ planeId ] = sample.received;
     
     // Make a note that this plane got a callback
-    last_callback_updated[ planeId ] = the_count;
+    af.last_callback_updated[ planeId ] = af.callback_count;
     
     // Set the plane's final destination based on what the goal service told us
-    planes[ planeId ].setFinalDestination( goalSrv.response.longitude, 
+    af.planes[ planeId ].setFinalDestination( goalSrv.response.longitude, 
                                            goalSrv.response.latitude);
-#ifdef DEBUG
-    ROS_INFO("You set plane %d's final destination to: %f,%f", 
-             planeId, goalSrv.response.longitude, goalSrv.response.latitude);
-#endif
+    ALOG_DEBUG("You set plane %d's final destination to: %f,%f", 
+               planeId, goalSrv.response.longitude, goalSrv.response.latitude);
+    
+    out_update.planeId = planeId;
+    out_update.latitude = current.getLat();
+    out_update.longitude = current.getLon();
+    out_update.altitude = currentAlt;
+    out_update.goal_latitude = goalSrv.response.latitude;
+    out_update.goal_longitude = goalSrv.response.longitude;
+    out_update.goal_altitude = goalSrv.response.altitude;
+    out_update.received = sample.received;
+    return true;
+  } // end if this is an okay goal
+  
+  // Bad goals are normal in the first couple rounds of updates
+  ROS_ERROR("Either you had a dest. lat-lon of (0, 0) or you had a bad goal returned: %f, %f",
+            goalSrv.response.latitude, goalSrv.response.longitude);
+  return false;
+}
+
+void set_endpoints( airfield & af, pending_update & update )
+{
+  int planeId = update.planeId;
+  double dist_from_goal = update.dist_from_goal;
+  
+  // If the plane is in a loop, give it a fake "break-out" goal
+  if( dist_from_goal < 45 && af.prev_dist[ planeId ] < dist_from_goal )
+  {
+    // "Break-out" goal is 75 meters in opposite direction of the plane's
+    // bearing to the real destination
+    bearing_t bearing_to_break_out =
+      map_tools::reverse_bearing( af.planes[ planeId ].get_named_bearing_to_dest() );
     
-    double dist_from_goal =
-      map_tools::calculate_distance_between_points( goalSrv.response.latitude, 
-                                                    goalSrv.response.longitude,
-                                                    current.getLat(), current.getLon(),
-                                                    "meters" );
+    double break_out_lat, break_out_lon;
+    map_tools::calculate_point( update.goal_latitude, update.goal_longitude,
+                                75, map_tools::bearing_to_double( bearing_to_break_out ),
+                                break_out_lat, break_out_lon );
     
-    // If the plane is in a loop, give it a fake "break-out" goal
-    if( dist_from_goal < 45 && prev_dist[ planeId ] < dist_from_goal )
+    // A goal near the edge of the field can put the break-out goal off of it,
+    // where there's no grid to plan on; such a plane just keeps circling
+    if( af.field.contains( break_out_lat, break_out_lon ) )
     {
-      // "Break-out" goal is 75 meters in opposite direction of the plane's
-      // bearing to the real destination
-      bearing_t bearing_to_break_out =
-        map_tools::reverse_bearing( planes[ planeId ].get_named_bearing_to_dest() );
-      
-      double break_out_lat, break_out_lon;
-      map_tools::calculate_point( goalSrv.response.latitude, goalSrv.response.longitude,
-                                  75, map_tools::bearing_to_double( bearing_to_break_out ),
-                                  break_out_lat, break_out_lon );
-      
       // Set the plane's INTERMEDIATE destination to a break-out waypoint
-      planes[ planeId ].setDestination( break_out_lon, break_out_lat );
-            
-      needs_a_push[ planeId ] = true;
+      af.planes[ planeId ].setDestination( break_out_lon, break_out_lat );
       
-#ifdef DEBUG
-      ROS_INFO( "Set plane %d's breakout waypoint to %f, %f", planeId, break_out_lon, break_out_lat );
-      ROS_INFO( "Plane %d had a bearing of %f ", planeId, planes[ planeId ].getBearing() );
-#endif
-    }
-    
-    // Grab stuff for A*
-    int startx = planes[planeId].getLocation().getX();
-    int starty = planes[planeId].getLocation().getY();
-    int endx = planes[planeId].getFinalDestination().getX();
-    int endy = planes[planeId].getFinalDestination().getY();
-    map_tools::bearing_t bearingNamed = planes[ planeId ].get_named_bearing();
-    
-    if( needs_a_push[ planeId ] ) // have A* solve to its intermediate waypoint, NOT
-    {                            // to the final destination as usual
-      endx = planes[ planeId ].getDestination().getX();
-      endy = planes[ planeId ].getDestination().getY();
+      af.needs_a_push[ planeId ] = true;
       
-      needs_a_push[ planeId ] = false;
+      ALOG_DEBUG( "Set plane %d's breakout waypoint to %f, %f", planeId, break_out_lon, break_out_lat );
+      ALOG_DEBUG( "Plane %d had a bearing of %f ", planeId, af.planes[ planeId ].getBearing() );
     }
+  }
+  
+  // Grab stuff for A*
+  update.startx = af.planes[planeId].getLocation().getX();
+  update.starty = af.planes[planeId].getLocation().getY();
+  update.endx = af.planes[planeId].getFinalDestination().getX();
+  update.endy = af.planes[planeId].getFinalDestination().getY();
+  
+  if( af.needs_a_push[ planeId ] ) // have A* solve to its intermediate waypoint, NOT
+  {                            // to the final destination as usual
+    update.endx = af.planes[ planeId ].getDestination().getX();
+    update.endy = af.planes[ planeId ].getDestination().getY();
     
-    // Begin A*ing
-    best_cost bc = best_cost( &planes, fieldWidth, fieldHeight, res, planeId);
-    
-    point commanded_pt;
-    commanded_pt = astar_point( &bc, startx, starty, endx, endy, planeId,
-                                bearingNamed, &planes );
-    // Prepare to send the plane to the commanded point
-    Position aStar( upperLeftLon, upperLeftLat, lonWidth, latWidth,
-                   commanded_pt.x, commanded_pt.y, res);
-    
-#ifdef DEBUG
-    ROS_INFO("A* says for plane %d to go here: \033[22;32m\nx: %d\ny: %d", 
-             planeId, commanded_pt.x, commanded_pt.y);
-    ROS_INFO("From here:\nx: %d\ny: %d", startx, starty);
-#endif
-    
-    // Set up the service to command a plane to go to a location
-    AU_UAV_ROS::GoToWaypoint srv;
-    
-    srv.request.planeID = planeId;
-    srv.request.longitude = aStar.getLon();
-    srv.request.latitude = aStar.getLat();
-    srv.request.altitude = goalSrv.response.altitude; // Don't change altitude
-    
-    // The point we're sending is an avoidance maneuver waypoint AND
-    // it will clear the avoidance queue
-    srv.request.isAvoidanceManeuver = true;
-    srv.request.isNewQueue = true;
-    
-    // Send the command! If the command isn't received, let the user know.
-    if( !client.call(srv) )
-      ROS_ERROR("Service failed to go through!");
-    
-    // Update the plane object
-    planes[planeId].update_intermediate_wp( aStar );
+    af.needs_a_push[ planeId ] = false;
+  }
+  
+  // Keep the planner's copy of the plane up to date (published with the rest
+  // of the batch)
+  af.fleet.set( af.planes[ planeId ] );
+}
+
+void plan_update( airfield & af, const fleet_table & version, const pending_update & update )
+{
+  int planeId = update.planeId;
+  int startx = update.startx, starty = update.starty;
+  int endx = update.endx, endy = update.endy;
+  
+  // Only the planes in this plane's altitude band matter to it
+  fleet_table layer;
+  const fleet_table & threats = layer_for( version, planeId, layer );
+  
+  // See if the plane's plan still holds
+  af.plans[ planeId ].advance( startx, starty );
+  af.updates_since_plan[ planeId ]++;
+  
+  const char * reason = replan_reason( af, threats, planeId, startx, starty, endx, endy );
+  if( reason != NULL )
+  {
+    ALOG_DEBUG( "Replanning plane %d in field %d, band %u (%u planes in its layer): %s",
+                planeId, af.index, bands.band_of( update.altitude ),
+                (unsigned int)threats.size(), reason );
+    plan_and_send( af, threats, planeId, startx, starty, endx, endy, update.goal_altitude );
+  }
+  else
+  {
+    // Still on plan; the coordinator has its remaining waypoints queued, so all
+    // we do is keep the plane's intermediate waypoint in step with them
+    const coord & next_wp = af.plans[ planeId ].next_waypoint();
+    af.planes[ planeId ].update_intermediate_wp( Position( &af.field, (int)next_wp.x, (int)next_wp.y ) );
+    af.fleet.set( af.planes[ planeId ] );
+  }
+  
+  // Whatever we speculated for this update has been used up; the next one can
+  // be planned for now
+  af.speculations[ planeId ] = speculation();
+  
+  if( saving_state && ( update.received - af.last_snapshot ).toSec() >= SNAPSHOT_PERIOD )
+  {
+    save_state( af );
+    af.last_snapshot = update.received;
+  }
+  
+  // Make a note of where the plane is now for the sake of checking next time 
+  // if it's in a loop
+  af.prev_dist[ planeId ] = update.dist_from_goal;
+  
+  // Garbage collection (delete dead planes)
+  vector< int > delete_these_keys;
+  for( map< int, Plane >::iterator crnt_plane = af.planes.begin(); 
+      crnt_plane != af.planes.end(); ++crnt_plane )
+  {
+    int crnt_id = (*crnt_plane).second.getId();
     
-    // Make a note of where the plane is now for the sake of checking next time 
-    // if it's in a loop
-    prev_dist[ planeId ] = dist_from_goal;
+    if( af.last_callback_updated[ crnt_id ] < (af.callback_count - (3 * af.planes.size()) ) &&
+       af.callback_count > 30 && crnt_id >= 0 )
+    {
+      // Current plane hasn't been updated in the last 3 rounds of callbacks.
+      // This *probably* means it's dead.
+      delete_these_keys.push_back( crnt_id );
+    }
+  }
+  for( vector< int >::iterator key = delete_these_keys.begin(); key != delete_these_keys.end();
+      ++key )
+  {
+    forget_plane( af, (*key) );
+    ROS_ERROR(" Deleting plane %d", (*key) );
+  }    
+  
+  ALOG_DEBUG( "End of callback" );
+}
+
+void planning_loop()
+{
+  for( unsigned int i = 0; i < fields.size(); i++ )
+    fields[ i ]->planning_reader = fields[ i ]->snapshots.register_reader();
+  
+  vector< telemetry_sample > batch;
+  batch.reserve( MAX_BATCH );
+  std::set< int > batched; // the planes with an update in the batch
+  telemetry_sample sample;
+  unsigned int turn = 0; // the field whose turn it is
+  ros::WallTime last_flush = ros::WallTime::now();
+  while( !stop_planning.load() )
+  {
+    if( recorder.is_open() && ( ros::WallTime::now() - last_flush ).toSec() >= RECORDING_FLUSH_PERIOD )
+    {
+      if( !recorder.flush() )
+        ALOG_ERROR_THROTTLE( 10.0, "The telemetry recording couldn't all be written" );
+      last_flush = ros::WallTime::now();
+    }
     
-    // Garbage collection (delete dead planes)
-    vector< int > delete_these_keys;
-    for( map< int, Plane >::iterator crnt_plane = planes.begin(); 
-        crnt_plane != planes.end(); ++crnt_plane )
+    // Give each field in turn the chance to handle a batch: whatever is waiting,
+    // up to the first repeat of a plane (which waits for the next batch)
+    bool handled_any = false;
+    for( unsigned int i = 0; i < fields.size(); i++ )
     {
-      int crnt_id = (*crnt_plane).second.getId();
+      airfield & af = *fields[ ( turn + i ) % fields.size() ];
+      batch.clear();
+      batched.clear();
       
-      if( last_callback_updated[ crnt_id ] < (the_count - (3 * planes.size()) ) &&
-         the_count > 30 && crnt_id >= 0 )
+      natural depth = af.ingest.size() + ( af.holding ? 1 : 0 );
+      if( depth > max_queue_depth )
+        max_queue_depth = depth;
+      
+      while( batch.size() < MAX_BATCH )
+      {
+        if( af.holding )
+        {
+          sample = af.held;
+          af.holding = false;
+        }
+        else if( !af.ingest.pop( sample ) )
+          break;
+        
+        if( !batched.insert( sample.planeID ).second )
+        {
+          af.held = sample;
+          af.holding = true;
+          break;
+        }
+        batch.push_back( sample );
+        total_queue_wait_ms += ( ros::WallTime::now() - sample.received ).toSec() * 1000;
+      }
+      if( batch.empty() )
+        continue;
+      handled_any = true;
+      
+      int count_before = the_count;
+      handle_batch( af, batch );
+      
+      ros::WallTime done = ros::WallTime::now();
+      for( unsigned int b = 0; b < batch.size(); b++ )
       {
-        // Current plane hasn't been updated in the last 3 rounds of callbacks.
-        // This *probably* means it's dead.
-        delete_these_keys.push_back( crnt_id );
+        double ingest_to_plan_ms = ( done - batch[ b ].received ).toSec() * 1000;
+        total_ingest_to_plan_ms += ingest_to_plan_ms;
+        if( ingest_to_plan_ms > max_ingest_to_plan_ms )
+          max_ingest_to_plan_ms = ingest_to_plan_ms;
       }
+      
+#ifdef DEBUG
+      if( the_count / INGEST_STATS_PERIOD != count_before / INGEST_STATS_PERIOD )
+        report_ingest_stats();
+#else
+      (void)count_before;
+#endif
     }
-    for( vector< int >::iterator key = delete_these_keys.begin(); key != delete_these_keys.end();
-        ++key )
+    turn = ( turn + 1 ) % fields.size();
+    
+    if( !handled_any )
     {
-      planes.erase( (*key) );
-      ROS_ERROR(" Deleting plane %d", (*key) );
-    }    
-  } // end if this is an okay goal
-  else // Bad goals are normal in the first couple rounds of updates
-  {
-    ROS_ERROR("Either you had a dest. lat-lon of (0, 0) or you had a bad goal returned: %f, %f",
-              goalSrv.response.latitude, goalSrv.response.longitude);
+      // Nothing to do, so get a head start on the next updates; if there's nothing
+      // to do there either, check back in a millisecond
+      bool speculated = false;
+      for( unsigned int i = 0; i < fields.size() && !speculated; i++ )
+        speculated = speculate( *fields[ ( turn + i ) % fields.size() ] );
+      if( !speculated )
+        boost::this_thread::sleep( boost::posix_time::milliseconds( 1 ) );
+    }
   }
   
-  ROS_INFO ("End of callback \n" );
+  for( unsigned int i = 0; i < fields.size(); i++ )
+    fields[ i ]->snapshots.unregister_reader( fields[ i ]->planning_reader );
+}
+
+void report_ingest_stats()
+{
+  if( the_count == 0 )
+    return;
+  
+  ROS_INFO( "Ingest: %d updates handled, %d dropped; queue depth max %u; "
+            "mean wait %.2f ms; ingest-to-plan mean %.2f ms, max %.2f ms",
+            the_count, ingest_drops.load(), max_queue_depth, total_queue_wait_ms / the_count,
+            total_ingest_to_plan_ms / the_count, max_ingest_to_plan_ms );
 }
 
+} // namespace
+
 /**
- * This method is only called once by the ROS framework; after initializing all
- * planes, it calls only the telemetry update callback
+ * Sets collision avoidance up on a node handle: subscribes to telemetry, connects
+ * to the coordinator's services, loads the fields and any saved state, and starts
+ * the planning thread. The caller does the spinning, then calls
+ * stopCollisionAvoidance().
+ * 
+ * @param n The node handle (ours alone, or shared with the other nodes)
  */
-int main(int argc, char **argv)
+void startCollisionAvoidance( ros::NodeHandle & n )
 {
   the_count = 0;
+  deadline_misses = 0;
+  plans_made = 0;
+  speculation_hits = speculation_misses = 0;
+  ingest_drops = 0;
+  max_queue_depth = 0;
+  total_queue_wait_ms = total_ingest_to_plan_ms = max_ingest_to_plan_ms = 0;
   
-  //standard ROS startup
-  ros::init(argc, argv, "collisionAvoidance");
-  ros::NodeHandle n;
-  
-  //setup the required data for our stuff
-  
+  // How much the hot paths log: debug, info (the default), warn, or error
+  ros::NodeHandle private_node( "~" );
+  string log_level;
+  private_node.param( "log_level", log_level, string( "info" ) );
+  if( !async_log::instance().set_level( log_level ) )
+    ROS_WARN( "Unknown log_level \"%s\"; logging at info", log_level.c_str() );
   
   //subscribe to telemetry outputs and create client for the avoid collision service and the goal giving service
-  ros::Subscriber sub = n.subscribe("telemetry", 1000, telemetryCallback);
-  client = n.serviceClient<AU_UAV_ROS::GoToWaypoint>("go_to_waypoint");
-  findGoal = n.serviceClient<AU_UAV_ROS::RequestWaypointInfo>("request_waypoint_info");
+  telemetry_sub = n.subscribe("telemetry", 1000, telemetryCallback);
+  fleet_telemetry_sub = n.subscribe("fleet_telemetry", 10, fleetTelemetryCallback);
+  client.connect( n, "go_to_waypoint" );
+  findGoal.connect( n, "request_waypoint_info" );
+  if( client.is_direct() )
+    ROS_INFO( "Sharing a process with the coordinator; calling its services directly" );
   
   //initialize counting
   the_count = 0;
   
-  makeField();
+  makeFields();
+  
+  if( bands.load( ALTITUDE_BANDS_PATH ) )
+    ROS_INFO( "Planning in %u altitude bands", bands.count() );
+  
+  // Split building each danger grid across the cores (see danger_grid_with_turns.h)
+  danger_tile_workers = boost::thread::hardware_concurrency();
+  if( danger_tile_workers < 1 )
+    danger_tile_workers = 1;
+  
+  for( unsigned int i = 0; i < fields.size(); i++ )
+  {
+    airfield & af = *fields[ i ];
+    if( af.state_file.open( af.snapshot_path ) )
+      af.restored = restore_state( af );
+    else
+      ROS_WARN( "Cannot open %s; field %d's planner state won't survive a restart",
+                af.snapshot_path.c_str(), af.index );
+    af.last_snapshot = ros::WallTime::now();
+  }
+  
+  // Record everything we're given, if asked to, so that this run can be replayed
+  // (see telemetryReplay.cpp)
+  string record_path;
+  private_node.param( "record_telemetry", record_path, string() );
+  if( !record_path.empty() )
+  {
+    if( recorder.open( record_path ) )
+    {
+      for( unsigned int i = 0; i < fields.size(); i++ )
+        record_field( *fields[ i ] );
+      record_bands();
+      ROS_INFO( "Recording telemetry to %s", record_path.c_str() );
+    }
+    else
+      ROS_ERROR( "Cannot open %s to record telemetry", record_path.c_str() );
+  }
+  
+  // Planning happens on its own thread; the spinner only queues telemetry for it
+  planning_thread = new boost::thread( planning_loop );
+}
+
+/**
+ * Stops the planning thread, reports how planning went, and frees the fields
+ */
+void stopCollisionAvoidance()
+{
+  stop_planning.store( true );
+  planning_thread->join();
+  delete planning_thread;
+  
+  ROS_INFO( "Planned %d times in %d callbacks; missed the %.0f ms deadline %d times",
+            plans_made, the_count, planning_budget_ms, deadline_misses );
+  ROS_INFO( "Speculative plans: %d used, %d thrown away", speculation_hits, speculation_misses );
+  report_ingest_stats();
+  
+  if( recorder.is_open() )
+  {
+    natural records = recorder.count();
+    if( recorder.close() )
+      ROS_INFO( "Recorded %u records", records );
+    else
+      ROS_ERROR( "The telemetry recording couldn't all be written" );
+  }
+  
+  for( unsigned int i = 0; i < fields.size(); i++ )
+    delete fields[ i ];
+}
+
+/**
+ * Sets collision avoidance up to replay a recording (see node_composition.h): it
+ * plans in the recorded fields and altitude bands, calling the services given to
+ * serve_locally(), with no subscriptions, no planning thread (so no speculative
+ * plans), and no saved state. Call replayTelemetry() on each recorded batch of
+ * updates, in order.
+ * 
+ * @param records The recording
+ * @param deadline_ms The planning deadline to use (see PLANNING_DEADLINE_MS); zero
+ *                    for none
+ * @param tile_workers The threads to fill danger grids with (see
+ *                     danger_tile_workers); zero for one per core
+ * @return FALSE if there are no stand-ins for the coordinator's services
+ */
+bool startCollisionAvoidanceReplay( const vector< telemetry_record > & records, double deadline_ms,
+                                    unsigned int tile_workers )
+{
+  the_count = 0;
+  deadline_misses = 0;
+  plans_made = 0;
+  speculation_hits = speculation_misses = 0;
+  planning_budget_ms = deadline_ms;
+  saving_state = false;
+  keeping_plan_times = true;
+  plan_times_ms.clear();
+  
+  if( !client.connect_local( "go_to_waypoint" ) || !findGoal.connect_local( "request_waypoint_info" ) )
+  {
+    ROS_ERROR( "Replaying needs stand-ins for go_to_waypoint and request_waypoint_info" );
+    return false;
+  }
+  
+  vector< double > boundaries;
+  double margin = 0;
+  for( unsigned int i = 0; i < records.size(); i++ )
+  {
+    const telemetry_record & r = records[ i ];
+    if( r.kind == telemetry_record::BANDS )
+    {
+      margin = r.values[ 0 ];
+      for( int b = 0; b < r.plane_id; b++ )
+        boundaries.push_back( r.values[ 1 + b ] );
+      continue;
+    }
+    if( r.kind != telemetry_record::FIELD )
+      continue;
+    
+    // (A field we couldn't load was recorded with no size, and stays uninitialized)
+    airfield * af = new airfield();
+    if( r.values[ 4 ] > 0 )
+      af->field.set_up( r.values[ 0 ], r.values[ 1 ], r.values[ 2 ], r.values[ 3 ], r.values[ 4 ] );
+    af->index = fields.size();
+    af->restored = ( r.flags & telemetry_record::RESTORED ) != 0;
+    if( af->restored )
+      ROS_WARN( "Field %d was recorded starting from saved planner state, which replays start without",
+                af->index );
+    fields.push_back( af );
+  }
+  if( fields.empty() )
+    fields.push_back( new airfield() );
+  ROS_INFO( "Replaying in %u field(s)", (unsigned int)fields.size() );
+  
+  bands.set_up( boundaries, margin );
+  ROS_INFO( "Planning in %u altitude bands", bands.count() );
+  
+  danger_tile_workers = tile_workers > 0 ? tile_workers : boost::thread::hardware_concurrency();
+  if( danger_tile_workers < 1 )
+    danger_tile_workers = 1;
+  
+  for( unsigned int i = 0; i < fields.size(); i++ )
+    fields[ i ]->planning_reader = fields[ i ]->snapshots.register_reader();
+  return true;
+}
+
+/**
+ * Handles one recorded batch of telemetry updates, just as the planning thread
+ * handled it
+ * @param batch The batch's TELEMETRY records, all from one field (anything else is
+ *              skipped)
+ * @return how long handling it took (ms)
+ */
+double replayTelemetry( const vector< telemetry_record > & batch )
+{
+  vector< telemetry_sample > samples;
+  int field = -1;
+  for( unsigned int i = 0; i < batch.size(); i++ )
+  {
+    const telemetry_record & record = batch[ i ];
+    if( record.kind != telemetry_record::TELEMETRY || record.field < 0 ||
+        record.field >= (int)fields.size() || ( field != -1 && record.field != field ) )
+      continue;
+    field = record.field;
+    
+    telemetry_sample sample;
+    sample.planeID = record.plane_id;
+    sample.currentLongitude = record.values[ 0 ];
+    sample.currentLatitude = record.values[ 1 ];
+    sample.currentAltitude = record.values[ 2 ];
+    sample.destLongitude = record.values[ 3 ];
+    sample.destLatitude = record.values[ 4 ];
+    sample.destAltitude = record.values[ 5 ];
+    sample.groundSpeed = record.values[ 6 ];
+    sample.targetBearing = record.values[ 7 ];
+    sample.received = ros::WallTime( record.received );
+    sample.departed = ( record.flags & telemetry_record::DEPARTED ) != 0;
+    samples.push_back( sample );
+  }
+  if( samples.empty() )
+    return 0;
+  
+  ros::WallTime start = ros::WallTime::now();
+  handle_batch( *fields[ field ], samples );
+  return ( ros::WallTime::now() - start ).toSec() * 1000;
+}
+
+/**
+ * Hands over the times of the plans made since the last call
+ * @param out_ms Each plan's time (ms), in the order they were made, is added here
+ */
+void takeReplayPlanTimes( vector< double > & out_ms )
+{
+  out_ms.insert( out_ms.end(), plan_times_ms.begin(), plan_times_ms.end() );
+  plan_times_ms.clear();
+}
+
+/**
+ * Reports how the replay's planning went, and frees the fields
+ */
+void stopCollisionAvoidanceReplay()
+{
+  if( planning_budget_ms > 0 )
+    ROS_INFO( "Planned %d times in %d callbacks; missed the %.0f ms deadline %d times",
+              plans_made, the_count, planning_budget_ms, deadline_misses );
+  else
+    ROS_INFO( "Planned %d times in %d callbacks, with no deadline", plans_made, the_count );
+  keeping_plan_times = false;
+  plan_times_ms.clear();
+  
+  for( unsigned int i = 0; i < fields.size(); i++ )
+  {
+    fields[ i ]->snapshots.unregister_reader( fields[ i ]->planning_reader );
+    delete fields[ i ];
+  }
+  fields.clear();
+}
+
+/**
+ * This method is only called once by the ROS framework; after initializing all
+ * planes, it calls only the telemetry update callback
+ */
+#ifndef COMPOSED_NODES
+int main(int argc, char **argv)
+{
+  //standard ROS startup
+  ros::init(argc, argv, "collisionAvoidance");
+  ros::NodeHandle n;
+  
+  startCollisionAvoidance( n );
   
   //needed for ROS to wait for callbacks
   ros::spin();
   
+  stopCollisionAvoidance();
+  
   // NOTE: We tried both versions of the multithreaded spinning and got 
   //       distastrous results with both. Use at your own risk--ROS is a fickle beast.
+  //       (Those ran the whole callback, planning and all, on several threads at
+  //       once; the planning thread above keeps planning on exactly one.)
   /*ros::MultiThreadedSpinner spinner(4); // Use 4 threads
   spinner.spin(); */
   
@@ -424,20 +1382,34 @@ int main(int argc, char **argv)
   
   return 0;
 }
+#endif
+
+namespace
+{
+
+const fleet_table & layer_for( const fleet_table & fleet, int planeId, fleet_table & scratch )
+{
+  int slot = fleet.slot_of( planeId );
+  if( bands.count() == 1 || slot == -1 )
+    return fleet;
+  
+  bands.layer( fleet, bands.band_of( fleet.altitude()[ slot ] ), scratch );
+  return scratch;
+}
 
 #ifdef COLLISIONTESTING
-bool collision_occurred( int id_to_check )
+bool collision_occurred( airfield & af, int id_to_check )
 {
-  for( unsigned int crnt_id = 0; crnt_id < plane_locs.size(); crnt_id++ )
+  for( unsigned int crnt_id = 0; crnt_id < af.plane_locs.size(); crnt_id++ )
   {
     if( crnt_id != id_to_check && /* this is a different plane */
-       plane_locs[ crnt_id ].x == plane_locs[ id_to_check ].x && /* with the same x pos */
-       plane_locs[ crnt_id ].y == plane_locs[ id_to_check ].y && /* and the same y pos */
-       plane_locs[ crnt_id ].t != -1 /* and it HAS been initialized */)
+       af.plane_locs[ crnt_id ].x == af.plane_locs[ id_to_check ].x && /* with the same x pos */
+       af.plane_locs[ crnt_id ].y == af.plane_locs[ id_to_check ].y && /* and the same y pos */
+       af.plane_locs[ crnt_id ].t != -1 /* and it HAS been initialized */)
     {
       cout << " Collision occurred between planes " << crnt_id << " and "
-      << id_to_check << " at (" << plane_locs[ crnt_id ].x << ", " <<
-      plane_locs[ crnt_id ].y << ")" << endl;
+      << id_to_check << " at (" << af.plane_locs[ crnt_id ].x << ", " <<
+      af.plane_locs[ crnt_id ].y << ")" << endl;
       cout << " (Note: presumably plane " << id_to_check
       << " was updated most recently)" << endl;
       return true;
@@ -449,41 +1421,497 @@ bool collision_occurred( int id_to_check )
 #endif
 
 
-void makeField()
+const char * replan_reason( airfield & af, const fleet_table & version, int planeId,
+                            int x, int y, int goal_x, int goal_y )
+{
+  const flight_plan & plan = af.plans[ planeId ];
+  
+  if( plan.finished() )
+    return "out of waypoints";
+  if( plan.goal_changed( goal_x, goal_y ) )
+    return "new goal";
+  if( plan.off_course( x, y, OFF_COURSE_TOLERANCE ) )
+    return "off course";
+  if( plan.threatened( version, planeId, THREAT_HORIZON, THREAT_CLEARANCE ) )
+    return "threat in corridor";
+  
+  // Nothing has gone wrong, so it's down to how long it has been
+  bool in_traffic = false;
+  const vector< int > & ids = version.ids();
+  const vector< int > & xs = version.x();
+  const vector< int > & ys = version.y();
+  for( unsigned int slot = 0; slot < version.size() && !in_traffic; slot++ )
+  {
+    if( ids[ slot ] != planeId &&
+        abs( xs[ slot ] - x ) <= NEAR_TRAFFIC_SQUARES &&
+        abs( ys[ slot ] - y ) <= NEAR_TRAFFIC_SQUARES )
+      in_traffic = true;
+  }
+  
+  int period = in_traffic ? NEAR_TRAFFIC_REPLAN_PERIOD : FAR_REPLAN_PERIOD;
+  if( af.updates_since_plan[ planeId ] >= period )
+    return "scheduled";
+  
+  return NULL;
+}
+
+void plan_and_send( airfield & af, const fleet_table & version, int planeId,
+                    int startx, int starty, int endx, int endy, double altitude )
+{
+  af.updates_since_plan[ planeId ] = 0;
+  
+  vector< point > path;
+  bool is_fallback = false;
+  bool is_speculative = take_speculation( af, version, planeId, startx, starty, endx, endy, path );
+  
+  // Begin A*ing (unless we already have); the clock starts now
+  planning_deadline deadline;
+  if( !is_speculative )
+  {
+    plans_made++;
+    deadline.start( planning_budget_ms );
+    
+    // If we ran late, whatever A* came up with (if anything) is discarded
+    is_fallback = !run_planner( af, version, planeId, startx, starty, endx, endy,
+                                af.planes[ planeId ].get_named_bearing(), path, deadline );
+    if( keeping_plan_times )
+      plan_times_ms.push_back( deadline.elapsed_ms() );
+  }
+  
+  if( is_fallback )
+  {
+    deadline_misses++;
+    
+    bool used_previous;
+    path.clear();
+    path.push_back( fallback_point( version, planeId, af.field.getWidth(), af.field.getHeight(),
+                                    used_previous ) );
+    
+    ALOG_WARN( "[FALLBACK] Planning for plane %d took %.1f ms (deadline %.0f ms); sending %s (%d, %d). Deadline misses this run: %d",
+               planeId, deadline.elapsed_ms(), deadline.get_budget_ms(),
+               used_previous ? "its previous waypoint" : "a straight-to-goal point",
+               path[ 0 ].x, path[ 0 ].y, deadline_misses );
+  }
+  
+#ifdef DEBUG
+  assert( !path.empty() );
+#endif
+  ALOG_DEBUG("%s says for plane %d to go here: \033[22;32m\nx: %d\ny: %d (+%d more waypoints)", 
+             is_fallback ? "[FALLBACK]" : ( is_speculative ? "Speculative A*" : "A*" ),
+             planeId, path[ 0 ].x, path[ 0 ].y,
+             (int)path.size() - 1 );
+  ALOG_DEBUG("From here:\nx: %d\ny: %d", startx, starty);
+  
+  // Send the waypoints, in order. They're avoidance maneuver waypoints, and the
+  // first one clears out the plane's avoidance queue.
+  vector< coord > sent;
+  for( unsigned int i = 0; i < path.size(); i++ )
+  {
+    Position wp( &af.field, path[ i ].x, path[ i ].y );
+    
+    AU_UAV_ROS::GoToWaypoint srv;
+    srv.request.planeID = planeId;
+    srv.request.longitude = wp.getLon();
+    srv.request.latitude = wp.getLat();
+    srv.request.altitude = altitude; // Don't change altitude
+    srv.request.isAvoidanceManeuver = true;
+    srv.request.isNewQueue = ( i == 0 );
+    
+    // Send the command! If the command isn't received, let the user know (and
+    // don't bother with the rest, since they'd be queued behind the wrong point).
+    bool received = client.call(srv);
+    record_command( af, srv.request, received, is_speculative, is_fallback );
+    if( !received )
+    {
+      ROS_ERROR("Service failed to go through!%s", is_fallback ? " [FALLBACK]" : "");
+      break;
+    }
+    
+    sent.push_back( coord( path[ i ].x, path[ i ].y, path[ i ].t ) );
+  }
+  
+  // Update the plane object
+  if( !sent.empty() )
+  {
+    af.planes[ planeId ].update_intermediate_wp( Position( &af.field, path[ 0 ].x, path[ 0 ].y ) );
+    af.fleet.set( af.planes[ planeId ] );
+  }
+  
+  // A fallback is only meant to tide the plane over, so don't keep it as a plan;
+  // that way the plane is planned again on its next update
+  if( is_fallback || sent.empty() )
+    af.plans[ planeId ].clear();
+  else
+    af.plans[ planeId ].set( startx, starty, sent, endx, endy );
+}
+
+bool run_planner( const airfield & af, const fleet_table & version, int planeId,
+                  int startx, int starty, int endx, int endy, map_tools::bearing_t bearing,
+                  vector< point > & path, const planning_deadline & deadline )
+{
+  // Building the grids stops at the deadline too, so a slow build can't hold up
+  // the fallback
+  best_cost bc = best_cost( &version, af.field.getWidthInMeters(), af.field.getHeightInMeters(),
+                            af.field.getResolution(), planeId, &deadline );
+  
+  if( !bc.is_complete() || deadline.expired() ) // no sense starting A* if we're already late
+    return false;
+  
+  astar_point( &bc, startx, starty, endx, endy, planeId, bearing, &version, &deadline, &path );
+  return !deadline.expired();
+}
+
+bool speculate( airfield & af )
+{
+  ros::WallTime now = ros::WallTime::now();
+  
+  // Find the plane whose next update is due soonest
+  int chosen = -1;
+  double soonest = 0;
+  for( map< int, Plane >::iterator crnt_plane = af.planes.begin();
+      crnt_plane != af.planes.end(); ++crnt_plane )
+  {
+    int id = (*crnt_plane).first;
+    if( af.speculations[ id ].attempted || af.last_report.find( id ) == af.last_report.end() )
+      continue;
+    
+    double due = af.report_interval[ id ] - ( now - af.last_report[ id ] ).toSec();
+    if( chosen == -1 || due < soonest )
+    {
+      chosen = id;
+      soonest = due;
+    }
+  }
+  
+  if( chosen == -1 )
+    return false;
+  
+  speculation & spec = af.speculations[ chosen ];
+  spec.attempted = true;
+  
+  // Dead reckon everybody to when the chosen plane should report next
+  double ahead = af.report_interval[ chosen ] - ( now - af.last_report[ chosen ] ).toSec();
+  if( ahead < 0 )
+    ahead = 0;
+  
+  const fleet_version * version = af.snapshots.pin( af.planning_reader );
+  fleet_table guess = version->fleet;
+  const vector< int > & ids = version->fleet.ids();
+  for( unsigned int slot = 0; slot < ids.size(); slot++ )
+  {
+    map< int, Plane >::iterator plane = af.planes.find( ids[ slot ] );
+    if( plane == af.planes.end() )
+      continue;
+    
+    // From its own last report, not from now
+    double seconds = ahead + ( now - af.last_report[ ids[ slot ] ] ).toSec();
+    double ex, ey;
+    (*plane).second.extrapolate( seconds, ex, ey );
+    int x = (int)floor( ex );
+    int y = (int)floor( ey );
+    x = x < 0 ? 0 : ( x >= af.field.getWidth() ? af.field.getWidth() - 1 : x );
+    y = y < 0 ? 0 : ( y >= af.field.getHeight() ? af.field.getHeight() - 1 : y );
+    
+    guess.set( ids[ slot ], x, y, version->fleet.dest_x()[ slot ], version->fleet.dest_y()[ slot ],
+               version->fleet.final_x()[ slot ], version->fleet.final_y()[ slot ],
+               version->fleet.bearing()[ slot ], version->fleet.bearing_to_dest()[ slot ],
+               version->fleet.altitude()[ slot ] );
+  }
+  af.snapshots.unpin( af.planning_reader );
+  
+  int slot = guess.slot_of( chosen );
+  if( slot == -1 )
+    return true;
+  
+  spec.x = guess.x()[ slot ];
+  spec.y = guess.y()[ slot ];
+  spec.goal_x = guess.final_x()[ slot ];
+  spec.goal_y = guess.final_y()[ slot ];
+  spec.made = now;
+  
+  fleet_table layer;
+  const fleet_table & threats = layer_for( guess, chosen, layer );
+  
+  planning_deadline deadline;
+  deadline.start( planning_budget_ms );
+  spec.valid = run_planner( af, threats, chosen, spec.x, spec.y, spec.goal_x, spec.goal_y,
+                            af.planes[ chosen ].get_named_bearing(), spec.path, deadline );
+  return true;
+}
+
+bool take_speculation( airfield & af, const fleet_table & version, int planeId,
+                       int startx, int starty, int endx, int endy, vector< point > & path )
+{
+  speculation & spec = af.speculations[ planeId ];
+  if( !spec.valid )
+    return false;
+  spec.valid = false;
+  
+  bool usable = abs( spec.x - startx ) <= SPECULATION_TOLERANCE &&
+                abs( spec.y - starty ) <= SPECULATION_TOLERANCE &&
+                spec.goal_x == endx && spec.goal_y == endy &&
+                ( ros::WallTime::now() - spec.made ).toSec() <= SPECULATION_MAX_AGE &&
+                !spec.path.empty();
+  
+  // Things may have changed since we made it; make sure it's still clear
+  if( usable )
+  {
+    vector< coord > waypoints;
+    for( unsigned int i = 0; i < spec.path.size(); i++ )
+      waypoints.push_back( coord( spec.path[ i ].x, spec.path[ i ].y ) );
+    
+    flight_plan check;
+    check.set( startx, starty, waypoints, endx, endy );
+    usable = !check.threatened( version, planeId, THREAT_HORIZON, THREAT_CLEARANCE );
+  }
+  
+  if( usable )
+  {
+    speculation_hits++;
+    path = spec.path;
+  }
+  else
+    speculation_misses++;
+  
+  return usable;
+}
+
+void forget_plane( airfield & af, int planeId )
+{
+  af.planes.erase( planeId );
+  af.fleet.remove( planeId );
+  af.plans.erase( planeId );
+  af.updates_since_plan.erase( planeId );
+  af.speculations.erase( planeId );
+  af.last_report.erase( planeId );
+  af.report_interval.erase( planeId );
+  af.last_callback_updated.erase( planeId );
+  af.prev_dist.erase( planeId );
+  af.needs_a_push.erase( planeId );
+#ifdef COLLISIONTESTING
+  if( planeId >= 0 && planeId < (int)af.plane_locs.size() )
+    af.plane_locs[ planeId ].t = -1;
+#endif
+}
+
+void save_state( airfield & af )
+{
+  vector< snapshot_plane > state;
+  for( map< int, Plane >::iterator crnt_plane = af.planes.begin();
+      crnt_plane != af.planes.end(); ++crnt_plane )
+  {
+    const Plane & plane = (*crnt_plane).second;
+    int id = (*crnt_plane).first;
+    
+    snapshot_plane r;
+    memset( &r, 0, sizeof( r ) );
+    r.id = id;
+    r.last_callback_updated = af.last_callback_updated[ id ];
+    r.needs_a_push = af.needs_a_push[ id ] ? 1 : 0;
+    r.prev_dist = af.prev_dist[ id ];
+    r.speed = (*crnt_plane).second.getSpeed();
+    r.altitude = plane.getAltitude();
+    r.current_lat = plane.getLocation().getLat();
+    r.current_lon = plane.getLocation().getLon();
+    r.last_lat = plane.getLastLocation().getLat();
+    r.last_lon = plane.getLastLocation().getLon();
+    r.dest_lat = plane.getDestination().getLat();
+    r.dest_lon = plane.getDestination().getLon();
+    r.final_lat = plane.getFinalDestination().getLat();
+    r.final_lon = plane.getFinalDestination().getLon();
+    state.push_back( r );
+  }
+  
+  if( !af.state_file.write( af.field, ros::WallTime::now().toSec(), af.callback_count, state ) )
+    ROS_ERROR( "Couldn't write field %d's planner snapshot", af.index );
+}
+
+bool restore_state( airfield & af )
 {
-  ifstream the_file( "/var/field.txt" );
-  if ( the_file.is_open() )
+  int saved_count;
+  vector< snapshot_plane > state;
+  if( !af.state_file.read( af.field, ros::WallTime::now().toSec(), SNAPSHOT_MAX_AGE,
+                           saved_count, state ) )
+  {
+    ROS_INFO( "No usable planner snapshot in %s; starting from scratch",
+              af.snapshot_path.c_str() );
+    return false;
+  }
+  
+  af.callback_count = saved_count;
+  for( unsigned int i = 0; i < state.size(); i++ )
   {
-    the_file >> upperLeftLon;
-    the_file >> upperLeftLat;
-    the_file >> lonWidth;
-    the_file >> latWidth;
-    the_file >> res;
-    the_file.close();
+    const snapshot_plane & r = state[ i ];
     
-    fieldWidth= /* in meters */
-    map_tools::calculate_distance_between_points( upperLeftLat, upperLeftLon,
-                                                 upperLeftLat, upperLeftLon + lonWidth,
-                                                 "meters");
+    // Put the plane at its previous position, then move it to its current one, so
+    // that its bearing comes out as it was
+    Plane plane( r.id, Position( &af.field, r.last_lon, r.last_lat ),
+                 Position( &af.field, r.final_lon, r.final_lat ) );
+    plane.update_current( Position( &af.field, r.current_lon, r.current_lat ), r.speed );
+    plane.setDestination( r.dest_lon, r.dest_lat );
+    plane.setAltitude( r.altitude );
     
-    fieldHeight =
-    map_tools::calculate_distance_between_points( upperLeftLat, upperLeftLon,
-                                                 upperLeftLat + latWidth, upperLeftLon,
-                                                 "meters");
+    af.planes[ r.id ] = plane;
+    af.last_callback_updated[ r.id ] = r.last_callback_updated;
+    af.needs_a_push[ r.id ] = ( r.needs_a_push != 0 );
+    af.prev_dist[ r.id ] = r.prev_dist;
+    af.fleet.set( af.planes[ r.id ] );
+    plane_field[ r.id ] = af.index; // (we haven't started spinning yet)
+  }
+  af.snapshots.publish( af.fleet );
+  
+  ROS_INFO( "Restored %u planes in field %d (as of callback %d) from %s",
+            (unsigned int)state.size(), af.index, af.callback_count,
+            af.snapshot_path.c_str() );
+  return true;
+}
+
+void makeFields()
+{
+  vector< string > paths;
+  ifstream list( FIELD_LIST_PATH );
+  string path;
+  while( list >> path )
+    paths.push_back( path );
+  if( paths.empty() )
+    paths.push_back( FIELD_PATH );
+  
+  for( unsigned int i = 0; i < paths.size(); i++ )
+  {
+    airfield * af = new airfield();
+    if( !af->field.load( paths[ i ] ) )
+    {
+      ROS_ERROR( "Cannot open field data in %s", paths[ i ].c_str() );
+      delete af;
+      continue;
+    }
+    
+    af->index = fields.size();
+    stringstream snapshot_path;
+    snapshot_path << SNAPSHOT_PATH;
+    if( af->index > 0 )
+      snapshot_path << "." << af->index;
+    af->snapshot_path = snapshot_path.str();
+    fields.push_back( af );
     
     /*
      cout << endl;
-     cout << "You've selected a field with upper left longitude: " << upperLeftLon << endl;
-     cout << " upper left latitude: " << upperLeftLat << endl;
-     cout << " width in deg longitude: " << lonWidth << endl;
-     cout << " width in deg latitude: " << latWidth << endl;
-     cout << " width in meters: " << fieldWidth << endl;
-     cout << " height in meters: " << fieldHeight << endl;
+     cout << "You've selected a field with upper left longitude: " << af->field.getUpperLeftLongitude() << endl;
+     cout << " upper left latitude: " << af->field.getUpperLeftLatitude() << endl;
+     cout << " width in deg longitude: " << af->field.getLonWidth() << endl;
+     cout << " width in deg latitude: " << af->field.getLatWidth() << endl;
+     cout << " width in meters: " << af->field.getWidthInMeters() << endl;
+     cout << " height in meters: " << af->field.getHeightInMeters() << endl;
      */
   }
-  else
+  
+  // Planes have to go somewhere, even if it's a field we know nothing about
+  if( fields.empty() )
+    fields.push_back( new airfield() );
+  
+  ROS_INFO( "Planning for %u field(s)", (unsigned int)fields.size() );
+}
+
+void record_field( const airfield & af )
+{
+  telemetry_record r;
+  memset( &r, 0, sizeof( r ) );
+  r.kind = telemetry_record::FIELD;
+  r.flags = af.restored ? telemetry_record::RESTORED : 0;
+  r.field = af.index;
+  r.plane_id = -1;
+  if( af.field.is_initialized() )
   {
-    ROS_ERROR("Cannot open field data");
+    r.values[ 0 ] = af.field.getUpperLeftLongitude();
+    r.values[ 1 ] = af.field.getUpperLeftLatitude();
+    r.values[ 2 ] = af.field.getLonWidth();
+    r.values[ 3 ] = af.field.getLatWidth();
+    r.values[ 4 ] = af.field.getResolution();
   }
+  recorder.write( r );
+}
+
+void record_bands()
+{
+  // The margin, then as many boundaries as fit in each record
+  const vector< double > & boundaries = bands.boundaries();
+  const natural PER_RECORD = sizeof( telemetry_record().values ) / sizeof( double ) - 1;
+  natural written = 0;
+  do
+  {
+    telemetry_record r;
+    memset( &r, 0, sizeof( r ) );
+    r.kind = telemetry_record::BANDS;
+    r.field = -1;
+    r.values[ 0 ] = bands.get_margin();
+    while( written < boundaries.size() && r.plane_id < (int)PER_RECORD )
+      r.values[ 1 + r.plane_id++ ] = boundaries[ written++ ];
+    recorder.write( r );
+  } while( written < boundaries.size() );
+}
+
+void record_sample( const airfield & af, const telemetry_sample & sample, bool batch_start )
+{
+  if( !recorder.is_open() )
+    return;
+  
+  telemetry_record r;
+  memset( &r, 0, sizeof( r ) );
+  r.kind = telemetry_record::TELEMETRY;
+  r.flags = ( sample.departed ? telemetry_record::DEPARTED : 0 ) |
+            ( batch_start ? telemetry_record::BATCH_START : 0 );
+  r.field = af.index;
+  r.plane_id = sample.planeID;
+  r.received = sample.received.toSec();
+  r.values[ 0 ] = sample.currentLongitude;
+  r.values[ 1 ] = sample.currentLatitude;
+  r.values[ 2 ] = sample.currentAltitude;
+  r.values[ 3 ] = sample.destLongitude;
+  r.values[ 4 ] = sample.destLatitude;
+  r.values[ 5 ] = sample.destAltitude;
+  r.values[ 6 ] = sample.groundSpeed;
+  r.values[ 7 ] = sample.targetBearing;
+  recorder.write( r );
+}
+
+void record_goal( const airfield & af, int planeId, bool succeeded,
+                  const AU_UAV_ROS::RequestWaypointInfo::Response & goal )
+{
+  if( !recorder.is_open() )
+    return;
+  
+  telemetry_record r;
+  memset( &r, 0, sizeof( r ) );
+  r.kind = telemetry_record::GOAL;
+  r.flags = succeeded ? telemetry_record::SUCCEEDED : 0;
+  r.field = af.index;
+  r.plane_id = planeId;
+  r.values[ 0 ] = goal.latitude;
+  r.values[ 1 ] = goal.longitude;
+  r.values[ 2 ] = goal.altitude;
+  recorder.write( r );
+}
+
+void record_command( const airfield & af, const AU_UAV_ROS::GoToWaypoint::Request & command,
+                     bool succeeded, bool speculative, bool fallback )
+{
+  if( !recorder.is_open() )
+    return;
+  
+  telemetry_record r;
+  memset( &r, 0, sizeof( r ) );
+  r.kind = telemetry_record::COMMAND;
+  r.flags = ( succeeded ? telemetry_record::SUCCEEDED : 0 ) |
+            ( command.isAvoidanceManeuver ? telemetry_record::AVOIDANCE : 0 ) |
+            ( command.isNewQueue ? telemetry_record::NEW_QUEUE : 0 ) |
+            ( speculative ? telemetry_record::SPECULATIVE : 0 ) |
+            ( fallback ? telemetry_record::FALLBACK : 0 );
+  r.field = af.index;
+  r.plane_id = command.planeID;
+  r.values[ 0 ] = command.latitude;
+  r.values[ 1 ] = command.longitude;
+  r.values[ 2 ] = command.altitude;
+  recorder.write( r );
 }
 
+} // namespace
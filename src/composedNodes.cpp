@@ -0,0 +1,40 @@
+/*
+composedNodes
+Runs the coordinator, the simulator and collision avoidance together in one process, as components sharing
+a single node.  Telemetry and commands are passed between them as pointers to the original messages instead
+of being serialized, and collision avoidance and the simulator call the coordinator's services as plain
+function calls (see node_composition.h).  Everything else (the topics and services other programs use, like
+the control menu) works just as it does with three separate nodes.
+
+Build it from coordinator.cpp, simulator.cpp and collisionAvoidance.cpp, each compiled with COMPOSED_NODES
+defined (which leaves out their own main functions), and this file.  The simulator reports the
+telemetry-to-command latency when it shuts down, labelled with the mode it ran in, so that this can be
+compared with running the three nodes on their own.
+*/
+
+//ROS headers
+#include "ros/ros.h"
+
+//the components' entry points
+#include "node_composition.h"
+
+int main(int argc, char **argv)
+{
+	//Standard ROS startup
+	ros::init(argc, argv, "composedNodes");
+	ros::NodeHandle n;
+
+	//the coordinator has to come first, so that the others find its services in this process
+	startCoordinator(n);
+	startSimulator(n);
+	startCollisionAvoidance(n);
+
+	//one spinner for all three; collision avoidance plans on its own thread
+	ros::spin();
+
+	stopCollisionAvoidance();
+	stopSimulator();
+	stopCoordinator();
+
+	return 0;
+}
@@ -7,11 +7,14 @@ avoidance as well.
 
 //Standard C++ headers
 #include <sstream>
+#include <vector>
+#include <math.h>
 
 //ROS headers
 #include "ros/ros.h"
 #include "ros/package.h"
 #include "AU_UAV_ROS/TelemetryUpdate.h"
+#include "AU_UAV_ROS/FleetTelemetry.h"
 #include "AU_UAV_ROS/Command.h"
 #include "AU_UAV_ROS/RequestPlaneID.h"
 #include "AU_UAV_ROS/GoToWaypoint.h"
@@ -19,16 +22,80 @@ avoidance as well.
 #include "AU_UAV_ROS/LoadPath.h"
 #include "AU_UAV_ROS/RequestWaypointInfo.h"
 #include "AU_UAV_ROS/LoadCourse.h"
+#include "AU_UAV_ROS/RequestWaypointQueues.h"
+
+//for running in the same process as the other nodes
+#include <boost/thread/mutex.hpp>
+#include "node_composition.h"
+
+//our table of planes, and the course and path file reader
+#include "slot_table.h"
+#include "course_file.h"
+#include "a_star/async_log.h"
+
+//everything but startCoordinator(...) is kept to this file, so that the coordinator can be linked into
+//one process with the other nodes (see composedNodes.cpp)
+namespace
+{
 
 //publisher is global so callbacks can access it
 ros::Publisher commandPub;
 
-//coordinator list of UAVs, may want to lengthen this or perhaps change it to a map, not sure
-std::map<int, AU_UAV_ROS::PlaneCoordinator> planesArray;
+//the telemetry subscriptions (one update at a time, or a tick's worth at once) and our services, kept for
+//as long as the coordinator runs
+ros::Subscriber telemetrySub;
+ros::Subscriber fleetTelemetrySub;
+std::vector<ros::ServiceServer> servers;
+
+//held by every callback; when the nodes share a process, collision avoidance calls our services directly
+//from its own thread rather than through the spinner
+boost::mutex coordinatorMutex;
+
+//plane IDs must be below this (collision avoidance sizes its telemetry queues to match; keep its MAX_PLANES in step)
+const int MAX_PLANES = 4096;
+
+//coordinator list of UAVs, indexed directly by plane ID; an ID is valid once it's been activated
+//(see slot_table.h)
+slot_table<AU_UAV_ROS::PlaneCoordinator> planesArray(MAX_PLANES);
 
 //just a count of the number of planes so far, init to zero
 int numPlanes = 0;
 
+//bumped whenever any plane's waypoint queues may have changed (a plane is added, points are queued, or a
+//plane moves on to its next point), so that clients of request_waypoint_queues can tell when they're
+//already up to date; starts at 1 so that 0 never matches
+uint64_t queueVersion = 1;
+
+/*
+Commands that would only repeat the last one sent to a plane aren't sent again: collision avoidance re-sends
+its current waypoint every second, and over the XBees every repeat costs airtime.  A command counts as a
+repeat if it's within commandTolerance meters (horizontally) and commandAltitudeTolerance meters (vertically)
+of the last one.  A repeat is sent anyway once commandResendInterval seconds have passed since the plane last
+got a command, in case that one was lost over the air (0 never resends, so a lost command is never made up).
+All three are read from the node's
+private parameters (~command_tolerance, ~command_altitude_tolerance, ~command_resend_interval).
+*/
+double commandTolerance = 0.5;
+double commandAltitudeTolerance = 0.5;
+double commandResendInterval = 5;
+
+//the last command sent to a plane
+struct sentCommand
+{
+	bool valid;
+	double latitude, longitude, altitude;
+	ros::WallTime sentAt;
+	
+	sentCommand() : valid(false), latitude(0), longitude(0), altitude(0) {}
+};
+
+//indexed by plane ID like planesArray, and cleared when an ID is handed out
+slot_table<sentCommand> lastCommands(MAX_PLANES);
+
+//this run's totals
+int commandsSent = 0;
+int commandsSuppressed = 0;
+
 /*
 isValidPlanID(...)
 simple function to make sure that an ID sent to us is known by the coordinator
@@ -36,33 +103,85 @@ simple function to make sure that an ID sent to us is known by the coordinator
 bool isValidPlaneID(int id)
 {
 	//if the number id is valid
-	//AND we have that id in the map
 	//AND that UAV is active
-	if(id >= 0 && planesArray.find(id) != planesArray.end() && planesArray[id].isActive) return true;
-	else return false;
+	return planesArray.is_active(id);
 }
 
 /*
-telemetryCallback(...)
-This function is run whenever a new telemetry update from any plane is recieved.  Mainly, it forwards the
-update onwards and it will send new commands if the plane coordinators deem it necessary.
+isRepeatCommand(...)
+Whether a command is close enough to the last one sent to its plane to be left out.  The distance is a flat
+approximation, which is plenty for tolerances of a few meters.
 */
-void telemetryCallback(const AU_UAV_ROS::TelemetryUpdate::ConstPtr& msg)
+bool isRepeatCommand(const sentCommand &last, const AU_UAV_ROS::Command &command)
+{
+	if(!last.valid) return false;
+	
+	const double METERS_PER_DEGREE = 111319.9;
+	double north = (command.latitude - last.latitude) * METERS_PER_DEGREE;
+	double east = (command.longitude - last.longitude) * METERS_PER_DEGREE * cos(last.latitude * M_PI / 180.0);
+	
+	return north*north + east*east <= commandTolerance*commandTolerance
+		&& fabs(command.altitude - last.altitude) <= commandAltitudeTolerance;
+}
+
+/*
+sendCommand(...)
+Publishes a command to its plane, unless it only repeats the last one (see commandTolerance above).
+@return true if it was published
+*/
+bool sendCommand(const AU_UAV_ROS::Command::Ptr &command)
+{
+	sentCommand &last = lastCommands[command->planeID];
+	ros::WallTime now = ros::WallTime::now();
+	
+	if(isRepeatCommand(last, *command)
+		&& (commandResendInterval <= 0 || (now - last.sentAt).toSec() < commandResendInterval))
+	{
+		commandsSuppressed++;
+		ALOG_DEBUG("Suppressed repeated command to plane #%d (%d so far)", command->planeID, commandsSuppressed);
+		return false;
+	}
+	
+	commandPub.publish(command);
+	commandsSent++;
+	
+	last.valid = true;
+	last.latitude = command->latitude;
+	last.longitude = command->longitude;
+	last.altitude = command->altitude;
+	last.sentAt = now;
+	
+	//every command at debug; at info, just a sample, since there's one per plane per update
+	ALOG_DEBUG("Sent command to plane #%d: (%f, %f, %f)", command->planeID, command->latitude, command->longitude, command->altitude);
+	ALOG_INFO_THROTTLE(1.0, "Sent command to plane #%d: (%f, %f, %f) (%d sent so far)", command->planeID,
+		command->latitude, command->longitude, command->altitude, commandsSent);
+	return true;
+}
+
+/*
+handleUpdate(...)
+Forwards one telemetry update to its plane's coordinator, and sends a new command if the coordinator deems
+it necessary.  The caller holds coordinatorMutex.
+*/
+void handleUpdate(const AU_UAV_ROS::TelemetryUpdate &update)
 {
-	ROS_INFO("Received update #[%d] from plane ID %d", msg->telemetryHeader.seq, msg->planeID);
+	ALOG_DEBUG("Received update #[%d] from plane ID %d", update.telemetryHeader.seq, update.planeID);
 	
 	//check the make sure the update is valid first
-	if(isValidPlaneID(msg->planeID))
+	if(isValidPlaneID(update.planeID))
 	{
-		//prep in case a command needs to be sent
-		AU_UAV_ROS::Command commandToSend;
+		//prep in case a command needs to be sent (published by pointer, so that a subscriber in this process
+		//gets it without a copy)
+		AU_UAV_ROS::Command::Ptr commandToSend(new AU_UAV_ROS::Command);
 		
 		//check whether the update warrants a new command or not
-		if(planesArray[msg->planeID].handleNewUpdate(*msg, &commandToSend))
+		if(planesArray[update.planeID].handleNewUpdate(update, commandToSend.get()))
 		{
+			//a new command means the plane has moved on in its queue
+			queueVersion++;
+			
 			//send new command
-			commandPub.publish(commandToSend);
-			ROS_INFO("Sent command to plane #%d: (%f, %f, %f)", commandToSend.planeID, commandToSend.latitude, commandToSend.longitude, commandToSend.altitude);
+			sendCommand(commandToSend);
 		}
 		else
 		{
@@ -71,52 +190,92 @@ void telemetryCallback(const AU_UAV_ROS::TelemetryUpdate::ConstPtr& msg)
 	}
 	else
 	{
-		ROS_ERROR("Received update from invalid plane ID #%d", msg->planeID);
+		ROS_ERROR("Received update from invalid plane ID #%d", update.planeID);
+	}
+}
+
+/*
+telemetryCallback(...)
+This function is run whenever a new telemetry update from any plane is recieved.  Mainly, it forwards the
+update onwards and it will send new commands if the plane coordinators deem it necessary.
+*/
+void telemetryCallback(const AU_UAV_ROS::TelemetryUpdate::ConstPtr& msg)
+{
+	boost::mutex::scoped_lock lock(coordinatorMutex);
+	handleUpdate(*msg);
+}
+
+/*
+fleetTelemetryCallback(...)
+Run when the simulator sends a whole tick's telemetry in one message: handles each plane's update in turn,
+just as telemetryCallback would, under one lock.
+*/
+void fleetTelemetryCallback(const AU_UAV_ROS::FleetTelemetry::ConstPtr& msg)
+{
+	boost::mutex::scoped_lock lock(coordinatorMutex);
+	
+	//one update, refilled for each plane
+	AU_UAV_ROS::TelemetryUpdate update;
+	update.telemetryHeader = msg->header;
+	for(unsigned int i = 0; i < msg->planeIDs.size(); i++)
+	{
+		update.telemetryHeader.seq = msg->sequences[i];
+		update.planeID = msg->planeIDs[i];
+		update.currentLatitude = msg->currentLatitudes[i];
+		update.currentLongitude = msg->currentLongitudes[i];
+		update.currentAltitude = msg->currentAltitudes[i];
+		update.destLatitude = msg->destLatitudes[i];
+		update.destLongitude = msg->destLongitudes[i];
+		update.destAltitude = msg->destAltitudes[i];
+		update.groundSpeed = msg->groundSpeeds[i];
+		update.targetBearing = msg->targetBearings[i];
+		update.currentWaypointIndex = msg->currentWaypointIndexes[i];
+		update.distanceToDestination = msg->distancesToDestination[i];
+		handleUpdate(update);
 	}
 }
 
 //service to run whenever a new plane enters the arena to tell it the ID number it should use
 bool requestPlaneID(AU_UAV_ROS::RequestPlaneID::Request &req, AU_UAV_ROS::RequestPlaneID::Response &res)
 {
+	boost::mutex::scoped_lock lock(coordinatorMutex);
+	
 	//check to see if we've been given an ID
 	if(req.requestedID == -1)
 	{
-		//we weren't given an ID, so pick the first that's free
-		int id = 0;
-		while(true)
+		//we weren't given an ID, so pick the first that's free and steal it
+		int id = planesArray.activate_lowest_free();
+		if(id == -1)
 		{
-			//check if the ID is occupied or inactive
-			if(planesArray.find(id) != planesArray.end() && planesArray[id].isActive)
-			{
-				//this id already exists, increment our id and try again
-				id++;
-			}
-			else
-			{
-				//we found an unused ID, lets steal it
-				planesArray[id] = AU_UAV_ROS::PlaneCoordinator();
-				planesArray[id].isActive = true;
-				numPlanes++;
-				
-				res.planeID = id;
-				return true;
-			}
+			ROS_ERROR("No free plane IDs (the limit is %d)", MAX_PLANES);
+			return false;
 		}
 		
-		//not sure how we'd get here, but better to handle it
-		return false;
+		planesArray[id].isActive = true;
+		lastCommands[id] = sentCommand();
+		numPlanes++;
+		queueVersion++;
+		
+		res.planeID = id;
+		return true;
 	}
 	else
 	{
 		//we've been given an ID, check if it's open or inactive
-		if(planesArray.find(req.requestedID) == planesArray.end() || !planesArray[req.requestedID].isActive)
+		if(planesArray.activate(req.requestedID))
 		{
-			planesArray[req.requestedID] = AU_UAV_ROS::PlaneCoordinator();
 			planesArray[req.requestedID].isActive = true;
+			lastCommands[req.requestedID] = sentCommand();
 			numPlanes++;
+			queueVersion++;
 			res.planeID = req.requestedID;
 			return true;
 		}
+		else if(!planesArray.in_range(req.requestedID))
+		{
+			ROS_ERROR("The ID #%d is out of range (IDs must be below %d).\n", req.requestedID, MAX_PLANES);
+			return false;
+		}
 		else
 		{
 			ROS_ERROR("The ID #%d is already taken.\n", req.requestedID);
@@ -133,7 +292,8 @@ this new point is added.
 */
 bool goToWaypoint(AU_UAV_ROS::GoToWaypoint::Request &req, AU_UAV_ROS::GoToWaypoint::Response &res)
 {
-	ROS_INFO("Service Request Received: Plane #%d go to (%f, %f, %f)", req.planeID, req.latitude, req.longitude, req.altitude);	
+	boost::mutex::scoped_lock lock(coordinatorMutex);
+	ALOG_DEBUG("Service Request Received: Plane #%d go to (%f, %f, %f)", req.planeID, req.latitude, req.longitude, req.altitude);	
 	
 	//check for valid plane ID
 	if(isValidPlaneID(req.planeID))
@@ -148,6 +308,7 @@ bool goToWaypoint(AU_UAV_ROS::GoToWaypoint::Request &req, AU_UAV_ROS::GoToWaypoi
 		if(planesArray[req.planeID].goToPoint(pointFromService, req.isAvoidanceManeuver, req.isNewQueue))
 		{
 			//success!
+			queueVersion++;
 			
 			/*
 			if we have a new queue, we want to forward the new point immediately, otherwise just
@@ -156,17 +317,16 @@ bool goToWaypoint(AU_UAV_ROS::GoToWaypoint::Request &req, AU_UAV_ROS::GoToWaypoi
 			if(req.isNewQueue)
 			{
 				//get the command
-				AU_UAV_ROS::Command commandToSend = planesArray[req.planeID].getPriorityCommand();
-				commandToSend.planeID = req.planeID;
+				AU_UAV_ROS::Command::Ptr commandToSend(new AU_UAV_ROS::Command(planesArray[req.planeID].getPriorityCommand()));
+				commandToSend->planeID = req.planeID;
 				
-				if(commandToSend.latitude == -1000 || commandToSend.longitude == -1000 || commandToSend.altitude == -1000)
+				if(commandToSend->latitude == -1000 || commandToSend->longitude == -1000 || commandToSend->altitude == -1000)
 				{
 					//dont send it
 				}
 				else
 				{
-					commandPub.publish(commandToSend);
-					ROS_INFO("Sent command to plane #%d: (%f, %f, %f)", commandToSend.planeID, commandToSend.latitude, commandToSend.longitude, commandToSend.altitude);
+					sendCommand(commandToSend);
 				}
 				
 			}
@@ -187,6 +347,28 @@ bool goToWaypoint(AU_UAV_ROS::GoToWaypoint::Request &req, AU_UAV_ROS::GoToWaypoi
 	}
 }
 
+/*
+queuePoints(...)
+Replaces a plane's normal queue with one plane's run of points from a course or path file.
+*/
+void queuePoints(int planeID, const course_file &file, const course_plane &run)
+{
+	bool isAvoidance = false;
+	for(unsigned int i = 0; i < run.count; i++)
+	{
+		const course_point &point = file.points()[run.first + i];
+		
+		struct AU_UAV_ROS::waypoint temp;
+		temp.latitude = point.latitude;
+		temp.longitude = point.longitude;
+		temp.altitude = point.altitude;
+		
+		//only clear the queue with the first point
+		planesArray[planeID].goToPoint(temp, isAvoidance, i == 0);
+	}
+	queueVersion++;
+}
+
 /*
 loadPathCallback(...)
 This is the callback used when the user requests for a plane to start a certain path.
@@ -195,64 +377,25 @@ bool loadPathCallback(AU_UAV_ROS::LoadPath::Request &req, AU_UAV_ROS::LoadPath::
 {
 	ROS_INFO("Received request: Load path from \"%s\" to plane #%d\n", req.filename.c_str(), req.planeID);
 	
+	//read the file before taking the lock; nothing in it depends on our planes
+	course_file path;
+	if(!path.load(ros::package::getPath("AU_UAV_ROS")+"/paths/"+req.filename, course_file::PATH))
+	{
+		ROS_ERROR("%s: %s", path.error().c_str(), req.filename.c_str());
+		res.error = path.error();
+		return false;
+	}
+	
+	boost::mutex::scoped_lock lock(coordinatorMutex);
+	
 	//check for a valid plane ID sent
 	if(isValidPlaneID(req.planeID))
 	{
-		//open our file
-		FILE *fp;
-		fp = fopen((ros::package::getPath("AU_UAV_ROS")+"/paths/"+req.filename).c_str(), "r");
+		//a path file has (at most) one run of points
+		if(!path.planes().empty()) queuePoints(req.planeID, path, path.planes()[0]);
 		
-		//check for a good file open
-		if(fp != NULL)
-		{
-			char buffer[256];
-			bool isFirstLine = true;
-			bool isAvoidance = false;
-			
-			//while we have something in the file
-			while(fgets(buffer, sizeof(buffer), fp))
-			{
-				//check first character for comment or if the line is blank
-				if(buffer[0] == '#' || isBlankLine(buffer))
-				{
-					//this line is a comment
-					continue;
-				}
-				else
-				{
-					//set some invalid defaults
-					struct AU_UAV_ROS::waypoint temp;
-					temp.latitude = temp.longitude = temp.altitude = -1000;
-					
-					//parse the string
-					sscanf(buffer, "%lf %lf %lf\n", &temp.latitude, &temp.longitude, &temp.altitude);
-					ROS_INFO("%lf %lf %lf", temp.latitude, temp.longitude, temp.altitude);
-					//check for the invalid defaults
-					if(temp.latitude == -1000 || temp.longitude == -1000 || temp.altitude == -1000)
-					{
-						//this means we have a bad file somehow
-						ROS_ERROR("Bad file parse");
-						res.error = "Bad file parse, some points loaded";
-						return false;
-					}
-					
-					//call the goToPoint function for the correct plane
-					planesArray[req.planeID].goToPoint(temp, isAvoidance, isFirstLine);
-					
-					//only clear the queue with the first point
-					if(isFirstLine) isFirstLine = false;
-				}
-			}
-			
-			//end of file, return
-			return true;
-		}
-		else
-		{
-			ROS_ERROR("Invalid filename or location: %s", req.filename.c_str());
-			res.error = "Invalid filename or location";
-			return false;
-		}
+		ROS_INFO("Loaded %u points to plane #%d", (unsigned int)path.points().size(), req.planeID);
+		return true;
 	}
 	else
 	{
@@ -272,72 +415,36 @@ bool loadCourseCallback(AU_UAV_ROS::LoadCourse::Request &req, AU_UAV_ROS::LoadCo
 {
 	ROS_INFO("Received request: Load course from \"%s\"\n", req.filename.c_str());
 	
-	//open our file
-	FILE *fp;
-	fp = fopen((ros::package::getPath("AU_UAV_ROS")+"/courses/"+req.filename).c_str(), "r");
+	//read the whole file (or its cache) before taking the lock, so a bad file loads nothing
+	course_file course;
+	if(!course.load(ros::package::getPath("AU_UAV_ROS")+"/courses/"+req.filename))
+	{
+		ROS_ERROR("%s: %s", course.error().c_str(), req.filename.c_str());
+		res.error = course.error();
+		return false;
+	}
 	
-	//check for a good file open
-	if(fp != NULL)
+	//we can't hold a plane with this ID
+	for(unsigned int p = 0; p < course.planes().size(); p++)
 	{
-		char buffer[256];
-		
-		std::map<int, bool> isFirstPoint;
-		bool isAvoidance = false;
-		
-		//while we have something in the file
-		while(fgets(buffer, sizeof(buffer), fp))
+		if(!planesArray.in_range(course.planes()[p].id))
 		{
-			//check first character
-			if(buffer[0] == '#' || isBlankLine(buffer))
-			{
-				//this line is a comment
-				continue;
-			}
-			else
-			{
-				//set some invalid defaults
-				int planeID = -1;
-				struct AU_UAV_ROS::waypoint temp;
-				temp.latitude = temp.longitude = temp.altitude = -1000;
-				
-				//TODO: change the parser to create planes that don't exist yet?
-				//parse the string
-				sscanf(buffer, "%d %lf %lf %lf\n", &planeID, &temp.latitude, &temp.longitude, &temp.altitude);
-				ROS_INFO("Loaded %d to %lf %lf %lf", planeID, temp.latitude, temp.longitude, temp.altitude);
-				
-				//check for the invalid defaults
-				if(planeID == -1 || temp.latitude == -1000 || temp.longitude == -1000 || temp.altitude == -1000)
-				{
-					//this means we have a bad file somehow
-					ROS_ERROR("Bad file parse");
-					res.error = "Bad file parse, some points loaded";
-					return false;
-				}
-				
-				//check our map for an entry, if we dont have one then this is the first time
-				//that this plane ID has been referenced so it's true
-				if(isFirstPoint.find(planeID) == isFirstPoint.end())
-				{
-					isFirstPoint[planeID] = true;
-				}
-				
-				//call the goToPoint function for the correct plane
-				planesArray[planeID].goToPoint(temp, isAvoidance, isFirstPoint[planeID]);
-				
-				//only clear the queue with the first point
-				if(isFirstPoint[planeID]) isFirstPoint[planeID] = false;
-			}
+			ROS_ERROR("Plane ID %d out of range", course.planes()[p].id);
+			res.error = "Plane ID out of range";
+			return false;
 		}
-		
-		//end of file, return
-		return true;
 	}
-	else
+	
+	//TODO: change the parser to create planes that don't exist yet?
+	boost::mutex::scoped_lock lock(coordinatorMutex);
+	for(unsigned int p = 0; p < course.planes().size(); p++)
 	{
-		ROS_ERROR("Invalid filename or location: %s", req.filename.c_str());
-		res.error = "Invalid filename or location";
-		return false;
+		queuePoints(course.planes()[p].id, course, course.planes()[p]);
 	}
+	
+	ROS_INFO("Loaded %u points for %u planes%s", (unsigned int)course.points().size(),
+		(unsigned int)course.planes().size(), course.from_cache() ? " (from the cache)" : "");
+	return true;
 }
 
 /*
@@ -352,6 +459,8 @@ position.
 */
 bool requestWaypointInfoCallback(AU_UAV_ROS::RequestWaypointInfo::Request &req, AU_UAV_ROS::RequestWaypointInfo::Response &res)
 {
+	boost::mutex::scoped_lock lock(coordinatorMutex);
+	
 	//check that the request ID is valid
 	if(isValidPlaneID(req.planeID))
 	{
@@ -377,23 +486,131 @@ bool requestWaypointInfoCallback(AU_UAV_ROS::RequestWaypointInfo::Request &req,
 	}
 }
 
+/*
+appendQueue(...)
+Adds every point in one of a plane's queues to a waypoint queues response, front first.
+@return the number of points added
+*/
+unsigned int appendQueue(int planeID, bool isAvoidance, AU_UAV_ROS::RequestWaypointQueues::Response &res)
+{
+	unsigned int count = 0;
+	while(true)
+	{
+		AU_UAV_ROS::waypoint temp = planesArray[planeID].getWaypointOfQueue(isAvoidance, count);
+		
+		//past the end of the queue
+		if(temp.latitude == -1000 && temp.longitude == -1000 && temp.altitude == -1000) return count;
+		
+		res.latitudes.push_back(temp.latitude);
+		res.longitudes.push_back(temp.longitude);
+		res.altitudes.push_back(temp.altitude);
+		count++;
+	}
+}
+
+/*
+requestWaypointQueuesCallback(...)
+The batched form of requestWaypointInfoCallback: returns the whole normal and avoidance queues of a list of
+planes (or, if the list is empty, of every plane) in one response, rather than one point per call.  See
+RequestWaypointQueues.srv for how they're laid out.
+
+The response carries queueVersion.  If the client sends back the version it last got and nothing has
+changed since, we just say so and skip filling in the queues.  The version is one counter for every plane, so
+it only says that the answer to the same request (the same planeIDs) hasn't changed; a client that asks for a
+different set of planes has to send 0.
+*/
+bool requestWaypointQueuesCallback(AU_UAV_ROS::RequestWaypointQueues::Request &req, AU_UAV_ROS::RequestWaypointQueues::Response &res)
+{
+	boost::mutex::scoped_lock lock(coordinatorMutex);
+	
+	res.version = queueVersion;
+	res.unchanged = (req.knownVersion == queueVersion);
+	if(res.unchanged) return true;
+	
+	//figure out which planes we're after
+	std::vector<int> ids(req.planeIDs.begin(), req.planeIDs.end());
+	if(ids.empty())
+	{
+		for(unsigned int id = 0; id < planesArray.slot_count(); id++)
+		{
+			if(planesArray.is_active(id)) ids.push_back(id);
+		}
+	}
+	
+	for(unsigned int i = 0; i < ids.size(); i++)
+	{
+		if(!isValidPlaneID(ids[i]))
+		{
+			ROS_ERROR("Invalid plane ID %d in RequestWaypointQueues", ids[i]);
+			res.error = "Invalid plane ID";
+			return false;
+		}
+		
+		res.planeIDs.push_back(ids[i]);
+		res.normalCounts.push_back(appendQueue(ids[i], false, res));
+		res.avoidanceCounts.push_back(appendQueue(ids[i], true, res));
+	}
+	
+	return true;
+}
+
+} //namespace
+
+/*
+startCoordinator(...)
+Subscribes to telemetry, advertises the commands topic and our services.  Services are advertised through
+serve(...) so that the other nodes can call them directly when they share our process.
+*/
+void startCoordinator(ros::NodeHandle &n)
+{
+	//Subscribe to telemetry message and advertise avoid collision service
+	telemetrySub = n.subscribe("telemetry", 1000, telemetryCallback);
+	fleetTelemetrySub = n.subscribe("fleet_telemetry", 10, fleetTelemetryCallback);
+	servers.push_back(serve(n, "request_plane_ID", requestPlaneID));
+	servers.push_back(serve(n, "go_to_waypoint", goToWaypoint));
+	servers.push_back(serve(n, "load_path", loadPathCallback));
+	servers.push_back(serve(n, "request_waypoint_info", requestWaypointInfoCallback));
+	servers.push_back(serve(n, "request_waypoint_queues", requestWaypointQueuesCallback));
+	servers.push_back(serve(n, "load_course", loadCourseCallback));
+	commandPub = n.advertise<AU_UAV_ROS::Command>("commands", 1000);
+	
+	//see commandTolerance
+	ros::NodeHandle privateNode("~");
+	privateNode.param("command_tolerance", commandTolerance, commandTolerance);
+	privateNode.param("command_altitude_tolerance", commandAltitudeTolerance, commandAltitudeTolerance);
+	privateNode.param("command_resend_interval", commandResendInterval, commandResendInterval);
+	
+	//how much we log: debug, info (the default), warn, or error
+	std::string logLevel;
+	privateNode.param("log_level", logLevel, std::string("info"));
+	if(!async_log::instance().set_level(logLevel))
+		ROS_WARN("Unknown log_level \"%s\"; logging at info", logLevel.c_str());
+}
+
+/*
+stopCoordinator(...)
+Reports how many commands were sent and how many were left out as repeats.
+*/
+void stopCoordinator()
+{
+	boost::mutex::scoped_lock lock(coordinatorMutex);
+	ROS_INFO("Sent %d commands; suppressed %d repeats", commandsSent, commandsSuppressed);
+}
+
+#ifndef COMPOSED_NODES
 int main(int argc, char **argv)
 {
 	//Standard ROS startup
 	ros::init(argc, argv, "coordinator");
 	ros::NodeHandle n;
 	
-	//Subscribe to telemetry message and advertise avoid collision service
-	ros::Subscriber sub = n.subscribe("telemetry", 1000, telemetryCallback);
-	ros::ServiceServer newPlaneServer = n.advertiseService("request_plane_ID", requestPlaneID);
-	ros::ServiceServer goToWaypointServer = n.advertiseService("go_to_waypoint", goToWaypoint);
-	ros::ServiceServer loadPathServer = n.advertiseService("load_path", loadPathCallback);
-	ros::ServiceServer requestWaypointInfo = n.advertiseService("request_waypoint_info", requestWaypointInfoCallback);
-	ros::ServiceServer loadCourseServer = n.advertiseService("load_course", loadCourseCallback);
-	commandPub = n.advertise<AU_UAV_ROS::Command>("commands", 1000);
+	startCoordinator(n);
 
 	//Needed for ROS to wait for callbacks
 	ros::spin();	
+	
+	stopCoordinator();
 
 	return 0;
 }
+#endif
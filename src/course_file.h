@@ -0,0 +1,423 @@
+//
+// course_file.h
+// AU_UAV_ROS
+//
+// Reads course files (lines of "planeID latitude longitude altitude") and path
+// files (lines of "latitude longitude altitude", all for one plane). Lines that
+// start with '#' and blank lines are skipped, as they always have been.
+//
+// The file is memory-mapped and parsed in place, without allocating anything
+// per line. The points come back grouped by plane (in the order each plane
+// first shows up in the file, and each plane's points in file order), which
+// is how everything that reads courses wants them.
+//
+// The parsed course is cached in a binary file next to the text one (the path
+// with "bin" on the end, so a.course is cached in a.coursebin), keyed by the
+// text file's modification time (to the nanosecond, so that a course rewritten
+// within the same second doesn't look untouched), size, and inode. As long as the course hasn't been
+// touched, loading it is a matter of checking the cache's header and copying its
+// points. If the cache can't be written (say, the directory is read-only), we
+// just parse the text file every time.
+//
+
+#ifndef COURSE_FILE
+#define COURSE_FILE
+
+#include <map>
+#include <string>
+#include <vector>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifndef natural
+#define natural unsigned int
+#endif
+
+using namespace std;
+
+/**
+ * One waypoint
+ */
+struct course_point
+{
+  double latitude;
+  double longitude;
+  double altitude;
+};
+
+/**
+ * One plane's run of waypoints in course_file::points()
+ */
+struct course_plane
+{
+  int32_t id;     // -1 in a path file, which doesn't name planes
+  uint32_t first; // the index of its first point
+  uint32_t count; // the number of points it has
+};
+
+class course_file
+{
+public:
+  enum format
+  {
+    COURSE, // planeID latitude longitude altitude
+    PATH    // latitude longitude altitude
+  };
+
+  course_file();
+
+  /**
+   * Reads a course or path file, from its cache if the cache is up to date,
+   * and updates the cache if it wasn't
+   * @param path The text file
+   * @param kind Which kind of file it is
+   * @return TRUE if it was read; if not, error() says why, and the course is empty
+   */
+  bool load( const string & path, format kind = COURSE );
+
+  /**
+   * @return the planes in the course, in the order they first show up
+   */
+  const vector< course_plane > & planes() const;
+
+  /**
+   * @return every point in the course, grouped by plane (see planes())
+   */
+  const vector< course_point > & points() const;
+
+  /**
+   * @return why the last load() failed
+   */
+  const string & error() const;
+
+  /**
+   * @return TRUE if the last load() came from the cache
+   */
+  bool from_cache() const;
+
+private:
+  /**
+   * Parses the text of a file into plane_list and point_list
+   */
+  bool parse( const char * text, size_t length, format kind );
+
+  /**
+   * Parses one (non-comment, non-blank) line
+   * @param line The start of the line
+   * @param end The end of the line (its '\n'), which must be followed by
+   *            something strtod() won't read as part of a number
+   * @return FALSE if the line isn't in the expected format
+   */
+  bool parse_line( const char * line, const char * end, format kind,
+                   int & out_id, course_point & out_point ) const;
+
+  bool read_cache( const string & cache_path, const struct stat & source, format kind );
+  void write_cache( const string & cache_path, const struct stat & source, format kind ) const;
+
+  struct cache_header
+  {
+    char magic[ 8 ];      // "AUCOURSE"
+    uint32_t version;     // CACHE_VERSION
+    uint32_t kind;        // the format the text was parsed as
+    int64_t source_mtime; // the text file's modification time (s, ns), size, and inode
+    int64_t source_mtime_ns;
+    int64_t source_size;
+    uint64_t source_inode;
+    uint32_t plane_count; // followed by this many course_planes, then
+    uint32_t point_count; // this many course_points
+  };
+
+  enum { CACHE_VERSION = 2 };
+
+  vector< course_plane > plane_list;
+  vector< course_point > point_list;
+  string last_error;
+  bool cached;
+};
+
+course_file::course_file()
+{
+  cached = false;
+}
+
+const vector< course_plane > & course_file::planes() const
+{
+  return plane_list;
+}
+
+const vector< course_point > & course_file::points() const
+{
+  return point_list;
+}
+
+const string & course_file::error() const
+{
+  return last_error;
+}
+
+bool course_file::from_cache() const
+{
+  return cached;
+}
+
+bool course_file::load( const string & path, format kind )
+{
+  plane_list.clear();
+  point_list.clear();
+  last_error.clear();
+  cached = false;
+
+  int fd = open( path.c_str(), O_RDONLY );
+  struct stat source;
+  if( fd == -1 || fstat( fd, &source ) != 0 )
+  {
+    if( fd != -1 )
+      close( fd );
+    last_error = "Invalid filename or location";
+    return false;
+  }
+
+  string cache_path = path + "bin";
+  if( read_cache( cache_path, source, kind ) )
+  {
+    close( fd );
+    cached = true;
+    return true;
+  }
+
+  bool parsed = true;
+  if( source.st_size > 0 )
+  {
+    void * text = mmap( NULL, source.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if( text == MAP_FAILED )
+    {
+      last_error = "Couldn't map the file";
+      parsed = false;
+    }
+    else
+    {
+      parsed = parse( (const char *)text, source.st_size, kind );
+      munmap( text, source.st_size );
+    }
+  }
+  close( fd );
+
+  if( !parsed )
+  {
+    plane_list.clear();
+    point_list.clear();
+    return false;
+  }
+
+  write_cache( cache_path, source, kind );
+  return true;
+}
+
+bool course_file::parse( const char * text, size_t length, format kind )
+{
+  const char * end = text + length;
+
+  // Size everything up front: at most one point per line
+  natural lines = 1;
+  for( const char * c = text; ( c = (const char *)memchr( c, '\n', end - c ) ) != NULL; c++ )
+    lines++;
+  vector< int > ids;
+  vector< course_point > in_file_order;
+  ids.reserve( lines );
+  in_file_order.reserve( lines );
+
+  natural line_number = 0;
+  for( const char * line = text; line < end; )
+  {
+    const char * eol = (const char *)memchr( line, '\n', end - line );
+    if( eol == NULL )
+      eol = end;
+    line_number++;
+
+    // Skip comments and blank lines
+    const char * first = line;
+    while( first < eol && isspace( *first ) )
+      first++;
+    if( line[ 0 ] != '#' && first < eol )
+    {
+      int id;
+      course_point point;
+      bool good;
+      if( eol < end )
+        good = parse_line( line, eol, kind, id, point );
+      else
+      {
+        // The last line has no newline after it, and there may be nothing mapped
+        // after it either, so give strtod() a copy that ends properly
+        char buffer[ 256 ];
+        size_t n = eol - line;
+        good = ( n < sizeof( buffer ) );
+        if( good )
+        {
+          memcpy( buffer, line, n );
+          buffer[ n ] = '\n';
+          good = parse_line( buffer, buffer + n, kind, id, point );
+        }
+      }
+
+      if( !good )
+      {
+        char message[ 64 ];
+        snprintf( message, sizeof( message ), "Bad file parse on line %u", line_number );
+        last_error = message;
+        return false;
+      }
+
+      ids.push_back( id );
+      in_file_order.push_back( point );
+    }
+
+    line = eol + 1;
+  }
+
+  // Group the points by plane: count each plane's points, then drop each point
+  // into its plane's run
+  map< int, natural > plane_of_id;
+  vector< natural > plane_of_point( ids.size() );
+  for( natural i = 0; i < ids.size(); i++ )
+  {
+    map< int, natural >::iterator found = plane_of_id.find( ids[ i ] );
+    if( found == plane_of_id.end() )
+    {
+      course_plane p;
+      p.id = ids[ i ];
+      p.first = p.count = 0;
+      found = plane_of_id.insert( make_pair( ids[ i ], (natural)plane_list.size() ) ).first;
+      plane_list.push_back( p );
+    }
+    plane_of_point[ i ] = (*found).second;
+    plane_list[ (*found).second ].count++;
+  }
+
+  natural next = 0;
+  vector< natural > filled( plane_list.size(), 0 );
+  for( natural p = 0; p < plane_list.size(); p++ )
+  {
+    plane_list[ p ].first = next;
+    next += plane_list[ p ].count;
+  }
+
+  point_list.resize( in_file_order.size() );
+  for( natural i = 0; i < in_file_order.size(); i++ )
+  {
+    natural p = plane_of_point[ i ];
+    point_list[ plane_list[ p ].first + filled[ p ]++ ] = in_file_order[ i ];
+  }
+  return true;
+}
+
+bool course_file::parse_line( const char * line, const char * end, format kind,
+                              int & out_id, course_point & out_point ) const
+{
+  const char * c = line;
+  char * next;
+
+  out_id = -1;
+  if( kind == COURSE )
+  {
+    long id = strtol( c, &next, 10 );
+    if( next == c || next > end || id < 0 || id > 0x7fffffff )
+      return false;
+    out_id = id;
+    c = next;
+  }
+
+  double * fields[ 3 ] = { &out_point.latitude, &out_point.longitude, &out_point.altitude };
+  for( natural f = 0; f < 3; f++ )
+  {
+    *fields[ f ] = strtod( c, &next );
+
+    // Nothing there (or it was on the next line), or the "invalid" value the
+    // coordinator uses for missing points
+    if( next == c || next > end || *fields[ f ] == -1000 )
+      return false;
+    c = next;
+  }
+  return true;
+}
+
+bool course_file::read_cache( const string & cache_path, const struct stat & source, format kind )
+{
+  int fd = open( cache_path.c_str(), O_RDONLY );
+  if( fd == -1 )
+    return false;
+
+  struct stat info;
+  if( fstat( fd, &info ) != 0 || (size_t)info.st_size < sizeof( cache_header ) )
+  {
+    close( fd );
+    return false;
+  }
+
+  void * m = mmap( NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  close( fd );
+  if( m == MAP_FAILED )
+    return false;
+
+  const char * bytes = (const char *)m;
+  const cache_header * h = (const cache_header *)bytes;
+  bool good = memcmp( h->magic, "AUCOURSE", 8 ) == 0 && h->version == CACHE_VERSION &&
+              h->kind == (uint32_t)kind && h->source_mtime == (int64_t)source.st_mtime &&
+              h->source_mtime_ns == (int64_t)source.st_mtim.tv_nsec &&
+              h->source_size == (int64_t)source.st_size && h->source_inode == (uint64_t)source.st_ino &&
+              (size_t)info.st_size == sizeof( cache_header ) +
+                                      h->plane_count * sizeof( course_plane ) +
+                                      h->point_count * sizeof( course_point );
+  if( good )
+  {
+    const course_plane * planes = (const course_plane *)( bytes + sizeof( cache_header ) );
+    const course_point * points = (const course_point *)( planes + h->plane_count );
+    plane_list.assign( planes, planes + h->plane_count );
+    point_list.assign( points, points + h->point_count );
+  }
+
+  munmap( m, info.st_size );
+  return good;
+}
+
+void course_file::write_cache( const string & cache_path, const struct stat & source,
+                               format kind ) const
+{
+  cache_header h;
+  memset( &h, 0, sizeof( h ) );
+  memcpy( h.magic, "AUCOURSE", 8 );
+  h.version = CACHE_VERSION;
+  h.kind = kind;
+  h.source_mtime = source.st_mtime;
+  h.source_mtime_ns = source.st_mtim.tv_nsec;
+  h.source_size = source.st_size;
+  h.source_inode = source.st_ino;
+  h.plane_count = plane_list.size();
+  h.point_count = point_list.size();
+
+  // Write it under another name and rename it into place, so that nobody ever
+  // reads a cache that's only partly written
+  string temp_path = cache_path + ".tmp";
+  FILE * out = fopen( temp_path.c_str(), "wb" );
+  if( out == NULL )
+    return;
+
+  bool written = fwrite( &h, sizeof( h ), 1, out ) == 1;
+  if( written && !plane_list.empty() )
+    written = fwrite( &plane_list[ 0 ], sizeof( course_plane ), plane_list.size(), out ) == plane_list.size();
+  if( written && !point_list.empty() )
+    written = fwrite( &point_list[ 0 ], sizeof( course_point ), point_list.size(), out ) == point_list.size();
+  written = ( fclose( out ) == 0 ) && written;
+
+  if( !written || rename( temp_path.c_str(), cache_path.c_str() ) != 0 )
+    unlink( temp_path.c_str() );
+}
+
+#endif
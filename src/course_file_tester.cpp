@@ -0,0 +1,165 @@
+//
+//  course_file_tester.cpp
+//  AU_UAV_ROS
+//
+//  Checks the course file reader against the fgets()/sscanf() parsing it
+//  replaced, then times loading a 1000-plane, 100-waypoint stress course, both
+//  from the text and from its .coursebin cache.
+//
+
+#include <cassert>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <time.h>
+#include "course_file.h"
+
+using namespace std;
+
+const char * COURSE_PATH = "/tmp/course_file_tester.course";
+const int PLANES = 1000;
+const int WAYPOINTS = 100;
+
+double seconds_since( const timespec & start )
+{
+  timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  return ( now.tv_sec - start.tv_sec ) + ( now.tv_nsec - start.tv_nsec ) / 1e9;
+}
+
+void write_file( const char * path, const string & text )
+{
+  ofstream out( path );
+  out << text;
+  out.close();
+  unlink( ( string( path ) + "bin" ).c_str() );
+}
+
+void check()
+{
+  course_file c;
+
+  // Comments, blank lines, planes interleaved, and no newline at the end
+  write_file( COURSE_PATH, "# a course\n"
+                           "\n"
+                           "2 32.5 -85.4 400\n"
+                           "   \t\n"
+                           "0 32.6 -85.5 400\n"
+                           "2 32.7 -85.6 400\n"
+                           "#0 1 1 1\n"
+                           "0 32.8 -85.7 410" );
+  assert( c.load( COURSE_PATH ) && !c.from_cache() );
+  assert( c.planes().size() == 2 && c.points().size() == 4 );
+  assert( c.planes()[ 0 ].id == 2 && c.planes()[ 0 ].first == 0 && c.planes()[ 0 ].count == 2 );
+  assert( c.planes()[ 1 ].id == 0 && c.planes()[ 1 ].first == 2 && c.planes()[ 1 ].count == 2 );
+  assert( c.points()[ 1 ].latitude == 32.7 && c.points()[ 3 ].altitude == 410 );
+
+  // The second time, it comes from the cache, and matches
+  course_file again;
+  assert( again.load( COURSE_PATH ) && again.from_cache() );
+  assert( again.points().size() == 4 && again.points()[ 3 ].longitude == -85.7 );
+
+  // Missing fields (even if the next line would fill them in), bad IDs, and the
+  // coordinator's "invalid" value are all bad parses
+  write_file( COURSE_PATH, "1 32.5 -85.4\n2 400 32 -85\n" );
+  assert( !c.load( COURSE_PATH ) && c.error() == "Bad file parse on line 1" && c.points().empty() );
+  write_file( COURSE_PATH, "1 32.5 -85.4 400\n-1 32.5 -85.4 400\n" );
+  assert( !c.load( COURSE_PATH ) && c.error() == "Bad file parse on line 2" );
+  write_file( COURSE_PATH, "1 32.5 -1000 400\n" );
+  assert( !c.load( COURSE_PATH ) );
+  assert( !c.load( "/tmp/no/such/course" ) && c.error() == "Invalid filename or location" );
+
+  // Paths have no plane IDs
+  write_file( COURSE_PATH, "32.5 -85.4 400\n32.6 -85.5 400\n" );
+  assert( c.load( COURSE_PATH, course_file::PATH ) );
+  assert( c.planes().size() == 1 && c.planes()[ 0 ].id == -1 && c.points().size() == 2 );
+
+  // A cache made for one kind of file isn't used for the other
+  c.load( COURSE_PATH, course_file::COURSE );
+  assert( !c.from_cache() );
+
+  // A course rewritten in place right away, to the same size, isn't read from
+  // the old cache (its modification time differs only in the nanoseconds)
+  write_file( COURSE_PATH, "1 32.5 -85.4 400\n" );
+  assert( c.load( COURSE_PATH ) && !c.from_cache() );
+  {
+    ofstream out( COURSE_PATH );
+    out << "2 32.5 -85.4 400\n";
+  }
+  assert( c.load( COURSE_PATH ) && !c.from_cache() && c.planes()[ 0 ].id == 2 );
+
+  cout << "course_file checks passed" << endl;
+}
+
+int main()
+{
+  check();
+
+  // Make the stress course, with the planes' points interleaved as in the
+  // generated courses
+  srand( 1 );
+  ofstream out( COURSE_PATH );
+  out << "# stress course" << endl << setprecision( 10 );
+  for( int w = 0; w < WAYPOINTS; w++ )
+    for( int p = 0; p < PLANES; p++ )
+      out << p << " " << 32.59 + rand() / (double)RAND_MAX * 0.01 << " "
+          << -85.49 + rand() / (double)RAND_MAX * 0.01 << " " << 400 << endl;
+  out.close();
+  unlink( ( string( COURSE_PATH ) + "bin" ).c_str() );
+
+  // The old way: fgets() and sscanf(), one line at a time, into a map of queues
+  timespec start;
+  clock_gettime( CLOCK_MONOTONIC, &start );
+  map< int, vector< course_point > > old_course;
+  FILE * fp = fopen( COURSE_PATH, "r" );
+  char buffer[ 256 ];
+  while( fgets( buffer, sizeof( buffer ), fp ) )
+  {
+    if( buffer[ 0 ] == '#' )
+      continue;
+    int id = -1;
+    course_point pt;
+    sscanf( buffer, "%d %lf %lf %lf\n", &id, &pt.latitude, &pt.longitude, &pt.altitude );
+    old_course[ id ].push_back( pt );
+  }
+  fclose( fp );
+  double old_time = seconds_since( start );
+
+  course_file text, cache;
+  clock_gettime( CLOCK_MONOTONIC, &start );
+  bool loaded = text.load( COURSE_PATH );
+  double text_time = seconds_since( start );
+  assert( loaded && !text.from_cache() );
+
+  clock_gettime( CLOCK_MONOTONIC, &start );
+  loaded = cache.load( COURSE_PATH );
+  double cache_time = seconds_since( start );
+  assert( loaded && cache.from_cache() );
+
+  // Both have to match sscanf() exactly
+  assert( text.planes().size() == (natural)PLANES && cache.points().size() == text.points().size() );
+  for( natural p = 0; p < text.planes().size(); p++ )
+  {
+    const course_plane & plane = text.planes()[ p ];
+    const vector< course_point > & expected = old_course[ plane.id ];
+    assert( plane.count == expected.size() );
+    for( natural i = 0; i < plane.count; i++ )
+    {
+      const course_point & a = text.points()[ plane.first + i ];
+      const course_point & b = cache.points()[ plane.first + i ];
+      assert( a.latitude == expected[ i ].latitude && a.longitude == expected[ i ].longitude &&
+              a.altitude == expected[ i ].altitude );
+      assert( memcmp( &a, &b, sizeof( a ) ) == 0 );
+    }
+  }
+
+  cout << PLANES << " planes x " << WAYPOINTS << " waypoints:" << endl;
+  cout << "  fgets/sscanf:      " << old_time * 1000 << " ms" << endl;
+  cout << "  course_file, text: " << text_time * 1000 << " ms" << endl;
+  cout << "  course_file, cache: " << cache_time * 1000 << " ms" << endl;
+
+  unlink( COURSE_PATH );
+  unlink( ( string( COURSE_PATH ) + "bin" ).c_str() );
+  return 0;
+}
@@ -0,0 +1,121 @@
+//
+//  danger_grid_tester.cpp
+//  AU_UAV_ROS
+//
+//  Checks that splitting danger grid construction across worker threads (see
+//  danger_tile_workers) doesn't change the grid: for random fleets of a few
+//  sizes, every square at every second must come out bit-for-bit the same on N
+//  workers as on one, grid after grid (the workers are reused from one grid to
+//  the next). Then times both.
+//
+
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <vector>
+#include <time.h>
+#include "danger_grid_with_turns.h"
+#include "FieldGeometry.h"
+#include "Plane_fixed.h"
+
+using namespace std;
+
+// Constants for the 700 field
+const double resolution = 10;
+const double upper_left_longitude = -115.808173;
+const double upper_left_latitude = 37.244956;
+const double width_in_degrees_longitude = 0.020983;
+const double height_in_degrees_latitude = -0.016023;
+
+const FieldGeometry field( upper_left_longitude, upper_left_latitude,
+                           width_in_degrees_longitude, height_in_degrees_latitude,
+                           resolution );
+
+const natural workers_to_test = 4;
+
+int failures = 0;
+
+Position random_position()
+{
+  double longitude = upper_left_longitude + width_in_degrees_longitude * rand() / RAND_MAX;
+  double latitude = upper_left_latitude + height_in_degrees_latitude * rand() / RAND_MAX;
+  return Position( &field, longitude, latitude );
+}
+
+fleet_table random_fleet( natural num_planes )
+{
+  std::map< int, Plane > planes;
+  for( natural i = 0; i < num_planes; i++ )
+  {
+    planes[ i ] = Plane( i, random_position(), random_position() );
+    planes[ i ].update( random_position(), random_position(), 30 );
+  }
+  return fleet_table( planes );
+}
+
+double seconds_since( const timespec & start )
+{
+  timespec end;
+  clock_gettime( CLOCK_MONOTONIC, &end );
+  return ( end.tv_sec - start.tv_sec ) + ( end.tv_nsec - start.tv_nsec ) / 1e9;
+}
+
+// Builds the grid for every plane in the fleet, once on one thread and once on
+// workers_to_test, and compares them square by square
+void check_fleet( natural num_planes )
+{
+  fleet_table fleet = random_fleet( num_planes );
+  double width = field.getWidthInMeters();
+  double height = field.getHeightInMeters();
+
+  double single_secs = 0, split_secs = 0;
+  natural squares_differing = 0;
+  for( natural id = 0; id < num_planes; id++ )
+  {
+    timespec start;
+    danger_tile_workers = 1;
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    danger_grid single( &fleet, width, height, resolution, id );
+    single_secs += seconds_since( start );
+
+    danger_tile_workers = workers_to_test;
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    danger_grid split( &fleet, width, height, resolution, id );
+    split_secs += seconds_since( start );
+
+    for( int t = 0; t <= (int)single.get_time_in_secs(); t++ )
+      for( natural x = 0; x < single.get_width_in_squares(); x++ )
+        for( natural y = 0; y < single.get_height_in_squares(); y++ )
+          if( single( x, y, t ) != split( x, y, t ) )
+            squares_differing++;
+  }
+
+  if( squares_differing > 0 )
+  {
+    cout << "FAILED: " << num_planes << " planes: " << squares_differing
+         << " squares differ between 1 and " << workers_to_test << " workers" << endl;
+    failures++;
+  }
+  cout << setw( 4 ) << num_planes << " planes: 1 worker " << single_secs * 1000 / num_planes
+       << " ms/grid, " << workers_to_test << " workers " << split_secs * 1000 / num_planes
+       << " ms/grid" << endl;
+}
+
+int main()
+{
+  srand( 700 );
+  cout << setprecision( 3 );
+
+  natural sizes[] = { 8, 32, 64 };
+  for( int s = 0; s < 3; s++ )
+    check_fleet( sizes[ s ] );
+
+  if( failures > 0 )
+  {
+    cout << failures << " checks failed" << endl;
+    return 1;
+  }
+  cout << "All checks passed" << endl;
+  return 0;
+}
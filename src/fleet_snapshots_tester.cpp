@@ -0,0 +1,105 @@
+//
+//  fleet_snapshots_tester.cpp
+//  AU_UAV_ROS
+//
+//  Stress tests fleet_snapshots with one writer and three readers. The writer
+//  publishes version after version of a fleet in which every row is stamped with
+//  the version's number; the readers pin, check that every row of what they got
+//  carries the same stamp (so nothing changed under them), and unpin, as fast as
+//  they can. At the end, every replaced version must have been freed.
+//
+//  Build with -fsanitize=address (or thread) to catch a version freed while a
+//  reader still holds it.
+//
+
+#define DEBUG
+
+#include <iostream>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include "fleet_snapshots.h"
+
+using namespace std;
+
+const natural planes = 64;
+const natural versions = 20000;
+const natural readers = 3;
+
+fleet_snapshots snapshots;
+boost::atomic< bool > writing( true );
+boost::atomic< natural > bad_versions( 0 );
+boost::atomic< natural > pins( 0 );
+
+void read( natural )
+{
+  int reader = snapshots.register_reader();
+  if( reader == -1 )
+  {
+    bad_versions++;
+    return;
+  }
+
+  natural last_seen = 0;
+  while( writing.load() )
+  {
+    const fleet_version * version = snapshots.pin( reader );
+
+    // Versions only go forward, and every row is from this one
+    bool good = version->number >= last_seen &&
+                version->fleet.size() == ( version->number == 0 ? 0 : planes );
+    for( natural slot = 0; good && slot < version->fleet.size(); slot++ )
+      good = version->fleet.altitude()[ slot ] == version->number &&
+             version->fleet.x()[ slot ] == (int)( version->number % 1000 );
+    last_seen = version->number;
+
+    snapshots.unpin( reader );
+    pins++;
+    if( !good )
+      bad_versions++;
+  }
+  snapshots.unregister_reader( reader );
+}
+
+int main()
+{
+  boost::thread_group reader_threads;
+  for( natural i = 0; i < readers; i++ )
+    reader_threads.create_thread( boost::bind( read, i ) );
+
+  fleet_table fleet;
+  natural most_retired = 0;
+  for( natural v = 1; v <= versions; v++ )
+  {
+    for( natural id = 0; id < planes; id++ )
+      fleet.set( id, v % 1000, id, 0, 0, 0, 0, 0, 0, v );
+    snapshots.publish( fleet );
+    if( snapshots.retired_count() > most_retired )
+      most_retired = snapshots.retired_count();
+    if( v % 64 == 0 )
+      boost::this_thread::yield();
+  }
+  writing.store( false );
+  reader_threads.join_all();
+
+  // With nobody pinned, the next publish frees everything it replaces
+  snapshots.publish( fleet );
+
+  cout << versions << " versions published, " << pins.load() << " pins by " << readers
+       << " readers; at most " << most_retired << " versions waiting to be freed" << endl;
+
+  int failures = 0;
+  if( bad_versions.load() > 0 )
+  {
+    cout << "FAILED: " << bad_versions.load() << " pinned versions changed or went backward" << endl;
+    failures++;
+  }
+  if( snapshots.retired_count() != 0 )
+  {
+    cout << "FAILED: " << snapshots.retired_count() << " replaced versions were never freed" << endl;
+    failures++;
+  }
+  if( failures > 0 )
+    return 1;
+  cout << "All checks passed" << endl;
+  return 0;
+}
@@ -0,0 +1,93 @@
+//
+//  headlessSimulator.cpp
+//  AU_UAV_ROS
+//
+//  Flies a course through collision avoidance with no ROS nodes, on a simulated
+//  clock, as fast as the planner will go (see headless_simulation.h), and reports
+//  how it went: conflicts, the closest any two planes came, how far the planes
+//  flew compared to their courses, and how long planning took.
+//
+//  Usage: headlessSimulator field.txt course_file [max_seconds [tick [deadline_ms]]]
+//
+//  With no deadline (the default), collision avoidance always finishes planning,
+//  so a course flown twice comes out the same. Build it from collisionAvoidance.cpp,
+//  compiled with COMPOSED_NODES defined, and this file, in the ROS build
+//  environment (it needs no roscore, but it links roscpp).
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "headless_simulation.h"
+
+using namespace std;
+
+int main( int argc, char ** argv )
+{
+  if( argc < 3 )
+  {
+    fprintf( stderr, "Usage: %s field.txt course_file [max_seconds [tick [deadline_ms]]]\n", argv[ 0 ] );
+    return 1;
+  }
+
+  FieldGeometry field;
+  if( !field.load( argv[ 1 ] ) )
+  {
+    fprintf( stderr, "Couldn't read the field from %s\n", argv[ 1 ] );
+    return 1;
+  }
+
+  course_file course;
+  if( !course.load( argv[ 2 ] ) )
+  {
+    fprintf( stderr, "Couldn't read the course from %s: %s\n", argv[ 2 ], course.error().c_str() );
+    return 1;
+  }
+
+  headless_config config;
+  if( argc > 3 )
+    config.max_seconds = atof( argv[ 3 ] );
+  if( argc > 4 )
+    config.tick = atof( argv[ 4 ] );
+  if( argc > 5 )
+    config.planning_deadline_ms = atof( argv[ 5 ] );
+
+  headless_simulation sim( &field, config );
+  sim.add_course( course );
+  const headless_result & r = sim.run();
+
+  vector< double > sorted( r.plan_ms );
+  sort( sorted.begin(), sorted.end() );
+  double median = sorted.empty() ? 0 : sorted[ sorted.size() / 2 ];
+  double total_plan_ms = 0;
+  for( natural i = 0; i < sorted.size(); i++ )
+    total_plan_ms += sorted[ i ];
+
+  printf( "Course:     %u planes, %u points\n", r.planes, (natural)course.points().size() );
+  printf( "Simulated:  %.0f s in %u ticks, in %.2f s (%.0fx real time)\n", r.simulated_seconds,
+          r.ticks, r.wall_seconds, r.wall_seconds > 0 ? r.simulated_seconds / r.wall_seconds : 0 );
+  printf( "Finished:   %u of %u planes; %u points reached\n", r.planes_finished, r.planes,
+          r.points_reached );
+  printf( "Conflicts:  %u (closer than %.0f m); minimum separation %.1f m\n", r.conflicts,
+          config.conflict_distance, r.min_separation );
+  printf( "Distance:   %.0f m flown, %.0f m of course (%.2fx)\n", r.distance_flown, r.course_length,
+          r.course_length > 0 ? r.distance_flown / r.course_length : 0 );
+  printf( "Planning:   %u plans, mean %.3f ms, median %.3f ms, max %.3f ms\n", (natural)sorted.size(),
+          sorted.empty() ? 0 : total_plan_ms / sorted.size(), median, sorted.empty() ? 0 : sorted.back() );
+  printf( "Batches:    %u updates in %u ticks, %u waypoints sent; per tick mean %.3f ms, max %.3f ms\n",
+          r.updates, r.batches, r.commands, r.batches > 0 ? r.total_batch_ms / r.batches : 0,
+          r.max_batch_ms );
+
+  printf( "\n  plane   finished at   flown (m)   course (m)\n" );
+  for( natural i = 0; i < sim.planes().size(); i++ )
+  {
+    const headless_plane & p = sim.planes()[ i ];
+    if( p.finished )
+      printf( "  %5d   %9.0f s   %9.0f   %10.0f\n", p.id, p.finish_time, p.distance_flown,
+              p.course_length );
+    else
+      printf( "  %5d   %11s   %9.0f   %10.0f\n", p.id, "-", p.distance_flown, p.course_length );
+  }
+
+  return 0;
+}
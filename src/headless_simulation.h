@@ -0,0 +1,666 @@
+//
+// headless_simulation.h
+// AU_UAV_ROS
+//
+// Flies a course on a simulated clock, with no ROS nodes: no simulator or
+// coordinator, and no waiting on ros::Rate. Collision avoidance itself runs in
+// this process, through the entry points telemetryReplay uses (see
+// node_composition.h), so what's flown is exactly what the node would do: each
+// tick, every plane's telemetry is handed to it as one batch, and it decides
+// whom to replan (see replan_reason() in collisionAvoidance.cpp), plans in the
+// planes' altitude layers, sends multi-waypoint plans, pushes planes that are
+// circling their goals out and back around, and (given a deadline) falls back
+// when planning runs late. Ticks follow one another as fast as it allows.
+//
+// The simulation stands in for the coordinator, answering collision avoidance's
+// request_waypoint_info and go_to_waypoint calls as it would: a plane's normal
+// queue is the rest of its course, and the waypoints collision avoidance sends
+// make up its avoidance queue, which it flies first.
+//
+// Collision avoidance only plans over its field, so a plane is only reported to
+// it while the plane and the course point it's headed for are both on the field;
+// a plane that strays off is reported as having left, and flies straight for its
+// course point until it's back.
+//
+// The planes fly as the simulator's planes do (they're a sim_fleet): at a
+// constant speed, turning no faster than a fixed rate, toward the front of their
+// queues, all of them advanced at once each tick. A plane that comes within
+// waypoint_radius of the point it's headed for moves on to the next, and leaves
+// the simulation when it has reached the last point of its course.
+//
+// Nothing in a run depends on the wall clock (unless it's given a planning
+// deadline; by default there's none) or on the order things happen in but the
+// order of the planes' IDs, so a course flown twice with the same settings comes
+// out exactly the same. Only the planner timings differ from run to run.
+//
+// This is not ROS-free. It needs no roscore and no other nodes running, but
+// collisionAvoidance.cpp is still built from its ROS sources: this header and
+// collision avoidance use roscpp's types and the package's generated service
+// headers, and the program links roscpp. It takes the same build environment
+// as the nodes. Build with collisionAvoidance.cpp, compiled with COMPOSED_NODES
+// defined. Collision avoidance's state is global, so only one
+// headless_simulation can exist at a time.
+//
+
+#ifndef HEADLESS_SIMULATION
+#define HEADLESS_SIMULATION
+
+#include <deque>
+#include <set>
+#include <vector>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include "ros/ros.h"
+#include "AU_UAV_ROS/GoToWaypoint.h"
+#include "AU_UAV_ROS/RequestWaypointInfo.h"
+#include "node_composition.h"
+#include "telemetry_recording.h"
+#include "a_star/map_tools.h"
+#include "a_star/FieldGeometry.h"
+#include "course_file.h"
+#include "sim_fleet.h"
+
+#ifndef natural
+#define natural unsigned int
+#endif
+
+using namespace std;
+
+/**
+ * How a headless run is flown
+ */
+struct headless_config
+{
+  double tick;                 // simulated seconds per step (the simulator sends updates at 1 Hz)
+  double speed;                // the planes' ground speed, m/s
+  double max_turn_rate;        // the fastest the planes can turn, degrees/s
+  double waypoint_radius;      // how close (m) a plane has to come to a waypoint to have reached it
+  double conflict_distance;    // two planes closer than this (m) are in conflict
+  double max_seconds;          // simulated time after which the run is stopped, finished or not
+  double planning_deadline_ms; // collision avoidance's planning deadline; 0 for none
+  natural tile_workers;        // threads it fills danger grids with; 0 for one per core
+
+  headless_config()
+  {
+    tick = 1.0;
+    speed = 11.176; // 25 mph
+    max_turn_rate = 22.5;
+    waypoint_radius = 10;
+    conflict_distance = 12;
+    max_seconds = 3600;
+    planning_deadline_ms = 0;
+    tile_workers = 0;
+  }
+};
+
+/**
+ * One simulated plane's progress through its course (where it is, and where it's
+ * headed, are kept in the simulation's sim_fleet)
+ */
+struct headless_plane
+{
+  int id;
+  natural first, count;             // its points in the course (see course_plane)
+  natural next_point;               // the course point it's headed for
+  deque< course_point > avoidance;  // the waypoints collision avoidance sent it, still to fly
+  bool reported;                    // TRUE while collision avoidance knows of it
+  bool finished;                    // TRUE once it has reached its last point
+  double finish_time;               // when it did (simulated seconds)
+  double distance_flown;            // m
+  double course_length;             // m, straight from point to point
+};
+
+/**
+ * What happened in a headless run
+ */
+struct headless_result
+{
+  natural ticks;
+  double simulated_seconds;
+  natural planes;
+  natural planes_finished;
+  natural points_reached;
+
+  // A conflict is counted each time two planes come within the conflict
+  // distance of each other (not for every tick they stay that close)
+  natural conflicts;
+  double min_separation; // m, between any two planes at any tick
+
+  double distance_flown; // m, all planes together
+  double course_length;  // m, all planes' courses flown straight, together
+
+  natural updates;          // telemetry updates handed to collision avoidance
+  natural commands;         // waypoints it sent
+  natural batches;           // ticks' worth of updates it handled
+  double total_batch_ms;     // time it took handling them
+  double max_batch_ms;
+  vector< double > batch_ms; // every batch's time, in order
+  vector< double > plan_ms;  // the time each of its plans (best cost grid and A*) took, in order
+
+  double wall_seconds;   // how long the run took
+};
+
+class headless_simulation
+{
+public:
+  /**
+   * Sets up a run over a field, starting collision avoidance on it
+   * @param field The field the course is flown in; it must outlive the simulation
+   * @param config How to fly it
+   */
+  headless_simulation( const FieldGeometry * field, const headless_config & config );
+
+  /**
+   * Stops collision avoidance
+   */
+  ~headless_simulation();
+
+  /**
+   * Adds every plane in a course, each starting at its first point, pointed at its
+   * second. Planes with fewer than two points have nowhere to go, and are left out.
+   * @param course A loaded course
+   * @return the number of planes added
+   */
+  natural add_course( const course_file & course );
+
+  /**
+   * Adds one plane, starting at its first point, pointed at its second
+   * @param id The plane's ID (non-negative, and not already in the simulation)
+   * @param course_points The plane's course, in the order it's to be flown
+   * @param count The number of points in it (at least two)
+   * @return FALSE if the plane couldn't be added (too few points, or its ID is taken)
+   */
+  bool add_plane( int id, const course_point * course_points, natural count );
+
+  /**
+   * Flies the course until every plane has finished or max_seconds have passed
+   * @return what happened
+   */
+  const headless_result & run();
+
+  /**
+   * Advances the simulation one tick: hands every plane's telemetry to collision
+   * avoidance, flies the planes, and checks them for conflicts
+   * @return FALSE if every plane had already finished
+   */
+  bool step();
+
+  const vector< headless_plane > & planes() const;
+  const headless_result & result() const;
+
+private:
+  /**
+   * Sends collision avoidance the telemetry of every plane still flying over the
+   * field, as the simulator's fleet telemetry would, along with word of the planes
+   * that have finished or left the field since last tick
+   */
+  void report();
+
+  /**
+   * Points a plane at the front of its avoidance queue or, if that's empty, its
+   * next course point
+   */
+  void aim( const headless_plane & p );
+
+  /**
+   * Moves a plane on to its next waypoint if it has reached this one (after it
+   * has flown the tick)
+   */
+  void check_goal( headless_plane & p );
+
+  /**
+   * Counts new conflicts and updates the minimum separation
+   */
+  void check_separation();
+
+  const course_point & point_of( const headless_plane & p, natural i ) const;
+
+  /**
+   * @return the plane with that ID, or NULL if there's none
+   */
+  headless_plane * plane_by_id( int id );
+
+  /**
+   * @return TRUE if the grid square is in the field
+   */
+  bool on_grid( int x, int y ) const;
+
+  /*
+   * The coordinator's services, as collision avoidance calls them (through
+   * serve_locally()), answered for the simulation that's running
+   */
+  static bool request_waypoint_info( AU_UAV_ROS::RequestWaypointInfo::Request & req,
+                                     AU_UAV_ROS::RequestWaypointInfo::Response & res );
+  static bool go_to_waypoint( AU_UAV_ROS::GoToWaypoint::Request & req,
+                              AU_UAV_ROS::GoToWaypoint::Response & res );
+  static headless_simulation * running;
+
+  const FieldGeometry * field;
+  headless_config config;
+  bool started; // TRUE if collision avoidance is running
+  vector< course_point > points;
+  vector< double > point_east, point_south; // the points, in kinematics' local coordinates
+  vector< headless_plane > fleet_state;     // in ID order
+  vector< int > index_by_id;                // each plane's place in fleet_state, by ID (-1 for none)
+
+  // Where the planes still flying are, and where they're headed
+  sim_fleet kinematics;
+
+  // The planes that finished last tick, which collision avoidance has yet to hear of
+  vector< int > departed;
+
+  // The pairs of planes (lower ID first) in conflict as of the last tick
+  set< pair< int, int > > in_conflict;
+
+  headless_result totals;
+};
+
+headless_simulation * headless_simulation::running = NULL;
+
+headless_simulation::headless_simulation( const FieldGeometry * field_to_use,
+                                          const headless_config & config_to_use )
+{
+  field = field_to_use;
+  config = config_to_use;
+
+  totals.ticks = 0;
+  totals.simulated_seconds = 0;
+  totals.planes = totals.planes_finished = totals.points_reached = 0;
+  totals.conflicts = 0;
+  totals.min_separation = HUGE_VAL;
+  totals.distance_flown = totals.course_length = 0;
+  totals.updates = totals.commands = totals.batches = 0;
+  totals.total_batch_ms = totals.max_batch_ms = 0;
+  totals.wall_seconds = 0;
+
+  // We're the coordinator, and the field is all collision avoidance needs to know
+  running = this;
+  serve_locally( "request_waypoint_info", request_waypoint_info );
+  serve_locally( "go_to_waypoint", go_to_waypoint );
+
+  vector< telemetry_record > setup( 1 );
+  telemetry_record & r = setup[ 0 ];
+  memset( &r, 0, sizeof( r ) );
+  r.kind = telemetry_record::FIELD;
+  r.plane_id = -1;
+  r.values[ 0 ] = field->getUpperLeftLongitude();
+  r.values[ 1 ] = field->getUpperLeftLatitude();
+  r.values[ 2 ] = field->getLonWidth();
+  r.values[ 3 ] = field->getLatWidth();
+  r.values[ 4 ] = field->getResolution();
+  started = startCollisionAvoidanceReplay( setup, config.planning_deadline_ms, config.tile_workers );
+}
+
+headless_simulation::~headless_simulation()
+{
+  if( started )
+    stopCollisionAvoidanceReplay();
+  running = NULL;
+}
+
+natural headless_simulation::add_course( const course_file & course )
+{
+  natural added = 0;
+  for( natural i = 0; i < course.planes().size(); i++ )
+  {
+    const course_plane & run = course.planes()[ i ];
+    if( run.count >= 2 && add_plane( run.id, &course.points()[ run.first ], run.count ) )
+      added++;
+  }
+  return added;
+}
+
+bool headless_simulation::add_plane( int id, const course_point * course_points, natural count )
+{
+  if( count < 2 )
+    return false;
+
+  headless_plane p;
+  p.id = id;
+  p.first = points.size();
+  p.count = count;
+
+  const course_point & start = course_points[ 0 ];
+  const course_point & second = course_points[ 1 ];
+  double bearing = map_tools::calculateBearing( start.latitude, start.longitude,
+                                                second.latitude, second.longitude );
+  if( !kinematics.add( p.id, start.latitude, start.longitude, start.altitude, bearing,
+                       config.speed, config.max_turn_rate ) )
+    return false; // the same ID twice
+  kinematics.set_target( p.id, second.latitude, second.longitude, second.altitude );
+
+  points.insert( points.end(), course_points, course_points + count );
+
+  // Convert the whole course at once: each point into kinematics' coordinates,
+  // and each leg into its length
+  vector< double > latitudes( count ), longitudes( count ), legs( count - 1 );
+  for( natural j = 0; j < count; j++ )
+  {
+    latitudes[ j ] = course_points[ j ].latitude;
+    longitudes[ j ] = course_points[ j ].longitude;
+  }
+  point_east.resize( points.size() );
+  point_south.resize( points.size() );
+  kinematics.project( &latitudes[ 0 ], &longitudes[ 0 ], count,
+                      &point_east[ p.first ], &point_south[ p.first ] );
+  map_tools::calculate_distances_between_points( &latitudes[ 0 ], &longitudes[ 0 ],
+                                                 &latitudes[ 1 ], &longitudes[ 1 ],
+                                                 count - 1, &legs[ 0 ] );
+
+  p.next_point = 1;
+  p.reported = false;
+  p.finished = false;
+  p.finish_time = 0;
+  p.distance_flown = 0;
+
+  p.course_length = 0;
+  for( natural j = 0; j + 1 < count; j++ )
+    p.course_length += legs[ j ];
+
+  // Keep them in ID order, so that every run reports them in the same order
+  vector< headless_plane >::iterator at = fleet_state.end();
+  while( at != fleet_state.begin() && ( at - 1 )->id > p.id )
+    at--;
+  natural index = at - fleet_state.begin();
+  fleet_state.insert( at, p );
+  if( index_by_id.size() <= (natural)p.id )
+    index_by_id.resize( p.id + 1, -1 );
+  for( natural i = index; i < fleet_state.size(); i++ )
+    index_by_id[ fleet_state[ i ].id ] = i;
+
+  totals.course_length += p.course_length;
+  totals.planes = fleet_state.size();
+  return true;
+}
+
+const headless_result & headless_simulation::run()
+{
+  timespec start, end;
+  clock_gettime( CLOCK_MONOTONIC, &start );
+
+  while( totals.simulated_seconds < config.max_seconds && step() )
+    ;
+
+  clock_gettime( CLOCK_MONOTONIC, &end );
+  totals.wall_seconds = ( end.tv_sec - start.tv_sec ) + ( end.tv_nsec - start.tv_nsec ) / 1e9;
+  return totals;
+}
+
+bool headless_simulation::step()
+{
+  if( totals.planes_finished == fleet_state.size() )
+    return false;
+
+  // Everyone reports from where they are now, and collision avoidance answers . . .
+  report();
+
+  // . . . then they all fly the tick at once
+  kinematics.step( config.tick );
+  for( natural i = 0; i < fleet_state.size(); i++ )
+    if( !fleet_state[ i ].finished )
+      check_goal( fleet_state[ i ] );
+
+  totals.ticks++;
+  totals.simulated_seconds += config.tick;
+  check_separation();
+  return true;
+}
+
+void headless_simulation::report()
+{
+  if( !started )
+    return;
+
+  vector< telemetry_record > batch;
+  telemetry_record r;
+  memset( &r, 0, sizeof( r ) );
+  r.kind = telemetry_record::TELEMETRY;
+  r.received = totals.simulated_seconds;
+
+  for( natural i = 0; i < departed.size(); i++ )
+  {
+    r.flags = telemetry_record::DEPARTED;
+    r.plane_id = departed[ i ];
+    batch.push_back( r );
+  }
+  departed.clear();
+
+  // Find the grid squares of every plane and the course point it's headed for at
+  // once (the squares collision avoidance would put them in), to tell which are
+  // over the field
+  natural n = kinematics.size();
+  vector< double > goal_latitudes( n ), goal_longitudes( n );
+  for( natural slot = 0; slot < n; slot++ )
+  {
+    const headless_plane & p = *plane_by_id( kinematics.ids()[ slot ] );
+    goal_latitudes[ slot ] = point_of( p, p.next_point ).latitude;
+    goal_longitudes[ slot ] = point_of( p, p.next_point ).longitude;
+  }
+  vector< int > x( n ), y( n ), goal_x( n ), goal_y( n );
+  if( n > 0 )
+  {
+    field->lat_lon_to_grid( &kinematics.latitude()[ 0 ], &kinematics.longitude()[ 0 ], n, &x[ 0 ], &y[ 0 ] );
+    field->lat_lon_to_grid( &goal_latitudes[ 0 ], &goal_longitudes[ 0 ], n, &goal_x[ 0 ], &goal_y[ 0 ] );
+  }
+
+  natural reported = 0;
+  for( natural slot = 0; slot < n; slot++ )
+  {
+    headless_plane & p = *plane_by_id( kinematics.ids()[ slot ] );
+    r.plane_id = p.id;
+    r.flags = 0;
+    memset( r.values, 0, sizeof( r.values ) );
+    if( !on_grid( x[ slot ], y[ slot ] ) || !on_grid( goal_x[ slot ], goal_y[ slot ] ) )
+    {
+      if( p.reported )
+      {
+        r.flags = telemetry_record::DEPARTED;
+        batch.push_back( r );
+        p.reported = false;
+        p.avoidance.clear();
+        aim( p );
+      }
+      continue;
+    }
+
+    r.values[ 0 ] = kinematics.longitude()[ slot ];
+    r.values[ 1 ] = kinematics.latitude()[ slot ];
+    r.values[ 2 ] = kinematics.altitude()[ slot ];
+    r.values[ 3 ] = kinematics.target_longitude()[ slot ];
+    r.values[ 4 ] = kinematics.target_latitude()[ slot ];
+    r.values[ 5 ] = kinematics.target_altitude()[ slot ];
+    r.values[ 6 ] = kinematics.speed()[ slot ];
+    r.values[ 7 ] = kinematics.bearing_to_target( slot );
+    batch.push_back( r );
+    p.reported = true;
+    reported++;
+  }
+  if( batch.empty() )
+    return;
+  batch[ 0 ].flags |= telemetry_record::BATCH_START;
+
+  double ms = replayTelemetry( batch );
+  totals.updates += reported;
+  totals.batches++;
+  totals.total_batch_ms += ms;
+  if( ms > totals.max_batch_ms )
+    totals.max_batch_ms = ms;
+  totals.batch_ms.push_back( ms );
+  takeReplayPlanTimes( totals.plan_ms );
+}
+
+void headless_simulation::aim( const headless_plane & p )
+{
+  const course_point & to = p.avoidance.empty() ? point_of( p, p.next_point ) : p.avoidance.front();
+  kinematics.set_target( p.id, to.latitude, to.longitude, to.altitude );
+}
+
+void headless_simulation::check_goal( headless_plane & p )
+{
+  int slot = kinematics.slot_of( p.id );
+  double distance = config.speed * config.tick;
+  p.distance_flown += distance;
+  totals.distance_flown += distance;
+
+  // It's headed for the front of its avoidance queue, if there's anything in it,
+  // and otherwise for its next course point
+  double target_east, target_south;
+  if( !p.avoidance.empty() )
+    kinematics.project( p.avoidance.front().latitude, p.avoidance.front().longitude,
+                        target_east, target_south );
+  else
+  {
+    target_east = point_east[ p.first + p.next_point ];
+    target_south = point_south[ p.first + p.next_point ];
+  }
+
+  double de = kinematics.east()[ slot ] - target_east;
+  double ds = kinematics.south()[ slot ] - target_south;
+  if( de * de + ds * ds > config.waypoint_radius * config.waypoint_radius )
+    return;
+
+  if( !p.avoidance.empty() )
+  {
+    p.avoidance.pop_front();
+    aim( p );
+    return;
+  }
+
+  totals.points_reached++;
+  p.next_point++;
+  if( p.next_point < p.count )
+  {
+    aim( p );
+    return;
+  }
+
+  // That was its last point; it's done, and no longer a threat to anyone
+  p.finished = true;
+  p.finish_time = totals.simulated_seconds + config.tick;
+  totals.planes_finished++;
+  if( p.reported )
+    departed.push_back( p.id );
+  kinematics.remove( p.id );
+}
+
+void headless_simulation::check_separation()
+{
+  // Only planes still flying are in kinematics; compare them on the local plane,
+  // straight down the columns
+  set< pair< int, int > > now_in_conflict;
+  const vector< double > & east = kinematics.east();
+  const vector< double > & south = kinematics.south();
+  const vector< int > & ids = kinematics.ids();
+  double closest_squared = totals.min_separation * totals.min_separation;
+  double conflict_squared = config.conflict_distance * config.conflict_distance;
+
+  for( natural i = 0; i < ids.size(); i++ )
+  {
+    for( natural j = i + 1; j < ids.size(); j++ )
+    {
+      double de = east[ i ] - east[ j ];
+      double ds = south[ i ] - south[ j ];
+      double squared = de * de + ds * ds;
+      if( squared < closest_squared )
+      {
+        closest_squared = squared;
+        totals.min_separation = sqrt( squared );
+      }
+
+      if( squared < conflict_squared )
+      {
+        pair< int, int > both( min( ids[ i ], ids[ j ] ), max( ids[ i ], ids[ j ] ) );
+        now_in_conflict.insert( both );
+        if( in_conflict.find( both ) == in_conflict.end() )
+          totals.conflicts++;
+      }
+    }
+  }
+  in_conflict.swap( now_in_conflict );
+}
+
+const course_point & headless_simulation::point_of( const headless_plane & p, natural i ) const
+{
+  return points[ p.first + i ];
+}
+
+bool headless_simulation::on_grid( int x, int y ) const
+{
+  return x >= 0 && y >= 0 && x < field->getWidth() && y < field->getHeight();
+}
+
+headless_plane * headless_simulation::plane_by_id( int id )
+{
+  if( id < 0 || id >= (int)index_by_id.size() || index_by_id[ id ] < 0 )
+    return NULL;
+  return &fleet_state[ index_by_id[ id ] ];
+}
+
+bool headless_simulation::request_waypoint_info( AU_UAV_ROS::RequestWaypointInfo::Request & req,
+                                                 AU_UAV_ROS::RequestWaypointInfo::Response & res )
+{
+  headless_plane * p = running == NULL ? NULL : running->plane_by_id( req.planeID );
+  if( p == NULL )
+  {
+    res.error = "Invalid plane ID";
+    return false;
+  }
+
+  // As the coordinator does, (-1000, -1000, -1000) for a point past the end of the queue
+  res.latitude = res.longitude = res.altitude = -1000;
+  natural position = req.positionInQueue;
+  const course_point * point = NULL;
+  if( req.isAvoidanceWaypoint )
+  {
+    if( position < p->avoidance.size() )
+      point = &p->avoidance[ position ];
+  }
+  else if( !p->finished && p->next_point + position < p->count )
+    point = &running->point_of( *p, p->next_point + position );
+
+  if( point == NULL )
+  {
+    res.error = "No points in that queue";
+    return true;
+  }
+  res.latitude = point->latitude;
+  res.longitude = point->longitude;
+  res.altitude = point->altitude;
+  return true;
+}
+
+bool headless_simulation::go_to_waypoint( AU_UAV_ROS::GoToWaypoint::Request & req,
+                                          AU_UAV_ROS::GoToWaypoint::Response & )
+{
+  headless_plane * p = running == NULL ? NULL : running->plane_by_id( req.planeID );
+
+  // A plane's normal queue is its course, which collision avoidance doesn't change
+  if( p == NULL || p->finished || !req.isAvoidanceManeuver )
+    return false;
+
+  if( req.isNewQueue )
+    p->avoidance.clear();
+  course_point waypoint;
+  waypoint.latitude = req.latitude;
+  waypoint.longitude = req.longitude;
+  waypoint.altitude = req.altitude;
+  p->avoidance.push_back( waypoint );
+
+  running->totals.commands++;
+  running->aim( *p );
+  return true;
+}
+
+const vector< headless_plane > & headless_simulation::planes() const
+{
+  return fleet_state;
+}
+
+const headless_result & headless_simulation::result() const
+{
+  return totals;
+}
+
+#endif
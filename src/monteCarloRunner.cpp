@@ -0,0 +1,686 @@
+//
+//  monteCarloRunner.cpp
+//  AU_UAV_ROS
+//
+//  Flies many random courses through collision avoidance (see headless_simulation.h)
+//  and reports how they went, taken together: conflicts, the closest any two planes
+//  came, how long planning took (percentiles, over every plan collision avoidance
+//  made: one best cost grid and A* search), and how fast the runs went. This is
+//  how to tell whether a change to collision avoidance is safe: run it before and
+//  after, over the same seeds, and compare.
+//
+//  A run is one field, one fleet size, and one seed. The seed picks the course:
+//  every plane gets points_per_plane random points in the field, and the same
+//  seed always gives the same points (a bigger fleet gets the smaller fleet's
+//  planes, and then some), so a run can be repeated exactly.
+//
+//  Each run gets a process of its own, forked from this one, since collision
+//  avoidance's state is global; up to jobs of them run at once (one per core,
+//  unless told otherwise). The cores are split between them: each run fills its
+//  danger grids with cores / jobs threads (at least one), so that the runs don't
+//  crowd each other and skew the plan times. A run that crashes is reported as
+//  failed, and doesn't take the rest with it.
+//
+//  Usage: monteCarloRunner [options] field.txt [field.txt ...]
+//    -s FIRST-LAST  the seeds to run (default 1-10)
+//    -n 4,8,16      the fleet sizes to run (default 8)
+//    -p POINTS      points per plane (default 6)
+//    -t SECONDS     simulated seconds after which a run is stopped (default 900)
+//    -j JOBS        runs at once (default: one per core)
+//    -d MS          collision avoidance's planning deadline (default: none, so
+//                   that runs can be repeated exactly)
+//    -c FILE        write a CSV report there, a row per run
+//    -o FILE        write a JSON report there: the settings, a summary for each
+//                   field and fleet size, and every run
+//
+//  Build it from collisionAvoidance.cpp, compiled with COMPOSED_NODES defined, and
+//  this file, in the ROS build environment (it needs no roscore, but it links
+//  roscpp).
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <boost/thread.hpp>
+#include "headless_simulation.h"
+
+using namespace std;
+
+/**
+ * One run: a field, a fleet size, and a seed
+ */
+struct scenario
+{
+  natural field;
+  natural planes;
+  natural seed;
+};
+
+/**
+ * What a run sends back to us (followed, in its result file, by the time each of
+ * its plans took, as floats)
+ */
+struct run_summary
+{
+  natural ticks;
+  double simulated_seconds;
+  natural planes;
+  natural planes_finished;
+  natural points_reached;
+  natural conflicts;
+  double min_separation;
+  double distance_flown;
+  double course_length;
+  natural updates;
+  natural commands;
+  natural batches;
+  double total_batch_ms;
+  natural plans;
+  double wall_seconds;
+};
+
+/**
+ * A run's summary and plan times, once it's done
+ */
+struct run_outcome
+{
+  bool ok;
+  run_summary summary;
+  vector< float > plan_ms;
+};
+
+/**
+ * The course generator's random numbers: xorshift, so that a seed gives the same
+ * courses everywhere (rand() differs from one C library to the next)
+ */
+class course_random
+{
+public:
+  course_random( natural seed )
+  {
+    state = seed * 2654435761u + 0x9e3779b9u;
+    if( state == 0 )
+      state = 1;
+    for( int i = 0; i < 8; i++ )
+      next();
+  }
+
+  uint32_t next()
+  {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  }
+
+  /**
+   * @return a number in [ 0, 1 )
+   */
+  double uniform()
+  {
+    return next() / 4294967296.0;
+  }
+
+private:
+  uint32_t state;
+};
+
+// Course points stay this fraction of the field's size away from its edges
+const double FIELD_MARGIN = 0.05;
+
+// Consecutive points on a plane's course are at least this far apart (m), if we
+// can find such a point in a few tries
+const double MIN_LEG_LENGTH = 50;
+
+// Every plane flies at this altitude (m), so that they're all in each other's way
+const double COURSE_ALTITUDE = 400;
+
+/**
+ * Makes a random course for a scenario
+ * @param field The field to fly in
+ * @param planes The number of planes
+ * @param points_per_plane The number of points in each plane's course
+ * @param seed Picks the course
+ * @return planes * points_per_plane points; plane i's are points_per_plane * i on
+ */
+vector< course_point > random_course( const FieldGeometry & field, natural planes,
+                                      natural points_per_plane, natural seed )
+{
+  course_random random( seed );
+  vector< course_point > points;
+  for( natural i = 0; i < planes * points_per_plane; i++ )
+  {
+    course_point p;
+    for( int tries = 0; tries < 10; tries++ )
+    {
+      p.latitude = field.getUpperLeftLatitude() + field.getLatWidth() *
+        ( FIELD_MARGIN + ( 1 - 2 * FIELD_MARGIN ) * random.uniform() );
+      p.longitude = field.getUpperLeftLongitude() + field.getLonWidth() *
+        ( FIELD_MARGIN + ( 1 - 2 * FIELD_MARGIN ) * random.uniform() );
+
+      if( i % points_per_plane == 0 ||
+          map_tools::calculate_distance_between_points( p.latitude, p.longitude, points.back().latitude,
+                                                        points.back().longitude ) >= MIN_LEG_LENGTH )
+        break;
+    }
+    p.altitude = COURSE_ALTITUDE;
+    points.push_back( p );
+  }
+  return points;
+}
+
+/**
+ * Flies one scenario and writes its outcome to a file (in the forked process)
+ * @return TRUE if it could be flown and its outcome written
+ */
+bool fly_scenario( const string & field_path, const scenario & s, natural points_per_plane,
+                   const headless_config & config, const string & result_path )
+{
+  FieldGeometry field;
+  if( !field.load( field_path ) )
+    return false;
+
+  headless_simulation sim( &field, config );
+  vector< course_point > points = random_course( field, s.planes, points_per_plane, s.seed );
+  for( natural i = 0; i < s.planes; i++ )
+    sim.add_plane( i, &points[ i * points_per_plane ], points_per_plane );
+  const headless_result & r = sim.run();
+
+  run_summary summary;
+  summary.ticks = r.ticks;
+  summary.simulated_seconds = r.simulated_seconds;
+  summary.planes = r.planes;
+  summary.planes_finished = r.planes_finished;
+  summary.points_reached = r.points_reached;
+  summary.conflicts = r.conflicts;
+  summary.min_separation = r.min_separation;
+  summary.distance_flown = r.distance_flown;
+  summary.course_length = r.course_length;
+  summary.updates = r.updates;
+  summary.commands = r.commands;
+  summary.batches = r.batches;
+  summary.total_batch_ms = r.total_batch_ms;
+  summary.plans = r.plan_ms.size();
+  summary.wall_seconds = r.wall_seconds;
+  vector< float > plan_ms( r.plan_ms.begin(), r.plan_ms.end() );
+
+  FILE * out = fopen( result_path.c_str(), "wb" );
+  if( out == NULL )
+    return false;
+  bool written = fwrite( &summary, sizeof( summary ), 1, out ) == 1;
+  if( !plan_ms.empty() )
+    written = written && fwrite( &plan_ms[ 0 ], sizeof( float ), plan_ms.size(), out ) == plan_ms.size();
+  return ( fclose( out ) == 0 ) && written;
+}
+
+/**
+ * Reads back what fly_scenario() wrote (and deletes the file)
+ */
+run_outcome read_outcome( const string & result_path )
+{
+  run_outcome outcome;
+  outcome.ok = false;
+
+  FILE * in = fopen( result_path.c_str(), "rb" );
+  if( in == NULL )
+    return outcome;
+  if( fread( &outcome.summary, sizeof( run_summary ), 1, in ) == 1 )
+  {
+    outcome.plan_ms.resize( outcome.summary.plans );
+    outcome.ok = outcome.plan_ms.empty() ||
+      fread( &outcome.plan_ms[ 0 ], sizeof( float ), outcome.plan_ms.size(), in ) == outcome.plan_ms.size();
+  }
+  fclose( in );
+  unlink( result_path.c_str() );
+  return outcome;
+}
+
+/**
+ * @param sorted Values, in increasing order
+ * @param percent Which percentile (0 to 100)
+ * @return the nearest-rank percentile (0 if there are no values)
+ */
+double percentile( const vector< float > & sorted, double percent )
+{
+  if( sorted.empty() )
+    return 0;
+  size_t rank = (size_t)ceil( percent / 100.0 * sorted.size() );
+  return sorted[ rank > 0 ? rank - 1 : 0 ];
+}
+
+/**
+ * Everything about one field and fleet size, over all its seeds
+ */
+struct group_summary
+{
+  natural field;
+  natural planes;
+  natural runs;
+  natural failed;
+  natural runs_finished;       // runs in which every plane finished its course
+  natural conflicts;
+  natural runs_with_conflicts;
+  double min_separation;       // the closest two planes came in any run
+  vector< double > separations; // each run's minimum separation
+  double simulated_seconds;
+  double wall_seconds;         // of all the runs, one after another
+  natural batches;             // ticks' worth of updates handled, in all the runs
+  double total_batch_ms;       // the time it took handling them
+  vector< float > plan_ms;     // every plan in every run
+};
+
+/**
+ * Parses "FIRST-LAST" (or just "SEED")
+ */
+bool parse_seeds( const char * text, natural & first, natural & last )
+{
+  char * end;
+  first = strtoul( text, &end, 10 );
+  if( end == text )
+    return false;
+  last = first;
+  if( *end == '-' )
+  {
+    const char * rest = end + 1;
+    last = strtoul( rest, &end, 10 );
+    if( end == rest )
+      return false;
+  }
+  return *end == '\0' && first <= last;
+}
+
+/**
+ * Parses "4,8,16"
+ */
+bool parse_sizes( const char * text, vector< natural > & sizes )
+{
+  sizes.clear();
+  while( *text != '\0' )
+  {
+    char * end;
+    long size = strtol( text, &end, 10 );
+    if( end == text || size < 1 )
+      return false;
+    sizes.push_back( size );
+    text = ( *end == ',' ) ? end + 1 : end;
+    if( *end != ',' && *end != '\0' )
+      return false;
+  }
+  return !sizes.empty();
+}
+
+/**
+ * Writes a string as a JSON string, quoted and escaped
+ */
+void print_json_string( FILE * out, const string & text )
+{
+  fputc( '"', out );
+  for( natural i = 0; i < text.size(); i++ )
+  {
+    unsigned char c = text[ i ];
+    if( c == '"' || c == '\\' )
+      fprintf( out, "\\%c", c );
+    else if( c < 0x20 )
+      fprintf( out, "\\u%04x", c );
+    else
+      fputc( c, out );
+  }
+  fputc( '"', out );
+}
+
+/**
+ * Writes a string as a CSV field, quoted if it has to be
+ */
+void print_csv_string( FILE * out, const string & text )
+{
+  if( text.find_first_of( ",\"\r\n" ) == string::npos )
+  {
+    fputs( text.c_str(), out );
+    return;
+  }
+  fputc( '"', out );
+  for( natural i = 0; i < text.size(); i++ )
+  {
+    if( text[ i ] == '"' )
+      fputc( '"', out );
+    fputc( text[ i ], out );
+  }
+  fputc( '"', out );
+}
+
+// JSON can't hold an infinite separation (a run with one plane has no pairs)
+void print_separation( FILE * out, double separation, const char * none )
+{
+  if( isinf( separation ) )
+    fprintf( out, "%s", none );
+  else
+    fprintf( out, "%.3f", separation );
+}
+
+void usage( const char * name )
+{
+  fprintf( stderr, "Usage: %s [-s FIRST-LAST] [-n 4,8,16] [-p POINTS] [-t SECONDS] [-j JOBS] [-d MS]\n"
+                   "       [-c report.csv] [-o report.json] field.txt [field.txt ...]\n", name );
+}
+
+int main( int argc, char ** argv )
+{
+  natural first_seed = 1, last_seed = 10;
+  vector< natural > sizes( 1, 8 );
+  natural points_per_plane = 6;
+  natural jobs = boost::thread::hardware_concurrency();
+  string csv_path, json_path;
+  headless_config config;
+  config.max_seconds = 900;
+
+  int option;
+  while( ( option = getopt( argc, argv, "s:n:p:t:j:d:c:o:" ) ) != -1 )
+  {
+    bool ok = true;
+    switch( option )
+    {
+      case 's': ok = parse_seeds( optarg, first_seed, last_seed ); break;
+      case 'n': ok = parse_sizes( optarg, sizes ); break;
+      case 'p': points_per_plane = atoi( optarg ); ok = points_per_plane >= 2; break;
+      case 't': config.max_seconds = atof( optarg ); ok = config.max_seconds > 0; break;
+      case 'j': jobs = atoi( optarg ); ok = jobs >= 1; break;
+      case 'd': config.planning_deadline_ms = atof( optarg ); ok = config.planning_deadline_ms > 0; break;
+      case 'c': csv_path = optarg; break;
+      case 'o': json_path = optarg; break;
+      default: ok = false;
+    }
+    if( !ok )
+    {
+      usage( argv[ 0 ] );
+      return 1;
+    }
+  }
+  if( optind >= argc )
+  {
+    usage( argv[ 0 ] );
+    return 1;
+  }
+  if( jobs < 1 )
+    jobs = 1;
+
+  // Split the cores between the runs going at once
+  natural cores = boost::thread::hardware_concurrency();
+  config.tile_workers = ( cores > jobs ) ? cores / jobs : 1;
+
+  vector< string > field_paths( argv + optind, argv + argc );
+  for( natural f = 0; f < field_paths.size(); f++ )
+  {
+    FieldGeometry field;
+    if( !field.load( field_paths[ f ] ) )
+    {
+      fprintf( stderr, "Couldn't read the field from %s\n", field_paths[ f ].c_str() );
+      return 1;
+    }
+  }
+
+  vector< scenario > scenarios;
+  for( natural f = 0; f < field_paths.size(); f++ )
+    for( natural n = 0; n < sizes.size(); n++ )
+      for( natural seed = first_seed; seed <= last_seed; seed++ )
+      {
+        scenario s = { f, sizes[ n ], seed };
+        scenarios.push_back( s );
+      }
+
+  char dir_template[] = "/tmp/monte_carlo_XXXXXX";
+  if( mkdtemp( dir_template ) == NULL )
+  {
+    perror( "Couldn't make a directory for the runs' results" );
+    return 1;
+  }
+  string results_dir = dir_template;
+
+  fprintf( stderr, "%u runs, %u at a time\n", (natural)scenarios.size(), jobs );
+  timespec start, end;
+  clock_gettime( CLOCK_MONOTONIC, &start );
+
+  // Keep jobs runs going until they're all done
+  vector< bool > exited_ok( scenarios.size(), false );
+  std::map< pid_t, natural > running;
+  natural next = 0, done = 0;
+  while( next < scenarios.size() || !running.empty() )
+  {
+    if( next < scenarios.size() && running.size() < jobs )
+    {
+      char result_path[ 64 ];
+      snprintf( result_path, sizeof( result_path ), "/%u", next );
+      fflush( NULL );
+      pid_t pid = fork();
+      if( pid == 0 )
+      {
+        bool ok = fly_scenario( field_paths[ scenarios[ next ].field ], scenarios[ next ],
+                                points_per_plane, config, results_dir + result_path );
+        _exit( ok ? 0 : 1 );
+      }
+      if( pid < 0 )
+      {
+        perror( "Couldn't start a run" );
+        if( running.empty() )
+          return 1;
+      }
+      else
+      {
+        running[ pid ] = next;
+        next++;
+        continue;
+      }
+    }
+
+    int status;
+    pid_t pid = waitpid( -1, &status, 0 );
+    if( pid < 0 )
+      break;
+    std::map< pid_t, natural >::iterator found = running.find( pid );
+    if( found == running.end() )
+      continue;
+
+    natural index = found->second;
+    running.erase( found );
+    exited_ok[ index ] = WIFEXITED( status ) && WEXITSTATUS( status ) == 0;
+    done++;
+    const scenario & s = scenarios[ index ];
+    fprintf( stderr, "[%u/%u] %s, %u planes, seed %u%s\n", done, (natural)scenarios.size(),
+             field_paths[ s.field ].c_str(), s.planes, s.seed, exited_ok[ index ] ? "" : ": FAILED" );
+  }
+
+  clock_gettime( CLOCK_MONOTONIC, &end );
+  double total_wall_seconds = ( end.tv_sec - start.tv_sec ) + ( end.tv_nsec - start.tv_nsec ) / 1e9;
+
+  // Gather up the outcomes, by field and fleet size
+  vector< run_outcome > outcomes( scenarios.size() );
+  vector< group_summary > groups;
+  natural failed = 0;
+  for( natural i = 0; i < scenarios.size(); i++ )
+  {
+    char result_path[ 64 ];
+    snprintf( result_path, sizeof( result_path ), "/%u", i );
+    outcomes[ i ] = read_outcome( results_dir + result_path );
+    outcomes[ i ].ok = outcomes[ i ].ok && exited_ok[ i ];
+
+    const scenario & s = scenarios[ i ];
+    if( groups.empty() || groups.back().field != s.field || groups.back().planes != s.planes )
+    {
+      group_summary g;
+      g.field = s.field;
+      g.planes = s.planes;
+      g.runs = g.failed = g.runs_finished = g.conflicts = g.runs_with_conflicts = 0;
+      g.min_separation = HUGE_VAL;
+      g.simulated_seconds = g.wall_seconds = 0;
+      g.batches = 0;
+      g.total_batch_ms = 0;
+      groups.push_back( g );
+    }
+
+    group_summary & g = groups.back();
+    g.runs++;
+    const run_outcome & o = outcomes[ i ];
+    if( !o.ok )
+    {
+      g.failed++;
+      failed++;
+      continue;
+    }
+    if( o.summary.planes_finished == o.summary.planes )
+      g.runs_finished++;
+    g.conflicts += o.summary.conflicts;
+    if( o.summary.conflicts > 0 )
+      g.runs_with_conflicts++;
+    g.min_separation = min( g.min_separation, o.summary.min_separation );
+    g.separations.push_back( o.summary.min_separation );
+    g.simulated_seconds += o.summary.simulated_seconds;
+    g.wall_seconds += o.summary.wall_seconds;
+    g.batches += o.summary.batches;
+    g.total_batch_ms += o.summary.total_batch_ms;
+    g.plan_ms.insert( g.plan_ms.end(), o.plan_ms.begin(), o.plan_ms.end() );
+    sort( outcomes[ i ].plan_ms.begin(), outcomes[ i ].plan_ms.end() );
+  }
+  rmdir( results_dir.c_str() );
+
+  for( natural i = 0; i < groups.size(); i++ )
+  {
+    sort( groups[ i ].plan_ms.begin(), groups[ i ].plan_ms.end() );
+    sort( groups[ i ].separations.begin(), groups[ i ].separations.end() );
+  }
+
+  // The summary, on the console
+  printf( "%u runs in %.1f s (%u failed)\n\n", (natural)scenarios.size(), total_wall_seconds, failed );
+  printf( "field                    planes  runs  done  conflicts  runs w/  min sep  median    plans"
+          "     p50     p90     p99     max  sim s/s\n" );
+  printf( "                                                        conflict      (m)  sep (m)"
+          "             (ms)    (ms)    (ms)    (ms)\n" );
+  for( natural i = 0; i < groups.size(); i++ )
+  {
+    const group_summary & g = groups[ i ];
+    double median_separation = g.separations.empty() ? HUGE_VAL : g.separations[ g.separations.size() / 2 ];
+    printf( "%-24s %6u %5u %5u %10u %8u %8.1f %8.1f %8u %7.2f %7.2f %7.2f %7.2f %8.1f\n",
+            field_paths[ g.field ].c_str(), g.planes, g.runs - g.failed, g.runs_finished, g.conflicts,
+            g.runs_with_conflicts, g.min_separation, median_separation, (natural)g.plan_ms.size(),
+            percentile( g.plan_ms, 50 ), percentile( g.plan_ms, 90 ), percentile( g.plan_ms, 99 ),
+            g.plan_ms.empty() ? 0 : g.plan_ms.back(),
+            g.wall_seconds > 0 ? g.simulated_seconds / g.wall_seconds : 0 );
+  }
+
+  if( !csv_path.empty() )
+  {
+    FILE * csv = fopen( csv_path.c_str(), "w" );
+    if( csv == NULL )
+      fprintf( stderr, "Couldn't write %s\n", csv_path.c_str() );
+    else
+    {
+      fprintf( csv, "field,planes,seed,ok,simulated_seconds,planes_finished,points_reached,conflicts,"
+                    "min_separation_m,distance_flown_m,course_length_m,updates,batches,batch_mean_ms,"
+                    "waypoints_sent,plans,plan_p50_ms,plan_p90_ms,plan_p99_ms,plan_max_ms,wall_seconds\n" );
+      for( natural i = 0; i < scenarios.size(); i++ )
+      {
+        const scenario & s = scenarios[ i ];
+        const run_outcome & o = outcomes[ i ];
+        print_csv_string( csv, field_paths[ s.field ] );
+        fprintf( csv, ",%u,%u,%d", s.planes, s.seed, o.ok ? 1 : 0 );
+        if( !o.ok )
+        {
+          fprintf( csv, ",,,,,,,,,,,,,,,,,\n" );
+          continue;
+        }
+        const run_summary & r = o.summary;
+        fprintf( csv, ",%.0f,%u,%u,%u,", r.simulated_seconds, r.planes_finished, r.points_reached, r.conflicts );
+        print_separation( csv, r.min_separation, "" );
+        fprintf( csv, ",%.1f,%.1f,%u,%u,%.3f,%u,%u,%.3f,%.3f,%.3f,%.3f,%.3f\n", r.distance_flown,
+                 r.course_length, r.updates, r.batches, r.batches > 0 ? r.total_batch_ms / r.batches : 0,
+                 r.commands, r.plans, percentile( o.plan_ms, 50 ), percentile( o.plan_ms, 90 ),
+                 percentile( o.plan_ms, 99 ), o.plan_ms.empty() ? 0 : o.plan_ms.back(), r.wall_seconds );
+      }
+      fclose( csv );
+    }
+  }
+
+  if( !json_path.empty() )
+  {
+    FILE * json = fopen( json_path.c_str(), "w" );
+    if( json == NULL )
+      fprintf( stderr, "Couldn't write %s\n", json_path.c_str() );
+    else
+    {
+      fprintf( json, "{\n  \"settings\": { \"first_seed\": %u, \"last_seed\": %u, \"points_per_plane\": %u, "
+                     "\"max_seconds\": %.0f, \"tick\": %g, \"conflict_distance\": %g, \"planning_deadline_ms\": %g, "
+                     "\"jobs\": %u, \"tile_workers\": %u },\n",
+               first_seed, last_seed, points_per_plane, config.max_seconds, config.tick,
+               config.conflict_distance, config.planning_deadline_ms, jobs, config.tile_workers );
+      fprintf( json, "  \"runs\": %u,\n  \"failed\": %u,\n  \"wall_seconds\": %.3f,\n",
+               (natural)scenarios.size(), failed, total_wall_seconds );
+
+      fprintf( json, "  \"groups\": [\n" );
+      for( natural i = 0; i < groups.size(); i++ )
+      {
+        const group_summary & g = groups[ i ];
+        double plans_total_ms = 0;
+        for( natural j = 0; j < g.plan_ms.size(); j++ )
+          plans_total_ms += g.plan_ms[ j ];
+
+        fprintf( json, "    { \"field\": " );
+        print_json_string( json, field_paths[ g.field ] );
+        fprintf( json, ", \"planes\": %u, \"runs\": %u, \"failed\": %u, "
+                       "\"runs_finished\": %u, \"conflicts\": %u, \"runs_with_conflicts\": %u, \"min_separation_m\": ",
+                 g.planes, g.runs, g.failed, g.runs_finished, g.conflicts, g.runs_with_conflicts );
+        print_separation( json, g.min_separation, "null" );
+        fprintf( json, ", \"median_min_separation_m\": " );
+        print_separation( json, g.separations.empty() ? HUGE_VAL : g.separations[ g.separations.size() / 2 ], "null" );
+        fprintf( json, ",\n      \"batches\": %u, \"batch_mean_ms\": %.3f,"
+                       "\n      \"plans\": %u, \"plan_mean_ms\": %.3f, \"plan_p50_ms\": %.3f, \"plan_p90_ms\": %.3f, "
+                       "\"plan_p99_ms\": %.3f, \"plan_p999_ms\": %.3f, \"plan_max_ms\": %.3f,\n"
+                       "      \"simulated_seconds\": %.0f, \"wall_seconds\": %.3f, \"simulated_per_wall_second\": %.2f, "
+                       "\"plans_per_wall_second\": %.2f }%s\n",
+                 g.batches, g.batches > 0 ? g.total_batch_ms / g.batches : 0,
+                 (natural)g.plan_ms.size(), g.plan_ms.empty() ? 0 : plans_total_ms / g.plan_ms.size(),
+                 percentile( g.plan_ms, 50 ), percentile( g.plan_ms, 90 ), percentile( g.plan_ms, 99 ),
+                 percentile( g.plan_ms, 99.9 ), g.plan_ms.empty() ? 0 : g.plan_ms.back(),
+                 g.simulated_seconds, g.wall_seconds,
+                 g.wall_seconds > 0 ? g.simulated_seconds / g.wall_seconds : 0,
+                 g.wall_seconds > 0 ? g.plan_ms.size() / g.wall_seconds : 0,
+                 i + 1 < groups.size() ? "," : "" );
+      }
+      fprintf( json, "  ],\n" );
+
+      fprintf( json, "  \"scenarios\": [\n" );
+      for( natural i = 0; i < scenarios.size(); i++ )
+      {
+        const scenario & s = scenarios[ i ];
+        const run_outcome & o = outcomes[ i ];
+        fprintf( json, "    { \"field\": " );
+        print_json_string( json, field_paths[ s.field ] );
+        fprintf( json, ", \"planes\": %u, \"seed\": %u, \"ok\": %s", s.planes, s.seed, o.ok ? "true" : "false" );
+        if( o.ok )
+        {
+          const run_summary & r = o.summary;
+          fprintf( json, ", \"simulated_seconds\": %.0f, \"planes_finished\": %u, \"points_reached\": %u, "
+                         "\"conflicts\": %u, \"min_separation_m\": ",
+                   r.simulated_seconds, r.planes_finished, r.points_reached, r.conflicts );
+          print_separation( json, r.min_separation, "null" );
+          fprintf( json, ", \"distance_flown_m\": %.1f, \"course_length_m\": %.1f, \"updates\": %u, "
+                         "\"batches\": %u, \"batch_mean_ms\": %.3f, \"waypoints_sent\": %u, \"plans\": %u, "
+                         "\"plan_p50_ms\": %.3f, \"plan_p99_ms\": %.3f, \"wall_seconds\": %.3f",
+                   r.distance_flown, r.course_length, r.updates, r.batches,
+                   r.batches > 0 ? r.total_batch_ms / r.batches : 0, r.commands, r.plans,
+                   percentile( o.plan_ms, 50 ), percentile( o.plan_ms, 99 ), r.wall_seconds );
+        }
+        fprintf( json, " }%s\n", i + 1 < scenarios.size() ? "," : "" );
+      }
+      fprintf( json, "  ]\n}\n" );
+      fclose( json );
+    }
+  }
+
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+//
+// node_composition.h
+// AU_UAV_ROS
+//
+// Lets the coordinator, the simulator, and collision avoidance run either as
+// their own ROS nodes, as usual, or as components of a single process (see
+// composedNodes.cpp), where telemetry, commands, and service calls never have to
+// be serialized.
+//
+// Topics take care of themselves: publish a boost::shared_ptr to the message,
+// and roscpp hands that same pointer to any subscriber in the process instead of
+// serializing it. (So never change a message once it has been published.)
+//
+// Services always go through a socket in roscpp, even within one process, so a
+// server advertises its callback with serve() and a client calls through a
+// service_link. If the server was advertised in the same process, the link calls
+// its callback directly; otherwise, it's an ordinary ROS service call. Nodes
+// don't need to know which mode they're in.
+//
+
+#ifndef NODE_COMPOSITION
+#define NODE_COMPOSITION
+
+#include <map>
+#include <string>
+#include <vector>
+#include "ros/ros.h"
+
+using namespace std;
+
+/**
+ * The service callbacks advertised in this process (through serve()), by name.
+ * These are only added to at startup, before any node starts calling them.
+ */
+template< class Request, class Response >
+map< string, bool (*)( Request &, Response & ) > & local_services()
+{
+  static map< string, bool (*)( Request &, Response & ) > services;
+  return services;
+}
+
+/**
+ * Advertises a service, and makes it available to service_links in this process
+ * @param n The node handle to advertise it on
+ * @param name The service's name
+ * @param callback The function that handles it. In a composed process, it can be
+ *                 called from any component's thread, so it must do its own
+ *                 locking.
+ * @return the server, which must be kept for as long as the service is offered
+ */
+template< class Request, class Response >
+ros::ServiceServer serve( ros::NodeHandle & n, const string & name,
+                          bool (*callback)( Request &, Response & ) )
+{
+  local_services< Request, Response >()[ name ] = callback;
+  return n.advertiseService( name, callback );
+}
+
+/**
+ * Makes a callback available to service_links in this process, without
+ * advertising it to ROS (for stand-ins, as in telemetryReplay.cpp)
+ * @param name The service's name
+ * @param callback The function that handles it
+ */
+template< class Request, class Response >
+void serve_locally( const string & name, bool (*callback)( Request &, Response & ) )
+{
+  local_services< Request, Response >()[ name ] = callback;
+}
+
+/**
+ * A client for one service, which skips ROS when the server is in this process
+ */
+template< class Service >
+class service_link
+{
+public:
+  typedef typename Service::Request request_type;
+  typedef typename Service::Response response_type;
+
+  service_link()
+  {
+    direct = NULL;
+  }
+
+  /**
+   * Finds the service. If it was serve()d in this process, we'll call it
+   * directly, so the server has to have been started first.
+   * @param n The node handle to make a ROS client on, if need be
+   * @param name The service's name
+   */
+  void connect( ros::NodeHandle & n, const string & name )
+  {
+    typename map< string, bool (*)( request_type &, response_type & ) >::iterator found =
+      local_services< request_type, response_type >().find( name );
+    if( found != local_services< request_type, response_type >().end() )
+      direct = (*found).second;
+    else
+      client = n.serviceClient< Service >( name );
+  }
+
+  /**
+   * Finds the service, only if it's in this process
+   * @param name The service's name
+   * @return FALSE if it isn't (in which case calls will fail)
+   */
+  bool connect_local( const string & name )
+  {
+    typename map< string, bool (*)( request_type &, response_type & ) >::iterator found =
+      local_services< request_type, response_type >().find( name );
+    direct = ( found != local_services< request_type, response_type >().end() ) ? (*found).second : NULL;
+    return direct != NULL;
+  }
+
+  /**
+   * Calls the service, just as ros::ServiceClient::call() would
+   * @param srv The request to send, and where the response goes
+   * @return TRUE if the call went through and the server reported success
+   */
+  bool call( Service & srv )
+  {
+    if( direct != NULL )
+      return direct( srv.request, srv.response );
+    return client.call( srv );
+  }
+
+  /**
+   * @return TRUE if calls go straight to a server in this process
+   */
+  bool is_direct() const
+  {
+    return direct != NULL;
+  }
+
+private:
+  ros::ServiceClient client;
+  bool (*direct)( request_type &, response_type & );
+};
+
+// The components' entry points, for composedNodes.cpp. Each sets its node up on
+// the given handle (subscriptions, services, and any threads or timers it needs),
+// leaving the spinning to the caller; the stop functions wind them down after
+// spinning ends. They're defined in coordinator.cpp, simulator.cpp, and
+// collisionAvoidance.cpp, each of which also has a main() (left out when built
+// with COMPOSED_NODES) that runs it as a node of its own.
+void startCoordinator( ros::NodeHandle & n );
+void stopCoordinator();
+void startSimulator( ros::NodeHandle & n );
+void stopSimulator();
+void startCollisionAvoidance( ros::NodeHandle & n );
+void stopCollisionAvoidance();
+
+// Collision avoidance's entry points for replaying a recording (see
+// telemetry_recording.h and telemetryReplay.cpp), also in collisionAvoidance.cpp.
+// Replay sets up the recorded fields and altitude bands and calls the
+// go_to_waypoint and request_waypoint_info services given to serve_locally(), with
+// no ROS and no planning thread: each recorded batch of updates is handled, start
+// to finish, by replayTelemetry(), which returns the time it took (ms). The time
+// each plan (best cost grid and A*) in it took is kept for takeReplayPlanTimes().
+// tile_workers is the number of threads danger grids are filled with; zero for
+// one per core.
+struct telemetry_record;
+bool startCollisionAvoidanceReplay( const vector< telemetry_record > & records, double deadline_ms,
+                                    unsigned int tile_workers = 0 );
+double replayTelemetry( const vector< telemetry_record > & batch );
+void takeReplayPlanTimes( vector< double > & out_ms );
+void stopCollisionAvoidanceReplay();
+
+#endif
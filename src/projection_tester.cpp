@@ -0,0 +1,111 @@
+//
+//  projection_tester.cpp
+//  AU_UAV_ROS
+//
+//  Compares the local tangent-plane projection in map_tools against the
+//  haversine distance + initial bearing conversion that Position used to do on
+//  every call, for square fields of a few sizes. The numbers this prints are the
+//  ones quoted in map_tools.h.
+//
+
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <time.h>
+#include "map_tools.h"
+
+#define DEBUG
+
+using namespace std;
+
+// Constants for the 700 field
+const double upper_left_longitude = -115.808173;
+const double upper_left_latitude = 37.244956;
+
+// Meters east and south of the origin, the way Position::lat_lon_to_decimal_xy()
+// computed them before the projection was added
+void haversine_east_south( double lat, double lon, double & east, double & south )
+{
+  double d = map_tools::calculate_distance_between_points( upper_left_latitude,
+                                                           upper_left_longitude,
+                                                           lat, lon, map_tools::METERS );
+  double bearing = map_tools::calculate_bearing_in_rad( upper_left_latitude,
+                                                        upper_left_longitude,
+                                                        lat, lon );
+  east = d * sin( bearing );
+  south = -d * cos( bearing );
+}
+
+int main()
+{
+  map_tools::local_projection proj;
+  map_tools::set_up_local_projection( upper_left_latitude, upper_left_longitude, proj );
+
+  double field_sizes[] = { 500, 1000, 2000, 5000 }; // meters on a side
+
+  cout << setprecision( 4 );
+  for( int f = 0; f < 4; f++ )
+  {
+    double size = field_sizes[ f ];
+    double lon_width = size / proj.m_per_deg_lon;
+    double lat_width = size / proj.m_per_deg_lat;
+
+    double worst = 0;       // worst disagreement with the haversine path
+    double worst_round_trip = 0; // worst projection -> lat-long -> projection error
+
+    for( int i = 1; i <= 100; i++ )
+    {
+      for( int j = 1; j <= 100; j++ )
+      {
+        double lat = upper_left_latitude - lat_width * i / 100.0;
+        double lon = upper_left_longitude + lon_width * j / 100.0;
+
+        double h_east, h_south, p_east, p_south;
+        haversine_east_south( lat, lon, h_east, h_south );
+        map_tools::project_to_local( proj, lat, lon, p_east, p_south );
+
+        double err = sqrt( (h_east - p_east)*(h_east - p_east) +
+                           (h_south - p_south)*(h_south - p_south) );
+        if( err > worst )
+          worst = err;
+
+        double back_lat, back_lon, rt_east, rt_south;
+        map_tools::unproject_from_local( proj, p_east, p_south, back_lat, back_lon );
+        map_tools::project_to_local( proj, back_lat, back_lon, rt_east, rt_south );
+        err = fabs( rt_east - p_east ) + fabs( rt_south - p_south );
+        if( err > worst_round_trip )
+          worst_round_trip = err;
+      }
+    }
+
+    cout << size << " m field: worst disagreement with haversine " << worst
+         << " m, worst round trip " << worst_round_trip << " m" << endl;
+  }
+
+  // Rough timing of the two paths
+  const int num_conversions = 1000000;
+  double sink = 0;
+  clock_t start = clock();
+  for( int i = 0; i < num_conversions; i++ )
+  {
+    double e, s;
+    haversine_east_south( upper_left_latitude - 0.001 - i * 1e-10,
+                          upper_left_longitude + 0.001, e, s );
+    sink += e;
+  }
+  double haversine_secs = (double)( clock() - start ) / CLOCKS_PER_SEC;
+
+  start = clock();
+  for( int i = 0; i < num_conversions; i++ )
+  {
+    double e, s;
+    map_tools::project_to_local( proj, upper_left_latitude - 0.001 - i * 1e-10,
+                                 upper_left_longitude + 0.001, e, s );
+    sink += e;
+  }
+  double projection_secs = (double)( clock() - start ) / CLOCKS_PER_SEC;
+
+  cout << num_conversions << " conversions: haversine " << haversine_secs
+       << " s, projection " << projection_secs << " s (" << sink << ")" << endl;
+}
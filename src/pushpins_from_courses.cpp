@@ -16,6 +16,7 @@
 #include <string>
 #include <vector>
 #include "map_tools.h"
+#include "course_file.h"
 
 #ifndef EPSILON
 #define EPSILON 0.0000001
@@ -91,11 +92,13 @@ int main()
   
   // Open the files
   ofstream pushpin_file;
-  ifstream input_file;
-  input_file.open( input_name_with_path.c_str() );
+  course_file course;
+  bool loaded = course.load( input_name_with_path );
   pushpin_file.open( output_name_with_path.c_str() );
   
-  assert( input_file.is_open() );
+  if( !loaded )
+    cout << course.error() << endl;
+  assert( loaded );
   assert( pushpin_file.is_open() );
   
   
@@ -261,31 +264,17 @@ int main()
   vector< double > prev_lats;
   vector< double > prev_lons;
     
-  // Read all the input
-  while( !input_file.eof() /* input not empty */ )
+  // Go through each plane's points in turn
+  for( natural p = 0; p < course.planes().size(); p++ )
   {
-    
-    // Try to read a line
-    string line;
-    getline(input_file, line);
-    
-    // See if we found a valid line
-    if(line.length() == 0 || line[0] == '#')
-    {
-      line.clear(); // Output empty string into line as sentinal value
-    }
-    
-    if( !line.empty() )
+    for( natural i = 0; i < course.planes()[ p ].count; i++ )
     {
       int plane_num, point_num;
       double lat, lon;
       
-      stringstream ss;
-      ss << line;
-      
-      ss >> plane_num;
-      ss >> lat;
-      ss >> lon;
+      plane_num = course.planes()[ p ].id;
+      lat = course.points()[ course.planes()[ p ].first + i ].latitude;
+      lon = course.points()[ course.planes()[ p ].first + i ].longitude;
       
       while( plane_num >= (int)plane_index.size() )
       {
@@ -322,7 +311,7 @@ int main()
         d_traveled[ plane_num ] += 
         map_tools::calculate_distance_between_points( lats[ plane_num ], lons[ plane_num ], 
                                                      prev_lats[ plane_num ], prev_lons[ plane_num ],
-                                                     "meters" );
+                                                     map_tools::METERS );
       }
       // End of distance calculation bit
       
@@ -362,8 +351,8 @@ int main()
 
       //pushpin_file << << endl;
       }
-    } // end if not empty
-  } // end while
+    } // end for each point
+  } // end for each plane
   for( vector< string >::iterator crnt_pins = pins.begin(); crnt_pins != pins.end(); ++crnt_pins )
   {
     // Close this pin's folder
@@ -0,0 +1,212 @@
+//
+//  sim_fleet_tester.cpp
+//  AU_UAV_ROS
+//
+//  Checks sim_fleet's kinematics (planes never turn faster than their limit, get
+//  to their targets, and keep their rows straight through removals; its
+//  projection agrees with map_tools'), then times a step of the whole fleet
+//  against flying the same planes one object at a time with map_tools, the way
+//  the simulator used to, for fleets of a few sizes.
+//
+//  Build with -mavx2 to time the vectorized loop.
+//
+
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <time.h>
+#include "map_tools.h"
+#include "sim_fleet.h"
+
+#define DEBUG
+
+using namespace std;
+
+// Constants for the 700 field
+const double upper_left_longitude = -115.808173;
+const double upper_left_latitude = 37.244956;
+
+const double speed = 11.176;
+const double max_turn_rate = 22.5;
+
+int failures = 0;
+
+void check( bool ok, const char * what )
+{
+  if( !ok )
+  {
+    cout << "FAILED: " << what << endl;
+    failures++;
+  }
+}
+
+// A plane flown the old way: its own object, moved with map_tools' great circle math
+struct aos_plane
+{
+  double latitude, longitude, bearing;
+  double target_latitude, target_longitude;
+
+  void fly( double dt )
+  {
+    double wanted = map_tools::calculateBearing( latitude, longitude, target_latitude, target_longitude );
+    double turn = fmod( wanted - bearing + 540.0, 360.0 ) - 180.0;
+    double max_turn = max_turn_rate * dt;
+    if( turn > max_turn )
+      turn = max_turn;
+    else if( turn < -max_turn )
+      turn = -max_turn;
+    bearing = fmod( bearing + turn + 360.0, 360.0 );
+    map_tools::calculate_point( latitude, longitude, speed * dt, bearing, latitude, longitude );
+  }
+};
+
+double seconds_since( const timespec & start )
+{
+  timespec end;
+  clock_gettime( CLOCK_MONOTONIC, &end );
+  return ( end.tv_sec - start.tv_sec ) + ( end.tv_nsec - start.tv_nsec ) / 1e9;
+}
+
+void test_turns_and_arrives()
+{
+  // Heading north, with a target due south: it has to come about
+  sim_fleet fleet;
+  fleet.add( 3, upper_left_latitude - 0.002, upper_left_longitude + 0.002, 100, 0, speed, max_turn_rate );
+  fleet.set_target( 3, upper_left_latitude - 0.004, upper_left_longitude + 0.002, 120 );
+  check( fleet.altitude()[ 0 ] == 120, "takes up the commanded altitude" );
+  check( fleet.targets_received()[ 0 ] == 1, "counts targets" );
+
+  double closest = fleet.distance_to_target( 0 );
+  double last_bearing = fleet.bearing( 0 );
+  for( int t = 0; t < 120; t++ )
+  {
+    fleet.step( 1.0 );
+    double turned = fabs( fmod( fleet.bearing( 0 ) - last_bearing + 540.0, 360.0 ) - 180.0 );
+    check( turned <= max_turn_rate + 1e-9, "turns no faster than its limit" );
+    last_bearing = fleet.bearing( 0 );
+    if( fleet.distance_to_target( 0 ) < closest )
+      closest = fleet.distance_to_target( 0 );
+  }
+  check( closest < speed, "gets to its target" );
+
+  // Its lat-long agrees with where it is on the local plane
+  double east, south;
+  map_tools::local_projection proj;
+  map_tools::set_up_local_projection( upper_left_latitude - 0.002, upper_left_longitude + 0.002, proj );
+  map_tools::project_to_local( proj, fleet.latitude()[ 0 ], fleet.longitude()[ 0 ], east, south );
+  check( fabs( east - fleet.east()[ 0 ] ) < 1e-6 && fabs( south - fleet.south()[ 0 ] ) < 1e-6,
+         "projects as map_tools does" );
+}
+
+void test_no_target()
+{
+  // With no target, a plane flies straight ahead
+  sim_fleet fleet;
+  fleet.add( 0, upper_left_latitude, upper_left_longitude, 100, 90, speed, max_turn_rate );
+  for( int t = 0; t < 10; t++ )
+    fleet.step( 1.0 );
+  check( fabs( fleet.bearing( 0 ) - 90 ) < 1e-9, "keeps its heading with no target" );
+  check( fabs( fleet.east()[ 0 ] - 10 * speed ) < 1e-9, "flies at its speed" );
+  check( fleet.distance_to_target( 0 ) == 0, "has no distance to go with no target" );
+  check( fleet.target_latitude()[ 0 ] == 0, "reports no target as (0, 0)" );
+}
+
+void test_removal()
+{
+  sim_fleet fleet;
+  for( int id = 0; id < 10; id++ )
+    check( fleet.add( id, upper_left_latitude - 0.0001 * id, upper_left_longitude, 100 + id, 0, speed,
+                      max_turn_rate ), "adds" );
+  check( !fleet.add( 4, upper_left_latitude, upper_left_longitude, 0, 0, speed, max_turn_rate ),
+         "won't add an ID twice" );
+  check( !fleet.set_target( 12, upper_left_latitude, upper_left_longitude, 0 ), "won't steer a missing plane" );
+
+  fleet.remove( 2 );
+  fleet.remove( 9 );
+  fleet.remove( 0 );
+  fleet.remove( 42 );
+  check( fleet.size() == 7, "removes" );
+  check( fleet.slot_of( 2 ) == -1 && fleet.slot_of( 9 ) == -1 && fleet.slot_of( 0 ) == -1, "forgets removed planes" );
+
+  for( natural i = 0; i < fleet.size(); i++ )
+  {
+    int id = fleet.ids()[ i ];
+    check( fleet.slot_of( id ) == (int)i, "keeps its slots straight" );
+    check( fleet.altitude()[ i ] == 100 + id, "moves whole rows" );
+  }
+}
+
+void time_fleet( natural planes )
+{
+  sim_fleet fleet;
+  vector< aos_plane > old_fleet( planes );
+  srand( 700 );
+  for( natural i = 0; i < planes; i++ )
+  {
+    aos_plane & p = old_fleet[ i ];
+    p.latitude = upper_left_latitude - 0.005 * rand() / RAND_MAX;
+    p.longitude = upper_left_longitude + 0.005 * rand() / RAND_MAX;
+    p.bearing = 360.0 * rand() / RAND_MAX;
+
+    // Targets farther than they'll fly, so that none of them start circling one
+    // (which would put the two fleets anywhere on their circles)
+    map_tools::calculate_point( p.latitude, p.longitude, 5000, 360.0 * rand() / RAND_MAX,
+                                p.target_latitude, p.target_longitude );
+
+    fleet.add( i, p.latitude, p.longitude, 100, p.bearing, speed, max_turn_rate );
+    fleet.set_target( i, p.target_latitude, p.target_longitude, 100 );
+  }
+
+  const int steps = 200;
+  timespec start;
+  clock_gettime( CLOCK_MONOTONIC, &start );
+  for( int t = 0; t < steps; t++ )
+    for( natural i = 0; i < planes; i++ )
+      old_fleet[ i ].fly( 1.0 );
+  double old_secs = seconds_since( start );
+
+  clock_gettime( CLOCK_MONOTONIC, &start );
+  for( int t = 0; t < steps; t++ )
+    fleet.step( 1.0 );
+  double new_secs = seconds_since( start );
+
+  // How far the two have drifted apart (the projection isn't quite a great circle)
+  double worst = 0;
+  for( natural i = 0; i < planes; i++ )
+  {
+    double apart = map_tools::calculate_distance_between_points( old_fleet[ i ].latitude, old_fleet[ i ].longitude,
+                                                                 fleet.latitude()[ i ], fleet.longitude()[ i ] );
+    if( apart > worst )
+      worst = apart;
+  }
+
+  cout << setw( 6 ) << planes << " planes, " << steps << " steps: one at a time "
+       << old_secs * 1e9 / ( steps * planes ) << " ns/plane, sim_fleet "
+       << new_secs * 1e9 / ( steps * planes ) << " ns/plane (" << old_secs / new_secs
+       << "x); farthest apart " << worst << " m" << endl;
+}
+
+int main()
+{
+  test_turns_and_arrives();
+  test_no_target();
+  test_removal();
+  if( failures > 0 )
+  {
+    cout << failures << " checks failed" << endl;
+    return 1;
+  }
+  cout << "All checks passed" << endl;
+
+#ifdef __AVX2__
+  cout << "Timing the AVX2 loop" << endl;
+#else
+  cout << "Timing the scalar loop" << endl;
+#endif
+  cout << setprecision( 3 );
+  natural sizes[] = { 16, 1000, 10000 };
+  for( int s = 0; s < 3; s++ )
+    time_fleet( sizes[ s ] );
+  return 0;
+}
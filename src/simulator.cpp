@@ -9,22 +9,83 @@ understand how this works.
 //Standard C++ headers
 #include <sstream>
 #include <map>
+#include <vector>
 
 //ROS headers
 #include "ros/ros.h"
 #include "AU_UAV_ROS/standardDefs.h"
 #include "AU_UAV_ROS/TelemetryUpdate.h"
+#include "AU_UAV_ROS/FleetTelemetry.h"
 #include "AU_UAV_ROS/Command.h"
 #include "AU_UAV_ROS/RequestPlaneID.h"
 #include "AU_UAV_ROS/CreateSimulatedPlane.h"
 #include "AU_UAV_ROS/DeleteSimulatedPlane.h"
-#include "AU_UAV_ROS/SimulatedPlane.h"
+
+//the planes' kinematics, advanced all at once
+#include "sim_fleet.h"
+
+//for running in the same process as the other nodes
+#include "node_composition.h"
+#include "a_star/async_log.h"
+
+//everything but the start and stop functions is kept to this file, so that the simulator can be linked
+//into one process with the other nodes (see composedNodes.cpp)
+namespace
+{
 
 //Coordinator Services
-ros::ServiceClient requestPlaneIDClient;
+service_link<AU_UAV_ROS::RequestPlaneID> requestPlaneIDClient;
+
+//every simulated plane: where it is, where it's headed, and how it flies
+sim_fleet simPlanes;
+
+//how the simulated planes fly: 25 mph, turning at most 22.5 degrees a second
+const double SIMULATED_SPEED = 11.176;
+const double SIMULATED_MAX_TURN_RATE = 22.5;
+
+//how often (Hz) the planes are moved and their telemetry sent
+const double UPDATE_RATE = 1;
+
+//each plane's telemetry update count, indexed by plane ID, for the messages' sequence numbers
+std::vector<unsigned int> updateIndex;
+
+//TRUE to send each tick's telemetry as one FleetTelemetry message on fleet_telemetry, rather than a
+//TelemetryUpdate per plane on telemetry; with many planes, that saves a message (and a callback in every
+//subscriber) per plane.  Set by the ~fleet_telemetry parameter.
+bool sendFleetTelemetry = false;
+
+//our topics, services and update timer, kept for as long as the simulator runs
+ros::Subscriber commandSub;
+ros::Publisher telemetryPub;
+ros::Publisher fleetTelemetryPub;
+ros::ServiceServer createSimulatedPlaneService;
+ros::ServiceServer deleteSimulatedPlaneService;
+ros::WallTimer updateTimer;
 
-//a map of plane IDs to the Simulated Plane with that ID
-std::map<int, AU_UAV_ROS::SimulatedPlane> simPlaneMap;
+//when each plane's latest telemetry update went out
+std::map<int, ros::WallTime> lastTelemetrySent;
+
+//telemetry-to-command latency: the time from a plane's latest update going out to a command for it coming
+//back.  That takes in everything in between (the coordinator, collision avoidance, and all the messages and
+//service calls between them), so it's the number to compare between running the nodes separately and
+//running them in one process.  Reported every LATENCY_REPORT_PERIOD commands and when we shut down.
+const int LATENCY_REPORT_PERIOD = 100;
+int commandsTimed = 0;
+double totalCommandLatencyMs = 0;
+double maxCommandLatencyMs = 0;
+
+/*
+reportLatency
+Prints the telemetry-to-command latency so far
+*/
+void reportLatency()
+{
+	if(commandsTimed == 0) return;
+	
+	ROS_INFO("Telemetry-to-command latency (%s): %d commands, mean %.3f ms, max %.3f ms",
+		requestPlaneIDClient.is_direct() ? "in one process" : "separate nodes",
+		commandsTimed, totalCommandLatencyMs / commandsTimed, maxCommandLatencyMs);
+}
 
 /*
 commandCallback:
@@ -34,16 +95,26 @@ the simulator so it must be verified before proceeding with any commands.
 void commandCallback(const AU_UAV_ROS::Command::ConstPtr& msg)
 {
 	//check to make sure that the plane ID is in the simulator
-	if(simPlaneMap.find(msg->planeID) != simPlaneMap.end())
+	if(simPlanes.slot_of(msg->planeID) != -1)
 	{
+		//time the round trip from the plane's latest update
+		std::map<int, ros::WallTime>::iterator sent = lastTelemetrySent.find(msg->planeID);
+		if(sent != lastTelemetrySent.end())
+		{
+			double latencyMs = (ros::WallTime::now() - sent->second).toSec() * 1000;
+			totalCommandLatencyMs += latencyMs;
+			if(latencyMs > maxCommandLatencyMs) maxCommandLatencyMs = latencyMs;
+			if(++commandsTimed % LATENCY_REPORT_PERIOD == 0) reportLatency();
+		}
+		
 		//let the simulator handle the new command now
-		ROS_INFO("Received new message: Plane #%d to (%f, %f, %f)", msg->planeID, msg->latitude, msg->longitude, msg->altitude);
-		simPlaneMap[msg->planeID].handleNewCommand(*msg);
+		ALOG_DEBUG("Received new message: Plane #%d to (%f, %f, %f)", msg->planeID, msg->latitude, msg->longitude, msg->altitude);
+		simPlanes.set_target(msg->planeID, msg->latitude, msg->longitude, msg->altitude);
 	}
 	else
 	{
 		//we may want to remove this message eventually
-		ROS_INFO("Received message to non-simulated plane $%d", msg->planeID);
+		ALOG_INFO_THROTTLE(1.0, "Received message to non-simulated plane #%d", msg->planeID);
 	}
 }
 
@@ -69,9 +140,15 @@ bool createSimulatedPlaneCallback(AU_UAV_ROS::CreateSimulatedPlane::Request &req
 			return false;
 		}
 		
-		//create and add our plane to the list of simulated planes
-		//AU_UAV_ROS::SimulatedPlane newPlane(srv.response.planeID, req);
-		simPlaneMap[srv.response.planeID] = AU_UAV_ROS::SimulatedPlane(srv.response.planeID, req);
+		//add our plane to the simulated planes; with no command yet, it flies straight ahead
+		if(!simPlanes.add(srv.response.planeID, req.startingLatitude, req.startingLongitude,
+			req.startingAltitude, req.startingBearing, SIMULATED_SPEED, SIMULATED_MAX_TURN_RATE))
+		{
+			ROS_ERROR("Plane #%d is already simulated", srv.response.planeID);
+			return false;
+		}
+		if(srv.response.planeID >= (int)updateIndex.size()) updateIndex.resize(srv.response.planeID + 1, 0);
+		updateIndex[srv.response.planeID] = 0;
 		
 		//plane created successfully
 		return true;
@@ -92,10 +169,11 @@ free up that plane ID in the coordinator.  New planes will still have higher IDs
 bool deleteSimulatedPlaneCallback(AU_UAV_ROS::DeleteSimulatedPlane::Request &req, AU_UAV_ROS::DeleteSimulatedPlane::Response &res)
 {
 	//check to make sure the plane is simulated
-	if(simPlaneMap.find(req.planeID) != simPlaneMap.end())
+	if(simPlanes.slot_of(req.planeID) != -1)
 	{
 		//we found it, erase that bad boy
-		simPlaneMap.erase(req.planeID);
+		simPlanes.remove(req.planeID);
+		lastTelemetrySent.erase(req.planeID);
 		return true;
 	}
 	else
@@ -106,59 +184,149 @@ bool deleteSimulatedPlaneCallback(AU_UAV_ROS::DeleteSimulatedPlane::Request &req
 	}
 }
 
-int main(int argc, char **argv)
+/*
+sendFleetUpdate
+Sends every simulated plane's telemetry in one message, straight from the simulator's columns.
+*/
+void sendFleetUpdate(const ros::Time &stamp)
 {
-	//Standard ROS startup
-	ros::init(argc, argv, "simulator");
-	ros::NodeHandle n;
+	const std::vector<int> &ids = simPlanes.ids();
+	unsigned int n = simPlanes.size();
+	
+	AU_UAV_ROS::FleetTelemetry::Ptr fleet(new AU_UAV_ROS::FleetTelemetry);
+	fleet->header.stamp = stamp;
+	fleet->planeIDs = ids;
+	fleet->currentLatitudes = simPlanes.latitude();
+	fleet->currentLongitudes = simPlanes.longitude();
+	fleet->currentAltitudes = simPlanes.altitude();
+	fleet->destLatitudes = simPlanes.target_latitude();
+	fleet->destLongitudes = simPlanes.target_longitude();
+	fleet->destAltitudes = simPlanes.target_altitude();
+	fleet->groundSpeeds = simPlanes.speed();
+	fleet->currentWaypointIndexes = simPlanes.targets_received();
+	
+	fleet->sequences.resize(n);
+	fleet->targetBearings.resize(n);
+	fleet->distancesToDestination.resize(n);
+	for(unsigned int i = 0; i < n; i++)
+	{
+		fleet->sequences[i] = updateIndex[ids[i]]++;
+		fleet->targetBearings[i] = simPlanes.bearing_to_target(i);
+		fleet->distancesToDestination[i] = simPlanes.distance_to_target(i);
+	}
+	
+	ros::WallTime now = ros::WallTime::now();
+	for(unsigned int i = 0; i < n; i++) lastTelemetrySent[ids[i]] = now;
+	fleetTelemetryPub.publish(fleet);
+}
+
+/*
+sendUpdates
+Run by the update timer; moves every simulated plane one step, then sends out a telemetry update for each.
+*/
+void sendUpdates(const ros::WallTimerEvent &event)
+{
+	//the whole fleet flies the step at once (see sim_fleet.h)
+	simPlanes.step(1.0/UPDATE_RATE);
 	
+	const std::vector<int> &ids = simPlanes.ids();
+	ros::Time stamp = ros::Time::now();
+	if(sendFleetTelemetry)
+	{
+		sendFleetUpdate(stamp);
+		return;
+	}
+	
+	for(unsigned int i = 0; i < simPlanes.size(); i++)
+	{
+		//each update gets its own message, published by pointer, so that a subscriber in this process
+		//gets it without a copy (which means we can't touch it again once it's sent)
+		AU_UAV_ROS::TelemetryUpdate::Ptr tUpdate(new AU_UAV_ROS::TelemetryUpdate);
+		tUpdate->telemetryHeader.seq = updateIndex[ids[i]]++;
+		tUpdate->telemetryHeader.stamp = stamp;
+		tUpdate->planeID = ids[i];
+		tUpdate->currentLatitude = simPlanes.latitude()[i];
+		tUpdate->currentLongitude = simPlanes.longitude()[i];
+		tUpdate->currentAltitude = simPlanes.altitude()[i];
+		
+		//a plane with no command yet reports a destination of (0, 0), which collision avoidance ignores
+		tUpdate->destLatitude = simPlanes.target_latitude()[i];
+		tUpdate->destLongitude = simPlanes.target_longitude()[i];
+		tUpdate->destAltitude = simPlanes.target_altitude()[i];
+		
+		tUpdate->groundSpeed = simPlanes.speed()[i];
+		tUpdate->targetBearing = simPlanes.bearing_to_target(i);
+		tUpdate->currentWaypointIndex = simPlanes.targets_received()[i];
+		tUpdate->distanceToDestination = simPlanes.distance_to_target(i);
+		
+		lastTelemetrySent[ids[i]] = ros::WallTime::now();
+		telemetryPub.publish(tUpdate);
+	}
+}
+
+} //namespace
+
+/*
+startSimulator
+Sets up our topics and services, and starts sending telemetry updates.  Expects the caller to spin.
+*/
+void startSimulator(ros::NodeHandle &n)
+{
 	//setup subscribing to command messages
-	ros::Subscriber sub = n.subscribe("commands", 1000, commandCallback);
+	commandSub = n.subscribe("commands", 1000, commandCallback);
 	
 	//setup publishing to telemetry message
-	ros::Publisher telemetryPub = n.advertise<AU_UAV_ROS::TelemetryUpdate>("telemetry", 1000);
+	telemetryPub = n.advertise<AU_UAV_ROS::TelemetryUpdate>("telemetry", 1000);
+	
+	//how much we log: debug, info (the default), warn, or error
+	ros::NodeHandle privateNode("~");
+	std::string logLevel;
+	privateNode.param("log_level", logLevel, std::string("info"));
+	if(!async_log::instance().set_level(logLevel))
+		ROS_WARN("Unknown log_level \"%s\"; logging at info", logLevel.c_str());
+	
+	//or, if asked, one message a tick for all the planes (see sendFleetTelemetry)
+	privateNode.param("fleet_telemetry", sendFleetTelemetry, sendFleetTelemetry);
+	if(sendFleetTelemetry)
+	{
+		fleetTelemetryPub = n.advertise<AU_UAV_ROS::FleetTelemetry>("fleet_telemetry", 10);
+		ROS_INFO("Sending each tick's telemetry as one message on fleet_telemetry");
+	}
 	
 	//setup server services
-	ros::ServiceServer createSimulatedPlaneService = n.advertiseService("create_simulated_plane", createSimulatedPlaneCallback);
-	ros::ServiceServer deleteSimulatedPlaneService = n.advertiseService("delete_simulated_plane", deleteSimulatedPlaneCallback);
+	createSimulatedPlaneService = n.advertiseService("create_simulated_plane", createSimulatedPlaneCallback);
+	deleteSimulatedPlaneService = n.advertiseService("delete_simulated_plane", deleteSimulatedPlaneCallback);
 	
-	//setup client services
-	requestPlaneIDClient = n.serviceClient<AU_UAV_ROS::RequestPlaneID>("request_plane_ID");
+	//setup client services (direct calls, if the coordinator is in this process)
+	requestPlaneIDClient.connect(n, "request_plane_ID");
 	
 	//TODO:check for validity of 1 Hz
 	//currently updates at 1 Hz, based of Justin Paladino'sestimate of approximately 1 update/sec
-	int loopRate = 1;
-	int loopMultiple = 10;
-	int loopPosition = 0;
+	updateTimer = n.createWallTimer(ros::WallDuration(1.0/UPDATE_RATE), sendUpdates);
+}
+
+/*
+stopSimulator
+Reports the telemetry-to-command latency; call once spinning is done.
+*/
+void stopSimulator()
+{
+	reportLatency();
+}
+
+#ifndef COMPOSED_NODES
+int main(int argc, char **argv)
+{
+	//Standard ROS startup
+	ros::init(argc, argv, "simulator");
+	ros::NodeHandle n;
+	
+	startSimulator(n);
 	
-	//we multiply so we can spin more
-	ros::Rate loop_rate(loopMultiple*loopRate);
-	 
 	//while the user doesn't kill the process or we get some crazy error
-	while(ros::ok())
-	{
-		//first check for callbacks
-		ros::spinOnce();
-		
-		//only run the update once every ten cycles
-		if(loopPosition == 0)
-		{
-			//prep to send some updates
-			AU_UAV_ROS::TelemetryUpdate tUpdate;
-			std::map<int, AU_UAV_ROS::SimulatedPlane>::iterator ii;
-		
-			//iterate through all simulated planes and generate an update for each
-			for(ii = simPlaneMap.begin(); ii != simPlaneMap.end(); ii++)
-			{
-				ii->second.fillTelemetryUpdate(&tUpdate);
-				telemetryPub.publish(tUpdate);
-			}
-		}
-		
-		//sleep until next update cycle
-		loopPosition = (loopPosition+1)%loopMultiple;
-		loop_rate.sleep();
-	}
+	ros::spin();
 	
+	stopSimulator();
 	return 0;
 }
+#endif
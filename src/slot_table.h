@@ -0,0 +1,208 @@
+//
+// slot_table.h
+// AU_UAV_ROS
+//
+// A table of things (in the coordinator, PlaneCoordinators) indexed directly by
+// a small, non-negative ID. A std::map would do, but looking up, validating, and
+// handing out IDs happens for every telemetry update and service call, so here
+// the entries live in a dense vector (slot i holds ID i), and a bitset records
+// which IDs are active.
+//
+// Handing out "the lowest ID not in use" scans the bitset a word (64 IDs) at a
+// time, starting from the lowest word that might have a free bit in it; since
+// IDs are usually handed out in order and seldom given back, that's O(1) in
+// practice.
+//
+
+#ifndef SLOT_TABLE
+#define SLOT_TABLE
+
+#include <vector>
+#include <stdint.h>
+
+#ifdef DEBUG
+#include <cassert>
+#endif
+
+#ifndef natural
+#define natural unsigned int
+#endif
+
+using namespace std;
+
+template< class T >
+class slot_table
+{
+public:
+  /**
+   * Creates an empty table
+   * @param max_slots IDs must be less than this; it keeps a bad ID from growing
+   *                  the table without bound
+   */
+  explicit slot_table( natural max_slots );
+
+  /**
+   * @param id An ID
+   * @return TRUE if the table can hold the ID (0 <= id < max_slots)
+   */
+  bool in_range( int id ) const;
+
+  /**
+   * @param id An ID (need not be in range)
+   * @return TRUE if the ID has been activated (and not deactivated since)
+   */
+  bool is_active( int id ) const;
+
+  /**
+   * Gets the entry for an ID, active or not, creating a default one if need be
+   * (just like std::map's operator[])
+   * @param id An ID; must be in range
+   * @return the ID's entry
+   */
+  T & operator[]( int id );
+
+  /**
+   * Activates the lowest ID that isn't active, giving it a fresh entry
+   * @return the ID, or -1 if every ID in range is taken
+   */
+  int activate_lowest_free();
+
+  /**
+   * Activates a particular ID, giving it a fresh entry
+   * @param id The ID
+   * @return TRUE if it was activated; FALSE if it was out of range or already active
+   */
+  bool activate( int id );
+
+  /**
+   * Frees up an ID to be handed out again. Its entry is left as is until then.
+   * @param id An active ID
+   */
+  void deactivate( int id );
+
+  /**
+   * @return the number of active IDs
+   */
+  natural active_count() const;
+
+  /**
+   * @return one more than the highest ID that might be active (for looping
+   *         over the active IDs with is_active())
+   */
+  natural slot_count() const;
+
+private:
+  /**
+   * Makes sure there's a slot (and a bit) for the ID
+   */
+  void grow_to( natural id );
+
+  enum { WORD_BITS = 64 };
+
+  vector< T > slots;
+  vector< uint64_t > active;  // bit ( id % 64 ) of word ( id / 64 ) is set if id is active
+  natural lowest_open_word;   // no word before this one has a clear bit
+  natural limit;
+  natural count;
+};
+
+template< class T >
+slot_table< T >::slot_table( natural max_slots )
+{
+  lowest_open_word = 0;
+  limit = max_slots;
+  count = 0;
+}
+
+template< class T >
+bool slot_table< T >::in_range( int id ) const
+{
+  return id >= 0 && (natural)id < limit;
+}
+
+template< class T >
+bool slot_table< T >::is_active( int id ) const
+{
+  if( id < 0 || (natural)id >= slots.size() )
+    return false;
+  return ( active[ id / WORD_BITS ] >> ( id % WORD_BITS ) ) & 1;
+}
+
+template< class T >
+T & slot_table< T >::operator[]( int id )
+{
+#ifdef DEBUG
+  assert( in_range( id ) );
+#endif
+  grow_to( id );
+  return slots[ id ];
+}
+
+template< class T >
+int slot_table< T >::activate_lowest_free()
+{
+  natural word = lowest_open_word;
+  while( word < active.size() && active[ word ] == ~(uint64_t)0 )
+    word++;
+  lowest_open_word = word;
+
+  natural id = word * WORD_BITS;
+  if( word < active.size() )
+    id += __builtin_ctzll( ~active[ word ] );
+
+  if( id >= limit )
+    return -1;
+  activate( id );
+  return id;
+}
+
+template< class T >
+bool slot_table< T >::activate( int id )
+{
+  if( !in_range( id ) || is_active( id ) )
+    return false;
+
+  grow_to( id );
+  slots[ id ] = T();
+  active[ id / WORD_BITS ] |= (uint64_t)1 << ( id % WORD_BITS );
+  count++;
+  return true;
+}
+
+template< class T >
+void slot_table< T >::deactivate( int id )
+{
+#ifdef DEBUG
+  assert( is_active( id ) );
+#endif
+  active[ id / WORD_BITS ] &= ~( (uint64_t)1 << ( id % WORD_BITS ) );
+  if( (natural)id / WORD_BITS < lowest_open_word )
+    lowest_open_word = id / WORD_BITS;
+  count--;
+}
+
+template< class T >
+natural slot_table< T >::active_count() const
+{
+  return count;
+}
+
+template< class T >
+natural slot_table< T >::slot_count() const
+{
+  return slots.size();
+}
+
+template< class T >
+void slot_table< T >::grow_to( natural id )
+{
+  if( id < slots.size() )
+    return;
+
+  // Grow in whole words, so that the bitset and the slots stay the same size
+  natural size = ( id / WORD_BITS + 1 ) * WORD_BITS;
+  slots.resize( size );
+  active.resize( size / WORD_BITS, 0 );
+}
+
+#endif
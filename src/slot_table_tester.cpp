@@ -0,0 +1,163 @@
+//
+//  slot_table_tester.cpp
+//  AU_UAV_ROS
+//
+//  Checks the coordinator's slot table, then benchmarks it against the
+//  std::map it replaced, with the coordinator's access pattern at 1000
+//  simulated planes: hand out every ID, then for each second of flight,
+//  validate and look up every plane for its telemetry update and for a
+//  GoToWaypoint call.
+//
+
+#define DEBUG
+
+#include <iostream>
+#include <map>
+#include <deque>
+#include <time.h>
+#include "slot_table.h"
+
+using namespace std;
+
+// Stands in for AU_UAV_ROS::PlaneCoordinator, which needs ROS
+struct fake_coordinator
+{
+  bool isActive;
+  deque< double > queue;
+  double last;
+
+  fake_coordinator()
+  {
+    isActive = false;
+    last = 0;
+  }
+
+  void update( double value )
+  {
+    last = value;
+    queue.push_back( value );
+    if( queue.size() > 4 )
+      queue.pop_front();
+  }
+};
+
+const int PLANES = 1000;
+const int SECONDS = 2000;
+
+double seconds_since( const timespec & start )
+{
+  timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  return ( now.tv_sec - start.tv_sec ) + ( now.tv_nsec - start.tv_nsec ) / 1e9;
+}
+
+// The old coordinator's ID handling, as it was
+int map_request_id( map< int, fake_coordinator > & planes )
+{
+  int id = 0;
+  while( planes.find( id ) != planes.end() && planes[ id ].isActive )
+    id++;
+  planes[ id ] = fake_coordinator();
+  planes[ id ].isActive = true;
+  return id;
+}
+
+bool map_is_valid( map< int, fake_coordinator > & planes, int id )
+{
+  return id >= 0 && planes.find( id ) != planes.end() && planes[ id ].isActive;
+}
+
+void check()
+{
+  slot_table< fake_coordinator > t( 200 );
+  assert( !t.is_active( 0 ) && !t.is_active( -1 ) && !t.is_active( 5000 ) );
+
+  // Handed out in order
+  for( int i = 0; i < 130; i++ )
+    assert( t.activate_lowest_free() == i );
+  assert( t.active_count() == 130 );
+
+  // A particular ID, and one that's taken
+  assert( t.activate( 150 ) );
+  assert( !t.activate( 150 ) );
+  assert( !t.activate( 200 ) && !t.activate( -3 ) );
+
+  // Freed IDs come back lowest first
+  t.deactivate( 70 );
+  t.deactivate( 3 );
+  assert( !t.is_active( 3 ) && !t.is_active( 70 ) );
+  assert( t.activate_lowest_free() == 3 );
+  assert( t.activate_lowest_free() == 70 );
+  assert( t.activate_lowest_free() == 130 );
+
+  // An inactive entry can be touched (as loading a course does), and is reset
+  // when its ID is activated
+  t[ 160 ].update( 1 );
+  assert( !t.is_active( 160 ) && t[ 160 ].last == 1 );
+  assert( t.activate( 160 ) && t[ 160 ].last == 0 );
+
+  // Fill it up
+  int id;
+  while( ( id = t.activate_lowest_free() ) != -1 )
+    assert( id < 200 );
+  assert( t.active_count() == 200 );
+
+  cout << "slot_table checks passed" << endl;
+}
+
+int main()
+{
+  check();
+
+  timespec start;
+  double sink = 0;
+
+  // The old way
+  clock_gettime( CLOCK_MONOTONIC, &start );
+  map< int, fake_coordinator > old_planes;
+  for( int i = 0; i < PLANES; i++ )
+    map_request_id( old_planes );
+  double map_alloc = seconds_since( start );
+
+  clock_gettime( CLOCK_MONOTONIC, &start );
+  for( int s = 0; s < SECONDS; s++ )
+  {
+    for( int id = 0; id < PLANES; id++ )
+    {
+      if( map_is_valid( old_planes, id ) ) // telemetry
+        old_planes[ id ].update( s );
+      if( map_is_valid( old_planes, id ) ) // GoToWaypoint
+        sink += old_planes[ id ].last;
+    }
+  }
+  double map_lookup = seconds_since( start );
+
+  // The new way
+  clock_gettime( CLOCK_MONOTONIC, &start );
+  slot_table< fake_coordinator > new_planes( 4096 );
+  for( int i = 0; i < PLANES; i++ )
+    new_planes[ new_planes.activate_lowest_free() ].isActive = true;
+  double table_alloc = seconds_since( start );
+
+  clock_gettime( CLOCK_MONOTONIC, &start );
+  for( int s = 0; s < SECONDS; s++ )
+  {
+    for( int id = 0; id < PLANES; id++ )
+    {
+      if( new_planes.is_active( id ) )
+        new_planes[ id ].update( s );
+      if( new_planes.is_active( id ) )
+        sink -= new_planes[ id ].last;
+    }
+  }
+  double table_lookup = seconds_since( start );
+
+  assert( sink == 0 ); // (and keeps the loops from being optimized away)
+
+  cout << PLANES << " planes, " << SECONDS << " seconds of updates" << endl;
+  cout << "  std::map:   allocate " << map_alloc * 1000 << " ms, update and look up "
+       << map_lookup * 1e9 / ( (double)PLANES * SECONDS ) << " ns/plane" << endl;
+  cout << "  slot_table: allocate " << table_alloc * 1000 << " ms, update and look up "
+       << table_lookup * 1e9 / ( (double)PLANES * SECONDS ) << " ns/plane" << endl;
+  return 0;
+}
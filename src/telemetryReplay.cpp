@@ -0,0 +1,301 @@
+/*
+telemetryReplay
+Plays a recording made by collision avoidance (see telemetry_recording.h and its ~record_telemetry parameter)
+back through the planner, in this process and as fast as it will go.  Each recorded batch of updates is handled
+just as the planning thread handled it, in the recorded fields and altitude bands; the coordinator's services are
+stood in for by the recording itself, which answers each goal request with the goal the coordinator gave at the
+time and each command with whether it went through.  The commands the planner sends are checked against the ones
+it sent when the recording was made, and the time each batch took is reported.
+
+usage: telemetryReplay recording [-d deadline_ms] [-c timings.csv]
+
+With no deadline (the default), the planner always finishes planning, so that a replay sends exactly the
+commands recorded from a node that never missed its deadline, on any machine.  Give the node's deadline to
+replay it as it ran (and see where a slower or faster machine would have missed it).  Replays make no speculative
+plans and start with no saved planner state, so only the commands A* worked out fresh are compared: a plane's
+commands are counted but not compared in a batch where the node sent it a speculative plan or a deadline
+fallback, and in a field the node started from saved state.
+
+Build it from collisionAvoidance.cpp, compiled with COMPOSED_NODES defined, and this file.  It exits with 1
+if any command differs from the recording.
+*/
+
+//standard C++ headers
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <unistd.h>
+
+//ROS headers
+#include "ros/ros.h"
+#include "AU_UAV_ROS/GoToWaypoint.h"
+#include "AU_UAV_ROS/RequestWaypointInfo.h"
+
+//the planner's entry points and the recording format
+#include "node_composition.h"
+#include "telemetry_recording.h"
+
+//how many batches' mismatched commands to print before just counting them
+const int MISMATCHES_SHOWN = 10;
+
+//how close a replayed command has to be to the recorded one (degrees, m)
+const double COMMAND_TOLERANCE = 1e-9;
+
+//what the recording says should happen in answer to the batch being replayed
+std::vector<telemetry_record> expectedGoals;
+unsigned int goalsGiven = 0;
+std::vector<telemetry_record> expectedCommands;
+
+//the commands the planner sent while handling it
+std::vector<AU_UAV_ROS::GoToWaypoint::Request> sentCommands;
+
+/* requestWaypointInfo(...) stands in for the coordinator, answering with the next recorded goal */
+bool requestWaypointInfo(AU_UAV_ROS::RequestWaypointInfo::Request &req, AU_UAV_ROS::RequestWaypointInfo::Response &res)
+{
+	if(goalsGiven >= expectedGoals.size())
+	{
+		ROS_WARN("Plane #%d asked for a goal the recording has no answer for", req.planeID);
+		return false;
+	}
+
+	const telemetry_record &goal = expectedGoals[goalsGiven++];
+	res.latitude = goal.values[0];
+	res.longitude = goal.values[1];
+	res.altitude = goal.values[2];
+	return (goal.flags & telemetry_record::SUCCEEDED) != 0;
+}
+
+/* goToWaypoint(...) stands in for the coordinator, keeping the command and answering as it did when recorded */
+bool goToWaypoint(AU_UAV_ROS::GoToWaypoint::Request &req, AU_UAV_ROS::GoToWaypoint::Response &res)
+{
+	unsigned int index = sentCommands.size();
+	sentCommands.push_back(req);
+	if(index < expectedCommands.size())
+		return (expectedCommands[index].flags & telemetry_record::SUCCEEDED) != 0;
+	return true;
+}
+
+/* sameCommand(...) returns true if the planner sent what the recording says it did */
+bool sameCommand(const telemetry_record &expected, const AU_UAV_ROS::GoToWaypoint::Request &sent)
+{
+	return expected.plane_id == sent.planeID &&
+		fabs(expected.values[0] - sent.latitude) <= COMMAND_TOLERANCE &&
+		fabs(expected.values[1] - sent.longitude) <= COMMAND_TOLERANCE &&
+		fabs(expected.values[2] - sent.altitude) <= COMMAND_TOLERANCE &&
+		((expected.flags & telemetry_record::AVOIDANCE) != 0) == (bool)sent.isAvoidanceManeuver &&
+		((expected.flags & telemetry_record::NEW_QUEUE) != 0) == (bool)sent.isNewQueue;
+}
+
+/* freshCommand(...) returns true if the node worked the command out with A* on the update it answered */
+bool freshCommand(const telemetry_record &command)
+{
+	return (command.flags & (telemetry_record::SPECULATIVE | telemetry_record::FALLBACK)) == 0;
+}
+
+/* percentile(...) returns the given percentile of some sorted timings */
+double percentile(const std::vector<double> &sorted, double p)
+{
+	if(sorted.empty())
+		return 0;
+	unsigned int index = (unsigned int)(p / 100.0 * (sorted.size() - 1) + 0.5);
+	return sorted[index];
+}
+
+void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s recording [-d deadline_ms] [-c timings.csv]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	double deadline = 0;
+	const char *csvPath = NULL;
+
+	int option;
+	while((option = getopt(argc, argv, "d:c:h")) != -1)
+	{
+		switch(option)
+		{
+			case 'd':
+				deadline = atof(optarg);
+				break;
+			case 'c':
+				csvPath = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				return 2;
+		}
+	}
+	if(optind != argc - 1)
+	{
+		usage(argv[0]);
+		return 2;
+	}
+
+	telemetry_recording recording;
+	if(!recording.load(argv[optind]))
+	{
+		fprintf(stderr, "Couldn't read %s: %s\n", argv[optind], recording.error().c_str());
+		return 2;
+	}
+	const std::vector<telemetry_record> &records = recording.records();
+
+	FILE *csv = NULL;
+	if(csvPath != NULL)
+	{
+		csv = fopen(csvPath, "w");
+		if(csv == NULL)
+		{
+			fprintf(stderr, "Couldn't write %s\n", csvPath);
+			return 2;
+		}
+		fprintf(csv, "batch,field,updates,received,ms,commands\n");
+	}
+
+	//the recording answers for the coordinator
+	serve_locally("request_waypoint_info", requestWaypointInfo);
+	serve_locally("go_to_waypoint", goToWaypoint);
+	if(!startCollisionAvoidanceReplay(records, deadline))
+		return 2;
+
+	//a replay can't reproduce a field that started from saved planner state
+	std::set<int> restoredFields;
+	for(unsigned int i = 0; i < records.size(); i++)
+		if(records[i].kind == telemetry_record::FIELD && (records[i].flags & telemetry_record::RESTORED))
+			restoredFields.insert(records[i].field);
+
+	std::vector<double> timings;
+	std::vector<telemetry_record> batch;
+	unsigned int updates = 0;
+	int commandsMatched = 0, commandsMismatched = 0, commandsSkipped = 0, batchesMismatched = 0;
+	for(unsigned int i = 0; i < records.size(); i++)
+	{
+		if(records[i].kind != telemetry_record::TELEMETRY)
+			continue;
+
+		//a batch runs up to the next update that starts one, and everything in between is what came of it
+		batch.clear();
+		expectedGoals.clear();
+		expectedCommands.clear();
+		sentCommands.clear();
+		goalsGiven = 0;
+		unsigned int j = i;
+		for(; j < records.size(); j++)
+		{
+			const telemetry_record &record = records[j];
+			if(record.kind == telemetry_record::TELEMETRY)
+			{
+				if(j > i && (record.flags & telemetry_record::BATCH_START))
+					break;
+				batch.push_back(record);
+			}
+			else if(record.kind == telemetry_record::GOAL)
+				expectedGoals.push_back(record);
+			else if(record.kind == telemetry_record::COMMAND)
+				expectedCommands.push_back(record);
+		}
+		i = j - 1;
+
+		double ms = replayTelemetry(batch);
+		timings.push_back(ms);
+		updates += batch.size();
+		if(csv != NULL)
+			fprintf(csv, "%u,%d,%u,%.6f,%.4f,%u\n", (unsigned int)timings.size() - 1, batch[0].field,
+				(unsigned int)batch.size(), batch[0].received, ms, (unsigned int)sentCommands.size());
+
+		//compare what was sent with what was recorded, plane by plane
+		std::map<int, std::vector<unsigned int> > expectedByPlane, sentByPlane;
+		std::set<int> planes;
+		for(unsigned int c = 0; c < expectedCommands.size(); c++)
+		{
+			expectedByPlane[expectedCommands[c].plane_id].push_back(c);
+			planes.insert(expectedCommands[c].plane_id);
+		}
+		for(unsigned int c = 0; c < sentCommands.size(); c++)
+		{
+			sentByPlane[sentCommands[c].planeID].push_back(c);
+			planes.insert(sentCommands[c].planeID);
+		}
+
+		bool restored = restoredFields.count(batch[0].field) > 0;
+		bool batchMismatched = false;
+		for(std::set<int>::iterator plane = planes.begin(); plane != planes.end(); ++plane)
+		{
+			const std::vector<unsigned int> &expected = expectedByPlane[*plane];
+			const std::vector<unsigned int> &sent = sentByPlane[*plane];
+
+			bool fresh = !restored;
+			for(unsigned int c = 0; c < expected.size() && fresh; c++)
+				fresh = freshCommand(expectedCommands[expected[c]]);
+			if(!fresh)
+			{
+				commandsSkipped += std::max(expected.size(), sent.size());
+				continue;
+			}
+
+			bool mismatched = sent.size() != expected.size();
+			unsigned int compared = std::min(sent.size(), expected.size());
+			for(unsigned int c = 0; c < compared; c++)
+			{
+				if(sameCommand(expectedCommands[expected[c]], sentCommands[sent[c]]))
+					commandsMatched++;
+				else
+				{
+					mismatched = true;
+					commandsMismatched++;
+				}
+			}
+			commandsMismatched += std::max(sent.size(), expected.size()) - compared;
+			if(!mismatched)
+				continue;
+
+			batchMismatched = true;
+			if(batchesMismatched >= MISMATCHES_SHOWN)
+				continue;
+			printf("Batch %u (field %d), plane #%d: sent %u command(s), recorded %u\n",
+				(unsigned int)timings.size() - 1, batch[0].field, *plane, (unsigned int)sent.size(),
+				(unsigned int)expected.size());
+			for(unsigned int c = 0; c < compared; c++)
+			{
+				const AU_UAV_ROS::GoToWaypoint::Request &s = sentCommands[sent[c]];
+				const telemetry_record &e = expectedCommands[expected[c]];
+				if(sameCommand(e, s))
+					continue;
+				printf("  #%u: sent (%.9f, %.9f, %.2f), recorded (%.9f, %.9f, %.2f)\n",
+					c, s.latitude, s.longitude, s.altitude, e.values[0], e.values[1], e.values[2]);
+			}
+		}
+		if(batchMismatched)
+			batchesMismatched++;
+	}
+
+	stopCollisionAvoidanceReplay();
+	if(csv != NULL)
+		fclose(csv);
+
+	//report
+	double total = 0;
+	for(unsigned int i = 0; i < timings.size(); i++)
+		total += timings[i];
+	std::vector<double> sorted(timings);
+	std::sort(sorted.begin(), sorted.end());
+
+	printf("Replayed %u updates in %u batches from %u records\n", updates, (unsigned int)timings.size(),
+		(unsigned int)records.size());
+	printf("Commands: %d matched, %d differed (in %d batches), %d not compared (speculative, fallback, or restored)\n",
+		commandsMatched, commandsMismatched, batchesMismatched, commandsSkipped);
+	if(!timings.empty())
+	{
+		printf("Per batch (ms): mean %.3f, p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n", total / timings.size(),
+			percentile(sorted, 50), percentile(sorted, 90), percentile(sorted, 99), sorted.back());
+		if(total > 0)
+			printf("%.0f updates/s\n", updates * 1000.0 / total);
+	}
+
+	return commandsMismatched > 0 ? 1 : 0;
+}
@@ -0,0 +1,284 @@
+//
+// telemetry_recording.h
+// AU_UAV_ROS
+//
+// Records everything collision avoidance is given to work with, in the order it
+// handles it, so that a run can be played back through the planner later (see
+// telemetryReplay.cpp): the fields it plans in (and whether it started from their
+// saved planner state), its altitude bands, every telemetry update (with when it
+// arrived, which field it was routed to, which batch it was handled in, and every
+// field the TelemetryUpdate carries that the planner reads), every goal the
+// coordinator gave back, and every command sent (and whether it came from a
+// speculative plan or was a deadline fallback).
+//
+// The file is an 8-byte magic number, a version, and then fixed-size records,
+// written as they're made (through a large buffer, so recording costs a copy per
+// update). Each record is 80 bytes, against a few hundred for the messages they
+// come from; an hour of 16 planes at 1 Hz, with a plan every few updates, is a
+// few tens of megabytes. The recorder's owner should flush() it every so often
+// (collision avoidance does every second), so that a node that's killed loses
+// only the last moments of its recording.
+//
+// The writer isn't thread safe; collision avoidance only records from its
+// planning thread.
+//
+
+#ifndef TELEMETRY_RECORDING
+#define TELEMETRY_RECORDING
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifndef natural
+#define natural unsigned int
+#endif
+
+using namespace std;
+
+/**
+ * One thing collision avoidance saw or did
+ */
+struct telemetry_record
+{
+  enum kind_t
+  {
+    FIELD = 1, // a field planned in: values are its upper left longitude and latitude,
+               // its width and height in degrees, and its resolution (m); field is its index
+    TELEMETRY, // an update from a plane, routed to field: values are its current
+               // longitude, latitude, and altitude, its destination's, its ground
+               // speed, and its target bearing; received is when it arrived
+    GOAL,      // the coordinator's answer to the update's goal request: values are
+               // the goal's latitude, longitude, and altitude
+    COMMAND,   // a waypoint sent to the coordinator: values are its latitude,
+               // longitude, and altitude
+    BANDS      // the altitude bands planned in (see altitude_bands.h): values[ 0 ]
+               // is the margin, and the plane_id values after it are boundaries
+               // (more than seven boundaries continue in further BANDS records)
+  };
+
+  // flags
+  enum
+  {
+    DEPARTED = 1,     // TELEMETRY: not an update, but word that the plane has left the field
+    SUCCEEDED = 2,    // GOAL, COMMAND: the service call went through
+    AVOIDANCE = 4,    // COMMAND: isAvoidanceManeuver
+    NEW_QUEUE = 8,    // COMMAND: isNewQueue
+    SPECULATIVE = 16, // COMMAND: from a plan made ahead of time, not A* on the update
+    FALLBACK = 32,    // COMMAND: planning missed its deadline; a fallback point
+    RESTORED = 64,    // FIELD: the planner started from the field's saved state,
+                      // which isn't in the recording
+    BATCH_START = 128 // TELEMETRY: the first update of a batch (the updates up to
+                      // the next BATCH_START were handled together)
+  };
+
+  uint8_t kind;
+  uint8_t flags;
+  int16_t field;
+  int32_t plane_id;
+  double received; // wall-clock seconds
+  double values[ 8 ];
+};
+
+// The layout is the file format; it mustn't change without bumping the version
+typedef char telemetry_record_is_80_bytes[ sizeof( telemetry_record ) == 80 ? 1 : -1 ];
+
+const char TELEMETRY_RECORDING_MAGIC[ 8 ] = { 'A', 'U', 'T', 'E', 'L', 'R', 'E', 'C' };
+const uint32_t TELEMETRY_RECORDING_VERSION = 2;
+
+/**
+ * Writes a recording
+ */
+class telemetry_recorder
+{
+public:
+  telemetry_recorder();
+  ~telemetry_recorder();
+
+  /**
+   * Starts a new recording (replacing any file already there)
+   * @param path Where to write it
+   * @return FALSE if the file couldn't be opened
+   */
+  bool open( const string & path );
+
+  /**
+   * @return TRUE if we're recording
+   */
+  bool is_open() const;
+
+  /**
+   * Adds a record (if we're recording)
+   */
+  void write( const telemetry_record & record );
+
+  /**
+   * Writes out everything recorded so far, keeping the file open
+   * @return FALSE if anything couldn't be written
+   */
+  bool flush();
+
+  /**
+   * Writes out everything recorded so far and closes the file
+   * @return FALSE if anything couldn't be written
+   */
+  bool close();
+
+  /**
+   * @return the number of records written
+   */
+  natural count() const;
+
+private:
+  // Not copyable
+  telemetry_recorder( const telemetry_recorder & );
+  telemetry_recorder & operator=( const telemetry_recorder & );
+
+  FILE * out;
+  vector< char > buffer;
+  natural records;
+  bool failed;
+};
+
+/**
+ * Reads a recording back
+ */
+class telemetry_recording
+{
+public:
+  /**
+   * Reads a whole recording into memory
+   * @param path The file
+   * @return FALSE if it couldn't be read or isn't a recording (see error()). A
+   *         recording cut off partway through a record (say, because the node was
+   *         killed) loads, without the partial record.
+   */
+  bool load( const string & path );
+
+  /**
+   * @return every record, in the order they were made
+   */
+  const vector< telemetry_record > & records() const;
+
+  /**
+   * @return what went wrong with the last load(), if anything
+   */
+  const string & error() const;
+
+private:
+  vector< telemetry_record > record_list;
+  string last_error;
+};
+
+inline telemetry_recorder::telemetry_recorder()
+{
+  out = NULL;
+  records = 0;
+  failed = false;
+}
+
+inline telemetry_recorder::~telemetry_recorder()
+{
+  close();
+}
+
+inline bool telemetry_recorder::open( const string & path )
+{
+  close();
+  out = fopen( path.c_str(), "wb" );
+  if( out == NULL )
+    return false;
+
+  buffer.resize( 1 << 20 );
+  setvbuf( out, &buffer[ 0 ], _IOFBF, buffer.size() );
+  records = 0;
+  failed = fwrite( TELEMETRY_RECORDING_MAGIC, sizeof( TELEMETRY_RECORDING_MAGIC ), 1, out ) != 1 ||
+           fwrite( &TELEMETRY_RECORDING_VERSION, sizeof( TELEMETRY_RECORDING_VERSION ), 1, out ) != 1;
+  return !failed;
+}
+
+inline bool telemetry_recorder::is_open() const
+{
+  return out != NULL;
+}
+
+inline void telemetry_recorder::write( const telemetry_record & record )
+{
+  if( out == NULL )
+    return;
+  if( fwrite( &record, sizeof( record ), 1, out ) != 1 )
+    failed = true;
+  records++;
+}
+
+inline bool telemetry_recorder::flush()
+{
+  if( out == NULL )
+    return !failed;
+  if( fflush( out ) != 0 )
+    failed = true;
+  return !failed;
+}
+
+inline bool telemetry_recorder::close()
+{
+  if( out == NULL )
+    return !failed;
+  bool ok = ( fclose( out ) == 0 ) && !failed;
+  out = NULL;
+  return ok;
+}
+
+inline natural telemetry_recorder::count() const
+{
+  return records;
+}
+
+inline bool telemetry_recording::load( const string & path )
+{
+  record_list.clear();
+  last_error.clear();
+
+  FILE * in = fopen( path.c_str(), "rb" );
+  if( in == NULL )
+  {
+    last_error = "can't open it";
+    return false;
+  }
+
+  char magic[ sizeof( TELEMETRY_RECORDING_MAGIC ) ];
+  uint32_t version;
+  if( fread( magic, sizeof( magic ), 1, in ) != 1 || fread( &version, sizeof( version ), 1, in ) != 1 ||
+      memcmp( magic, TELEMETRY_RECORDING_MAGIC, sizeof( magic ) ) != 0 )
+  {
+    last_error = "not a telemetry recording";
+    fclose( in );
+    return false;
+  }
+  if( version != TELEMETRY_RECORDING_VERSION )
+  {
+    last_error = "recorded in a different version of the format";
+    fclose( in );
+    return false;
+  }
+
+  telemetry_record record;
+  while( fread( &record, sizeof( record ), 1, in ) == 1 )
+    record_list.push_back( record );
+  fclose( in );
+  return true;
+}
+
+inline const vector< telemetry_record > & telemetry_recording::records() const
+{
+  return record_list;
+}
+
+inline const string & telemetry_recording::error() const
+{
+  return last_error;
+}
+
+#endif
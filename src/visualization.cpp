@@ -13,6 +13,7 @@ TODO: nothing is in this file yet, decide on visual system and implement
 #include <ros/ros.h>
 #include <visualization_msgs/Marker.h>
 #include "AU_UAV_ROS/TelemetryUpdate.h"
+#include "AU_UAV_ROS/FleetTelemetry.h"
 
 //set up a publisher to the visualization messages
 ros::Publisher markerPub;
@@ -60,6 +61,40 @@ void telemetryCallback(const AU_UAV_ROS::TelemetryUpdate::ConstPtr& msg)
 	markerPub.publish(line_strip);
 }
 
+/*
+fleetTelemetryCallback(...)
+when the simulator sends a whole tick's telemetry in one message, we send rviz every plane's position as
+one set of points
+*/
+void fleetTelemetryCallback(const AU_UAV_ROS::FleetTelemetry::ConstPtr& msg)
+{
+	visualization_msgs::Marker points;
+	points.header.frame_id = "/my_frame";
+	points.header.stamp = msg->header.stamp;
+	points.ns = "points_and_lines";
+	points.action = visualization_msgs::Marker::ADD;
+	points.pose.orientation.w = 1.0;
+	
+	points.id = 0;
+	points.type = visualization_msgs::Marker::POINTS;
+	
+	points.scale.x = .2;
+	points.scale.y = .2;
+	
+	points.color.g = 1.0;
+	points.color.a = 1.0;
+	
+	points.points.resize(msg->planeIDs.size());
+	for(unsigned int i = 0; i < msg->planeIDs.size(); i++)
+	{
+		points.points[i].x = msg->currentLongitudes[i];
+		points.points[i].y = msg->currentLatitudes[i];
+		points.points[i].z = msg->currentAltitudes[i];
+	}
+	
+	markerPub.publish(points);
+}
+
 int main(int argc, char* argv[])
 {
 	//standard ROS startup
@@ -68,6 +103,7 @@ int main(int argc, char* argv[])
 	
 	//subscribe to telemetry updates so we can forward them to rviz
 	ros::Subscriber sub = n.subscribe("telemetry", 1000, telemetryCallback);
+	ros::Subscriber fleetSub = n.subscribe("fleet_telemetry", 10, fleetTelemetryCallback);
 	
 	//set up our publishing
 	markerPub = n.advertise<visualization_msgs::Marker>("visualization_marker", 10);